@@ -0,0 +1,78 @@
+/*******************************************************************************
+ Copyright 2006-2012 Lukas Käll <lukas.kall@scilifelab.se>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+
+ *******************************************************************************/
+
+/*
+* Replaces the global allocation functions to count the allocations for the
+* Profiler. Only linked into the percolator executable, so that the library 
+* and its other users keep the default allocation functions.
+*/
+
+#include <cstdlib>
+#include <new>
+
+#include "Profiler.h"
+
+namespace {
+inline void* countedAlloc(std::size_t size) {
+  Profiler::countAllocation(size);
+  void* p = std::malloc(size > 0u ? size : 1u);
+  if (p == NULL) throw std::bad_alloc();
+  return p;
+}
+}
+
+void* operator new(std::size_t size) {
+  return countedAlloc(size);
+}
+
+void* operator new[](std::size_t size) {
+  return countedAlloc(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+  Profiler::countAllocation(size);
+  return std::malloc(size > 0u ? size : 1u);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+  Profiler::countAllocation(size);
+  return std::malloc(size > 0u ? size : 1u);
+}
+
+void operator delete(void* p) noexcept {
+  std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+  std::free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept {
+  std::free(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept {
+  std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+  std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept {
+  std::free(p);
+}
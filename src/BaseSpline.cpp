@@ -133,19 +133,36 @@ void BaseSpline::roughnessPenaltyIRLS() {
 void BaseSpline::iterativeReweightedLeastSquares(double alpha) {
   double step = 0.0;
   int iter = 0;
-  unsigned int n = static_cast<unsigned int>(x.size());
+  std::size_t n = x.size(), m = n - 2;
+  vector<double> gam(m);
   do {
     g = gnew;
     calcPZW();
-    PackedMatrix diag = PackedMatrix::packedDiagonalMatrix(PackedVector(static_cast<int>(n), 1) / w).packedMultiply(alpha);
-    PackedMatrix aWiQ = (diag).packedMultiply(Q);
-    PackedMatrix M = R.packedAdd(Qt.packedMultiply(aWiQ));
-    gamma = Qt.packedMultiply(z);
-    solveInPlace(M,gamma);
-    gnew = z.packedSubtract(aWiQ.packedMultiply(gamma));
+    factorizeB(alpha);
+    // gamma = B^-1 * Qt * z
+    for (std::size_t ix = 0; ix < m; ++ix) {
+      gam[ix] = q0[ix] * z[ix] + q1[ix] * z[ix + 1] + q2[ix] * z[ix + 2];
+    }
+    solveFactorizedB(gam);
+    for (std::size_t ix = 0; ix < m; ++ix) {
+      gamma.packedReplace(static_cast<int>(ix), gam[ix]);
+    }
+    // gnew = z - alpha * W^-1 * Q * gamma
+    for (std::size_t ix = 0; ix < n; ++ix) {
+      double qGamma = 0.0;
+      if (ix >= 2) qGamma += q2[ix - 2] * gam[ix - 2];
+      if (ix >= 1 && ix - 1 < m) qGamma += q1[ix - 1] * gam[ix - 1];
+      if (ix < m) qGamma += q0[ix] * gam[ix];
+      gnew.packedReplace(static_cast<int>(ix), 
+                         z[ix] - alpha / w[ix] * qGamma);
+    }
     limitg();
-    PackedVector difference = g.packedSubtract(gnew);
-    step = packedNorm(difference) / n;
+    double sumSq = 0.0;
+    for (std::size_t ix = 0; ix < n; ++ix) {
+      double diff = g[ix] - gnew[ix];
+      sumSq += diff * diff;
+    }
+    step = sqrt(sumSq) / static_cast<double>(n);
     if (VERB > 3) {
       cerr << "step size:" << step << endl;
     }
@@ -226,34 +243,70 @@ double BaseSpline::alphaLinearSearchBA(double min_p,
 
 void BaseSpline::initiateQR() {
   int n = static_cast<int>(x.size());
+  std::size_t m = static_cast<std::size_t>(n - 2);
   dx.resize(n-1);
   for (std::size_t ix = 0; static_cast<int>(ix) < n - 1; ix++) {
     dx.addElement(static_cast<int>(ix), x[ix + 1] - x[ix]);
     assert(dx[ix] > 0);
   }
-  Q = PackedMatrix(n,n-2);
-  R = PackedMatrix(n-2, n-2);
-  //Fill Q
-  Q[0].packedAddElement(0, 1 / dx[0]);
-  Q[1].packedAddElement(0, -1 / dx[0] - 1 / dx[1]);
-  Q[1].packedAddElement(1, 1 / dx[1]);
-  for (int j = 2; j < n - 2; j++) {
-    Q[j].packedAddElement(j-2, 1 / dx[j - 1]);
-    Q[j].packedAddElement(j-1, -1 / dx[j - 1] - 1 / dx[j]);
-    Q[j].packedAddElement(j, 1 / dx[j]);
+  //Fill the diagonals of Q and R
+  q0.resize(m); q1.resize(m); q2.resize(m);
+  r0.resize(m); r1.resize(m);
+  for (std::size_t j = 0; j < m; j++) {
+    q0[j] = 1 / dx[j];
+    q1[j] = -1 / dx[j] - 1 / dx[j + 1];
+    q2[j] = 1 / dx[j + 1];
+    r0[j] = (dx[j] + dx[j + 1]) / 3;
+    r1[j] = (j + 1 < m ? dx[j + 1] / 6 : 0.0);
+  }
+  d.resize(m); l1.resize(m); l2.resize(m);
+}
+
+/**
+ * Builds B = R + alpha*Qt*W^-1*Q from the diagonals of Q and R and 
+ * decomposes it into L*D*Lt in place, see page 26 of Green & Silverman. 
+ * B is pentadiagonal, so this takes linear time in the number of bins.
+ */
+void BaseSpline::factorizeB(double alpha) {
+  std::size_t m = q0.size();
+  // ka[i]=B[i,i+a]=B[i+a,i], stored in d, l1 and l2 until factorized
+  for (std::size_t i = 0; i < m; ++i) {
+    d[i] = r0[i] + alpha * (q0[i] * q0[i] / w[i] + q1[i] * q1[i] / w[i + 1] 
+                            + q2[i] * q2[i] / w[i + 2]);
+    l1[i] = (i + 1 < m ? r1[i] + alpha * (q1[i] * q0[i + 1] / w[i + 1] 
+                                          + q2[i] * q1[i + 1] / w[i + 2])
+                       : 0.0);
+    l2[i] = (i + 2 < m ? alpha * q2[i] * q0[i + 2] / w[i + 2] : 0.0);
   }
-  Q[n - 2].packedAddElement(n-4, 1 / dx[n - 3]);
-  Q[n - 2].packedAddElement(n - 3, -1 / dx[n - 3] - 1 / dx[n - 2]);
-  Q[n - 1].packedAddElement(n - 3,  1 / dx[n - 2]);
-  //Fill R
-  for (int i = 0; i < n - 3; i++) {
-    R[i].packedAddElement(i, (dx[i] + dx[i + 1]) / 3);
-    R[i].packedAddElement(i + 1, dx[i + 1] / 6);
-    R[i + 1].packedAddElement(i, dx[i + 1] / 6);
+  if (m > 1) {
+    l1[0] /= d[0];
+    d[1] -= l1[0] * l1[0] * d[0];
+  }
+  for (std::size_t row = 2; row < m; ++row) {
+    l2[row - 2] /= d[row - 2];
+    l1[row - 1] = (l1[row - 1] - l1[row - 2] * l2[row - 2] * d[row - 2])
+        / d[row - 1];
+    d[row] -= l1[row - 1] * l1[row - 1] * d[row - 1]
+        + l2[row - 2] * l2[row - 2] * d[row - 2];
+  }
+}
+
+/**
+ * Solves B*x = res in place, using the factorization of factorizeB
+ */
+void BaseSpline::solveFactorizedB(vector<double>& res) const {
+  std::size_t m = d.size();
+  for (std::size_t ix = 1; ix < m; ++ix) {
+    res[ix] -= l1[ix - 1] * res[ix - 1];
+    if (ix >= 2) res[ix] -= l2[ix - 2] * res[ix - 2];
+  }
+  for (std::size_t ix = 0; ix < m; ++ix) {
+    res[ix] /= d[ix];
+  }
+  for (std::size_t ix = m - 1; ix--;) {
+    res[ix] -= l1[ix] * res[ix + 1];
+    if (ix + 2 < m) res[ix] -= l2[ix] * res[ix + 2];
   }
-  R[n - 3].packedAddElement(n - 3, (dx[n - 3] + dx[n - 2]) / 3);
-  Qt = PackedMatrix(n-2,n);
-  Qt = Qt.packedTranspose(Q);
 }
 
 double BaseSpline::evaluateSlope(double alpha) {
@@ -290,40 +343,8 @@ double BaseSpline::evaluateSlope(double alpha) {
 
 
 double BaseSpline::crossValidation(double alpha) {
-  std::size_t n = static_cast<std::size_t>(R.numRows());
-  //  Vec k0(n),k1(n),k2(n);
-  vector<double> k0(n), k1(n), k2(n);
-  PackedMatrix B = R.packedAdd( ((Qt.packedMultiply(alpha)).packedMultiply(
-      PackedMatrix::packedDiagonalMatrix(Vector(static_cast<int>(n)+2, 1.0) / w)).packedMultiply(Q)));
-  // Get the diagonals from K
-  // ka[i]=B[i,i+a]=B[i+a,i]
-  for (std::size_t row = 0; row < n; ++row) {
-    for (int rowPos = B[row].numberEntries(); rowPos--;) {
-      std::size_t col = static_cast<std::size_t>(B[row].index(rowPos));
-      if (col == row) {
-        k0[row] = B[row][rowPos];
-      } else if (col + 1 == row) {
-        k1[row] = B[row][rowPos];
-      } else if (col + 2 == row) {
-        k2[row] = B[row][rowPos];
-      }
-    }
-  }
-  // LDL decompose Page 26 Green Silverman
-  // d[i]=D[i,i]
-  // la[i]=L[i+a,i]
-  //  Vec d(n),l1(n),l2(n);
-  vector<double> d(n), l1(n), l2(n);
-  d[0] = k0[0];
-  l1[0] = k1[0] / d[0];
-  d[1] = k0[1] - l1[0] * l1[0] * d[0];
-  for (std::size_t row = 2; row < n; ++row) {
-    l2[row - 2] = k2[row - 2] / d[row - 2];
-    l1[row - 1] = (k1[row - 1] - l1[row - 2] * l2[row - 2] * d[row - 2])
-        / d[row - 1];
-    d[row] = k0[row] - l1[row - 1] * l1[row - 1] * d[row - 1]
-        - l2[row - 2] * l2[row - 2] * d[row - 2];
-  }
+  std::size_t n = d.size();
+  factorizeB(alpha);
   // Find diagonals of inverse Page 34 Green Silverman
   // ba[i]=B^{-1}[i+a,i]=B^{-1}[i,i+a]
   //  Vec b0(n),b1(n),b2(n);
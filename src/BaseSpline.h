@@ -54,6 +54,8 @@ class BaseSpline {
     virtual void limitg() {}
     virtual void limitgamma() {}
     void initiateQR();
+    void factorizeB(double alpha);
+    void solveFactorizedB(vector<double>& res) const;
     double crossValidation(double alpha);
     double evaluateSlope(double alpha);
     pair<double, double> alphaLinearSearch(double min_p, double max_p,
@@ -65,7 +67,12 @@ class BaseSpline {
     void testPerformance();
     Transform transf;
 
-    PackedMatrix Q, Qt, R;
+    // Q is n x (n-2) and tridiagonal along its columns, Q[j+a,j] = qa[j];
+    // R is symmetric tridiagonal, R[i,i] = r0[i] and R[i,i+1] = r1[i]
+    vector<double> q0, q1, q2, r0, r1;
+    // LDL^T factorization of the pentadiagonal B = R + alpha*Qt*W^-1*Q,
+    // d[i] = D[i,i] and la[i] = L[i+a,i]
+    vector<double> d, l1, l2;
     PackedVector gnew, w, z, dx;
     PackedVector g, gamma;
     vector<double> x;
@@ -0,0 +1,495 @@
+/*******************************************************************************
+ Copyright 2006-2012 Lukas Käll <lukas.kall@scilifelab.se>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+
+ *******************************************************************************/
+
+#include "BinaryCache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+
+#include "MappedFile.h"
+#include "SymbolTable.h"
+#include "MyException.h"
+#include "Globals.h"
+
+const char BinaryCache::kMagic[8] = { 'P', 'I', 'N', '.', 'B', 'I', 'N', '\0' };
+const uint32_t BinaryCache::kVersion;
+const uint32_t BinaryCache::kByteOrderMark;
+const uint32_t BinaryCache::kFlagDOC;
+const uint64_t BinaryCache::kChecksumSeed;
+
+namespace {
+std::size_t paddedLength(std::size_t length) {
+  return (length + 7u) & ~static_cast<std::size_t>(7u);
+}
+}
+
+/**
+ * Mixes in data word by word, length has to be a multiple of 8. One multiply
+ * per 8 bytes keeps validation close to memory bandwidth.
+ */
+uint64_t BinaryCache::updateChecksum(uint64_t checksum, const char* data,
+                                     std::size_t length) {
+  for (std::size_t i = 0; i < length; i += 8u) {
+    uint64_t word;
+    memcpy(&word, data + i, 8u);
+    checksum = (checksum ^ word) * 0x9E3779B97F4A7C15ULL;
+    checksum ^= checksum >> 32;
+  }
+  return checksum;
+}
+
+BinaryCache::Writer::Writer(const std::string& fileName) :
+    fileName_(fileName), tempFileName_(fileName + ".tmp"),
+    out_(tempFileName_.c_str(), ios::out | ios::binary), closed_(false),
+    checksum_(kChecksumSeed) {
+  if (!out_.is_open()) {
+    ostringstream temp;
+    temp << "ERROR: Could not open the binary cache file " << tempFileName_
+        << " for writing." << std::endl;
+    throw MyException(temp.str());
+  }
+}
+
+BinaryCache::Writer::~Writer() {
+  if (!closed_) {
+    out_.close();
+    remove(tempFileName_.c_str());
+  }
+}
+
+void BinaryCache::Writer::write(const void* data, std::size_t length) {
+  const char* bytes = static_cast<const char*>(data);
+  out_.write(bytes, static_cast<std::streamsize>(length));
+  pending_.insert(pending_.end(), bytes, bytes + length);
+  std::size_t numFull = pending_.size() & ~static_cast<std::size_t>(7u);
+  if (numFull > 0u) {
+    checksum_ = updateChecksum(checksum_, &pending_[0], numFull);
+    pending_.erase(pending_.begin(), pending_.begin() + static_cast<std::ptrdiff_t>(numFull));
+  }
+}
+
+void BinaryCache::Writer::beginSection(uint32_t id, std::size_t length) {
+  SectionHeader sectionHeader;
+  sectionHeader.id = id;
+  sectionHeader.reserved = 0u;
+  sectionHeader.length = static_cast<uint64_t>(length);
+  write(&sectionHeader, sizeof(sectionHeader));
+}
+
+void BinaryCache::Writer::endSection(std::size_t length) {
+  const char padding[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+  write(padding, paddedLength(length) - length);
+}
+
+void BinaryCache::Writer::writeSection(uint32_t id, const void* data,
+                                       std::size_t length) {
+  beginSection(id, length);
+  if (length > 0u) write(data, length);
+  endSection(length);
+}
+
+/**
+ * Stores strings as their number, the offsets of each string and one past the
+ * last string, followed by the concatenated characters
+ */
+void BinaryCache::Writer::writeStringSection(uint32_t id,
+    const std::vector<std::string>& strings) {
+  std::vector<uint64_t> offsets(strings.size() + 2u);
+  offsets[0] = static_cast<uint64_t>(strings.size());
+  offsets[1] = 0u;
+  for (std::size_t i = 0; i < strings.size(); ++i) {
+    offsets[i + 2u] = offsets[i + 1u] + strings[i].size();
+  }
+  std::vector<char> data(offsets.size() * sizeof(uint64_t) + offsets.back());
+  memcpy(&data[0], &offsets[0], offsets.size() * sizeof(uint64_t));
+  char* chars = &data[0] + offsets.size() * sizeof(uint64_t);
+  for (std::size_t i = 0; i < strings.size(); ++i) {
+    memcpy(chars + offsets[i + 1u], strings[i].data(), strings[i].size());
+  }
+  writeSection(id, &data[0], data.size());
+}
+
+void BinaryCache::Writer::close() {
+  assert(pending_.empty());
+  out_.write(reinterpret_cast<const char*>(&checksum_), sizeof(checksum_));
+  out_.close();
+  if (!out_) {
+    throw MyException("ERROR: Failed to write the binary cache file.\n");
+  }
+  if (rename(tempFileName_.c_str(), fileName_.c_str()) != 0) {
+    ostringstream temp;
+    temp << "ERROR: Could not rename " << tempFileName_ << " to " << fileName_
+        << "." << std::endl;
+    throw MyException(temp.str());
+  }
+  closed_ = true;
+}
+
+/**
+ * Writes the PSMs of setHandler, which should not be normalized yet, together
+ * with the feature names, information of the sanity check and the command 
+ * line of the search engine (otherCall)
+ */
+void BinaryCache::write(const std::string& fileName, SetHandler& setHandler,
+                        SanityCheck* pCheck, const std::string& otherCall) {
+  const std::vector<PSMDescription*>& targetPsms =
+      setHandler.getSubsetFromLabel(1)->getPsms();
+  const std::vector<PSMDescription*>& decoyPsms =
+      setHandler.getSubsetFromLabel(-1)->getPsms();
+  std::size_t numTargets = targetPsms.size();
+  std::size_t numPsms = numTargets + decoyPsms.size();
+  std::size_t numFeatures = setHandler.getFeaturePool().getNumFeatures();
+  
+  // merges targets and decoys by the position of their feature rows in the 
+  // pool, which keeps the order of the PSMs within each set
+  std::vector<const double*> rows(numPsms);
+  for (std::size_t i = 0; i < numPsms; ++i) {
+    rows[i] = (i < numTargets) ? targetPsms[i]->features : decoyPsms[i - numTargets]->features;
+  }
+  std::vector<unsigned int> rowIdxs;
+  setHandler.getFeaturePool().getRowIndices(rows, rowIdxs);
+  std::vector<PSMDescription*> psms;
+  std::vector<int32_t> labels;
+  psms.reserve(numPsms);
+  labels.reserve(numPsms);
+  std::size_t t = 0u, d = 0u;
+  while (t + d < numPsms) {
+    if (d == decoyPsms.size() || 
+        (t < numTargets && rowIdxs[t] < rowIdxs[numTargets + d])) {
+      psms.push_back(targetPsms[t++]);
+      labels.push_back(1);
+    } else {
+      psms.push_back(decoyPsms[d++]);
+      labels.push_back(-1);
+    }
+  }
+
+  std::vector<uint32_t> scans(numPsms);
+  std::vector<double> expMasses(numPsms), calcMasses(numPsms);
+  std::vector<double> retentionTimes, massDiffs;
+  std::vector<std::string> psmIds(numPsms);
+  std::vector<uint32_t> peptideIdxs(numPsms);
+  std::vector<uint64_t> proteinOffsets(numPsms + 1u, 0u);
+  std::vector<uint32_t> proteinIdxs;
+  SymbolTable peptides, proteins;
+  for (std::size_t i = 0; i < numPsms; ++i) {
+    PSMDescription* psm = psms[i];
+    scans[i] = psm->scan;
+    expMasses[i] = psm->expMass;
+    calcMasses[i] = psm->calcMass;
+    if (DataSet::getCalcDoc()) {
+      retentionTimes.push_back(psm->getRetentionTime());
+      massDiffs.push_back(psm->getMassDiff());
+    }
+    psmIds[i] = psm->getId();
+    peptideIdxs[i] = peptides.intern(psm->peptide);
+    std::vector<unsigned int>::const_iterator protIt = psm->proteinIds.begin();
+    for ( ; protIt != psm->proteinIds.end(); ++protIt) {
+      proteinIdxs.push_back(proteins.intern(PSMDescription::getProteinName(*protIt)));
+    }
+    proteinOffsets[i + 1u] = proteinIdxs.size();
+  }
+
+  std::vector<std::string> featureNames;
+  FeatureNames& names = DataSet::getFeatureNames();
+  std::size_t numNamedFeatures = (DataSet::getCalcDoc() && names.getDocFeatNum() >= 0) ?
+      static_cast<std::size_t>(names.getDocFeatNum()) : FeatureNames::getNumFeatures();
+  for (unsigned int j = 0; j < numNamedFeatures; ++j) {
+    featureNames.push_back(names.getFeatureName(j));
+  }
+  std::vector<std::string> peptideDict(peptides.size()), proteinDict(proteins.size());
+  for (std::size_t j = 0; j < peptides.size(); ++j) {
+    peptideDict[j] = peptides.getName(static_cast<unsigned int>(j));
+  }
+  for (std::size_t j = 0; j < proteins.size(); ++j) {
+    proteinDict[j] = proteins.getName(static_cast<unsigned int>(j));
+  }
+  std::vector<double>& defaultWeights = SanityCheck::getDefaultWeights();
+
+  Header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.byteOrderMark = kByteOrderMark;
+  header.flags = DataSet::getCalcDoc() ? kFlagDOC : 0u;
+  header.numFeatures = static_cast<uint32_t>(numFeatures);
+  header.numPsms = static_cast<uint64_t>(numPsms);
+  header.concatenatedSearch = (pCheck != NULL && pCheck->concatenatedSearch()) ? 1u : 0u;
+  header.numSections = DataSet::getCalcDoc() ? 16u : 14u;
+
+  Writer writer(fileName);
+  writer.write(&header, sizeof(header));
+  writer.writeStringSection(FEATURE_NAMES, featureNames);
+  writer.writeSection(DEFAULT_WEIGHTS, defaultWeights.empty() ? NULL : &defaultWeights[0],
+                      defaultWeights.size() * sizeof(double));
+  writer.writeSection(LABELS, labels.empty() ? NULL : &labels[0], numPsms * sizeof(int32_t));
+  writer.writeSection(SCANS, scans.empty() ? NULL : &scans[0], numPsms * sizeof(uint32_t));
+  writer.writeSection(EXP_MASS, expMasses.empty() ? NULL : &expMasses[0], numPsms * sizeof(double));
+  writer.writeSection(CALC_MASS, calcMasses.empty() ? NULL : &calcMasses[0], numPsms * sizeof(double));
+  if (DataSet::getCalcDoc()) {
+    writer.writeSection(RETENTION_TIME, retentionTimes.empty() ? NULL : &retentionTimes[0],
+                        numPsms * sizeof(double));
+    writer.writeSection(MASS_DIFF, massDiffs.empty() ? NULL : &massDiffs[0],
+                        numPsms * sizeof(double));
+  }
+  // feature rows are copied straight from the FeatureMemoryPool
+  std::size_t featuresLength = numPsms * numFeatures * sizeof(double);
+  writer.beginSection(FEATURES, featuresLength);
+  for (std::size_t i = 0; i < numPsms; ++i) {
+    writer.write(psms[i]->features, numFeatures * sizeof(double));
+  }
+  writer.endSection(featuresLength);
+  writer.writeStringSection(PSM_IDS, psmIds);
+  writer.writeStringSection(PEPTIDE_DICT, peptideDict);
+  writer.writeSection(PEPTIDE_IDX, peptideIdxs.empty() ? NULL : &peptideIdxs[0],
+                      numPsms * sizeof(uint32_t));
+  writer.writeStringSection(PROTEIN_DICT, proteinDict);
+  writer.writeSection(PROTEIN_OFFSETS, &proteinOffsets[0],
+                      proteinOffsets.size() * sizeof(uint64_t));
+  writer.writeSection(PROTEIN_IDX, proteinIdxs.empty() ? NULL : &proteinIdxs[0],
+                      proteinIdxs.size() * sizeof(uint32_t));
+  writer.writeStringSection(OTHER_CALL, std::vector<std::string>(1u, otherCall));
+  writer.close();
+
+  if (VERB > 1) {
+    std::cerr << "Wrote " << numPsms << " PSMs to binary cache " << fileName
+        << std::endl;
+  }
+}
+
+void BinaryCache::readStrings(const Section& section,
+                              std::vector<std::string>& strings) {
+  uint64_t count = 0u;
+  if (section.length >= sizeof(uint64_t)) memcpy(&count, section.data, sizeof(uint64_t));
+  if (section.length < (count + 2u) * sizeof(uint64_t)) {
+    throw MyException("ERROR: Reading binary cache, corrupt string section.\n");
+  }
+  std::vector<uint64_t> offsets(count + 1u);
+  memcpy(&offsets[0], section.data + sizeof(uint64_t), offsets.size() * sizeof(uint64_t));
+  const char* chars = section.data + (count + 2u) * sizeof(uint64_t);
+  uint64_t numChars = section.length - (count + 2u) * sizeof(uint64_t);
+  strings.resize(count);
+  for (std::size_t i = 0; i < count; ++i) {
+    if (offsets[i] > offsets[i + 1u] || offsets[i + 1u] > numChars) {
+      throw MyException("ERROR: Reading binary cache, corrupt string section.\n");
+    }
+    strings[i].assign(chars + offsets[i], chars + offsets[i + 1u]);
+  }
+}
+
+const BinaryCache::Section& BinaryCache::getSection(
+    const std::vector<Section>& sections, uint32_t id, uint64_t expectedLength) {
+  const Section& section = sections[id];
+  if (section.data == NULL || section.length != expectedLength) {
+    ostringstream temp;
+    temp << "ERROR: Reading binary cache, section " << id
+        << " is missing or has an unexpected size." << std::endl;
+    throw MyException(temp.str());
+  }
+  return section;
+}
+
+/**
+ * Locates the sections following a header of headerSize bytes in the mapped
+ * file; sections with an id beyond the size of sections are skipped
+ */
+void BinaryCache::findSections(const char* data, std::size_t size,
+    std::size_t headerSize, uint32_t numSections, std::vector<Section>& sections) {
+  std::size_t pos = headerSize;
+  for (uint32_t s = 0; s < numSections; ++s) {
+    SectionHeader sectionHeader;
+    if (pos + sizeof(sectionHeader) > size - sizeof(uint64_t)) {
+      throw MyException("ERROR: Reading binary cache, truncated section header.\n");
+    }
+    memcpy(&sectionHeader, data + pos, sizeof(sectionHeader));
+    pos += sizeof(sectionHeader);
+    if (sectionHeader.length > size - sizeof(uint64_t) - pos) {
+      throw MyException("ERROR: Reading binary cache, truncated section.\n");
+    }
+    if (sectionHeader.id < sections.size()) {
+      sections[sectionHeader.id].data = data + pos;
+      sections[sectionHeader.id].length = sectionHeader.length;
+    }
+    pos += paddedLength(static_cast<std::size_t>(sectionHeader.length));
+  }
+}
+
+int BinaryCache::read(const std::string& fileName, SetHandler& setHandler,
+                      SanityCheck*& pCheck, std::string& otherCall) {
+  MappedFile mappedCache;
+  if (!mappedCache.open(fileName)) {
+    std::cerr << "ERROR: Cannot open binary cache file " << fileName << "." << std::endl;
+    return 0;
+  }
+  const char* data = mappedCache.data();
+  std::size_t size = mappedCache.size();
+
+  Header header;
+  if (size < sizeof(header) + sizeof(uint64_t) || size % 8u != 0u) {
+    std::cerr << "ERROR: " << fileName << " is not a binary cache file." << std::endl;
+    return 0;
+  }
+  memcpy(&header, data, sizeof(header));
+  if (memcmp(header.magic, kMagic, sizeof(kMagic)) != 0) {
+    std::cerr << "ERROR: " << fileName << " is not a binary cache file." << std::endl;
+    return 0;
+  }
+  if (header.byteOrderMark != kByteOrderMark || header.version != kVersion) {
+    std::cerr << "ERROR: The binary cache file " << fileName << " was written by "
+        << "an incompatible version or on a platform with a different byte order,"
+        << " regenerate it with --write-binary-cache." << std::endl;
+    return 0;
+  }
+  uint64_t storedChecksum;
+  memcpy(&storedChecksum, data + size - sizeof(uint64_t), sizeof(uint64_t));
+  if (updateChecksum(kChecksumSeed, data, size - sizeof(uint64_t)) != storedChecksum) {
+    std::cerr << "ERROR: Checksum mismatch, the binary cache file " << fileName
+        << " is corrupt." << std::endl;
+    return 0;
+  }
+  bool cacheHasDOC = (header.flags & kFlagDOC) != 0u;
+  if (cacheHasDOC != DataSet::getCalcDoc()) {
+    std::cerr << "ERROR: The binary cache file " << fileName << " was written "
+        << (cacheHasDOC ? "with" : "without") << " the -D option, which has to "
+        << "match the current run." << std::endl;
+    return 0;
+  }
+
+  std::vector<Section> sections(OTHER_CALL + 1);
+  findSections(data, size, sizeof(header), header.numSections, sections);
+
+  std::size_t numPsms = static_cast<std::size_t>(header.numPsms);
+  std::size_t numFeatures = header.numFeatures;
+
+  std::vector<std::string> featureNames;
+  readStrings(getSection(sections, FEATURE_NAMES, sections[FEATURE_NAMES].length),
+              featureNames);
+  FeatureNames& names = DataSet::getFeatureNames();
+  for (std::size_t j = 0; j < featureNames.size(); ++j) {
+    names.insertFeature(featureNames[j]);
+  }
+  names.initFeatures(DataSet::getCalcDoc());
+  if (numFeatures < DataSet::getNumFeatures()) {
+    throw MyException("ERROR: Reading binary cache, feature names do not match the feature rows.\n");
+  }
+  setHandler.getFeaturePool().createPool(numFeatures);
+
+  const Section& defaultWeights = sections[DEFAULT_WEIGHTS];
+  if (defaultWeights.length > 0u) {
+    std::vector<double> initValues(defaultWeights.length / sizeof(double));
+    memcpy(&initValues[0], defaultWeights.data, initValues.size() * sizeof(double));
+    SanityCheck::addDefaultWeights(initValues);
+  }
+
+  const int32_t* labels = reinterpret_cast<const int32_t*>(
+      getSection(sections, LABELS, numPsms * sizeof(int32_t)).data);
+  const uint32_t* scans = reinterpret_cast<const uint32_t*>(
+      getSection(sections, SCANS, numPsms * sizeof(uint32_t)).data);
+  const double* expMasses = reinterpret_cast<const double*>(
+      getSection(sections, EXP_MASS, numPsms * sizeof(double)).data);
+  const double* calcMasses = reinterpret_cast<const double*>(
+      getSection(sections, CALC_MASS, numPsms * sizeof(double)).data);
+  const double* retentionTimes = NULL;
+  const double* massDiffs = NULL;
+  if (cacheHasDOC) {
+    retentionTimes = reinterpret_cast<const double*>(
+        getSection(sections, RETENTION_TIME, numPsms * sizeof(double)).data);
+    massDiffs = reinterpret_cast<const double*>(
+        getSection(sections, MASS_DIFF, numPsms * sizeof(double)).data);
+  }
+  const double* features = reinterpret_cast<const double*>(
+      getSection(sections, FEATURES, numPsms * numFeatures * sizeof(double)).data);
+  const uint32_t* peptideIdxs = reinterpret_cast<const uint32_t*>(
+      getSection(sections, PEPTIDE_IDX, numPsms * sizeof(uint32_t)).data);
+  const uint64_t* proteinOffsets = reinterpret_cast<const uint64_t*>(
+      getSection(sections, PROTEIN_OFFSETS, (numPsms + 1u) * sizeof(uint64_t)).data);
+  const Section& proteinIdxSection = getSection(sections, PROTEIN_IDX,
+      proteinOffsets[numPsms] * sizeof(uint32_t));
+  const uint32_t* proteinIdxs = reinterpret_cast<const uint32_t*>(proteinIdxSection.data);
+
+  std::vector<std::string> psmIds, peptides, proteins;
+  readStrings(getSection(sections, PSM_IDS, sections[PSM_IDS].length), psmIds);
+  readStrings(getSection(sections, PEPTIDE_DICT, sections[PEPTIDE_DICT].length), peptides);
+  readStrings(getSection(sections, PROTEIN_DICT, sections[PROTEIN_DICT].length), proteins);
+  if (psmIds.size() != numPsms) {
+    throw MyException("ERROR: Reading binary cache, number of PSM ids does not match.\n");
+  }
+  std::vector<std::string> otherCalls;
+  readStrings(getSection(sections, OTHER_CALL, sections[OTHER_CALL].length), otherCalls);
+  if (otherCalls.size() != 1u) {
+    throw MyException("ERROR: Reading binary cache, corrupt command line section.\n");
+  }
+  otherCall = otherCalls[0];
+  std::vector<unsigned int> proteinSymbols(proteins.size());
+  for (std::size_t j = 0; j < proteins.size(); ++j) {
+    proteinSymbols[j] = PSMDescription::internProteinName(proteins[j]);
+  }
+
+  DataSet* targetSet = new DataSet();
+  targetSet->setLabel(1);
+  DataSet* decoySet = new DataSet();
+  decoySet->setLabel(-1);
+  setHandler.push_back_dataset(targetSet);
+  setHandler.push_back_dataset(decoySet);
+
+  // the rows are stored in pool order, so they can be copied in bulk
+  unsigned int firstRowIdx = 
+      setHandler.getFeaturePool().appendRows(features, numPsms);
+  for (std::size_t i = 0; i < numPsms; ++i) {
+    PSMDescription* myPsm = NULL;
+    if (DataSet::getCalcDoc()) {
+      myPsm = new PSMDescriptionDOC();
+      myPsm->setRetentionTime(retentionTimes[i]);
+      myPsm->setMassDiff(massDiffs[i]);
+    } else {
+      myPsm = new PSMDescription();
+    }
+    myPsm->features = setHandler.getFeaturePool().addressFromIdx(
+        firstRowIdx + static_cast<unsigned int>(i));
+    myPsm->scan = scans[i];
+    myPsm->expMass = expMasses[i];
+    myPsm->calcMass = calcMasses[i];
+    myPsm->id_.swap(psmIds[i]);
+    if (peptideIdxs[i] >= peptides.size() || proteinOffsets[i] > proteinOffsets[i + 1u]) {
+      throw MyException("ERROR: Reading binary cache, corrupt dictionary index.\n");
+    }
+    myPsm->peptide = peptides[peptideIdxs[i]];
+    myPsm->proteinIds.reserve(static_cast<std::size_t>(proteinOffsets[i + 1u] - proteinOffsets[i]));
+    for (uint64_t k = proteinOffsets[i]; k < proteinOffsets[i + 1u]; ++k) {
+      if (proteinIdxs[k] >= proteinSymbols.size()) {
+        throw MyException("ERROR: Reading binary cache, corrupt dictionary index.\n");
+      }
+      myPsm->proteinIds.push_back(proteinSymbols[proteinIdxs[k]]);
+    }
+    if (labels[i] == 1) {
+      targetSet->registerPsm(myPsm);
+    } else {
+      decoySet->registerPsm(myPsm);
+    }
+  }
+
+  pCheck = SanityCheck::initialize(otherCall);
+  pCheck->checkAndSetDefaultDir();
+  pCheck->setConcatenatedSearch(header.concatenatedSearch != 0u);
+
+  if (VERB > 1) {
+    std::cerr << "Read " << numPsms << " PSMs from binary cache " << fileName
+        << std::endl;
+  }
+  return 1;
+}
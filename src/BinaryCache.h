@@ -0,0 +1,129 @@
+/*******************************************************************************
+ Copyright 2006-2012 Lukas Käll <lukas.kall@scilifelab.se>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+
+ *******************************************************************************/
+#ifndef BINARY_CACHE_H_
+#define BINARY_CACHE_H_
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <stdint.h>
+
+#include "SetHandler.h"
+#include "SanityCheck.h"
+
+/*
+* BinaryCache
+*
+* Versioned binary columnar copy ("pin.bin") of the parsed input, i.e. of the
+* PSMs held by a SetHandler right after reading pin-tab or pin-xml input and
+* before normalization. Reloading it avoids the text parse on repeated runs
+* over the same input.
+*
+* Layout, all in native byte order and padded to multiples of 8 bytes:
+*   header    magic, version, byte order mark, flags, feature row width,
+*             number of PSMs, concatenated search flag, number of sections
+*   sections  (id, byte length, data) for the feature names, default weights,
+*             labels, scan numbers, expMass, calcMass, retention times and
+*             mass differences (DOC only), feature rows in FeatureMemoryPool
+*             layout, PSM ids, the peptide and protein dictionaries, per PSM
+*             indices into these dictionaries, and the command line of the
+*             search engine that selects the SanityCheck
+*
+* PSMs are stored in the order of their feature rows in the pool, such that
+* reading the cache registers them in the same order as the original parse
+* and can copy the feature rows into the pool block by block.
+*   trailer   checksum over all preceding bytes
+*
+*/
+class BinaryCache {
+ public:
+  static void write(const std::string& fileName, SetHandler& setHandler,
+                    SanityCheck* pCheck, const std::string& otherCall);
+  // returns 0 on error, 1 on success, like SetHandler::readTab
+  static int read(const std::string& fileName, SetHandler& setHandler,
+                  SanityCheck*& pCheck, std::string& otherCall);
+
+ protected:
+  static const char kMagic[8];
+  static const uint32_t kVersion = 2u;
+  static const uint32_t kByteOrderMark = 0x01020304u;
+  static const uint32_t kFlagDOC = 1u;
+  static const uint64_t kChecksumSeed = 14695981039346656037ULL;
+
+  enum SectionId {
+    FEATURE_NAMES = 1, DEFAULT_WEIGHTS, LABELS, SCANS, EXP_MASS, CALC_MASS,
+    RETENTION_TIME, MASS_DIFF, FEATURES, PSM_IDS, PEPTIDE_DICT, PEPTIDE_IDX,
+    PROTEIN_DICT, PROTEIN_OFFSETS, PROTEIN_IDX, OTHER_CALL
+  };
+
+  struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrderMark;
+    uint32_t flags;
+    uint32_t numFeatures;
+    uint64_t numPsms;
+    uint32_t concatenatedSearch;
+    uint32_t numSections;
+    uint64_t reserved[3];
+  };
+
+  struct SectionHeader {
+    uint32_t id;
+    uint32_t reserved;
+    uint64_t length;
+  };
+
+  // a section as found in a mapped cache file
+  struct Section {
+    const char* data;
+    uint64_t length;
+    Section() : data(NULL), length(0u) {}
+  };
+
+  // streaming writer that keeps the checksum up to date. The file is written
+  // under a temporary name and only renamed to fileName by close(), such
+  // that an interrupted write never leaves a partial cache behind.
+  class Writer {
+   public:
+    Writer(const std::string& fileName);
+    ~Writer();
+    void write(const void* data, std::size_t length);
+    void beginSection(uint32_t id, std::size_t length);
+    void endSection(std::size_t length);
+    void writeSection(uint32_t id, const void* data, std::size_t length);
+    void writeStringSection(uint32_t id, const std::vector<std::string>& strings);
+    void close();
+   private:
+    std::string fileName_, tempFileName_;
+    std::ofstream out_;
+    bool closed_;
+    uint64_t checksum_;
+    std::vector<char> pending_; // bytes not yet forming a full 8-byte word
+  };
+
+  static uint64_t updateChecksum(uint64_t checksum, const char* data,
+                                 std::size_t length);
+  static void readStrings(const Section& section, std::vector<std::string>& strings);
+  static void findSections(const char* data, std::size_t size,
+                           std::size_t headerSize, uint32_t numSections,
+                           std::vector<Section>& sections);
+  static const Section& getSection(const std::vector<Section>& sections,
+                                   uint32_t id, uint64_t expectedLength);
+};
+
+#endif /* BINARY_CACHE_H_ */
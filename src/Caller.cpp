@@ -36,16 +36,19 @@ using namespace std;
 Caller::Caller() :
     pNorm_(NULL), pCheck_(NULL), protEstimator_(NULL), enzyme_(NULL),
     tabInput_(true), readStdIn_(false), inputFN_(""), xmlSchemaValidation_(true),
+    binaryCacheInFN_(""), binaryCacheOutFN_(""),
     tabOutputFN_(""), xmlOutputFN_(""), weightOutputFN_(""),
     psmResultFN_(""), peptideResultFN_(""), proteinResultFN_(""),
     decoyPsmResultFN_(""), decoyPeptideResultFN_(""), decoyProteinResultFN_(""),
+    profileOutputFN_(""),
     xmlPrintDecoys_(false), xmlPrintExpMass_(true), reportUniquePeptides_(true),
     targetDecoyCompetition_(false), useMixMax_(false), inputSearchType_("auto"),
     selectionFdr_(0.01), initialSelectionFdr_(0.01), testFdr_(0.01),
     numIterations_(10), maxPSMs_(0u),
     nestedXvalBins_(1u), selectedCpos_(0.0), selectedCneg_(0.0),
     reportEachIteration_(false), quickValidation_(false), 
-    trainBestPositive_(false), numThreads_(3u) {
+    trainBestPositive_(false), svmColdStart_(false), numThreads_(3u),
+    maxSortMemory_(0u) {
 }
 
 Caller::~Caller() {
@@ -366,10 +369,40 @@ bool Caller::parseOptions(int argc, char **argv) {
       "Enforce that, for each spectrum, at most one PSM is included in the positive set during each training iteration. If the user only provides one PSM per spectrum, this filter will have no effect.",
       "",
       TRUE_IF_SET);
+  cmd.defineOption(Option::EXPERIMENTAL_FEATURE,
+      "svm-cold-start",
+      "Start the training of every SVM from zero weights, instead of from the weights of the previous iteration or of the neighbouring Cpos/Cneg pair.",
+      "",
+      TRUE_IF_SET);
+  cmd.defineOption(Option::EXPERIMENTAL_FEATURE,
+      "max-sort-memory",
+      "Maximum amount of memory in MB for the sort keys when sorting the scored PSMs by score and for the target-decoy competition. Larger sorts write sorted runs of the keys to a temporary file and merge them into a sort order, after which the PSMs are reordered in memory. This does not bound the memory used for the PSMs and their features, nor for the q-values, peptide-level deduplication or the output. When set, PSMs with equal sort keys keep their input order. Default = 0 (no limit).",
+      "value");
   cmd.defineOption(Option::EXPERIMENTAL_FEATURE,
       "train-fdr-initial",
       "Set the FDR threshold for the first iteration. This is useful in cases where the original features do not display a good separation between targets and decoys. In subsequent iterations, the normal --trainFDR will be used.",
       "value");
+  cmd.defineOption(Option::EXPERIMENTAL_FEATURE,
+      "write-binary-cache",
+      "Write the parsed input to a binary cache file, which can be read in subsequent runs with --read-binary-cache to skip parsing the input.",
+      "filename");
+  cmd.defineOption(Option::EXPERIMENTAL_FEATURE,
+      "read-binary-cache",
+      "Read the input from a binary cache file written with --write-binary-cache instead of from a pin file. The -D option has to be the same as when writing the cache.",
+      "filename");
+  cmd.defineOption(Option::EXPERIMENTAL_FEATURE,
+      "picked-protein-cache",
+      "Store the fragment and duplicate proteins found by the in-silico digest of the --picked-protein fasta file in a cache file. Subsequent runs with the same fasta file and digestion settings read them from this file instead of digesting the database again; otherwise the file is regenerated.",
+      "filename");
+  cmd.defineOption(Option::EXPERIMENTAL_FEATURE,
+      "fido-gridsearch-refine",
+      "Estimate Fido's alpha, beta and gamma parameters by a coarse-to-fine search instead of the grid of --fido-gridsearch-depth. A coarse 4x4x4 grid over the range of depth 4 is refined 4 times around the best point at half the previous step size. Each refinement evaluates the at most 26 neighbours that were not evaluated before, so the search takes at most 168 instead of 2448 evaluations.",
+      "",
+      TRUE_IF_SET);
+  cmd.defineOption(Option::EXPERIMENTAL_FEATURE,
+      "profile-json",
+      "Write the time, CPU time, allocations and peak memory use of each processing stage, and counters such as the number of CGLS iterations, to a file in JSON format.",
+      "filename");
   cmd.defineOption(Option::EXPERIMENTAL_FEATURE,
       "parameter-file",
       "Read flags from a parameter file. If flags are specified on the command line as well, these will override the ones in the parameter file.",
@@ -509,13 +542,15 @@ bool Caller::parseOptions(int argc, char **argv) {
       if (cmd.optionSet("fido-protein-truncation-threshold")) fidoProteinThreshold = cmd.getDouble("fido-protein-truncation-threshold", 0.0, 1.0);
       if (cmd.optionSet("fido-gridsearch-mse-threshold")) fidoMseThreshold = cmd.getDouble("fido-gridsearch-mse-threshold",0.001,1.0);
 
-      protEstimator_ = new FidoInterface(fidoAlpha, fidoBeta, fidoGamma,
+      FidoInterface* fido = new FidoInterface(fidoAlpha, fidoBeta, fidoGamma,
                 fidoNoClustering, fidoNoPartitioning, fidoNoPruning,
                 fidoGridSearchDepth, fidoGridSearchThreshold,
                 fidoProteinThreshold, fidoMseThreshold,
                 protEstimatorAbsenceRatio, protEstimatorOutputEmpirQVal,
                 protEstimatorDecoyPrefix, protEstimatorTrivialGrouping,
                 protEstimatorPeptideQvalThreshold);
+      fido->setGridSearchRefine(cmd.optionSet("fido-gridsearch-refine"));
+      protEstimator_ = fido;
     } else if (cmd.optionSet("picked-protein")) {
       std::string fastaDatabase = cmd.options["picked-protein"];
 
@@ -526,12 +561,16 @@ bool Caller::parseOptions(int argc, char **argv) {
       if (cmd.optionSet("protein-report-fragments")) pickedProteinReportFragmentProteins = true;
       if (cmd.optionSet("protein-report-duplicates")) pickedProteinReportDuplicateProteins = true;
 
-      protEstimator_ = new PickedProteinInterface(fastaDatabase,
+      PickedProteinInterface* picked = new PickedProteinInterface(fastaDatabase,
           pickedProteinPvalueCutoff, pickedProteinReportFragmentProteins,
           pickedProteinReportDuplicateProteins,
           protEstimatorTrivialGrouping, protEstimatorAbsenceRatio,
           protEstimatorOutputEmpirQVal, protEstimatorDecoyPrefix,
           protEstimatorPeptideQvalThreshold);
+      if (cmd.optionSet("picked-protein-cache")) {
+        picked->setDigestCacheFile(cmd.options["picked-protein-cache"]);
+      }
+      protEstimator_ = picked;
     }
   }
 
@@ -567,6 +606,17 @@ bool Caller::parseOptions(int argc, char **argv) {
                << "with the option --Cpos" << std::endl;
     }
   }
+  if (cmd.optionSet("write-binary-cache")) {
+    binaryCacheOutFN_ = cmd.options["write-binary-cache"];
+    checkIsWritable(binaryCacheOutFN_);
+  }
+  if (cmd.optionSet("read-binary-cache")) {
+    binaryCacheInFN_ = cmd.options["read-binary-cache"];
+  }
+  if (cmd.optionSet("profile-json")) {
+    profileOutputFN_ = cmd.options["profile-json"];
+    checkIsWritable(profileOutputFN_);
+  }
   if (cmd.optionSet("tab-out")) {
     tabOutputFN_ = cmd.options["tab-out"];
     checkIsWritable(tabOutputFN_);
@@ -597,6 +647,12 @@ bool Caller::parseOptions(int argc, char **argv) {
   if (cmd.optionSet("train-best-positive")) {
     trainBestPositive_ = true;
   }
+  if (cmd.optionSet("svm-cold-start")) {
+    svmColdStart_ = true;
+  }
+  if (cmd.optionSet("max-sort-memory")) {
+    maxSortMemory_ = cmd.getUInt("max-sort-memory", 0, 16777216);
+  }
   if (cmd.optionSet("trainFDR")) {
     selectionFdr_ = cmd.getDouble("trainFDR", 0.0, 1.0);
     initialSelectionFdr_ = selectionFdr_;
@@ -616,6 +672,11 @@ bool Caller::parseOptions(int argc, char **argv) {
   if (cmd.optionSet("subset-max-train")) {
     maxPSMs_ = cmd.getUInt("subset-max-train", 0, 100000000);
   }
+  if ((binaryCacheInFN_.size() > 0 || binaryCacheOutFN_.size() > 0) && maxPSMs_ > 0u) {
+    std::cerr << "Error: the binary cache options cannot be combined with the "
+      << "-N/--subset-max-train option." << std::endl;
+    return 0;
+  }
   if (cmd.optionSet("seed")) {
     PseudoRandom::setSeed(static_cast<unsigned long int>(cmd.getInt("seed", 1, 20000)));
   }
@@ -686,7 +747,7 @@ bool Caller::parseOptions(int argc, char **argv) {
   }
   // if there are no arguments left...
   if (cmd.arguments.size() == 0) {
-    if(!cmd.optionSet("tab-in") && !cmd.optionSet("xml-in") && !cmd.optionSet("stdinput-xml") && !cmd.optionSet("stdinput-tab")){ // unless the input comes from -j, -k or -e option
+    if(!cmd.optionSet("tab-in") && !cmd.optionSet("xml-in") && !cmd.optionSet("stdinput-xml") && !cmd.optionSet("stdinput-tab") && !cmd.optionSet("read-binary-cache")){ // unless the input comes from -j, -k, -e or --read-binary-cache option
       cerr << "Error: too few arguments.";
       cerr << "\nInvoke with -h option for help\n";
       return 0; // ...error
@@ -732,6 +793,7 @@ void Caller::calculatePSMProb(Scores& allScores, bool isUniquePeptideRun){
   }
 
   if (isUniquePeptideRun) {
+    Profiler::Scope profile("weed-out-redundant");
     if (ProteinProbEstimator::getCalcProteinLevelProb()) {
       allScores.weedOutRedundant(protEstimator_->getPeptideSpecCounts(),
                                  protEstimator_->getSpecCountQvalThreshold());
@@ -739,6 +801,7 @@ void Caller::calculatePSMProb(Scores& allScores, bool isUniquePeptideRun){
       allScores.weedOutRedundant();
     }
   } else if (targetDecoyCompetition_) {
+    Profiler::Scope profile("weed-out-redundant");
     allScores.weedOutRedundantTDC();
     if (VERB > 0) {
       std::cerr << "Selected best-scoring PSM per scan+expMass"
@@ -755,7 +818,11 @@ void Caller::calculatePSMProb(Scores& allScores, bool isUniquePeptideRun){
     std::cerr << "Calculating q values." << std::endl;
   }
 
-  int foundPSMs = allScores.calcQ(testFdr_);
+  int foundPSMs;
+  {
+    Profiler::Scope profile("q-value");
+    foundPSMs = allScores.calcQ(testFdr_);
+  }
 
   if (VERB > 0 && writeOutput) {
     if (useMixMax_) {
@@ -768,7 +835,10 @@ void Caller::calculatePSMProb(Scores& allScores, bool isUniquePeptideRun){
     std::cerr << "Calculating posterior error probabilities (PEPs)." << std::endl;
   }
 
-  allScores.calcPep();
+  {
+    Profiler::Scope profile("pep");
+    allScores.calcPep();
+  }
 
   if (VERB > 1 && writeOutput) {
     timer.stop();
@@ -785,6 +855,7 @@ void Caller::calculatePSMProb(Scores& allScores, bool isUniquePeptideRun){
     decoyFN = decoyPsmResultFN_;
   }
 
+  Profiler::Scope profile("output");
   if (!targetFN.empty()) {
     ofstream targetStream(targetFN.c_str(), ios::out);
     allScores.print(NORMAL, targetStream);
@@ -803,6 +874,7 @@ void Caller::calculatePSMProb(Scores& allScores, bool isUniquePeptideRun){
  */
 void Caller::calculateProteinProbabilities(Scores& allScores) {
   Timer localTimer;
+  Profiler::Scope profile("protein-inference");
 
   if (VERB > 0) {
     cerr << "\nCalculating protein level probabilities.\n";
@@ -842,6 +914,9 @@ void Caller::calculateProteinProbabilities(Scores& allScores) {
       " cpu seconds or " << localTimer.getWallTimeStr() << " seconds wall clock time." << endl;
   }
 
+  // the protein output is profiled separately from the inference
+  profile.stop();
+  Profiler::Scope profileOutput("output");
   protEstimator_->printOut(proteinResultFN_, decoyProteinResultFN_);
 }
 
@@ -856,7 +931,9 @@ void Caller::checkIsWritable(const std::string& filePath) {
 }
 
 std::istream& Caller::getDataInStream(std::ifstream& fileStream){
-  if (!readStdIn_) {
+  if (binaryCacheInFN_.size() > 0) {
+    return fileStream; // the binary cache is memory mapped instead
+  } else if (!readStdIn_) {
     if (!tabInput_) fileStream.exceptions(ifstream::badbit | ifstream::failbit);
     fileStream.open(inputFN_.c_str(), ios::in);
   } else if (maxPSMs_ > 0u) {
@@ -869,7 +946,15 @@ std::istream& Caller::getDataInStream(std::ifstream& fileStream){
 
 bool Caller::loadAndNormalizeData(std::istream &dataStream, XMLInterface& xmlInterface, SetHandler& setHandler, Scores& allScores){
   bool success;
-  if (!tabInput_) {
+  Profiler::Scope profileParse("parse");
+  if (binaryCacheInFN_.size() > 0) {
+    if (VERB > 1) {
+      std::cerr << "Reading binary cache " << binaryCacheInFN_ << std::endl;
+    }
+    std::string otherCall;
+    success = BinaryCache::read(binaryCacheInFN_, setHandler, pCheck_, otherCall);
+    xmlInterface.setOtherCall(otherCall);
+  } else if (!tabInput_) {
     if (VERB > 1) {
       std::cerr << "Reading pin-xml input from datafile " << inputFN_ << std::endl;
     }
@@ -891,7 +976,14 @@ bool Caller::loadAndNormalizeData(std::istream &dataStream, XMLInterface& xmlInt
   if (VERB > 2) {
     std::cerr << "FeatureNames::getNumFeatures(): "<< FeatureNames::getNumFeatures() << endl;
   }
+  
+  if (binaryCacheOutFN_.size() > 0) {
+    BinaryCache::write(binaryCacheOutFN_, setHandler, pCheck_, 
+                       xmlInterface.getOtherCall());
+  }
+  profileParse.stop();
 
+  Profiler::Scope profileNormalize("normalize");
   setHandler.normalizeFeatures(pNorm_);
 
   /*
@@ -972,6 +1064,7 @@ bool Caller::loadAndNormalizeData(std::istream &dataStream, XMLInterface& xmlInt
  */
 int Caller::run() {
   timer.reset();
+  Profiler::setEnabled(!profileOutputFN_.empty());
 
   if (VERB > 0) {
     std::cerr << extendedGreeter();
@@ -983,12 +1076,14 @@ int Caller::run() {
   omp_set_num_threads(static_cast<int>(
     std::min((unsigned int)omp_get_max_threads(), numThreads_)));
 #endif
+  Scores::setMaxSortMemory(static_cast<std::size_t>(maxSortMemory_) << 20);
 
   int success = 0;
   std::ifstream fileStream;
   XMLInterface xmlInterface(xmlOutputFN_, xmlSchemaValidation_, xmlPrintDecoys_, xmlPrintExpMass_);
   SetHandler setHandler(maxPSMs_);
   Scores allScores(useMixMax_);
+  if (tabInput_ && !readStdIn_) setHandler.setInputFileName(inputFN_);
 
   if(!loadAndNormalizeData(getDataInStream(fileStream), xmlInterface, setHandler, allScores))
     exit(EXIT_FAILURE);
@@ -997,8 +1092,13 @@ int Caller::run() {
                                   testFdr_, selectionFdr_, initialSelectionFdr_, selectedCpos_,
                                   selectedCneg_, numIterations_, useMixMax_,
                                   nestedXvalBins_, trainBestPositive_, numThreads_, skipNormalizeScores_);
+  crossValidation.setSvmColdStart(svmColdStart_);
 
-  int firstNumberOfPositives = crossValidation.preIterationSetup(allScores, pCheck_, pNorm_, setHandler.getFeaturePool());
+  int firstNumberOfPositives;
+  {
+    Profiler::Scope profile("xval-setup");
+    firstNumberOfPositives = crossValidation.preIterationSetup(allScores, pCheck_, pNorm_, setHandler.getFeaturePool());
+  }
 
   if (VERB > 0) {
     cerr << "Found " << firstNumberOfPositives << " test set positives with q<"
@@ -1019,7 +1119,10 @@ int Caller::run() {
   }
 
   // Do the SVM training
-  crossValidation.train(pNorm_);
+  {
+    Profiler::Scope profile("train");
+    crossValidation.train(pNorm_);
+  }
 
   if (weightOutputFN_.size() > 0) {
     ofstream weightStream(weightOutputFN_.c_str(), ios::out);
@@ -1028,7 +1131,10 @@ int Caller::run() {
   }
 
   // Calculate the final SVM scores and clean up structures
-  crossValidation.postIterationProcessing(allScores, pCheck_);
+  {
+    Profiler::Scope profile("xval-finalize");
+    crossValidation.postIterationProcessing(allScores, pCheck_);
+  }
 
   if (VERB > 0 && DataSet::getCalcDoc()) {
     crossValidation.printDOC();
@@ -1038,6 +1144,7 @@ int Caller::run() {
     if (VERB > 0) {
       cerr << "Scoring full list of PSMs with trained SVMs." << endl;
     }
+    Profiler::Scope profile("score-full-list");
     std::vector<double> rawWeights;
     crossValidation.getAvgWeights(rawWeights, pNorm_);
     setHandler.reset();
@@ -1067,6 +1174,10 @@ int Caller::run() {
   }
 
   calcAndOutputResult(allScores, xmlInterface);
+  
+  if (!profileOutputFN_.empty()) {
+    Profiler::writeJson(profileOutputFN_);
+  }
   return 1;
 }
 
@@ -1106,6 +1217,7 @@ void Caller::calcAndOutputResult(Scores& allScores, XMLInterface& xmlInterface){
     }
   }
   // write output to file
+  Profiler::Scope profile("output");
   xmlInterface.writeXML(allScores, protEstimator_, call_);
 }
 
@@ -35,6 +35,7 @@
 #include "MyException.h"
 #include "Option.h"
 #include "SetHandler.h"
+#include "BinaryCache.h"
 #include "DataSet.h"
 #include "Scores.h"
 #include "SanityCheck.h"
@@ -45,6 +46,7 @@
 #include "XMLInterface.h"
 #include "CrossValidation.h"
 #include "Enzyme.h"
+#include "Profiler.h"
 
 #define  NO_BOOST_DATE_TIME_INLINE
 #include <boost/asio.hpp>
@@ -84,12 +86,14 @@ class Caller {
   bool readStdIn_;
   std::string inputFN_;
   bool xmlSchemaValidation_;
+  std::string binaryCacheInFN_, binaryCacheOutFN_;
   
   // file output parameters
   std::string tabOutputFN_, xmlOutputFN_;
   std::string weightOutputFN_;
   std::string psmResultFN_, peptideResultFN_, proteinResultFN_;
   std::string decoyPsmResultFN_, decoyPeptideResultFN_, decoyProteinResultFN_;
+  std::string profileOutputFN_;
   bool xmlPrintDecoys_, xmlPrintExpMass_;
   
   // report level parameters
@@ -101,9 +105,10 @@ class Caller {
   // SVM / cross validation parameters
   double selectionFdr_, initialSelectionFdr_, testFdr_;
   unsigned int numIterations_, maxPSMs_, nestedXvalBins_, numThreads_;
+  unsigned int maxSortMemory_; // in MB, 0 means no limit
   double selectedCpos_, selectedCneg_;
   bool reportEachIteration_, quickValidation_, trainBestPositive_,
-    skipNormalizeScores_;
+    skipNormalizeScores_, svmColdStart_;
   
   // reporting parameters
   std::string call_;
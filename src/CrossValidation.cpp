@@ -16,6 +16,7 @@
  *******************************************************************************/
 
 #include "CrossValidation.h"
+#include "Profiler.h"
 
 // number of folds for cross validation
 const unsigned int CrossValidation::numFolds_ = 3u;
@@ -35,6 +36,7 @@ CrossValidation::CrossValidation(bool quickValidation,
   unsigned int nestedXvalBins, bool trainBestPositive, unsigned int numThreads, bool skipNormalizeScores) :
     quickValidation_(quickValidation), usePi0_(usePi0),
     reportPerformanceEachIteration_(reportPerformanceEachIteration), 
+    svmColdStart_(false), hasTrainedWeights_(false),
     testFdr_(testFdr), selectionFdr_(selectionFdr), initialSelectionFdr_(initialSelectionFdr),
     selectedCpos_(selectedCpos), selectedCneg_(selectedCneg), niter_(niter),
     nestedXvalBins_(nestedXvalBins), trainBestPositive_(trainBestPositive),
@@ -75,6 +77,21 @@ int CrossValidation::preIterationSetup(Scores& fullset, SanityCheck* pCheck,
   
   fullset.createXvalSetsBySpectrum(trainScores_, testScores_, numFolds_, featurePool);
   
+  // the nested folds are fixed for all iterations; they are stored by scan
+  // number, since the training sets get reordered in every iteration
+  if (nestedXvalBins_ > 1) {
+    nestedFoldOfScan_.resize(numFolds_);
+    nestedFolds_.resize(numFolds_);
+    for (std::size_t set = 0; set < numFolds_; ++set) {
+      std::vector<unsigned int> folds;
+      trainScores_[set].assignXvalFoldsBySpectrum(nestedXvalBins_, folds);
+      std::vector<ScoreHolder>::const_iterator scoreIt = trainScores_[set].begin();
+      for (std::size_t ix = 0; scoreIt != trainScores_[set].end(); ++scoreIt, ++ix) {
+        nestedFoldOfScan_[set][scoreIt->pPSM->scan] = folds[ix];
+      }
+    }
+  }
+  
   if (selectionFdr_ <= 0.0) {
     selectionFdr_ = testFdr_;
   }
@@ -178,6 +195,7 @@ void CrossValidation::train(Normalizer* pNorm) {
   // iterate
   int foundPositivesOldOld = 0, foundPositivesOld = 0, foundPositives = 0; 
   for (unsigned int i = 0; i < niter_; i++) {
+    Profiler::Scope profile("cv-iteration");
     if (VERB > 1) {
       cerr << "Iteration " << i + 1 << ":\t";
     }
@@ -257,6 +275,12 @@ int CrossValidation::doStep(bool updateDOC, Normalizer* pNorm, double selectionF
   pOptions.mfnitermax = MFNITERMAX;
   int estTruePos = 0;
   
+#ifdef _OPENMP
+  svmWorkspaces_.resize(static_cast<std::size_t>(omp_get_max_threads()));
+#else
+  svmWorkspaces_.resize(1u);
+#endif
+  
   // for determining an appropriate positive training set, the decoys+1 in the 
   // FDR estimates is too restrictive for small datasets
   bool skipDecoysPlusOne = true; 
@@ -285,47 +309,168 @@ int CrossValidation::doStep(bool updateDOC, Normalizer* pNorm, double selectionF
   // ////
 
   // Create SVM input data for parallelization
-   std::vector<AlgIn*> svmInputsVec;
-   std::vector< std::vector< Scores > > nestedTestScoresVec;
-   for (std::size_t set = 0; set < numFolds_; ++set) {
-     std::vector<Scores> nestedTrainScores(nestedXvalBins_, usePi0_), nestedTestScores(nestedXvalBins_, usePi0_);
-     if (nestedXvalBins_ > 1) {
-       FeatureMemoryPool featurePool;
-       trainScores_[set].createXvalSetsBySpectrum(nestedTrainScores, nestedTestScores, nestedXvalBins_, featurePool);
-     } else {
-       // sub-optimal cross validation
-       nestedTrainScores[0] = trainScores_[set];
-       nestedTestScores[0] = trainScores_[set];
-     }
-     nestedTestScoresVec.push_back(nestedTestScores);
-     // Set SVM input data for L2-SVM-MFN
-     for (std::size_t nestedFold = 0; nestedFold < nestedXvalBins_; ++nestedFold)
-       {
-         AlgIn* svmInput = svmInputs_[set * nestedXvalBins_ + nestedFold];
-         if ((VERB > 2) && (nestedFold==0)){
-           cerr << "Split " << set + 1 << ": Training with " 
-                << svmInput->positives << " positives and "
-                << svmInput->negatives << " negatives" << std::endl;
-         }
-         nestedTrainScores[nestedFold].generateNegativeTrainingSet(*svmInput, 1.0);
-         nestedTrainScores[nestedFold].generatePositiveTrainingSet(*svmInput, selectionFdr, 1.0, trainBestPositive_);
-         svmInputsVec.push_back(svmInput);
-       }
-   }
-
-#pragma omp parallel for schedule(dynamic, 1) ordered 
-   for (int pairIdx = 0; pairIdx < classWeightsPerFold_.size(); pairIdx++){
-    candidateCposCfrac* cpCnFold = &classWeightsPerFold_[pairIdx];
-    AlgIn* svmInput = svmInputsVec[cpCnFold->set * nestedXvalBins_  + 
-    static_cast<unsigned int>(cpCnFold->nestedSet)];
-    trainCpCnPair(*cpCnFold, pOptions,svmInput);
-  }
-
-  estTruePos = mergeCpCnPairs(selectionFdr, pOptions, nestedTestScoresVec, candidatesCpos_, 
+  std::vector<AlgIn*> svmInputsVec;
+  for (std::size_t set = 0; set < numFolds_; ++set) {
+    if (nestedXvalBins_ > 1) {
+      updateNestedFolds(set);
+    }
+    for (std::size_t nestedFold = 0; nestedFold < nestedXvalBins_; ++nestedFold) {
+      svmInputsVec.push_back(svmInputs_[set * nestedXvalBins_ + nestedFold]);
+    }
+  }
+
+  trainAndValidateCpCnPairs(selectionFdr, pOptions, svmInputsVec);
+  hasTrainedWeights_ = true;
+
+  estTruePos = mergeCpCnPairs(selectionFdr, pOptions, candidatesCpos_, 
                               candidatesCfrac_);
   return estTruePos;
 }
 
+/**
+ * Looks up the nested fold of each PSM of a training set in its current order
+ */
+void CrossValidation::updateNestedFolds(std::size_t set) {
+  std::vector<unsigned int>& folds = nestedFolds_[set];
+  folds.clear();
+  std::vector<ScoreHolder>::const_iterator scoreIt = trainScores_[set].begin();
+  for ( ; scoreIt != trainScores_[set].end(); ++scoreIt) {
+    folds.push_back(nestedFoldOfScan_[set][scoreIt->pPSM->scan]);
+  }
+}
+
+/**
+ * Returns the nested training (isTest = false) or test set (isTest = true) 
+ * of a nested fold as a view on trainScores_[set]. Without nested bins, both 
+ * are the complete training set.
+ */
+ScoreSubset CrossValidation::getNestedSet(std::size_t set, 
+    std::size_t nestedFold, bool isTest) const {
+  if (nestedXvalBins_ <= 1) return ScoreSubset();
+  return ScoreSubset(nestedFolds_[set], static_cast<unsigned int>(nestedFold), 
+                     !isTest);
+}
+
+/**
+ * Generates the SVM training sets, then trains and validates all (cpos, cneg)
+ * pairs of all nested CV folds as OpenMP tasks, which idle threads pick up as
+ * soon as they are ready, rather than splitting the work per fold. A pair is 
+ * validated as soon as its weights are trained, and the scoring of large 
+ * validation sets is split further, see Scores::calcScoreBatch.
+ * @param svmInputsVec training data per nested CV fold
+ */
+void CrossValidation::trainAndValidateCpCnPairs(double selectionFdr,
+    options& pOptions, std::vector<AlgIn*>& svmInputsVec) {
+  bool byContinuation = !svmColdStart_ && !hasTrainedWeights_;
+  int numInputs = static_cast<int>(svmInputsVec.size());
+  int numPairs = static_cast<int>(classWeightsPerFold_.size());
+#pragma omp parallel
+#pragma omp single
+  {
+    for (int input = 0; input < numInputs; ++input) {
+#pragma omp task firstprivate(input)
+      {
+        // without nested bins, this is sub-optimal cross validation on the
+        // complete training set
+        std::size_t set = static_cast<std::size_t>(input) / nestedXvalBins_;
+        std::size_t nestedFold = static_cast<std::size_t>(input) % nestedXvalBins_;
+        ScoreSubset nestedTrainSet = getNestedSet(set, nestedFold, false);
+        AlgIn* svmInput = svmInputsVec[static_cast<std::size_t>(input)];
+        trainScores_[set].generateNegativeTrainingSet(*svmInput, 1.0, nestedTrainSet);
+        trainScores_[set].generatePositiveTrainingSet(*svmInput, selectionFdr, 
+            1.0, trainBestPositive_, nestedTrainSet);
+      }
+    }
+#pragma omp taskwait
+    if (VERB > 2) {
+      for (std::size_t set = 0; set < numFolds_; ++set) {
+        AlgIn* svmInput = svmInputsVec[set * nestedXvalBins_];
+        cerr << "Split " << set + 1 << ": Training with " 
+             << svmInput->positives << " positives and "
+             << svmInput->negatives << " negatives" << std::endl;
+      }
+    }
+    
+    if (byContinuation) {
+      for (int chain = 0; chain < numInputs; ++chain) {
+#pragma omp task firstprivate(chain)
+        trainCpCnPairsByContinuation(static_cast<std::size_t>(chain), 
+                                     pOptions, svmInputsVec);
+      }
+    } else {
+      for (int pairIdx = 0; pairIdx < numPairs; ++pairIdx) {
+#pragma omp task firstprivate(pairIdx)
+        {
+          candidateCposCfrac& cpCnFold = classWeightsPerFold_[static_cast<std::size_t>(pairIdx)];
+          AlgIn* svmInput = svmInputsVec[cpCnFold.set * nestedXvalBins_ + 
+              static_cast<unsigned int>(cpCnFold.nestedSet)];
+          trainCpCnPair(cpCnFold, pOptions, svmInput);
+          validateCpCnPair(cpCnFold);
+        }
+      }
+    }
+  } // all tasks are finished at the barrier that ends the parallel region
+}
+
+static bool isMoreRegularized(const candidateCposCfrac* a, 
+                              const candidateCposCfrac* b) {
+  return (a->cpos < b->cpos) || (a->cpos == b->cpos && a->cfrac < b->cfrac);
+}
+
+/**
+ * Trains the (cpos, cneg) pairs of one nested CV fold by continuation, i.e.
+ * in order of decreasing regularization (increasing cpos and cneg), each 
+ * starting from the weights of its predecessor. Used in the first iteration, 
+ * when there are no weights from an earlier iteration to start from yet. The
+ * validation of each trained pair is spawned as a separate task, such that 
+ * it runs concurrently with the training of the next pair.
+ * @param chain index of the nested CV fold over all CV folds
+ */
+void CrossValidation::trainCpCnPairsByContinuation(std::size_t chain,
+    options& pOptions, std::vector<AlgIn*>& svmInputsVec) {
+  std::size_t numPairsPerChain = classWeightsPerFold_.size() / 
+                                     svmInputsVec.size();
+  std::vector<candidateCposCfrac*> pairs;
+  for (std::size_t k = 0; k < numPairsPerChain; ++k) {
+    pairs.push_back(&classWeightsPerFold_[chain * numPairsPerChain + k]);
+  }
+  std::sort(pairs.begin(), pairs.end(), isMoreRegularized);
+  for (std::size_t k = 0; k < pairs.size(); ++k) {
+    if (k > 0) pairs[k]->ww = pairs[k - 1]->ww;
+    AlgIn* svmInput = svmInputsVec[pairs[k]->set * nestedXvalBins_ + 
+                                   static_cast<unsigned int>(pairs[k]->nestedSet)];
+    trainCpCnPair(*pairs[k], pOptions, svmInput);
+    candidateCposCfrac* pair = pairs[k];
+#pragma omp task firstprivate(pair)
+    validateCpCnPair(*pair);
+  }
+}
+
+/**
+ * Counts the PSMs of the nested test set below testFdr_ with the weights 
+ * learned for a (cpos, cneg) pair; without nested bins, the nested test set
+ * is the complete training set.
+ */
+void CrossValidation::validateCpCnPair(candidateCposCfrac& cpCnFold) {
+  // for determining the number of positives, the decoys+1 in the FDR estimates 
+  // is too restrictive for small datasets
+  bool skipDecoysPlusOne = true;
+  cpCnFold.tp = trainScores_[cpCnFold.set].calcNumPositives(cpCnFold.ww, 
+      testFdr_, skipDecoysPlusOne, getNestedSet(cpCnFold.set, 
+      static_cast<std::size_t>(cpCnFold.nestedSet), true));
+}
+
+/**
+ * Returns the CGLS buffers of the calling thread
+ */
+SvmWorkspace& CrossValidation::getSvmWorkspace() {
+#ifdef _OPENMP
+  return svmWorkspaces_[static_cast<std::size_t>(omp_get_thread_num())];
+#else
+  return svmWorkspaces_[0];
+#endif
+}
+
 /** 
  * Train SVM over a single (cpos, cneg) pair
  * @param cpCnFold contains cpos, cneg pair and SVM learned weights
@@ -350,15 +495,25 @@ void CrossValidation::trainCpCnPair(candidateCposCfrac& cpCnFold,
 
   if (VERB > 3) cerr << "- cross-validation with Cpos=" << cpos
                      << ", Cneg=" << cfrac * cpos << endl;
-  for (int ix = 0; ix < pWeights.d; ix++) {
-    pWeights.vec[ix] = 0;
-  }
-  for (int ix = 0; ix < Outputs.d; ix++) {
-    Outputs.vec[ix] = 0;
+  if (svmColdStart_) {
+    for (int ix = 0; ix < pWeights.d; ix++) {
+      pWeights.vec[ix] = 0;
+    }
+    for (int ix = 0; ix < Outputs.d; ix++) {
+      Outputs.vec[ix] = 0;
+    }
+  } else {
+    // warm start from the weights of this pair in the previous iteration, or
+    // from its neighbour in the grid, see trainCpCnPairsByContinuation
+    for (int ix = 0; ix < pWeights.d; ix++) {
+      pWeights.vec[ix] = cpCnFold.ww[static_cast<std::size_t>(ix)];
+    }
+    setOutputs(*svmInput, pWeights, Outputs);
   }
         
   // Call SVM algorithm (see ssl.cpp)
-  L2_SVM_MFN(*svmInput, pOptions, pWeights, Outputs, cpos, cfrac * cpos);
+  L2_SVM_MFN(*svmInput, pOptions, pWeights, Outputs, cpos, cfrac * cpos,
+             getSvmWorkspace());
         
   for (std::size_t i = FeatureNames::getNumFeatures() + 1; i--;) {
     cpCnFold.ww[i] = pWeights.vec[i];
@@ -366,28 +521,20 @@ void CrossValidation::trainCpCnPair(candidateCposCfrac& cpCnFold,
 }
 
 /** 
- * Validate and merge weights learned per cpos,cneg pairs per nested CV fold per CV fold
+ * Select and merge weights learned per cpos,cneg pairs per nested CV fold per CV fold
  * @param pWeights results vector from the SVM algorithm
  * @param pOptions options for the SVM algorithm
- * @param nestedTestScoresVec 2D vector, test sets per nested CV fold per CV fold
 */
-int CrossValidation::mergeCpCnPairs(double selectionFdr,
-                                    options& pOptions, vector< vector<Scores> >& nestedTestScoresVec,
+int CrossValidation::mergeCpCnPairs(double selectionFdr, options& pOptions,
                                     const vector<double>& cposCandidates, const vector<double>& cfracCandidates) {
-  // for determining the number of positives, the decoys+1 in the FDR estimates 
-  // is too restrictive for small datasets
-  bool skipDecoysPlusOne = true;
-  
   vector<int> bestTruePoses(numFolds_, 0);
   vector<double> bestCposes(numFolds_, 1);
   vector<double> bestCfracs(numFolds_, 1);
   
   int set = 0;
-  // Validate learned parameters per (cpos,cneg) pair per nested CV fold
-  // Note: this cannot be done in trainCpCnPair without setting a critical pragma, due to the 
-  //       scoring calculation in calcScores.
+  // Select the best (cpos,cneg) pair per CV fold, from the number of positives 
+  // that trainAndValidateCpCnPairs found for each pair per nested CV fold
   unsigned int numCpCnPairsPerSet = static_cast<unsigned int>(classWeightsPerFold_.size() / numFolds_);
-#pragma omp parallel for schedule(dynamic, 1) ordered
   for (set = 0; set < numFolds_; ++set) {
     unsigned int a = set * numCpCnPairsPerSet;
     unsigned int b = (set+1) * numCpCnPairsPerSet;
@@ -395,9 +542,8 @@ int CrossValidation::mergeCpCnPairs(double selectionFdr,
     std::vector<candidateCposCfrac>::iterator itCpCnPair;
     std::map<std::pair<double, double>, int> intermediateResults;
     for (itCpCnPair = classWeightsPerFold_.begin() + a; itCpCnPair < classWeightsPerFold_.begin() + b; itCpCnPair++) {
-      tp = nestedTestScoresVec[set][static_cast<std::size_t>(itCpCnPair->nestedSet)].calcScores(itCpCnPair->ww, testFdr_, skipDecoysPlusOne);
+      tp = itCpCnPair->tp;
       intermediateResults[std::make_pair(itCpCnPair->cpos, itCpCnPair->cfrac)] += tp;
-      itCpCnPair->tp = tp;
       if (nestedXvalBins_ <= 1) {
         if(tp >= bestTruePoses[set]){
           bestTruePoses[set] = tp;
@@ -443,14 +589,23 @@ int CrossValidation::mergeCpCnPairs(double selectionFdr,
       Outputs.vec = new double[numInputs];
       Outputs.d = static_cast<int>(numInputs);
     
-      for (int ix = 0; ix < pWeights.d; ix++) {
-        pWeights.vec[ix] = 0;
-      }
-      for (int ix = 0; ix < Outputs.d; ix++) {
-        Outputs.vec[ix] = 0;
+      if (svmColdStart_) {
+        for (int ix = 0; ix < pWeights.d; ix++) {
+          pWeights.vec[ix] = 0;
+        }
+        for (int ix = 0; ix < Outputs.d; ix++) {
+          Outputs.vec[ix] = 0;
+        }
+      } else {
+        // warm start from the weights of this fold in the previous iteration
+        for (int ix = 0; ix < pWeights.d; ix++) {
+          pWeights.vec[ix] = w_[set][static_cast<std::size_t>(ix)];
+        }
+        setOutputs(*svmInput, pWeights, Outputs);
       }
       // Call SVM algorithm (see ssl.cpp)
-      L2_SVM_MFN(*svmInput, pOptions, pWeights, Outputs, bestCposes[set], bestCposes[set] * bestCfracs[set]);
+      L2_SVM_MFN(*svmInput, pOptions, pWeights, Outputs, bestCposes[set], 
+                 bestCposes[set] * bestCfracs[set], getSvmWorkspace());
     
       for (std::size_t i = FeatureNames::getNumFeatures() + 1; i--;) {
         w_[set][i] = pWeights.vec[i];
@@ -74,6 +74,7 @@ class CrossValidation {
   void inline setNiter(unsigned int n) { niter_ = n; }
   unsigned int inline getNiter() { return niter_; }
   void inline setQuickValidation(bool on) { quickValidation_ = on; }
+  void inline setSvmColdStart(bool on) { svmColdStart_ = on; }
   void inline setReportPerformanceEachIteration(bool on) { 
     reportPerformanceEachIteration_ = on;
   }
@@ -86,6 +87,8 @@ class CrossValidation {
   bool quickValidation_;
   bool usePi0_;
   bool reportPerformanceEachIteration_;
+  bool svmColdStart_; // train every SVM from zero weights
+  bool hasTrainedWeights_; // weights from an earlier iteration are available
 
   unsigned int numThreads_;
   
@@ -107,12 +110,26 @@ class CrossValidation {
   const static unsigned int numAlgInObjects_;
   std::vector<Scores> trainScores_, testScores_;
   std::vector<double> candidatesCpos_, candidatesCfrac_;
+  std::vector<SvmWorkspace> svmWorkspaces_; // one per thread
+  // nested fold of each scan, and of each PSM in the current order, per fold
+  std::vector< boost::unordered_map<unsigned int, unsigned int> > nestedFoldOfScan_;
+  std::vector< std::vector<unsigned int> > nestedFolds_;
+  
+  void updateNestedFolds(std::size_t set);
+  ScoreSubset getNestedSet(std::size_t set, std::size_t nestedFold, 
+                           bool isTest) const;
+  
+  SvmWorkspace& getSvmWorkspace();
 
   void trainCpCnPair(candidateCposCfrac& cpCnFold,
                      options& pOptions, AlgIn* svmInput);
+  void trainCpCnPairsByContinuation(std::size_t chain, options& pOptions, 
+                                    std::vector<AlgIn*>& svmInputsVec);
+  void validateCpCnPair(candidateCposCfrac& cpCnFold);
+  void trainAndValidateCpCnPairs(double selectionFdr, options& pOptions,
+                                 std::vector<AlgIn*>& svmInputsVec);
 
-  int mergeCpCnPairs(double selectionFdr,
-                     options& pOptions, std::vector< std::vector<Scores> >& nestedTestScoresVec,
+  int mergeCpCnPairs(double selectionFdr, options& pOptions,
                      const vector<double>& cpos_vec, 
                      const vector<double>& cfrac_vec);
   int doStep(bool updateDOC, Normalizer* pNorm, double selectionFdr);
@@ -137,14 +137,31 @@ int DataSet::readPsm(const std::string& line, const unsigned int lineNr,
     const std::vector<OptionalField>& optionalFields, bool readProteins,
     PSMDescription*& myPsm, FeatureMemoryPool& featurePool) {
   TabReader reader(line);
-  std::string tmp;
+  int label = readPsm(reader, lineNr, optionalFields, myPsm, 
+                      featurePool.allocate());
+  if (readProteins) DataSet::readProteins(reader, myPsm);
+  return label;
+}
+
+/**
+ * Parses a single psm line up to and including the peptide, leaving the 
+ * reader at the first protein column. Does not touch any shared state and 
+ * can therefore be called concurrently for different lines.
+ * @param featureRow row of a FeatureMemoryPool reserved for this psm
+ */
+int DataSet::readPsm(TabReader& reader, const unsigned int lineNr,
+    const std::vector<OptionalField>& optionalFields,
+    PSMDescription*& myPsm, double* featureRow) {
+  const char* field;
+  size_t fieldLength;
   
   if (calcDOC_) {
     myPsm = new PSMDescriptionDOC();
   } else {
     myPsm = new PSMDescription();
   }
-  myPsm->setId(reader.readString());
+  reader.readField(field, fieldLength);
+  myPsm->id_.assign(field, fieldLength);
   int label = reader.readInt();
   
   bool hasScannr = false;
@@ -188,7 +205,6 @@ int DataSet::readPsm(const std::string& line, const unsigned int lineNr,
   if (calcDOC_) {
     numFeatures -= static_cast<unsigned int>(DescriptionOfCorrect::numDOCFeatures());
   }
-  double* featureRow = featurePool.allocate();
   myPsm->features = featureRow;
   for (register unsigned int j = 0; j < numFeatures; j++) {
     featureRow[j] = reader.readDouble();
@@ -213,8 +229,9 @@ int DataSet::readPsm(const std::string& line, const unsigned int lineNr,
     throw MyException(temp.str());
   }
   
-  std::string peptide_seq = reader.readString();
-  myPsm->peptide = peptide_seq;
+  reader.readField(field, fieldLength);
+  myPsm->peptide.assign(field, fieldLength);
+  const std::string& peptide_seq = myPsm->peptide;
   if (reader.error()) {
     ostringstream temp;
     temp << "ERROR: Reading tab file, error reading PSM " << myPsm->getId() 
@@ -237,16 +254,25 @@ int DataSet::readPsm(const std::string& line, const unsigned int lineNr,
     }
   }
   
-  if (readProteins) {
-    std::vector<std::string> proteins;
-    while (!reader.error()) {
-      std::string tmp = reader.readString();
-      if (tmp.size() > 0) proteins.push_back(tmp);
+  return label;
+}
+
+/**
+ * Reads the remaining columns of a psm line as protein accessions and stores
+ * them as ids of the global protein symbol table. Interning is not thread 
+ * safe, this should be called for one psm at a time, in line order.
+ */
+void DataSet::readProteins(TabReader& reader, PSMDescription* myPsm) {
+  std::vector<unsigned int> proteins;
+  const char* field;
+  size_t fieldLength;
+  while (!reader.error()) {
+    reader.readField(field, fieldLength);
+    if (fieldLength > 0) {
+      proteins.push_back(PSMDescription::internProteinName(field, fieldLength));
     }
-    proteins.swap(myPsm->proteinIds); // shrink to fit
   }
-  
-  return label;
+  proteins.swap(myPsm->proteinIds); // shrink to fit
 }
 
 void DataSet::registerPsm(PSMDescription* myPsm) {
@@ -28,6 +28,8 @@
 #include <vector>
 #include <map>
 #include <cerrno>
+#include <cstring>
+#include <climits>
 
 #include "Scores.h"
 #include "ResultHolder.h"
@@ -39,23 +41,34 @@
 #include "FeatureMemoryPool.h"
 #include "ProteinProbEstimator.h"
 
-// using char pointers is much faster than istringstream
+// using char pointers is much faster than istringstream. A line is parsed in
+// place as the range [line, lineEnd), which allows reading lines directly from
+// a shared buffer or memory mapped file without copying them. The character
+// at lineEnd has to be readable and either a whitespace or a null character.
 class TabReader {
  public:
-  TabReader(const std::string& line) : f_(line.c_str()), err(0) {
+  TabReader(const std::string& line) : 
+      f_(line.c_str()), end_(line.c_str() + line.size()), err(0) {
+    errno = 0;
+  }
+  TabReader(const char* line) : f_(line), end_(line + strlen(line)), err(0) {
+    errno = 0;
+  }
+  TabReader(const char* line, const char* lineEnd) : 
+      f_(line), end_(lineEnd), err(0) {
     errno = 0;
   }
   
   void advance(const char* next) {
-    if (*next != '\0') {
+    if (next < end_) {
       f_ = next + 1; // eats up the tab
     } else {
-      f_ = next; // prevents pointing over the null byte
+      f_ = end_; // prevents pointing over the end of the line
     }
   }
   
   void skip() {
-    const char* pch = strchr(f_, '\t');
+    const char* pch = findTab();
     if (pch == NULL) {
       err = 1;
     } else {
@@ -68,10 +81,14 @@ class TabReader {
   }
   
   double readDouble() {
+    if (f_ >= end_) {
+      err = 1;
+      return 0.0;
+    }
     char* next = NULL;
     errno = 0;
     double d = strtod(f_, &next);
-    if (next == f_ || (*next != '\0' && !isspace(*next))
+    if (next == f_ || next > end_ || (*next != '\0' && !isspace(*next))
                    || ((d == HUGE_VAL || d == -HUGE_VAL) && errno == ERANGE)) {
       err = errno ? errno : 1;
     }
@@ -80,10 +97,14 @@ class TabReader {
   }
   
   int readInt() {
+    if (f_ >= end_) {
+      err = 1;
+      return 0;
+    }
     char* next = NULL;
     errno=0;
     long val = strtol(f_, &next, 10);
-    if (next == f_ || (*next != '\0' && !isspace(*next))
+    if (next == f_ || next > end_ || (*next != '\0' && !isspace(*next))
                    || val < INT_MIN || val > INT_MAX) {
       err = errno ? errno : 1;
     }
@@ -92,21 +113,34 @@ class TabReader {
   }
   
   std::string readString() {
-    const char* pch = strchr(f_, '\t');
+    const char* field;
+    size_t length;
+    readField(field, length);
+    return std::string(field, length);
+  }
+  
+  // points field to the next field without copying it
+  void readField(const char*& field, size_t& length) {
+    const char* pch = findTab();
+    field = f_;
     if (pch == NULL) {
       err = 1;
-      return std::string(f_);
+      length = static_cast<size_t>(end_ - f_);
     } else {
-      std::string s(f_, static_cast<std::basic_string<char>::size_type>(pch - f_));
+      length = static_cast<size_t>(pch - f_);
       advance(pch);
-      return s;
     }
   }
   
   bool error() { return err != 0; }
  private:
   const char* f_;
+  const char* end_;
   int err;
+  
+  const char* findTab() const {
+    return static_cast<const char*>(memchr(f_, '\t', static_cast<size_t>(end_ - f_)));
+  }
 };
 
 
@@ -126,6 +160,7 @@ class DataSet {
   int inline getLabel() const { return label_; }
   
   unsigned int inline getSize() const { return static_cast<unsigned int>(psms_.size()); }
+  const std::vector<PSMDescription*>& getPsms() const { return psms_; }
   
   static inline void setCalcDoc(bool on) { calcDOC_ = on; }
   static inline bool getCalcDoc() { return calcDOC_; }
@@ -153,6 +188,10 @@ class DataSet {
   static int readPsm(const std::string& line, const unsigned int lineNr,
     const std::vector<OptionalField>& optionalFields, bool readProteins,
     PSMDescription*& myPsm, FeatureMemoryPool& featurePool);
+  static int readPsm(TabReader& reader, const unsigned int lineNr,
+    const std::vector<OptionalField>& optionalFields,
+    PSMDescription*& myPsm, double* featureRow);
+  static void readProteins(TabReader& reader, PSMDescription* myPsm);
   
   void registerPsm(PSMDescription* myPsm);
   
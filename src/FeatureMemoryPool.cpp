@@ -17,6 +17,10 @@
 
 #include "FeatureMemoryPool.h"
 
+#include <algorithm>
+#include <cstring>
+#include <functional>
+
 void FeatureMemoryPool::createPool(size_t numFeatures) {
   numFeatures_ = static_cast<unsigned int>(numFeatures);
   numRowsPerBlock_ = kBlockSize / numFeatures_;
@@ -42,6 +46,37 @@ double* FeatureMemoryPool::addressFromIdx(unsigned int i) const {
   return memStarts_.at(i / numRowsPerBlock_) + (i % numRowsPerBlock_) * numFeatures_;
 }
 
+namespace {
+struct BlockStartOrder {
+  bool operator()(const std::pair<const double*, unsigned int>& a,
+                  const std::pair<const double*, unsigned int>& b) const {
+    return std::less<const double*>()(a.first, b.first);
+  }
+};
+}
+
+/**
+ * Inverse of addressFromIdx for a batch of rows of this pool, looking up the
+ * block of each row in the block starts sorted by address
+ */
+void FeatureMemoryPool::getRowIndices(const std::vector<const double*>& rows,
+    std::vector<unsigned int>& rowIndices) const {
+  std::vector<std::pair<const double*, unsigned int> > blockStarts;
+  for (size_t i = 0; i < memStarts_.size(); ++i) {
+    blockStarts.push_back(std::make_pair(memStarts_[i], static_cast<unsigned int>(i)));
+  }
+  std::sort(blockStarts.begin(), blockStarts.end(), BlockStartOrder());
+  rowIndices.resize(rows.size());
+  for (size_t j = 0; j < rows.size(); ++j) {
+    std::vector<std::pair<const double*, unsigned int> >::const_iterator it =
+        std::upper_bound(blockStarts.begin(), blockStarts.end(),
+                         std::make_pair(rows[j], 0u), BlockStartOrder());
+    --it;
+    rowIndices[j] = it->second * numRowsPerBlock_ + 
+        static_cast<unsigned int>((rows[j] - it->first) / numFeatures_);
+  }
+}
+
 double* FeatureMemoryPool::allocate() {
   if (freeRows_.size() == 0) {
     if (initializedRows_ >= numRowsPerBlock_ * memStarts_.size()) {
@@ -58,3 +93,25 @@ double* FeatureMemoryPool::allocate() {
 void FeatureMemoryPool::deallocate(double* p) {
   freeRows_.push_back(p);
 }
+
+/**
+ * Copies numRows consecutive rows of numFeatures_ doubles into fresh rows of 
+ * the pool, one block at a time, and returns the index of the first row. The 
+ * rows get consecutive indices, regardless of rows that were deallocated.
+ */
+unsigned int FeatureMemoryPool::appendRows(const double* rows, size_t numRows) {
+  unsigned int firstIdx = initializedRows_;
+  while (numRows > 0u) {
+    if (initializedRows_ >= numRowsPerBlock_ * memStarts_.size()) {
+      createNewBlock();
+    }
+    size_t numFree = numRowsPerBlock_ * memStarts_.size() - initializedRows_;
+    size_t numCopied = std::min(numRows, numFree);
+    memcpy(addressFromIdx(initializedRows_), rows, 
+           numCopied * numFeatures_ * sizeof(double));
+    rows += numCopied * numFeatures_;
+    numRows -= numCopied;
+    initializedRows_ += static_cast<unsigned int>(numCopied);
+  }
+  return firstIdx;
+}
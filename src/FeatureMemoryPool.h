@@ -40,10 +40,14 @@ class FeatureMemoryPool {
   void destroyPool();
   
   inline bool isInitialized() const { return isInitialized_; }
+  inline unsigned int getNumFeatures() const { return numFeatures_; }
 
   double* addressFromIdx(unsigned int i) const;
+  void getRowIndices(const std::vector<const double*>& rows, 
+                     std::vector<unsigned int>& rowIndices) const;
 
   double* allocate();
+  unsigned int appendRows(const double* rows, size_t numRows);
   void deallocate(double* p);
 };
 
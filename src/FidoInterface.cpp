@@ -15,6 +15,12 @@
 
  *******************************************************************************/
 
+#include <set>
+#include <algorithm>
+#ifdef _OPENMP
+  #include <omp.h>
+#endif
+
 #include "FidoInterface.h"
 
 const double FidoInterface::kPsmThreshold = 0.0;
@@ -87,7 +93,7 @@ FidoInterface::FidoInterface(double alpha, double beta, double gamma,
   noPruning_(noPruning), proteinThreshold_(proteinThreshold), 
   gridSearchDepth_(gridSearchDepth), 
   gridSearchThreshold_(gridSearchThreshold), mseThreshold_(mseThreshold),
-  doGridSearch_(false), rocN_(kDefaultRocN) {}
+  doGridSearch_(false), gridSearchRefine_(false), rocN_(kDefaultRocN) {}
       
 FidoInterface::~FidoInterface() {  
   if (proteinGraph_) {
@@ -138,7 +144,7 @@ double FidoInterface::estimatePriors(Scores& peptideScores) {
       double prior = prior_protein * size;
       double tmp_prior = prior;
       // for each protein
-      for(std::vector<std::string>::iterator protIt = psm->pPSM->proteinIds.begin(); 
+      for(std::vector<unsigned int>::iterator protIt = psm->pPSM->proteinIds.begin(); 
 	          protIt != psm->pPSM->proteinIds.end(); protIt++) {
 	      unsigned index = static_cast<unsigned>(std::distance(psm->pPSM->proteinIds.begin(), protIt));
 	      tmp_prior = (tmp_prior * prior_protein * (size - index)) / (index + 1);
@@ -167,7 +173,7 @@ double FidoInterface::estimatePriors(Scores& peptideScores) {
 }
 
 void FidoInterface::run() {  
-  proteinGraph_ = new GroupPowerBigraph(alpha_, beta_, gamma_, noClustering_, noPartitioning_, noPruning_, trivialGrouping_);
+  proteinGraph_ = new GroupPowerBigraph(noClustering_, noPartitioning_, noPruning_, trivialGrouping_);
   proteinGraph_->setMaxAllowedConfigurations(LOG_MAX_ALLOWED_CONFIGURATIONS);
   proteinGraph_->setPeptidePrior(localPeptidePrior_);
   
@@ -242,6 +248,8 @@ void FidoInterface::computeProbabilities(const std::string& fname) {
     
     if (kOptimizeParams)
       gridSearchOptimize(); 
+    else if (gridSearchRefine_)
+      gridSearchRefine();
     else
       gridSearch();
     
@@ -266,7 +274,8 @@ void FidoInterface::computeProbabilities(const std::string& fname) {
 
 
   if (gridSearchThreshold_ > 0.0 && doGridSearch_) {
-    //NOTE reset the tree after grid searching
+    //NOTE reset the tree after grid searching, the graph that was read is 
+    //     pruned and partitioned again with the final thresholds
     proteinGraph_->setProteinThreshold(proteinThreshold_);
     proteinGraph_->setPsmThreshold(kPsmThreshold);
     proteinGraph_->setPeptideThreshold(kPeptideThreshold);
@@ -276,16 +285,11 @@ void FidoInterface::computeProbabilities(const std::string& fname) {
     proteinGraph_->setTrivialGrouping(trivialGrouping_);
     proteinGraph_->setMultipleLabeledPeptides(kAddPeptideDecoyLabel);
     
-    if (fname.size() > 0) {
-      proteinGraph_->read(fin);
-    } else {
-      proteinGraph_->read(peptideScorePtr_);
-    }
+    proteinGraph_->repartition();
     if (trivialGrouping_) updateTargetDecoySizes();
   }
   
-  proteinGraph_->setAlphaBetaGamma(alpha_, beta_, gamma_);
-  proteinGraph_->getProteinProbs();
+  proteinGraph_->getProteinProbs(Model(alpha_, beta_, gamma_));
   proteinGraph_->getProteinProbsPercolator(proteins_, proteinToIdxMap_);
 }
 
@@ -410,44 +414,153 @@ void FidoInterface::gridSearchOptimize() {
   gridSearch(alpha_search, beta_search, gamma_search);
 }
 
+/**
+ * Coarse-to-fine alternative to the exhaustive grids of gridSearch(): starts 
+ * from a coarse grid over the range of the depth 4 grid, with alpha and beta 
+ * on a log scale, and then repeatedly evaluates the neighbours of the best 
+ * point at half the step size. Parameters set by the user are kept fixed.
+ */
+void FidoInterface::gridSearchRefine() {
+  // dimensions in the order of the loops of gridSearch: gamma, alpha, beta
+  double lower[3] = { 0.1, log10(0.001), log10(0.00001) };
+  double upper[3] = { 0.9, log10(0.76), log10(0.8) };
+  bool logScale[3] = { false, true, true };
+  double userValues[3] = { gamma_, alpha_, beta_ };
+  double step[3];
+  for (unsigned int d = 0; d < 3u; ++d) {
+    if (userValues[d] != -1) {
+      lower[d] = upper[d] = userValues[d];
+      logScale[d] = false;
+    }
+    step[d] = (upper[d] - lower[d]) / (kRefineCoarsePoints - 1u);
+  }
+  
+  std::set<std::vector<double> > evaluated;
+  std::vector<double> best(lower, lower + 3);
+  double bestObjective = -100000000;
+  for (unsigned int level = 0; level <= kRefineSteps; ++level) {
+    std::vector<std::vector<double> > candidates(1u);
+    for (unsigned int d = 0; d < 3u; ++d) {
+      std::vector<double> values;
+      if (level == 0u) {
+        for (unsigned int i = 0; i < kRefineCoarsePoints; ++i) {
+          values.push_back(lower[d] + step[d] * i);
+        }
+      } else {
+        for (int i = -1; i <= 1; ++i) {
+          values.push_back(std::max(lower[d], 
+                               std::min(upper[d], best[d] + step[d] * i)));
+        }
+      }
+      std::vector<std::vector<double> > extended;
+      for (size_t c = 0; c < candidates.size(); ++c) {
+        for (size_t v = 0; v < values.size(); ++v) {
+          extended.push_back(candidates[c]);
+          extended.back().push_back(values[v]);
+        }
+      }
+      candidates.swap(extended);
+    }
+    
+    std::vector<std::vector<double> > coordinates;
+    std::vector<Model> points;
+    for (size_t c = 0; c < candidates.size(); ++c) {
+      if (!evaluated.insert(candidates[c]).second) continue;
+      double values[3];
+      for (unsigned int d = 0; d < 3u; ++d) {
+        values[d] = logScale[d] ? pow(10, candidates[c][d]) : candidates[c][d];
+      }
+      coordinates.push_back(candidates[c]);
+      points.push_back(Model(values[1], values[2], values[0]));
+    }
+    
+    std::vector<double> objectives;
+    evaluateGridPoints(points, objectives);
+    for (size_t i = 0; i < points.size(); ++i) {
+      if (objectives[i] > bestObjective) {
+        bestObjective = objectives[i];
+        best = coordinates[i];
+        alpha_ = points[i].alpha;
+        beta_ = points[i].beta;
+        gamma_ = points[i].gamma;
+      }
+    }
+    if (VERB > 1) {
+      std::cerr << "Evaluated " << points.size() << " parameter sets at "
+                << "refinement level " << level << ", best so far: alpha = " 
+                << alpha_ << ", beta = " << beta_ << ", gamma = " << gamma_ 
+                << std::endl;
+    }
+    for (unsigned int d = 0; d < 3u; ++d) step[d] /= 2.0;
+  }
+}
+
 void FidoInterface::gridSearch(std::vector<double>& alpha_search, 
     std::vector<double>& beta_search, 
     std::vector<double>& gamma_search) {
-  double gamma_best = -1.0, alpha_best = -1.0, beta_best = -1.0;
-  double best_objective = -100000000;
-  double current_objective;
-  
+  std::vector<Model> points;
   for (unsigned int i = 0; i < gamma_search.size(); i++) {
-    double gamma_local = gamma_search[i];
     for (unsigned int j = 0; j < alpha_search.size(); j++) {
-      double alpha_local = alpha_search[j];
       for (unsigned int k = 0; k < beta_search.size(); k++) {
-        double beta_local = beta_search[k];
-        
-        current_objective = calcObjective(alpha_local, beta_local, gamma_local);
-        if (current_objective > best_objective) {
-          best_objective = current_objective;
-          gamma_best = gamma_local;
-          alpha_best = alpha_local;
-          beta_best = beta_local;
-        }
+        points.push_back(Model(alpha_search[j], beta_search[k], gamma_search[i]));
       }
     }
   }
+  
+  std::vector<double> objectives;
+  evaluateGridPoints(points, objectives);
+  
+  double gamma_best = -1.0, alpha_best = -1.0, beta_best = -1.0;
+  double best_objective = -100000000;
+  for (size_t i = 0; i < points.size(); ++i) {
+    if (objectives[i] > best_objective) {
+      best_objective = objectives[i];
+      gamma_best = points[i].gamma;
+      alpha_best = points[i].alpha;
+      beta_best = points[i].beta;
+    }
+  }
   alpha_ = alpha_best;
   beta_ = beta_best;
   gamma_ = gamma_best;
 }
 
-double FidoInterface::calcObjective(double alpha, double beta, double gamma) {
-  std::vector<std::vector<std::string> > names;
-  std::vector<double> probs, empq, estq; 
+/**
+ * Calculates the objective function for each of the points. The protein 
+ * probabilities, which dominate the run time, are calculated concurrently 
+ * for a batch of points at a time. The objectives are then calculated in the 
+ * order of the points, as rocN_ and pi0_ depend on the preceding points.
+ */
+void FidoInterface::evaluateGridPoints(const std::vector<Model>& points,
+                                       std::vector<double>& objectives) {
+  objectives.resize(points.size());
+  int numThreads = 1;
+#ifdef _OPENMP
+  numThreads = omp_get_max_threads();
+#endif
+  const size_t batchSize = 4u * static_cast<size_t>(numThreads);
+  std::vector<std::vector<std::vector<std::string> > > names(batchSize);
+  std::vector<std::vector<double> > probs(batchSize);
+  for (size_t start = 0; start < points.size(); start += batchSize) {
+    int batchEnd = static_cast<int>(std::min(points.size(), start + batchSize));
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (int i = static_cast<int>(start); i < batchEnd; ++i) {
+      Array<double> groupProbs = proteinGraph_->proteinProbs(points[i]);
+      proteinGraph_->getProteinProbsAndNames(groupProbs, names[i - start], 
+                                             probs[i - start]);
+    }
+    for (int i = static_cast<int>(start); i < batchEnd; ++i) {
+      objectives[i] = calcObjective(points[i], names[i - start], probs[i - start]);
+    }
+  }
+}
+
+double FidoInterface::calcObjective(const Model& model,
+    const std::vector<std::vector<string> >& names,
+    const std::vector<double>& probs) {
+  std::vector<double> empq, estq; 
   double roc ,mse, objective;
   
-  proteinGraph_->setAlphaBetaGamma(alpha, beta, gamma);
-  proteinGraph_->getProteinProbs();
-  proteinGraph_->getProteinProbsAndNames(names, probs);
-  
   getEstimated_and_Empirical_FDR(names, probs, empq, estq);
   getFDR_MSE(estq, empq, mse);
   getROC_AUC(names, probs, roc);
@@ -457,9 +570,9 @@ double FidoInterface::calcObjective(double alpha, double beta, double gamma) {
   
   if (VERB > 2) {
     std::cerr.precision(10);
-    std::cerr << "Grid searching Alpha= "  << alpha << 
-                 " Beta= " << beta << 
-                 " Gamma= "  << gamma << std::endl;
+    std::cerr << "Grid searching Alpha= "  << model.alpha << 
+                 " Beta= " << model.beta << 
+                 " Gamma= "  << model.gamma << std::endl;
     std::cerr.unsetf(std::ios::floatfield);
     std::cerr << "The ROC AUC estimated values is : " << roc << std::endl;
     std::cerr << "The MSE FDR estimated values is : " << mse << std::endl;
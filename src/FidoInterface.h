@@ -62,6 +62,10 @@ class FidoInterface : public ProteinProbEstimator {
   const static bool kUpdateRocN = true;
   /** activate the optimization of the parameters to see the best boundaries**/
   const static bool kOptimizeParams = false;
+  /** number of points per parameter of the coarse grid and number of times 
+      the step size is halved around the best point in gridSearchRefine() **/
+  const static unsigned kRefineCoarsePoints = 4u;
+  const static unsigned kRefineSteps = 4u;
 
  public:
   FidoInterface(double alpha = -1, double beta = -1, double gamma = -1, 
@@ -76,6 +80,7 @@ class FidoInterface : public ProteinProbEstimator {
   
   bool initialize(Scores& peptideScores, const Enzyme* enzyme);
   void run();
+  void setGridSearchRefine(bool refine) { gridSearchRefine_ = refine; }
   void computeProbabilities(const std::string& fname = "");
   
   std::ostream& printParametersXML(std::ostream &os);
@@ -104,6 +109,8 @@ class FidoInterface : public ProteinProbEstimator {
   unsigned int gridSearchDepth_;
   /* determines if grid search is activated by the user */
   bool doGridSearch_;
+  /* replaces the exhaustive grid by a coarse-to-fine search */
+  bool gridSearchRefine_;
   /* uses strict thresholds to create a sparse graph for the grid search */ 
   double gridSearchThreshold_;
   /* threshold in MSE estimation */
@@ -129,10 +136,15 @@ class FidoInterface : public ProteinProbEstimator {
   
   void gridSearch();
   void gridSearchOptimize();
+  void gridSearchRefine();
   void gridSearch(std::vector<double>& alpha_search, 
                   std::vector<double>& beta_search, 
                   std::vector<double>& gamma_search);
-  double calcObjective(double alpha, double beta, double gamma);  
+  void evaluateGridPoints(const std::vector<Model>& points, 
+                          std::vector<double>& objectives);
+  double calcObjective(const Model& model,
+                       const std::vector<std::vector<string> >& names,
+                       const std::vector<double>& probs);
   
 };
 
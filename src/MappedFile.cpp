@@ -0,0 +1,75 @@
+/*******************************************************************************
+ Copyright 2006-2012 Lukas Käll <lukas.kall@scilifelab.se>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+
+ *******************************************************************************/
+
+#include "MappedFile.h"
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+bool MappedFile::open(const std::string& fileName) {
+  close();
+#ifdef _WIN32
+  return false;
+#else
+  int fd = ::open(fileName.c_str(), O_RDONLY);
+  if (fd < 0) return false;
+
+  struct stat fileStat;
+  if (fstat(fd, &fileStat) != 0 || !S_ISREG(fileStat.st_mode) ||
+      fileStat.st_size <= 0) {
+    ::close(fd);
+    return false;
+  }
+  size_t fileSize = static_cast<size_t>(fileStat.st_size);
+  void* addr = mmap(NULL, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd); // the mapping stays valid after closing the descriptor
+  if (addr == MAP_FAILED) return false;
+
+  madvise(addr, fileSize, MADV_SEQUENTIAL);
+  data_ = static_cast<const char*>(addr);
+  size_ = fileSize;
+  return true;
+#endif
+}
+
+void MappedFile::close() {
+#ifndef _WIN32
+  if (data_ != NULL) {
+    munmap(const_cast<char*>(data_), size_);
+  }
+#endif
+  data_ = NULL;
+  size_ = 0u;
+}
+
+void MappedFile::dropPages(std::size_t offset, std::size_t length) {
+#ifndef _WIN32
+  if (data_ == NULL || offset >= size_) return;
+  if (length > size_ - offset) length = size_ - offset;
+  std::size_t pageSize = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+  // only drop pages that lie completely within the range
+  std::size_t first = (offset + pageSize - 1u) / pageSize * pageSize;
+  std::size_t last = (offset + length) / pageSize * pageSize;
+  if (first < last) {
+    madvise(const_cast<char*>(data_) + first, last - first, MADV_DONTNEED);
+  }
+#endif
+}
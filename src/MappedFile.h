@@ -0,0 +1,55 @@
+/*******************************************************************************
+ Copyright 2006-2012 Lukas Käll <lukas.kall@scilifelab.se>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+
+ *******************************************************************************/
+#ifndef MAPPED_FILE_H_
+#define MAPPED_FILE_H_
+
+#include <string>
+#include <cstddef>
+
+/*
+* MappedFile
+*
+* Read-only memory mapping of a complete file. Mapping is only supported on
+* POSIX systems; open() returns false if the file cannot be mapped, in which
+* case the caller should fall back to reading it through a stream.
+*
+*/
+class MappedFile {
+ public:
+  MappedFile() : data_(NULL), size_(0u) {}
+  ~MappedFile() { close(); }
+
+  bool open(const std::string& fileName);
+  void close();
+
+  inline bool isOpen() const { return data_ != NULL; }
+  inline const char* data() const { return data_; }
+  inline std::size_t size() const { return size_; }
+
+  // tells the kernel that the pages in [offset, offset+length) will not be
+  // accessed again, such that they do not count towards our resident memory
+  void dropPages(std::size_t offset, std::size_t length);
+
+ private:
+  const char* data_;
+  std::size_t size_;
+
+  MappedFile(const MappedFile&);
+  MappedFile& operator=(const MappedFile&);
+};
+
+#endif /* MAPPED_FILE_H_ */
@@ -21,6 +21,8 @@
 #include "PSMDescription.h"
 #include "DescriptionOfCorrect.h"
 
+SymbolTable PSMDescription::proteinNames_;
+
 PSMDescription::PSMDescription() :
     features(NULL), expMass(0.), calcMass(0.), scan(0),
     id_(""), peptide("") {
@@ -70,8 +72,8 @@ std::string PSMDescription::removePTMs(const string& peptide) {
 }
 
 void PSMDescription::printProteins(std::ostream& out) {
-  std::vector<std::string>::const_iterator it = proteinIds.begin();
+  std::vector<unsigned int>::const_iterator it = proteinIds.begin();
   for ( ; it != proteinIds.end(); ++it) {
-    out << '\t' << *it;
+    out << '\t' << getProteinName(*it);
   }
 }
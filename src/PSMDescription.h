@@ -22,6 +22,7 @@
 #include <iostream>
 
 #include "Enzyme.h"
+#include "SymbolTable.h"
 
 /*
 * PSMDescription
@@ -43,6 +44,18 @@ class PSMDescription {
   void clear() { proteinIds.clear(); }
   double* getFeatures() { return features; }
   
+  // protein accessions are shared between PSMs through a global symbol table
+  static unsigned int internProteinName(const char* name, std::size_t length) {
+    return proteinNames_.intern(name, length);
+  }
+  static unsigned int internProteinName(const std::string& name) {
+    return proteinNames_.intern(name);
+  }
+  static const std::string& getProteinName(unsigned int proteinId) {
+    return proteinNames_.getName(proteinId);
+  }
+  static SymbolTable& getProteinNames() { return proteinNames_; }
+  
   // TODO: move these static functions somewhere else
   static std::string removePTMs(const std::string& peptideSeq);
   static std::string removeFlanks(const std::string& peptideSeq) { 
@@ -120,7 +133,10 @@ class PSMDescription {
   unsigned int scan;
   std::string id_;
   std::string peptide;
-  std::vector<std::string> proteinIds;
+  std::vector<unsigned int> proteinIds; // ids in the protein symbol table
+  
+ protected:
+  static SymbolTable proteinNames_;
 };
 
 inline std::ostream& operator<<(std::ostream& out, PSMDescription& psm) {
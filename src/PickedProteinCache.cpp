@@ -0,0 +1,239 @@
+/*******************************************************************************
+ Copyright 2006-2012 Lukas Käll <lukas.kall@scilifelab.se>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+
+ *******************************************************************************/
+
+#include "PickedProteinCache.h"
+
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+
+#include "MappedFile.h"
+#include "MyException.h"
+#include "Globals.h"
+
+const char PickedProteinCache::kMagic[8] = { 'P', 'I', 'C', 'K', 'D', 'I', 'G', '\0' };
+const uint32_t PickedProteinCache::kVersion;
+const uint32_t PickedProteinCache::kFlagFastaHasDecoys;
+
+namespace {
+void warnCorrupt(const std::string& fileName, const std::string& reason) {
+  std::string trimmed(reason);
+  while (!trimmed.empty() && trimmed[trimmed.size() - 1u] == '\n') {
+    trimmed.erase(trimmed.size() - 1u);
+  }
+  std::cerr << "Warning: The digestion cache " << fileName << " is corrupt ("
+      << trimmed << ") and will be regenerated." << std::endl;
+}
+}
+
+/**
+ * Hashes the fasta file in blocks of 1MB, the last block is padded with zeros
+ * which is why the file size is part of the key as well
+ */
+bool PickedProteinCache::computeKey(const std::string& fastaFN,
+    const std::string& digestParams, Key& key) {
+  std::ifstream fasta(fastaFN.c_str(), ios::in | ios::binary);
+  if (!fasta.is_open()) return false;
+  
+  std::vector<char> buffer(1u << 20);
+  key.fastaSize = 0u;
+  key.fastaHash = kChecksumSeed;
+  while (fasta) {
+    fasta.read(&buffer[0], static_cast<std::streamsize>(buffer.size()));
+    std::size_t numRead = static_cast<std::size_t>(fasta.gcount());
+    if (numRead == 0u) break;
+    std::size_t numWords = (numRead + 7u) / 8u;
+    memset(&buffer[0] + numRead, 0, numWords * 8u - numRead);
+    key.fastaHash = updateChecksum(key.fastaHash, &buffer[0], numWords * 8u);
+    key.fastaSize += numRead;
+  }
+  if (fasta.bad()) return false;
+  key.digestParams = digestParams;
+  return true;
+}
+
+/**
+ * Translates name -> representative pairs into index pairs into proteins
+ */
+void PickedProteinCache::getPairs(
+    const std::map<std::string, std::string>& proteinMap,
+    SymbolTable& proteins, std::vector<uint32_t>& pairs) {
+  pairs.reserve(proteinMap.size() * 2u);
+  std::map<std::string, std::string>::const_iterator it = proteinMap.begin();
+  for ( ; it != proteinMap.end(); ++it) {
+    pairs.push_back(proteins.intern(it->first));
+    pairs.push_back(proteins.intern(it->second));
+  }
+}
+
+void PickedProteinCache::write(const std::string& fileName, const Key& key,
+    bool fastaHasDecoys,
+    const std::map<std::string, std::string>& fragment_map,
+    const std::map<std::string, std::string>& duplicate_map) {
+  SymbolTable proteins;
+  std::vector<uint32_t> fragmentPairs, duplicatePairs;
+  getPairs(fragment_map, proteins, fragmentPairs);
+  getPairs(duplicate_map, proteins, duplicatePairs);
+  std::vector<std::string> proteinDict(proteins.size());
+  for (std::size_t j = 0; j < proteins.size(); ++j) {
+    proteinDict[j] = proteins.getName(static_cast<unsigned int>(j));
+  }
+  
+  Header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.byteOrderMark = kByteOrderMark;
+  header.flags = fastaHasDecoys ? kFlagFastaHasDecoys : 0u;
+  header.numSections = 4u;
+  header.fastaSize = key.fastaSize;
+  header.fastaHash = key.fastaHash;
+  header.numFragments = static_cast<uint64_t>(fragment_map.size());
+  header.numDuplicates = static_cast<uint64_t>(duplicate_map.size());
+  
+  Writer writer(fileName);
+  writer.write(&header, sizeof(header));
+  writer.writeStringSection(DIGEST_PARAMS, std::vector<std::string>(1u, key.digestParams));
+  writer.writeStringSection(PROTEIN_DICT, proteinDict);
+  writer.writeSection(FRAGMENT_PAIRS, fragmentPairs.empty() ? NULL : &fragmentPairs[0],
+                      fragmentPairs.size() * sizeof(uint32_t));
+  writer.writeSection(DUPLICATE_PAIRS, duplicatePairs.empty() ? NULL : &duplicatePairs[0],
+                      duplicatePairs.size() * sizeof(uint32_t));
+  writer.close();
+  
+  if (VERB > 1) {
+    std::cerr << "Wrote " << fragment_map.size() << " fragment and "
+        << duplicate_map.size() << " duplicate proteins to digestion cache "
+        << fileName << std::endl;
+  }
+}
+
+/**
+ * Pairs were written in the order of the map, so inserting at the end is
+ * amortized constant time
+ */
+void PickedProteinCache::readPairs(const Section& section, uint64_t numPairs,
+    const std::vector<std::string>& proteins,
+    std::map<std::string, std::string>& proteinMap) {
+  const uint32_t* pairs = reinterpret_cast<const uint32_t*>(section.data);
+  for (uint64_t i = 0; i < numPairs; ++i) {
+    uint32_t proteinIdx = pairs[2u * i], representativeIdx = pairs[2u * i + 1u];
+    if (proteinIdx >= proteins.size() || representativeIdx >= proteins.size()) {
+      throw MyException("ERROR: Reading digestion cache, corrupt dictionary index.\n");
+    }
+    proteinMap.insert(proteinMap.end(),
+        std::make_pair(proteins[proteinIdx], proteins[representativeIdx]));
+  }
+}
+
+bool PickedProteinCache::read(const std::string& fileName, const Key& key,
+    bool& fastaHasDecoys,
+    std::map<std::string, std::string>& fragment_map,
+    std::map<std::string, std::string>& duplicate_map) {
+  // files that cannot be mapped, e.g. empty ones, are read through a stream
+  MappedFile mappedCache;
+  std::vector<char> buffer;
+  const char* data = NULL;
+  std::size_t size = 0u;
+  if (mappedCache.open(fileName)) {
+    data = mappedCache.data();
+    size = mappedCache.size();
+  } else {
+    std::ifstream cacheStream(fileName.c_str(), ios::in | ios::binary);
+    if (!cacheStream.is_open()) {
+      if (VERB > 1) {
+        std::cerr << "Digestion cache " << fileName << " not found, it will be "
+            << "created after the digest." << std::endl;
+      }
+      return false;
+    }
+    buffer.assign(std::istreambuf_iterator<char>(cacheStream),
+                  std::istreambuf_iterator<char>());
+    data = buffer.empty() ? NULL : &buffer[0];
+    size = buffer.size();
+  }
+  
+  // anything without the magic is not ours to overwrite, anything with it
+  // that fails validation is regenerated
+  Header header;
+  if (size < sizeof(kMagic) || memcmp(data, kMagic, sizeof(kMagic)) != 0) {
+    ostringstream temp;
+    temp << "ERROR: " << fileName << " exists but is not a digestion cache file, "
+        << "refusing to overwrite it." << std::endl;
+    throw MyException(temp.str());
+  }
+  if (size < sizeof(header) + sizeof(uint64_t) || size % 8u != 0u) {
+    warnCorrupt(fileName, "it is truncated");
+    return false;
+  }
+  memcpy(&header, data, sizeof(header));
+  if (header.byteOrderMark != kByteOrderMark || header.version != kVersion) {
+    if (VERB > 1) {
+      std::cerr << "Digestion cache " << fileName << " was written by an "
+          << "incompatible version, it will be regenerated." << std::endl;
+    }
+    return false;
+  }
+  uint64_t storedChecksum;
+  memcpy(&storedChecksum, data + size - sizeof(uint64_t), sizeof(uint64_t));
+  if (updateChecksum(kChecksumSeed, data, size - sizeof(uint64_t)) != storedChecksum) {
+    warnCorrupt(fileName, "checksum mismatch");
+    return false;
+  }
+  
+  std::map<std::string, std::string> fragments, duplicates;
+  try {
+    std::vector<Section> sections(DUPLICATE_PAIRS + 1);
+    findSections(data, size, sizeof(header), header.numSections, sections);
+    std::vector<std::string> digestParams;
+    readStrings(getSection(sections, DIGEST_PARAMS, sections[DIGEST_PARAMS].length),
+                digestParams);
+    if (header.fastaSize != key.fastaSize || header.fastaHash != key.fastaHash ||
+        digestParams.size() != 1u || digestParams[0] != key.digestParams) {
+      if (VERB > 1) {
+        std::cerr << "Digestion cache " << fileName << " was written for another "
+            << "fasta database or other digestion settings, it will be "
+            << "regenerated." << std::endl;
+      }
+      return false;
+    }
+    
+    std::vector<std::string> proteins;
+    readStrings(getSection(sections, PROTEIN_DICT, sections[PROTEIN_DICT].length),
+                proteins);
+    const Section& fragmentPairs = getSection(sections, FRAGMENT_PAIRS,
+        header.numFragments * 2u * sizeof(uint32_t));
+    const Section& duplicatePairs = getSection(sections, DUPLICATE_PAIRS,
+        header.numDuplicates * 2u * sizeof(uint32_t));
+    readPairs(fragmentPairs, header.numFragments, proteins, fragments);
+    readPairs(duplicatePairs, header.numDuplicates, proteins, duplicates);
+  } catch (MyException& e) {
+    warnCorrupt(fileName, e.what());
+    return false;
+  }
+  fragment_map.swap(fragments);
+  duplicate_map.swap(duplicates);
+  fastaHasDecoys = (header.flags & kFlagFastaHasDecoys) != 0u;
+  
+  if (VERB > 1) {
+    std::cerr << "Read " << header.numFragments << " fragment and "
+        << header.numDuplicates << " duplicate proteins from digestion cache "
+        << fileName << std::endl;
+  }
+  return true;
+}
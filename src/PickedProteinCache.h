@@ -0,0 +1,105 @@
+/*******************************************************************************
+ Copyright 2006-2012 Lukas Käll <lukas.kall@scilifelab.se>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+
+ *******************************************************************************/
+
+#ifndef PICKED_PROTEIN_CACHE_H_
+#define PICKED_PROTEIN_CACHE_H_
+
+#include <string>
+#include <vector>
+#include <map>
+#include <stdint.h>
+
+#include "BinaryCache.h"
+#include "SymbolTable.h"
+
+/*
+* PickedProteinCache
+*
+* On-disk copy of the fragment and duplicate proteins that the picked-protein
+* method derives from an in-silico digest of the fasta database. The file is
+* keyed by a hash over the fasta file contents and by the digestion settings,
+* such that repeated runs over the same database skip the digest.
+*
+* Only the protein relations are stored: the peptide dictionary and postings
+* of the digest are not needed anymore once the relations are known and
+* would make the cache orders of magnitude larger.
+*
+* Layout, in the section format of BinaryCache:
+*   header    magic, version, byte order mark, flags, fasta size and hash,
+*             number of fragment and duplicate relations
+*   sections  the digestion settings, the dictionary of proteins involved in
+*             any relation and (protein, representative) index pairs for the
+*             fragment and the duplicate proteins
+*   trailer   checksum over all preceding bytes
+*
+* kVersion has to be increased whenever the grouping in PickedProteinCaller
+* changes its results.
+*
+*/
+class PickedProteinCache : protected BinaryCache {
+ public:
+  struct Key {
+    uint64_t fastaSize;
+    uint64_t fastaHash;
+    std::string digestParams; // PeptideConstraint settings and decoy pattern
+  };
+
+  // returns false if the fasta file cannot be read
+  static bool computeKey(const std::string& fastaFN,
+                         const std::string& digestParams, Key& key);
+
+  static void write(const std::string& fileName, const Key& key,
+                    bool fastaHasDecoys,
+                    const std::map<std::string, std::string>& fragment_map,
+                    const std::map<std::string, std::string>& duplicate_map);
+  // returns false if the file does not exist, does not match the key or is
+  // corrupt, and throws if the file exists but is not a digestion cache
+  static bool read(const std::string& fileName, const Key& key,
+                   bool& fastaHasDecoys,
+                   std::map<std::string, std::string>& fragment_map,
+                   std::map<std::string, std::string>& duplicate_map);
+
+ protected:
+  static const char kMagic[8];
+  static const uint32_t kVersion = 1u;
+  static const uint32_t kFlagFastaHasDecoys = 1u;
+
+  enum SectionId {
+    DIGEST_PARAMS = 1, PROTEIN_DICT, FRAGMENT_PAIRS, DUPLICATE_PAIRS
+  };
+
+  struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrderMark;
+    uint32_t flags;
+    uint32_t numSections;
+    uint64_t fastaSize;
+    uint64_t fastaHash;
+    uint64_t numFragments;
+    uint64_t numDuplicates;
+    uint64_t reserved[2];
+  };
+
+  static void getPairs(const std::map<std::string, std::string>& proteinMap,
+                       SymbolTable& proteins, std::vector<uint32_t>& pairs);
+  static void readPairs(const Section& section, uint64_t numPairs,
+                        const std::vector<std::string>& proteins,
+                        std::map<std::string, std::string>& proteinMap);
+};
+
+#endif /* PICKED_PROTEIN_CACHE_H_ */
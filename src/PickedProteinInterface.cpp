@@ -197,50 +197,86 @@ bool PickedProteinInterface::initialize(Scores& peptideScores, const Enzyme* enz
   pickedProteinCaller.initConstraints(cruxEnzyme, digest, min_peptide_length, 
                                 max_peptide_length, max_miscleavages);
   
-  groupProteins(peptideScores, pickedProteinCaller);
+  std::ostringstream digestParams;
+  digestParams << "enzyme=" << cruxEnzyme << ", digestion=" << digest
+               << ", min-pept-length=" << min_peptide_length
+               << ", max-pept-length=" << max_peptide_length
+               << ", max-miscleavages=" << max_miscleavages
+               << ", decoy-pattern=" << decoyPattern_;
+  groupProteins(peptideScores, pickedProteinCaller, digestParams.str());
   
   return true;
 }
 
-void PickedProteinInterface::groupProteins(Scores& peptideScores,
-    PickedProteinCaller& pickedProteinCaller) {
-  std::map<std::string, std::string> fragment_map, duplicate_map;
-  if (fastaProteinFN_ != "auto") {
-    pickedProteinCaller.setFastaDatabase(fastaProteinFN_, decoyPattern_);
-    
+/**
+ * Digests the target and, unless the fasta file contains decoys already, the
+ * reversed decoy proteins. Returns false if the fasta database could not be
+ * processed and the error was ignored due to the no-terminate flag.
+ */
+bool PickedProteinInterface::getFragmentsAndDuplicates(
+    PickedProteinCaller& pickedProteinCaller,
+    std::map<std::string, std::string>& fragment_map,
+    std::map<std::string, std::string>& duplicate_map) {
+  pickedProteinCaller.setFastaDatabase(fastaProteinFN_, decoyPattern_);
+  
+  if (VERB > 1) {
+    std::cerr << "Detecting protein fragments/duplicates in target database" << std::endl;
+  }
+  bool success = true, reverseProteinSeqs = false;
+  bool fail = pickedProteinCaller.getProteinFragmentsAndDuplicates(fragment_map, duplicate_map, reverseProteinSeqs);
+  if (fail) {
+    ostringstream oss;
+    oss << "ERROR: Could not process the fasta database, check if path is correct." << std::endl;
+    if (NO_TERMINATE) {
+      std::cerr << oss.str() << "No-terminate flag set: ignoring error and skipping protein grouping." << std::endl;
+      success = false;
+    } else {
+      throw MyException(oss.str());
+    }
+  }
+  
+  if (!pickedProteinCaller.fastaHasDecoys()) {
     if (VERB > 1) {
-      std::cerr << "Detecting protein fragments/duplicates in target database" << std::endl;
+      std::cerr << "Detecting protein fragments/duplicates in decoy database" << std::endl;
     }
-    bool reverseProteinSeqs = false;
-    bool fail = pickedProteinCaller.getProteinFragmentsAndDuplicates(fragment_map, duplicate_map, reverseProteinSeqs);
+    reverseProteinSeqs = true;
+    fail = pickedProteinCaller.getProteinFragmentsAndDuplicates(fragment_map, duplicate_map, reverseProteinSeqs);
     if (fail) {
       ostringstream oss;
       oss << "ERROR: Could not process the fasta database, check if path is correct." << std::endl;
       if (NO_TERMINATE) {
         std::cerr << oss.str() << "No-terminate flag set: ignoring error and skipping protein grouping." << std::endl;
+        success = false;
       } else {
         throw MyException(oss.str());
       }
     }
-    
-    if (!pickedProteinCaller.fastaHasDecoys()) {
-      if (VERB > 1) {
-        std::cerr << "Detecting protein fragments/duplicates in decoy database" << std::endl;
-      }
-      reverseProteinSeqs = true;
-      fail = pickedProteinCaller.getProteinFragmentsAndDuplicates(fragment_map, duplicate_map, reverseProteinSeqs);
-      if (fail) {
-        ostringstream oss;
-        oss << "ERROR: Could not process the fasta database, check if path is correct." << std::endl;
-        if (NO_TERMINATE) {
-          std::cerr << oss.str() << "No-terminate flag set: ignoring error and skipping protein grouping." << std::endl;
-        } else {
-          throw MyException(oss.str());
-        }
+  } else if (VERB > 1) {
+    std::cerr << "Decoy proteins detected in fasta database, "
+              << "no need to generate decoy database" << std::endl;
+  }
+  return success;
+}
+
+void PickedProteinInterface::groupProteins(Scores& peptideScores,
+    PickedProteinCaller& pickedProteinCaller, const std::string& digestParams) {
+  std::map<std::string, std::string> fragment_map, duplicate_map;
+  if (fastaProteinFN_ != "auto") {
+    PickedProteinCache::Key cacheKey;
+    bool useCache = !digestCacheFN_.empty() && 
+        PickedProteinCache::computeKey(fastaProteinFN_, digestParams, cacheKey);
+    bool fastaHasDecoys = false;
+    if (useCache && PickedProteinCache::read(digestCacheFN_, cacheKey, 
+                        fastaHasDecoys, fragment_map, duplicate_map)) {
+      if (VERB > 1 && fastaHasDecoys) {
+        std::cerr << "Decoy proteins detected in fasta database, "
+                  << "no need to generate decoy database" << std::endl;
       }
-    } else if (VERB > 1) {
-      std::cerr << "Decoy proteins detected in fasta database, "
-                << "no need to generate decoy database" << std::endl;
+    } else if (getFragmentsAndDuplicates(pickedProteinCaller, 
+                                         fragment_map, duplicate_map) 
+                 && useCache) {
+      PickedProteinCache::write(digestCacheFN_, cacheKey, 
+          pickedProteinCaller.fastaHasDecoys(), fragment_map, duplicate_map);
     }
   }
   
@@ -254,18 +290,19 @@ void PickedProteinInterface::groupProteins(Scores& peptideScores,
     
     if (peptideIt->p > maxPeptidePval_) continue;
     
-    for (std::vector<std::string>::iterator protIt = peptideIt->pPSM->proteinIds.begin(); 
+    for (std::vector<unsigned int>::iterator protIt = peptideIt->pPSM->proteinIds.begin(); 
             protIt != peptideIt->pPSM->proteinIds.end(); protIt++) {
-      std::string proteinId = *protIt;
+      const std::string& proteinName = PSMDescription::getProteinName(*protIt);
+      std::string proteinId = proteinName;
       
       if (fragment_map.find(proteinId) != fragment_map.end()) {
-        if (reportFragmentProteins_) proteinsInGroup.insert(*protIt);
+        if (reportFragmentProteins_) proteinsInGroup.insert(proteinName);
         proteinId = fragment_map[proteinId];
       } else if (duplicate_map.find(proteinId) != duplicate_map.end()) {
-        if (reportDuplicateProteins_) proteinsInGroup.insert(*protIt);
+        if (reportDuplicateProteins_) proteinsInGroup.insert(proteinName);
         proteinId = duplicate_map[proteinId];
       } else {
-        proteinsInGroup.insert(*protIt);
+        proteinsInGroup.insert(proteinName);
       }
       
       if (isFirst) {
@@ -337,7 +374,7 @@ void PickedProteinInterface::computeProbabilities(const std::string& fname) {
   }
   for (std::vector<ProteinScoreHolder>::iterator it = proteins_.begin(); 
         it != proteins_.end(); it++) {
-    const std::vector<ProteinScoreHolder::Peptide> peptides = it->getPeptidesByRef();
+    const std::vector<ProteinScoreHolder::Peptide>& peptides = it->getPeptidesByRef();
     switch (protInferenceMethod_) {
       case FISHER: {
         double fisher = 0.0;
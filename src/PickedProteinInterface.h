@@ -27,6 +27,7 @@
 #include "ProteinProbEstimator.h"
 #include "PosteriorEstimator.h"
 #include "PickedProteinCaller.h"
+#include "PickedProteinCache.h"
 #include "Enzyme.h"
 #include "PseudoRandom.h"
 
@@ -61,6 +62,12 @@ class PickedProteinInterface : public ProteinProbEstimator {
     double specCountQvalThreshold);
   virtual ~PickedProteinInterface();
   
+  // skip the in-silico digest if fileName holds the results for the same
+  // fasta database and digestion settings, otherwise (re)write it
+  void setDigestCacheFile(const std::string& fileName) {
+    digestCacheFN_ = fileName;
+  }
+  
   bool initialize(Scores& fullset, const Enzyme* enzyme);
   void run() {}
   void computeProbabilities(const std::string& fname = "");
@@ -70,7 +77,10 @@ class PickedProteinInterface : public ProteinProbEstimator {
 
  private:
   void groupProteins(Scores& peptideScores, 
-    PickedProteinCaller& pickedProteinCaller);
+    PickedProteinCaller& pickedProteinCaller, const std::string& digestParams);
+  bool getFragmentsAndDuplicates(PickedProteinCaller& pickedProteinCaller,
+    std::map<std::string, std::string>& fragment_map,
+    std::map<std::string, std::string>& duplicate_map);
   
   void pickedProteinStrategy();
   bool pickedProteinCheckId(std::string& proteinId, bool isDecoy,
@@ -81,7 +91,7 @@ class PickedProteinInterface : public ProteinProbEstimator {
   
   /** PICKED_PROTEIN PARAMETERS **/
   ProteinInferenceMethod protInferenceMethod_;
-  std::string fastaProteinFN_;
+  std::string fastaProteinFN_, digestCacheFN_;
   bool reportFragmentProteins_, reportDuplicateProteins_;
   double maxPeptidePval_;
   
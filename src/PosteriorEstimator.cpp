@@ -47,6 +47,7 @@ bool PosteriorEstimator::pvalInput = false;
 bool PosteriorEstimator::competition = false;
 bool PosteriorEstimator::includeNegativesInResult = false;
 bool PosteriorEstimator::usePi0_ = true;
+QValueEngine PosteriorEstimator::qvalueEngine_;
 
 pair<double, bool> make_my_pair(double d, bool b) {
   return make_pair(d, b);
@@ -63,17 +64,43 @@ bool isMixed(const pair<double, bool>& aPair) {
   return aPair.second;
 }
 
-template<class T> void bootstrap(const vector<T>& in, vector<T>& out,
-                                 size_t max_size = 1000) {
-  out.clear();
-  double n = static_cast<double>(in.size());
-  size_t num_draw = min(in.size(), max_size);
-  for (size_t ix = 0; ix < num_draw; ++ix) {
-    size_t draw = (size_t)((double)PseudoRandom::lcg_rand() / ((double)PseudoRandom::kRandMax + (double)1) * n);
-    out.push_back(in[draw]);
-  }
-  // sort in desending order
-  sort(out.begin(), out.end());
+/*
+ * Squared deviations of bootstrapped pi0 estimates from minPi0, for each of 
+ * numBoot replicates of min(n, max_size) p-values drawn with replacement.
+ * p is sorted in ascending order and startIdx[ix] is the index of the first 
+ * p-value >= lambdas[ix]. Instead of sorting a resampled vector, a 
+ * replicate only counts how many draws land in each interval between 
+ * consecutive lambdas. The replicates run in parallel, each from its own 
+ * part of the PseudoRandom sequence, so the result does not depend on the 
+ * number of threads; the shared generator is advanced past all draws.
+ */
+void bootstrapPi0Errors(std::size_t n, const vector<double>& lambdas,
+    const vector<std::size_t>& startIdx, double minPi0, unsigned int numBoot,
+    vector<double>& sqErrors, size_t max_size = 1000) {
+  const std::size_t numLambdas = lambdas.size();
+  const std::size_t num_draw = min(n, max_size);
+  sqErrors.assign(numBoot * numLambdas, 0.0);
+  
+  #pragma omp parallel for schedule(static)
+  for (int boot = 0; boot < static_cast<int>(numBoot); ++boot) {
+    PseudoRandom::Stream stream(static_cast<uint64_t>(boot) * num_draw);
+    // counts[b] is the number of draws with exactly b lambdas <= p
+    vector<std::size_t> counts(numLambdas + 1, 0u);
+    for (std::size_t ix = 0; ix < num_draw; ++ix) {
+      size_t draw = (size_t)((double)stream.lcg_rand() / ((double)PseudoRandom::kRandMax + (double)1) * (double)n);
+      ++counts[upper_bound(startIdx.begin(), startIdx.end(), draw) - 
+               startIdx.begin()];
+    }
+    std::size_t Wl = counts[numLambdas];
+    for (std::size_t ix = numLambdas; ix--; ) {
+      double pi0Boot = (double)Wl / static_cast<double>(num_draw) / 
+                           (1. - lambdas[ix]);
+      sqErrors[boot * numLambdas + ix] = 
+          (pi0Boot - minPi0) * (pi0Boot - minPi0);
+      Wl += counts[ix];
+    }
+  }
+  PseudoRandom::skip(static_cast<uint64_t>(numBoot) * num_draw);
 }
 
 double mymin(double a, double b) {
@@ -387,9 +414,8 @@ void PosteriorEstimator::getMixMaxCounts(const vector<pair<double, bool> >& comb
 }
 
 /**
- * This is a reimplementation of 
- *   Crux/src/app/AssignConfidenceApplication.cpp::compute_decoy_qvalues_mixmax 
- * Which itself was a reimplementation of Uri Keich's code written in R.
+ * Appends the mix-max q-values of the targets, or of all elements if 
+ * includeNegativesInResult is set, to q. See QValueEngine.
  *
  * Assumes that scores are sorted in descending order
  * 
@@ -398,58 +424,10 @@ void PosteriorEstimator::getMixMaxCounts(const vector<pair<double, bool> >& comb
 void PosteriorEstimator::getQValues(double pi0, 
     const vector<pair<double, bool> >& combined, vector<double>& q,
     bool skipDecoysPlusOne) {
-  std::vector<double> h_w_le_z, h_z_le_z; // N_{w<=z} and N_{z<=z}
-  if (pi0 < 1.0) {
-    getMixMaxCounts(combined, h_w_le_z, h_z_le_z);
-  }
-
-  double estPx_lt_zj = 0.0;
-  double E_f1_mod_run_tot = 0.0;
-  double fdr = 0.0;
-
-  int n_z_ge_w = 1, n_w_ge_w = 0; // N_{z>=w} and N_{w>=w}
-  if (skipDecoysPlusOne) n_z_ge_w = 0;
-  
-  std::vector<pair<double, bool> >::const_iterator myPair = combined.begin();
-  int decoyQueue = 0, targetQueue = 0; // handles ties
-  for ( ; myPair != combined.end(); ++myPair) {
-    if (myPair->second) { 
-      ++n_w_ge_w; // target PSM
-      ++targetQueue;
-    } else {
-      ++n_z_ge_w; // decoy PSM
-      ++decoyQueue;
-    }
-    
-    // handles ties
-    if (myPair+1 == combined.end() || myPair->first != (myPair+1)->first) {
-      if (pi0 < 1.0 && decoyQueue > 0) {
-        int j = static_cast<int>(h_w_le_z.size()) - (n_z_ge_w - 1);
-        int cnt_w = static_cast<int>(h_w_le_z.at(static_cast<std::size_t>(j)));
-        int cnt_z = static_cast<int>(h_z_le_z.at(static_cast<std::size_t>(j)));
-        estPx_lt_zj = (double)(cnt_w - pi0*cnt_z) / ((1.0 - pi0)*cnt_z);
-        estPx_lt_zj = estPx_lt_zj > 1 ? 1 : estPx_lt_zj;
-        estPx_lt_zj = estPx_lt_zj < 0 ? 0 : estPx_lt_zj;
-        E_f1_mod_run_tot += decoyQueue * estPx_lt_zj * (1.0 - pi0);
-        if (VERB > 4) {
-          std::cerr << "Mix-max num negatives correction: "
-            << (1.0-pi0) * n_z_ge_w << " vs. " << E_f1_mod_run_tot << std::endl;
-        }
-      }
-      
-      if (includeNegativesInResult) {
-        targetQueue += decoyQueue;
-      }
-      fdr = (n_z_ge_w * pi0 + E_f1_mod_run_tot) / (double)((std::max)(1, n_w_ge_w));
-      for (int i = 0; i < targetQueue; ++i) {
-        q.push_back((std::min)(fdr, 1.0));
-      }
-      decoyQueue = 0;
-      targetQueue = 0;
-    }
-  }
-  // Convert the FDRs into q-values.
-  partial_sum(q.rbegin(), q.rend(), q.rbegin(), mymin);
+  qvalueEngine_.setSkipDecoysPlusOne(skipDecoysPlusOne);
+  qvalueEngine_.setIncludeDecoys(includeNegativesInResult);
+  const std::vector<double>& qvals = qvalueEngine_.calcQValues(combined, pi0);
+  q.insert(q.end(), qvals.begin(), qvals.end());
 }
 
 void PosteriorEstimator::getQValuesFromP(double pi0,
@@ -517,6 +495,7 @@ bool PosteriorEstimator::checkSeparation(std::vector<double>& p) {
 double PosteriorEstimator::estimatePi0(vector<double>& p,
                                        const unsigned int numBoot) {
   vector<double> lambdas, pi0s;
+  vector<std::size_t> startIdx;
   vector<double>::iterator start;
   size_t n = p.size();
   // Calculate pi0 for different values for lambda
@@ -532,6 +511,7 @@ double PosteriorEstimator::estimatePi0(vector<double>& p,
     if (pi0 > 0.0) {
       lambdas.push_back(lambda);
       pi0s.push_back(pi0);
+      startIdx.push_back(static_cast<std::size_t>(distance(p.begin(), start)));
     }
   }
   
@@ -553,20 +533,13 @@ double PosteriorEstimator::estimatePi0(vector<double>& p,
   }
   double minPi0 = *min_element(pi0s.begin(), pi0s.end());
   
-  vector<double> pBoot, mse;
-  // Initialize the vector mse with zeroes.
-  fill_n(back_inserter(mse), pi0s.size(), 0.0);
   // Examine which lambda level that is most stable under bootstrap
+  vector<double> sqErrors, mse(pi0s.size(), 0.0);
+  bootstrapPi0Errors(n, lambdas, startIdx, minPi0, numBoot, sqErrors);
   for (unsigned int boot = 0; boot < numBoot; ++boot) {
-    // Create an array of bootstrapped p-values, and sort in ascending order.
-    bootstrap<double> (p, pBoot);
-    n = pBoot.size();
     for (unsigned int ix = 0; ix < lambdas.size(); ++ix) {
-      start = lower_bound(pBoot.begin(), pBoot.end(), lambdas[ix]);
-      double Wl = (double)distance(start, pBoot.end());
-      double pi0Boot = Wl / static_cast<double>(n) / (1. - lambdas[ix]);
       // Estimated mean-squared error.
-      mse[ix] += (pi0Boot - minPi0) * (pi0Boot - minPi0);
+      mse[ix] += sqErrors[boot * lambdas.size() + ix];
     }
   }
   // Which index did the iterator get?
@@ -24,6 +24,7 @@
 
 #include "LogisticRegression.h"
 #include "PseudoRandom.h"
+#include "QValueEngine.h"
 
 class PosteriorEstimator {
  public:
@@ -84,6 +85,9 @@ class PosteriorEstimator {
   // used for standalone execution
   std::string targetFile, decoyFile;
   static bool reversed, pvalInput, competition, includeNegativesInResult, usePi0_;
+  // keeps its q-value buffer between getQValues calls, which like the flags
+  // above makes getQValues not thread safe
+  static QValueEngine qvalueEngine_;
   std::string resultFileName;
 };
 
@@ -0,0 +1,256 @@
+/*******************************************************************************
+ Copyright 2006-2012 Lukas Käll <lukas.kall@scilifelab.se>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+
+ *******************************************************************************/
+
+#include <ctime>
+#include <map>
+#include <vector>
+#include <fstream>
+#include <chrono>
+
+#ifdef _WIN32
+  #include <windows.h>
+  #include <psapi.h>
+#else
+  #include <sys/resource.h>
+#endif
+
+#include "Profiler.h"
+#include "MyException.h"
+#include "Version.h"
+
+bool Profiler::enabled_ = false;
+const int Profiler::kMaxThreadSlots;
+Profiler::AllocationSlot Profiler::allocationSlots_[Profiler::kMaxThreadSlots];
+double Profiler::startWallTime_ = 0.0;
+const Profiler::Scope* Profiler::serialScope_ = NULL;
+
+namespace {
+
+struct StageStats {
+  StageStats() : calls(0u), wallTime(0.0), cpuTime(0.0), allocations(0u),
+    allocatedBytes(0u), peakRssKb(0) {}
+  uint64_t calls;
+  double wallTime, cpuTime;
+  uint64_t allocations, allocatedBytes;
+  long peakRssKb;
+  std::string parent; // stage of the enclosing Scope when first entered
+  std::vector<std::pair<std::string, double> > counters; // in order of addition
+};
+
+// stages in the order they were first entered
+std::vector<std::pair<std::string, StageStats> > stages;
+
+StageStats& getStage(const char* name) {
+  for (std::size_t i = 0; i < stages.size(); ++i) {
+    if (stages[i].first == name) return stages[i].second;
+  }
+  stages.push_back(std::make_pair(std::string(name), StageStats()));
+  return stages.back().second;
+}
+
+}
+
+void Profiler::setEnabled(bool enabled) {
+  enabled_ = enabled;
+  if (enabled_) startWallTime_ = getWallTime();
+}
+
+double Profiler::getWallTime() {
+  return std::chrono::duration<double>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// CPU time of the whole process, i.e. of all threads
+double Profiler::getCpuTime() {
+  return static_cast<double>(clock()) / static_cast<double>(CLOCKS_PER_SEC);
+}
+
+// CPU time of the calling thread only
+double Profiler::getThreadCpuTime() {
+#ifdef _WIN32
+  FILETIME creationTime, exitTime, kernelTime, userTime;
+  if (!GetThreadTimes(GetCurrentThread(), &creationTime, &exitTime, 
+                      &kernelTime, &userTime)) {
+    return 0.0;
+  }
+  ULARGE_INTEGER kernel, user;
+  kernel.LowPart = kernelTime.dwLowDateTime;
+  kernel.HighPart = kernelTime.dwHighDateTime;
+  user.LowPart = userTime.dwLowDateTime;
+  user.HighPart = userTime.dwHighDateTime;
+  return static_cast<double>(kernel.QuadPart + user.QuadPart) * 1e-7;
+#elif defined(CLOCK_THREAD_CPUTIME_ID)
+  struct timespec time;
+  if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time) != 0) return 0.0;
+  return static_cast<double>(time.tv_sec) + 1e-9 * static_cast<double>(time.tv_nsec);
+#else
+  return getCpuTime();
+#endif
+}
+
+bool Profiler::inParallel() {
+#ifdef _OPENMP
+  return omp_in_parallel() != 0;
+#else
+  return false;
+#endif
+}
+
+void Profiler::getAllocations(int slot, uint64_t& allocations, 
+                              uint64_t& allocatedBytes) {
+  #pragma omp atomic read
+  allocations = allocationSlots_[slot].numAllocations;
+  #pragma omp atomic read
+  allocatedBytes = allocationSlots_[slot].allocatedBytes;
+}
+
+void Profiler::getTotalAllocations(uint64_t& allocations, 
+                                   uint64_t& allocatedBytes) {
+  allocations = 0u;
+  allocatedBytes = 0u;
+  for (int slot = 0; slot < kMaxThreadSlots; ++slot) {
+    uint64_t slotAllocations, slotAllocatedBytes;
+    getAllocations(slot, slotAllocations, slotAllocatedBytes);
+    allocations += slotAllocations;
+    allocatedBytes += slotAllocatedBytes;
+  }
+}
+
+long Profiler::getPeakRssKb() {
+#ifdef _WIN32
+  PROCESS_MEMORY_COUNTERS counters;
+  if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+    return static_cast<long>(counters.PeakWorkingSetSize / 1024u);
+  }
+  return 0;
+#else
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+  #ifdef __APPLE__
+    return static_cast<long>(usage.ru_maxrss / 1024); // in bytes on macOS
+  #else
+    return static_cast<long>(usage.ru_maxrss);
+  #endif
+#endif
+}
+
+Profiler::Scope::Scope(const char* stage) : stage_(stage), active_(enabled_),
+    threadOnly_(false), parent_(NULL), startWallTime_(0.0), 
+    startCpuTime_(0.0), startAllocations_(0u), startAllocatedBytes_(0u) {
+  if (!active_) return;
+  threadOnly_ = inParallel();
+  parent_ = serialScope_;
+  if (!threadOnly_) serialScope_ = this;
+  startWallTime_ = getWallTime();
+  getCounts(startCpuTime_, startAllocations_, startAllocatedBytes_);
+}
+
+void Profiler::Scope::getCounts(double& cpuTime, uint64_t& allocations, 
+                                uint64_t& allocatedBytes) const {
+  if (threadOnly_) {
+    cpuTime = getThreadCpuTime();
+    getAllocations(getThreadSlot(), allocations, allocatedBytes);
+  } else {
+    cpuTime = getCpuTime();
+    getTotalAllocations(allocations, allocatedBytes);
+  }
+}
+
+void Profiler::Scope::stop() {
+  if (!active_) return;
+  active_ = false;
+  if (serialScope_ == this) serialScope_ = parent_;
+  double wallTime = getWallTime() - startWallTime_;
+  double cpuTime;
+  uint64_t allocations, allocatedBytes;
+  getCounts(cpuTime, allocations, allocatedBytes);
+  long peakRssKb = getPeakRssKb();
+  #pragma omp critical (profiler_stages)
+  {
+    StageStats& stats = getStage(stage_);
+    if (stats.calls == 0u && parent_ != NULL) stats.parent = parent_->stage_;
+    ++stats.calls;
+    stats.wallTime += wallTime;
+    stats.cpuTime += cpuTime - startCpuTime_;
+    stats.allocations += allocations - startAllocations_;
+    stats.allocatedBytes += allocatedBytes - startAllocatedBytes_;
+    if (peakRssKb > stats.peakRssKb) stats.peakRssKb = peakRssKb;
+  }
+}
+
+void Profiler::addCount(const char* stage, const char* counter, double value) {
+  if (!enabled_) return;
+  #pragma omp critical (profiler_stages)
+  {
+    std::vector<std::pair<std::string, double> >& counters = 
+        getStage(stage).counters;
+    std::size_t i = 0u;
+    while (i < counters.size() && counters[i].first != counter) ++i;
+    if (i == counters.size()) {
+      counters.push_back(std::make_pair(std::string(counter), 0.0));
+    }
+    counters[i].second += value;
+  }
+}
+
+void Profiler::writeJson(const std::string& fileName) {
+  std::ofstream os(fileName.c_str());
+  if (!os.is_open()) {
+    throw MyException("ERROR: Could not open " + fileName + 
+                      " to write the profile.\n");
+  }
+  int numThreads = 1;
+#ifdef _OPENMP
+  numThreads = omp_get_max_threads();
+#endif
+  uint64_t numAllocations, allocatedBytes;
+  getTotalAllocations(numAllocations, allocatedBytes);
+  os.precision(9);
+  os << "{\n"
+     << "  \"version\": \"" << VERSION << "\",\n"
+     << "  \"threads\": " << numThreads << ",\n"
+     << "  \"wall_seconds\": " << getWallTime() - startWallTime_ << ",\n"
+     << "  \"cpu_seconds\": " << getCpuTime() << ",\n"
+     << "  \"peak_rss_kb\": " << getPeakRssKb() << ",\n"
+     << "  \"allocations\": " << numAllocations << ",\n"
+     << "  \"allocated_bytes\": " << allocatedBytes << ",\n"
+     << "  \"stages\": [";
+  for (std::size_t i = 0; i < stages.size(); ++i) {
+    const StageStats& stats = stages[i].second;
+    os << (i > 0u ? "," : "") << "\n    {\n"
+       << "      \"name\": \"" << stages[i].first << "\",\n"
+       << "      \"parent\": ";
+    if (stats.parent.empty()) {
+      os << "null,\n";
+    } else {
+      os << "\"" << stats.parent << "\",\n";
+    }
+    os << "      \"calls\": " << stats.calls << ",\n"
+       << "      \"wall_seconds\": " << stats.wallTime << ",\n"
+       << "      \"cpu_seconds\": " << stats.cpuTime << ",\n"
+       << "      \"allocations\": " << stats.allocations << ",\n"
+       << "      \"allocated_bytes\": " << stats.allocatedBytes << ",\n"
+       << "      \"peak_rss_kb\": " << stats.peakRssKb << ",\n"
+       << "      \"counters\": {";
+    for (std::size_t j = 0; j < stats.counters.size(); ++j) {
+      os << (j > 0u ? ", " : "") << "\"" << stats.counters[j].first << "\": " 
+         << stats.counters[j].second;
+    }
+    os << "}\n    }";
+  }
+  os << "\n  ]\n}" << std::endl;
+}
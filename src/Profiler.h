@@ -0,0 +1,121 @@
+/*******************************************************************************
+ Copyright 2006-2012 Lukas Käll <lukas.kall@scilifelab.se>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+
+ *******************************************************************************/
+#ifndef PROFILER_H_
+#define PROFILER_H_
+
+#include <string>
+#include <cstddef>
+#include <stdint.h>
+
+#ifdef _OPENMP
+  #include <omp.h>
+#endif
+
+/*
+* Profiler
+*
+* Collects wall and CPU time, allocation counts and named counters for the 
+* stages of a percolator run and writes them as JSON (--profile-json). 
+* Profiling is off by default, in which case a Scope or addCount costs a 
+* single branch. Stages are recorded from any OpenMP thread: their times are
+* summed over all calls, so the wall time of stages that run concurrently in 
+* several threads can add up to more than the wall clock time of the run.
+* 
+* A Scope that is entered inside a parallel region only counts the CPU time
+* and the allocations of its own thread, one entered outside of a parallel 
+* region those of all threads, i.e. including the parallel regions that it 
+* starts. Scopes can be nested, the JSON names the enclosing stage of each
+* stage as its parent, whose counts include those of the child.
+*
+* Allocations are only counted in executables that link AllocationCounter.cpp,
+* which forwards every operator new to countAllocation(). Each thread counts
+* in its own slot, the slots are added up where totals are needed.
+*
+*/
+class Profiler {
+ public:
+  /* Records the time spent in its lifetime, and the allocations done in the
+   * meantime, under the name of the stage */
+  class Scope {
+   public:
+    explicit Scope(const char* stage);
+    ~Scope() { stop(); }
+    void stop(); // ends the stage before the end of the scope
+   private:
+    const char* stage_;
+    bool active_;
+    bool threadOnly_; // entered inside a parallel region
+    const Scope* parent_;
+    double startWallTime_, startCpuTime_;
+    uint64_t startAllocations_, startAllocatedBytes_;
+    
+    void getCounts(double& cpuTime, uint64_t& allocations, 
+                   uint64_t& allocatedBytes) const;
+  };
+  
+  static void setEnabled(bool enabled);
+  inline static bool isEnabled() { return enabled_; }
+  
+  static void addCount(const char* stage, const char* counter, double value);
+  
+  inline static void countAllocation(std::size_t bytes) {
+    if (!enabled_) return;
+    AllocationSlot& slot = allocationSlots_[getThreadSlot()];
+    #pragma omp atomic
+    slot.numAllocations += 1u;
+    #pragma omp atomic
+    slot.allocatedBytes += bytes;
+  }
+  
+  static long getPeakRssKb();
+  static void writeJson(const std::string& fileName);
+  
+ protected:
+  // allocation counts of one thread, padded to a cache line such that the 
+  // threads do not write to the same line
+  struct AllocationSlot {
+    uint64_t numAllocations, allocatedBytes;
+    char padding[64 - 2 * sizeof(uint64_t)];
+  };
+  // threads beyond kMaxThreadSlots share slots, which keeps the counts exact
+  static const int kMaxThreadSlots = 256;
+  
+  static bool enabled_;
+  static AllocationSlot allocationSlots_[kMaxThreadSlots];
+  // innermost active Scope outside of parallel regions, which is only 
+  // changed outside of parallel regions
+  static const Scope* serialScope_;
+  static double startWallTime_;
+  
+  inline static int getThreadSlot() {
+#ifdef _OPENMP
+    return omp_get_thread_num() % kMaxThreadSlots;
+#else
+    return 0;
+#endif
+  }
+  static void getAllocations(int slot, uint64_t& allocations, 
+                             uint64_t& allocatedBytes);
+  static void getTotalAllocations(uint64_t& allocations, 
+                                  uint64_t& allocatedBytes);
+  static double getWallTime();
+  static double getCpuTime();
+  static double getThreadCpuTime();
+  static bool inParallel();
+};
+
+#endif /* PROFILER_H_ */
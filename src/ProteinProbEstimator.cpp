@@ -21,6 +21,7 @@ const double ProteinProbEstimator::target_decoy_ratio = 1.0;
 const double ProteinProbEstimator::psmThresholdMayu = 0.90;
 const double ProteinProbEstimator::prior_protein = 0.5;
 bool ProteinProbEstimator::calcProteinLevelProb = false;
+const unsigned int ProteinProbEstimator::kNoProtein;
 
 ProteinProbEstimator::ProteinProbEstimator(bool trivialGrouping, double absenceRatio, 
 					     bool outputEmpirQVal, std::string decoyPattern, 
@@ -172,22 +173,20 @@ void ProteinProbEstimator::getTPandPFfromPeptides(double psm_threshold,
    */
   for (std::vector<ProteinScoreHolder>::const_iterator it = proteins_.begin();
        it != proteins_.end(); it++) {
-    unsigned num_target_confident = 0;
-    unsigned num_decoy_confident = 0;
-    std::string protname = it->getName();
-    const std::vector<ProteinScoreHolder::Peptide> peptides = it->getPeptidesByRef();
+    bool hasConfidentTarget = false, hasConfidentDecoy = false;
+    const std::vector<ProteinScoreHolder::Peptide>& peptides = it->getPeptidesByRef();
     for(std::vector<ProteinScoreHolder::Peptide>::const_iterator itP = peptides.begin();
           itP != peptides.end(); ++itP) {
-      if(itP->q <= psm_threshold && itP->isdecoy)
-        ++num_decoy_confident;
-      if(itP->q <= psm_threshold && !itP->isdecoy)
-        ++num_target_confident;
+      if (itP->q <= psm_threshold) {
+        if (itP->isdecoy) hasConfidentDecoy = true;
+        else hasConfidentTarget = true;
+      }
     }
-    if (num_decoy_confident > 0) {
-      numberFP.insert(protname);
+    if (hasConfidentDecoy) {
+      numberFP.insert(it->getName());
     }
-    if (num_target_confident > 0) {
-      numberTP.insert(protname);
+    if (hasConfidentTarget) {
+      numberTP.insert(it->getName());
     }
   }
 }
@@ -304,32 +303,37 @@ void ProteinProbEstimator::estimateQValuesEmp() {
 }
 
 void ProteinProbEstimator::setTargetandDecoysNames(Scores& peptideScores) {
+  markDecoyProteinSymbols();
+  proteinSymbolToIdx_.assign(decoyProteinSymbols_.size(), kNoProtein);
   int numGroups = 0;
   bool decoyFound = false;
   std::vector<ScoreHolder>::iterator psm = peptideScores.begin();
   for (; psm!= peptideScores.end(); ++psm) {
+    ProteinScoreHolder::Peptide peptide(psm->pPSM->getPeptideSequence(), 
+        psm->isDecoy(), psm->p, psm->pep, psm->q, psm->score);
     // for each protein
-    std::vector<std::string>::iterator protIt = psm->pPSM->proteinIds.begin();
+    std::vector<unsigned int>::const_iterator protIt = psm->pPSM->proteinIds.begin();
     for (; protIt != psm->pPSM->proteinIds.end(); protIt++) {
-      ProteinScoreHolder::Peptide peptide(psm->pPSM->getPeptideSequence(), 
-          psm->isDecoy(), psm->p, psm->pep, psm->q, psm->score);
-      if (proteinToIdxMap_.find(*protIt) == proteinToIdxMap_.end()) {
-	      ProteinScoreHolder newProtein(*protIt, psm->isDecoy(), peptide, ++numGroups);
-	      proteinToIdxMap_[*protIt] = proteins_.size();
-	      proteins_.push_back(newProtein);
-	      
-	      if (!useDecoyPrefix) {
-	        if (psm->isDecoy()) {
-	          falsePosSet_.insert(*protIt);
-	          decoyFound = true;
-	        } else {
-	          truePosSet_.insert(*protIt);
-	        }
-	      } else if (isDecoy(*protIt)) {
-	        decoyFound = true;
-	      }
+      unsigned int& proteinIdx = proteinSymbolToIdx_[*protIt];
+      if (proteinIdx == kNoProtein) {
+        const std::string& proteinName = PSMDescription::getProteinName(*protIt);
+        proteinIdx = static_cast<unsigned int>(proteins_.size());
+        proteinToIdxMap_[proteinName] = proteins_.size();
+        proteins_.push_back(ProteinScoreHolder(proteinName, psm->isDecoy(), 
+                                               peptide, ++numGroups));
+        
+        if (!useDecoyPrefix) {
+          if (psm->isDecoy()) {
+            falsePosSet_.insert(proteinName);
+            decoyFound = true;
+          } else {
+            truePosSet_.insert(proteinName);
+          }
+        } else if (isDecoyProteinSymbol(*protIt)) {
+          decoyFound = true;
+        }
       } else {
-      	proteins_.at(proteinToIdxMap_[*protIt]).addPeptide(peptide);
+        proteins_[proteinIdx].addPeptide(peptide);
       }
     }
   }
@@ -347,25 +351,71 @@ void ProteinProbEstimator::setTargetandDecoysNames(Scores& peptideScores) {
   }
 }
 
+/**
+ * Precomputes the decoy status of all protein symbols, such that the 
+ * decoy pattern is searched for only once per protein name
+ */
+void ProteinProbEstimator::markDecoyProteinSymbols() {
+  const SymbolTable& proteinNames = PSMDescription::getProteinNames();
+  decoyProteinSymbols_.resize(proteinNames.size());
+  for (unsigned int symbol = 0; symbol < proteinNames.size(); ++symbol) {
+    decoyProteinSymbols_[symbol] = isDecoy(proteinNames.getName(symbol));
+  }
+}
+
+/**
+ * Rebuilds the index from protein symbols to proteins_ from proteinToIdxMap_,
+ * as derived classes may fill the latter with names of their own choosing
+ */
+void ProteinProbEstimator::indexProteinSymbols() {
+  const SymbolTable& proteinNames = PSMDescription::getProteinNames();
+  proteinSymbolToIdx_.assign(proteinNames.size(), kNoProtein);
+  std::map<std::string, size_t>::const_iterator it = proteinToIdxMap_.begin();
+  for (; it != proteinToIdxMap_.end(); ++it) {
+    unsigned int symbol = proteinNames.find(it->first);
+    if (symbol != SymbolTable::kNoSymbol) {
+      proteinSymbolToIdx_[symbol] = static_cast<unsigned int>(it->second);
+    }
+  }
+}
+
+/**
+ * The spectral counts are moved from the peptide map to a flat array indexed
+ * by an interned peptide id, the proteins of each PSM are then found through
+ * the protein symbol index
+ */
 void ProteinProbEstimator::addSpectralCounts(Scores& peptideScores) {
+  indexProteinSymbols();
+  
+  SymbolTable peptides;
+  std::vector<unsigned int> peptideSpecCounts;
+  peptideSpecCounts.reserve(peptideSpecCounts_.size());
+  std::map<std::string, unsigned int>::const_iterator countIt = peptideSpecCounts_.begin();
+  for (; countIt != peptideSpecCounts_.end(); ++countIt) {
+    peptides.intern(countIt->first);
+    peptideSpecCounts.push_back(countIt->second);
+  }
+  
+  std::vector<unsigned int> proteinIdxs;
   std::vector<ScoreHolder>::iterator psm = peptideScores.begin();
   for (; psm!= peptideScores.end(); ++psm) {
     // for each protein
-    std::vector<std::string>::const_iterator protIt = psm->pPSM->proteinIds.begin();
-    std::set<unsigned int> seenProteinIdxs;
+    proteinIdxs.clear();
+    std::vector<unsigned int>::const_iterator protIt = psm->pPSM->proteinIds.begin();
     for (; protIt != psm->pPSM->proteinIds.end(); protIt++) {
-      if (proteinToIdxMap_.find(*protIt) != proteinToIdxMap_.end()) {
-        unsigned int proteinIdx = static_cast<unsigned int>(proteinToIdxMap_[*protIt]);
-        if (seenProteinIdxs.find(proteinIdx) == seenProteinIdxs.end()) {
-          seenProteinIdxs.insert(proteinIdx);
-        }
-      }
+      unsigned int proteinIdx = proteinSymbolToIdx_[*protIt];
+      if (proteinIdx != kNoProtein) proteinIdxs.push_back(proteinIdx);
     }
+    std::sort(proteinIdxs.begin(), proteinIdxs.end());
+    proteinIdxs.erase(std::unique(proteinIdxs.begin(), proteinIdxs.end()), 
+                      proteinIdxs.end());
     
-    bool isUnique = (seenProteinIdxs.size() == 1);
-    unsigned int psmCount = peptideSpecCounts_[psm->pPSM->getPeptideSequence()];
-    std::set<unsigned int>::const_iterator protIdxIt = seenProteinIdxs.begin();
-    for (; protIdxIt != seenProteinIdxs.end(); ++protIdxIt) {
+    bool isUnique = (proteinIdxs.size() == 1);
+    unsigned int peptideId = peptides.find(psm->pPSM->getPeptideSequence());
+    unsigned int psmCount = (peptideId == SymbolTable::kNoSymbol) ? 
+                                0u : peptideSpecCounts[peptideId];
+    std::vector<unsigned int>::const_iterator protIdxIt = proteinIdxs.begin();
+    for (; protIdxIt != proteinIdxs.end(); ++protIdxIt) {
       proteins_[*protIdxIt].addSpecCounts(psmCount, isUnique);
     }
   }
@@ -460,7 +510,7 @@ void ProteinProbEstimator::writeOutputToXML(string xmlOutputFN, bool outputDecoy
 	      os << "      <p_value>" << scientific << myP->getP() << "</p_value>\n";
 	    }
 	  
-	    const std::vector<ProteinScoreHolder::Peptide> peptides = myP->getPeptidesByRef();
+	    const std::vector<ProteinScoreHolder::Peptide>& peptides = myP->getPeptidesByRef();
 	    for (std::vector<ProteinScoreHolder::Peptide>::const_iterator peptIt = peptides.begin(); 
 	        peptIt != peptides.end(); peptIt++) {
 	      if (peptIt->name != "") {
@@ -490,10 +540,10 @@ void ProteinProbEstimator::print(ostream& myout, bool decoy) {
       if (specCountQvalThreshold_ > 0.0) {
         myout << myP->getSpecCountsUnique() << "\t" << myP->getSpecCountsAll() << "\t";
       }
-      const std::vector<ProteinScoreHolder::Peptide> peptides = myP->getPeptidesByRef();
+      const std::vector<ProteinScoreHolder::Peptide>& peptides = myP->getPeptidesByRef();
       std::vector<ProteinScoreHolder::Peptide>::const_iterator peptIt = peptides.begin();
       for(; peptIt != peptides.end(); peptIt++) {
-        if (peptIt->name != "") {
+        if (!peptIt->name.empty()) {
           myout << peptIt->name << " ";
         }
       }
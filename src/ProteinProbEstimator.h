@@ -21,11 +21,13 @@
 #include <functional>
 #include <numeric>
 #include <iterator>
+#include <algorithm>
 #include <string>
 #include <vector>
 #include <cmath>
 #include <iostream>
 #include <fstream>
+#include <climits>
 
 #include "Globals.h"
 #include "ProteinFDRestimator.h"
@@ -194,6 +196,15 @@ class ProteinProbEstimator {
   bool isTarget(const std::string& proteinName);
   bool isDecoy(const std::string& proteinName);
   
+  /** decoy status and index into proteins_ of the protein symbols of 
+   * PSMDescription, such that the passes over the PSMs need no string 
+   * lookups **/
+  void markDecoyProteinSymbols();
+  void indexProteinSymbols();
+  inline bool isDecoyProteinSymbol(unsigned int proteinSymbol) const {
+    return decoyProteinSymbols_[proteinSymbol];
+  }
+  
   /** print a tab delimited list of proteins probabilities in a file or stdout**/
   void print(ostream& myout, bool decoy=false);
   
@@ -231,6 +242,10 @@ class ProteinProbEstimator {
   std::vector<ProteinScoreHolder> proteins_;
   std::map<std::string, size_t> proteinToIdxMap_;
   
+  static const unsigned int kNoProtein = UINT_MAX;
+  std::vector<unsigned int> proteinSymbolToIdx_;
+  std::vector<bool> decoyProteinSymbols_;
+  
   /** protein groups are either present or absent and cannot be partially present **/
   bool trivialGrouping_;
   
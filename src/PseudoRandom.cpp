@@ -22,6 +22,23 @@ uint64_t PseudoRandom::seed_ = 1u;
 // Park–Miller random number generator
 // from wikipedia
 unsigned long PseudoRandom::lcg_rand() {
-  seed_ = (seed_ * 279470273u) % 4294967291u;
+  seed_ = (seed_ * kMultiplier) % kRandMax;
   return seed_;
 }
+
+unsigned long PseudoRandom::Stream::lcg_rand() {
+  state_ = (state_ * kMultiplier) % kRandMax;
+  return state_;
+}
+
+// state * kMultiplier^n mod kRandMax, by square and multiply; all factors 
+// are below 2^32 so the products fit in 64 bits
+uint64_t PseudoRandom::skipAhead(uint64_t state, uint64_t n) {
+  uint64_t factor = kMultiplier;
+  while (n > 0) {
+    if (n & 1u) state = (state * factor) % kRandMax;
+    factor = (factor * factor) % kRandMax;
+    n >>= 1;
+  }
+  return state;
+}
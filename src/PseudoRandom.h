@@ -32,8 +32,27 @@ class PseudoRandom {
   inline static void setSeed(unsigned long s) { seed_ = s; }
   static unsigned long lcg_rand();
   const static uint64_t kRandMax = 4294967291u;
+  
+  /*
+  * Stream is an independent copy of the generator that yields the same 
+  * numbers lcg_rand would yield after the given number of calls, so that 
+  * threads can each draw their own part of the sequence.
+  */
+  class Stream {
+   public:
+    explicit Stream(uint64_t offset) : state_(skipAhead(seed_, offset)) {}
+    unsigned long lcg_rand();
+   protected:
+    uint64_t state_;
+  };
+  
+  // advances the shared generator as if lcg_rand was called n times
+  inline static void skip(uint64_t n) { seed_ = skipAhead(seed_, n); }
  protected:
   static uint64_t seed_;
+  static const uint64_t kMultiplier = 279470273u;
+  
+  static uint64_t skipAhead(uint64_t state, uint64_t n);
 };
 
 
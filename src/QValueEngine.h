@@ -0,0 +1,224 @@
+/*******************************************************************************
+ Copyright 2006-2012 Lukas Käll <lukas.kall@scilifelab.se>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+
+ *******************************************************************************/
+#ifndef QVALUE_ENGINE_H_
+#define QVALUE_ENGINE_H_
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <iostream>
+
+#include "Globals.h"
+
+/*
+* QValueTraits<T> tells QValueEngine how to read the score and label of an 
+* element of a sorted list. It is specialized for (score, isTarget) pairs 
+* here, and for the ScoreHolders and sort keys of Scores in Scores.cpp.
+*/
+template<class T> struct QValueTraits;
+
+template<> struct QValueTraits< std::pair<double, bool> > {
+  static inline bool isTarget(const std::pair<double, bool>& x) { 
+    return x.second; 
+  }
+  static inline bool sameScore(const std::pair<double, bool>& x, 
+                               const std::pair<double, bool>& y) {
+    return x.first == y.first;
+  }
+};
+
+/*
+* QValueEngine
+*
+* Target-decoy q-values of a list of PSMs, peptides or proteins sorted by 
+* descending score, including the mix-max correction for pi0 < 1, which is a
+* reimplementation of
+*   Crux/src/app/AssignConfidenceApplication.cpp::compute_decoy_qvalues_mixmax
+* which itself was a reimplementation of Uri Keich's code written in R.
+*
+* The counts of targets and decoys with lower scores that the mix-max 
+* correction needs follow from the totals and the running counts, so the 
+* FDRs are calculated in a single pass down the list. The q-values are kept 
+* in a buffer that is reused by subsequent calls on the same engine. 
+* countPositives only determines the number of targets below a q-value 
+* threshold and stops as soon as no lower FDR can follow.
+*
+* If pi0 == 1.0 this is equal to the "traditional" q-value calculation.
+*
+*/
+class QValueEngine {
+ public:
+  QValueEngine() : skipDecoysPlusOne_(false), includeDecoys_(false) {}
+  
+  // leave out the +1 of the decoy count in the FDR estimates
+  void setSkipDecoysPlusOne(bool skip) { skipDecoysPlusOne_ = skip; }
+  // also report q-values for the decoys, otherwise only for the targets
+  void setIncludeDecoys(bool include) { includeDecoys_ = include; }
+  
+  template<class T> 
+  const std::vector<double>& calcQValues(const std::vector<T>& sorted, 
+                                         double pi0);
+  template<class T> 
+  int countPositives(const std::vector<T>& sorted, double pi0, 
+                     double fdr) const;
+  
+  const std::vector<double>& getQValues() const { return qvals_; }
+  
+ protected:
+  bool skipDecoysPlusOne_, includeDecoys_;
+  std::vector<double> qvals_;
+  
+  // running counts down the list, one group of tied scores at a time
+  class FdrCounter {
+   public:
+    FdrCounter(double pi0, int totalTargets, int totalDecoys, 
+               bool skipDecoysPlusOne) : pi0_(pi0), 
+      totalTargets_(totalTargets), totalDecoys_(totalDecoys),
+      numTargets_(0), numDecoys_(0), 
+      decoyCount_(skipDecoysPlusOne ? 0 : 1), mixMaxDecoys_(0.0) {}
+    
+    // FDR of the list down to and including the next group of ties
+    double addGroup(int groupTargets, int groupDecoys) {
+      if (pi0_ < 1.0 && groupDecoys > 0) {
+        // targets and decoys scoring at most as high as this group
+        int cnt_w = totalTargets_ - numTargets_;
+        int cnt_z = totalDecoys_ - numDecoys_;
+        double estPx_lt_zj = (double)(cnt_w - pi0_*cnt_z) / ((1.0 - pi0_)*cnt_z);
+        estPx_lt_zj = estPx_lt_zj > 1 ? 1 : estPx_lt_zj;
+        estPx_lt_zj = estPx_lt_zj < 0 ? 0 : estPx_lt_zj;
+        mixMaxDecoys_ += groupDecoys * estPx_lt_zj * (1.0 - pi0_);
+        if (VERB > 4) {
+          std::cerr << "Mix-max num negatives correction: "
+            << (1.0-pi0_) * (decoyCount_ + groupDecoys) << " vs. " 
+            << mixMaxDecoys_ << std::endl;
+        }
+      }
+      numTargets_ += groupTargets;
+      numDecoys_ += groupDecoys;
+      decoyCount_ += groupDecoys;
+      double fdr = (decoyCount_ * pi0_ + mixMaxDecoys_) / 
+                       (double)((std::max)(1, numTargets_));
+      return (std::min)(fdr, 1.0);
+    }
+    
+    // lower bound on the FDR of any longer part of the list
+    double minFutureFdr() const {
+      return (std::min)(decoyCount_ * pi0_ / 
+                            (double)((std::max)(1, totalTargets_)), 1.0);
+    }
+    
+    inline int numTargets() const { return numTargets_; }
+    
+   private:
+    double pi0_;
+    int totalTargets_, totalDecoys_;
+    int numTargets_, numDecoys_; // seen so far
+    int decoyCount_; // numDecoys_, plus one unless skipDecoysPlusOne
+    double mixMaxDecoys_; // expected number of incorrect targets from mix-max
+  };
+  
+  template<class T> 
+  static void countLabels(const std::vector<T>& sorted, int& numTargets, 
+                          int& numDecoys);
+};
+
+template<class T> 
+void QValueEngine::countLabels(const std::vector<T>& sorted, int& numTargets,
+                               int& numDecoys) {
+  numTargets = 0;
+  for (std::size_t ix = 0; ix < sorted.size(); ++ix) {
+    if (QValueTraits<T>::isTarget(sorted[ix])) ++numTargets;
+  }
+  numDecoys = static_cast<int>(sorted.size()) - numTargets;
+}
+
+/**
+ * Calculates the q-values of a list sorted by descending score
+ * @return the q-values, in the order of the list, of all elements or only of
+ *         the targets, see setIncludeDecoys
+ */
+template<class T> 
+const std::vector<double>& QValueEngine::calcQValues(
+    const std::vector<T>& sorted, double pi0) {
+  int totalTargets = 0, totalDecoys = 0;
+  if (pi0 < 1.0) countLabels(sorted, totalTargets, totalDecoys);
+  FdrCounter counter(pi0, totalTargets, totalDecoys, skipDecoysPlusOne_);
+  
+  const std::size_t numScores = sorted.size();
+  qvals_.resize(numScores);
+  std::size_t numQvals = 0u;
+  int groupTargets = 0, groupDecoys = 0;
+  for (std::size_t ix = 0; ix < numScores; ++ix) {
+    if (QValueTraits<T>::isTarget(sorted[ix])) {
+      ++groupTargets;
+    } else {
+      ++groupDecoys;
+    }
+    if (ix + 1u == numScores || 
+          !QValueTraits<T>::sameScore(sorted[ix], sorted[ix + 1u])) {
+      double fdr = counter.addGroup(groupTargets, groupDecoys);
+      int groupSize = includeDecoys_ ? groupTargets + groupDecoys : groupTargets;
+      for (int i = 0; i < groupSize; ++i) qvals_[numQvals++] = fdr;
+      groupTargets = 0;
+      groupDecoys = 0;
+    }
+  }
+  qvals_.resize(numQvals);
+  
+  // Convert the FDRs into q-values.
+  for (std::size_t ix = numQvals; ix-- > 1u; ) {
+    if (qvals_[ix - 1u] > qvals_[ix]) qvals_[ix - 1u] = qvals_[ix];
+  }
+  return qvals_;
+}
+
+/**
+ * Counts the targets with a q-value below fdr in a list sorted by descending
+ * score, without storing the q-values. These are the targets down to the 
+ * last group of ties with an FDR below the threshold, so the pass can stop 
+ * as soon as the FDR cannot drop below the threshold anymore.
+ */
+template<class T> 
+int QValueEngine::countPositives(const std::vector<T>& sorted, double pi0, 
+                                 double fdr) const {
+  int totalTargets = 0, totalDecoys = 0;
+  countLabels(sorted, totalTargets, totalDecoys);
+  FdrCounter counter(pi0, totalTargets, totalDecoys, skipDecoysPlusOne_);
+  
+  const std::size_t numScores = sorted.size();
+  int numPos = 0, groupTargets = 0, groupDecoys = 0;
+  for (std::size_t ix = 0; ix < numScores; ++ix) {
+    if (QValueTraits<T>::isTarget(sorted[ix])) {
+      ++groupTargets;
+    } else {
+      ++groupDecoys;
+    }
+    if (ix + 1u == numScores || 
+          !QValueTraits<T>::sameScore(sorted[ix], sorted[ix + 1u])) {
+      if (counter.addGroup(groupTargets, groupDecoys) < fdr) {
+        numPos = counter.numTargets();
+      } else if (fdr <= 1.0 && counter.minFutureFdr() >= fdr) {
+        break;
+      }
+      groupTargets = 0;
+      groupDecoys = 0;
+    }
+  }
+  return numPos;
+}
+
+#endif /* QVALUE_ENGINE_H_ */
@@ -27,7 +27,9 @@
 #include <vector>
 #include <string>
 #include <cmath>
+#include <cstring>
 #include <memory>
+#include <queue>
 
 #include "DataSet.h"
 #include "Normalizer.h"
@@ -35,13 +37,33 @@
 #include "Scores.h"
 #include "Globals.h"
 #include "PosteriorEstimator.h"
+#include "QValueEngine.h"
 #include "ssl.h"
 #include "MassHandler.h"
+#include "TempFile.h"
 
 #ifdef CRUX
 #include "app/PercolatorAdapter.h"
 #endif
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// The vectorized scoring kernels are compiled for AVX2 and AVX-512 through
+// function attributes and selected at runtime, so that the binary still runs
+// on older CPUs. Fused multiply-adds are disabled to keep the scores
+// identical to the ones of the scalar kernel.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  #include <immintrin.h>
+  #define SCORES_SIMD_DISPATCH
+  #ifdef __clang__
+    #define SCORES_TARGET(isa) __attribute__((target(isa)))
+  #else
+    #define SCORES_TARGET(isa) __attribute__((target(isa), optimize("fp-contract=off")))
+  #endif
+#endif
+
 inline bool operator>(const ScoreHolder& one, const ScoreHolder& other) {
   return (one.score > other.score) 
       || (one.score == other.score && one.pPSM->scan > other.pPSM->scan) 
@@ -106,9 +128,9 @@ void ScoreHolder::printPSM(ostream& os, bool printDecoys, bool printExpMass) {
       os << "      <peptide_seq n=\"" << n << "\" c=\"" << c << "\" seq=\"" << centpep << "\"/>" << endl;
     }
     
-    std::vector<std::string>::const_iterator pidIt = pPSM->proteinIds.begin();
+    std::vector<unsigned int>::const_iterator pidIt = pPSM->proteinIds.begin();
     for ( ; pidIt != pPSM->proteinIds.end() ; ++pidIt) {
-      os << "      <protein_id>" << getRidOfUnprintablesAndUnicode(*pidIt) << "</protein_id>" << endl;
+      os << "      <protein_id>" << getRidOfUnprintablesAndUnicode(PSMDescription::getProteinName(*pidIt)) << "</protein_id>" << endl;
     }
     
     os << "      <p_value>" << scientific << p << "</p_value>" <<endl;
@@ -136,9 +158,9 @@ void ScoreHolder::printPeptide(ostream& os, bool printDecoys, bool printExpMass,
     }
     os << "      <calc_mass>" << fixed << setprecision (3)  << pPSM->calcMass << "</calc_mass>" << endl;
     
-    std::vector<std::string>::const_iterator pidIt = pPSM->proteinIds.begin();
+    std::vector<unsigned int>::const_iterator pidIt = pPSM->proteinIds.begin();
     for ( ; pidIt != pPSM->proteinIds.end() ; ++pidIt) {
-      os << "      <protein_id>" << getRidOfUnprintablesAndUnicode(*pidIt) << "</protein_id>" << endl;
+      os << "      <protein_id>" << getRidOfUnprintablesAndUnicode(PSMDescription::getProteinName(*pidIt)) << "</protein_id>" << endl;
     }
     
     os << "      <p_value>" << scientific << p << "</p_value>" <<endl;
@@ -154,10 +176,326 @@ void ScoreHolder::printPeptide(ostream& os, bool printDecoys, bool printExpMass,
   }
 }
 
+ScoreColumns::ScoreColumns(const std::vector<ScoreHolder>& scores) {
+  *this = ScoreColumns(scores.begin(), scores.end());
+}
+
+ScoreColumns::ScoreColumns(std::vector<ScoreHolder>::const_iterator first,
+                           std::vector<ScoreHolder>::const_iterator last) {
+  std::size_t numScores = static_cast<std::size_t>(last - first);
+  score.resize(numScores);
+  expMass.resize(numScores);
+  scan.resize(numScores);
+  label.resize(numScores);
+  for (std::size_t ix = 0; ix < numScores; ++ix, ++first) {
+    score[ix] = first->score;
+    expMass[ix] = first->pPSM->expMass;
+    scan[ix] = first->pPSM->scan;
+    label[ix] = first->label;
+  }
+}
+
+std::size_t Scores::maxSortMemory_ = 0u;
+const std::size_t Scores::kMinSortRunSize;
+
+namespace {
+
+// The order of equivalent elements after std::sort in the parallel mode of 
+// libstdc++ depends on the number of threads. It decides which PSMs end up
+// next to each other in the SVM training sets, and which PSM represents a
+// peptide, so these sorts are done sequentially.
+template<class RandomIt, class Compare>
+inline void sortSequential(RandomIt first, RandomIt last, Compare comp) {
+#ifdef _GLIBCXX_PARALLEL
+  std::sort(first, last, comp, __gnu_parallel::sequential_tag());
+#else
+  std::sort(first, last, comp);
+#endif
+}
+
+}
+
+/**
+ * Reorders scores_ such that scores_[ix] becomes the old scores_[order[ix]]
+ */
+void Scores::permute(const std::vector<unsigned int>& order) {
+  std::vector<ScoreHolder> permuted;
+  permuted.reserve(order.size());
+  std::vector<unsigned int>::const_iterator it = order.begin();
+  for ( ; it != order.end(); ++it) {
+    permuted.push_back(scores_[*it]);
+  }
+  scores_.swap(permuted);
+}
+
+/**
+ * Same as permute, but follows the cycles of the permutation instead of 
+ * copying scores_. The order may select a subset of the ScoreHolders, in 
+ * which case the others are removed; it is extended in the process.
+ */
+void Scores::permuteInPlace(std::vector<unsigned int>& order) {
+  std::size_t numSelected = order.size();
+  std::vector<bool> done(scores_.size(), false);
+  for (std::size_t ix = 0; ix < numSelected; ++ix) {
+    done[order[ix]] = true;
+  }
+  for (std::size_t ix = 0; ix < scores_.size(); ++ix) {
+    if (!done[ix]) order.push_back(static_cast<unsigned int>(ix));
+  }
+  done.assign(scores_.size(), false);
+  for (std::size_t start = 0; start < order.size(); ++start) {
+    if (done[start]) continue;
+    ScoreHolder first = scores_[start];
+    std::size_t ix = start;
+    while (order[ix] != start) {
+      scores_[ix] = scores_[order[ix]];
+      done[ix] = true;
+      ix = order[ix];
+    }
+    scores_[ix] = first;
+    done[ix] = true;
+  }
+  scores_.resize(numSelected);
+}
+
+/**
+ * Checks whether sorting scores_ in memory, i.e. the ScoreColumns, the index
+ * order and the permuted copy of the ScoreHolders, would take more memory 
+ * than allowed by setMaxSortMemory.
+ */
+bool Scores::exceedsMaxSortMemory() const {
+  const std::size_t bytesPerScore = sizeof(ScoreHolder) + 2u * sizeof(double) +
+      2u * sizeof(unsigned int) + sizeof(int);
+  return maxSortMemory_ > 0u && scores_.size() > maxSortMemory_ / bytesPerScore;
+}
+
+namespace {
+
+// the fields of a ScoreHolder that the ScoreColumns comparators compare on,
+// as written to the sorted runs of Scores::sortOnDisk
+struct ScoreRecord {
+  double score, expMass;
+  unsigned int scan;
+  int label;
+  unsigned int index;
+  unsigned int padding;
+};
+
+// breaks the ties of Order on the index, which makes the order of the 
+// ScoreHolders well-defined, independently of the sort algorithm. In the 
+// merge of sortOnDisk the heads are indexed by run, and earlier runs hold 
+// the lower indices. Only used when a sort memory budget is set, such that 
+// the order of ties without --max-sort-memory stays that of std::sort.
+template<class Order> struct IndexTieBreak {
+  Order order;
+  explicit IndexTieBreak(const ScoreColumns& columns) : order(columns) {}
+  bool operator()(unsigned int x, unsigned int y) const {
+    return order(x, y) || (!order(y, x) && x < y);
+  }
+};
+
+struct ScoreRun {
+  uint64_t offset; // of the next record in the TempFile
+  std::size_t numLeft; // records in the file after offset
+  std::vector<ScoreRecord> buffer;
+  std::size_t bufferPos;
+};
+
+// orders the runs such that a priority queue returns the run with the 
+// smallest head first, or the earliest run among equivalent heads
+template<class Order> struct LaterRun {
+  IndexTieBreak<Order> order;
+  explicit LaterRun(const ScoreColumns& heads) : order(heads) {}
+  bool operator()(unsigned int x, unsigned int y) const {
+    return order(y, x);
+  }
+};
+
+// reads the next record of a run, refilling its buffer from the file
+bool nextRecord(TempFile& runFile, ScoreRun& run, std::size_t bufferSize,
+                ScoreRecord& record) {
+  if (run.bufferPos == run.buffer.size()) {
+    if (run.numLeft == 0u) return false;
+    std::size_t numRead = std::min(bufferSize, run.numLeft);
+    run.buffer.resize(numRead);
+    runFile.read(run.offset, &run.buffer[0], numRead * sizeof(ScoreRecord));
+    run.offset += numRead * sizeof(ScoreRecord);
+    run.numLeft -= numRead;
+    run.bufferPos = 0u;
+  }
+  record = run.buffer[run.bufferPos++];
+  return true;
+}
+
+void setHead(ScoreColumns& heads, std::vector<unsigned int>& headIndex,
+             std::size_t run, const ScoreRecord& record) {
+  heads.score[run] = record.score;
+  heads.expMass[run] = record.expMass;
+  heads.scan[run] = record.scan;
+  heads.label[run] = record.label;
+  headIndex[run] = record.index;
+}
+
+// Same comparator for sortOnDisk without deduplication
+struct NeverSame {
+  explicit NeverSame(const ScoreColumns&) {}
+  bool operator()(unsigned int, unsigned int) const { return false; }
+};
+
+// fills order with the indices of columns in sorted order, breaking ties on
+// the index if breakTies is set
+template<class Order> 
+void sortIndices(const ScoreColumns& columns, std::size_t size, bool breakTies,
+                 std::vector<unsigned int>& order) {
+  order.resize(size);
+  for (std::size_t ix = 0; ix < order.size(); ++ix) {
+    order[ix] = static_cast<unsigned int>(ix);
+  }
+  if (breakTies) {
+    sortSequential(order.begin(), order.end(), IndexTieBreak<Order>(columns));
+  } else {
+    sortSequential(order.begin(), order.end(), Order(columns));
+  }
+}
+
+} // namespace
+
+/**
+ * External merge sort of scores_, for when sorting in memory would exceed
+ * maxSortMemory_. Runs of ScoreHolders that fit into the budget are sorted 
+ * and written as ScoreRecords to a temporary file, after which the runs are 
+ * merged with the same comparator. Ties are broken on the index in both 
+ * steps, so the order is the same as that of the sorts in memory with a 
+ * budget set.
+ * @param order filled with the indices of scores_ in sorted order
+ * @param unique keep only the first of each group of elements that are the 
+ *        same according to Same, like std::unique
+ */
+template<class Order, class Same> 
+void Scores::sortOnDisk(std::vector<unsigned int>& order, bool unique) const {
+  const std::size_t bytesPerRecord = sizeof(ScoreRecord) + 
+      2u * sizeof(double) + 2u * sizeof(unsigned int) + sizeof(int);
+  const std::size_t runSize = std::max(kMinSortRunSize, 
+                                       maxSortMemory_ / bytesPerRecord);
+  TempFile runFile;
+  std::vector<ScoreRun> runs;
+  std::vector<unsigned int> runOrder;
+  std::vector<ScoreRecord> records;
+  for (std::size_t first = 0; first < scores_.size(); first += runSize) {
+    std::size_t last = std::min(first + runSize, scores_.size());
+    ScoreColumns columns(scores_.begin() + static_cast<std::ptrdiff_t>(first), 
+                         scores_.begin() + static_cast<std::ptrdiff_t>(last));
+    runOrder.resize(last - first);
+    for (std::size_t ix = 0; ix < runOrder.size(); ++ix) {
+      runOrder[ix] = static_cast<unsigned int>(ix);
+    }
+    sortSequential(runOrder.begin(), runOrder.end(), 
+                   IndexTieBreak<Order>(columns));
+    records.resize(runOrder.size());
+    for (std::size_t ix = 0; ix < runOrder.size(); ++ix) {
+      unsigned int local = runOrder[ix];
+      ScoreRecord& record = records[ix];
+      record.score = columns.score[local];
+      record.expMass = columns.expMass[local];
+      record.scan = columns.scan[local];
+      record.label = columns.label[local];
+      record.index = static_cast<unsigned int>(first) + local;
+      record.padding = 0u;
+    }
+    ScoreRun run;
+    run.offset = runFile.append(&records[0], records.size() * sizeof(ScoreRecord));
+    run.numLeft = records.size();
+    run.bufferPos = 0u;
+    runs.push_back(run);
+  }
+  std::vector<ScoreRecord>().swap(records);
+  
+  if (VERB > 2) {
+    std::cerr << "Sorting " << scores_.size() << " PSMs by merging " 
+              << runs.size() << " sorted runs from a temporary file" << std::endl;
+  }
+  
+  // the last slot of heads holds the last record in the output, for unique
+  const std::size_t numRuns = runs.size();
+  const std::size_t bufferSize = std::max<std::size_t>(256u, 
+      maxSortMemory_ / (std::max<std::size_t>(numRuns, 1u) * sizeof(ScoreRecord)));
+  ScoreColumns heads(numRuns + 1u);
+  Same sameHead(heads);
+  std::vector<unsigned int> headIndex(numRuns);
+  std::priority_queue<unsigned int, std::vector<unsigned int>, 
+                      LaterRun<Order> > queue((LaterRun<Order>(heads)));
+  ScoreRecord record;
+  for (std::size_t r = 0; r < numRuns; ++r) {
+    if (nextRecord(runFile, runs[r], bufferSize, record)) {
+      setHead(heads, headIndex, r, record);
+      queue.push(static_cast<unsigned int>(r));
+    }
+  }
+  
+  const unsigned int lastOut = static_cast<unsigned int>(numRuns);
+  order.clear();
+  order.reserve(scores_.size());
+  while (!queue.empty()) {
+    unsigned int r = queue.top();
+    queue.pop();
+    if (!unique || order.empty() || !sameHead(lastOut, r)) {
+      order.push_back(headIndex[r]);
+      heads.copy(lastOut, r);
+    }
+    if (nextRecord(runFile, runs[r], bufferSize, record)) {
+      setHead(heads, headIndex, r, record);
+      queue.push(r);
+    }
+  }
+}
+
+/**
+ * Sorts scores_ with one of the ScoreColumns comparators. With a sort memory
+ * budget, ties are broken on the position in scores_, like a stable sort, 
+ * such that the result is the same as that of sortOnDisk.
+ */
+template<class Order> void Scores::sortByColumns() {
+  std::vector<unsigned int> order;
+  if (exceedsMaxSortMemory()) {
+    sortOnDisk<Order, NeverSame>(order, false);
+    permuteInPlace(order);
+    return;
+  }
+  ScoreColumns columns(scores_);
+  sortIndices<Order>(columns, scores_.size(), maxSortMemory_ > 0u, order);
+  permute(order);
+}
+
+/**
+ * Sorts scores_ and moves the first element of each group of equal elements
+ * to the front, like std::sort followed by std::unique.
+ * @return iterator to the new end of the unique elements in scores_
+ */
+template<class Order, class Same> 
+std::vector<ScoreHolder>::iterator Scores::sortAndUniqueByColumns() {
+  std::vector<unsigned int> order;
+  if (exceedsMaxSortMemory()) {
+    // the duplicates are removed from scores_ right away
+    sortOnDisk<Order, Same>(order, true);
+    permuteInPlace(order);
+    return scores_.end();
+  }
+  ScoreColumns columns(scores_);
+  sortIndices<Order>(columns, scores_.size(), maxSortMemory_ > 0u, order);
+  std::size_t numUnique = static_cast<std::size_t>(std::unique(order.begin(), 
+      order.end(), Same(columns)) - order.begin());
+  permute(order);
+  return scores_.begin() + numUnique;
+}
+
+void Scores::sortByScore() {
+  sortByColumns<ScoreColumns::Greater>();
+}
+
 void Scores::merge(std::vector<Scores>& sv, double fdr, bool skipNormalizeScores) {
   scores_.clear();
   for (std::vector<Scores>::iterator a = sv.begin(); a != sv.end(); a++) {
-    sort(a->begin(), a->end(), greater<ScoreHolder> ());
+    a->sortByScore();
     a->checkSeparationAndSetPi0();
     a->calcQ(fdr);
     if (!skipNormalizeScores) {
@@ -169,7 +507,7 @@ void Scores::merge(std::vector<Scores>& sv, double fdr, bool skipNormalizeScores
 }
 
 void Scores::postMergeStep() {
-  sort(scores_.begin(), scores_.end(), greater<ScoreHolder> ());
+  sortByScore();
   totalNumberOfDecoys_ = static_cast<unsigned int>(count_if(scores_.begin(),
       scores_.end(),
       mem_fn(&ScoreHolder::isDecoy)));
@@ -199,6 +537,211 @@ double Scores::calcScore(const double* feat, const std::vector<double>& w) const
   return score;
 }
 
+/*
+ * Batched scoring kernels. Each kernel computes the scores of several rows at
+ * once, one row per vector lane, so that every lane performs exactly the same
+ * sequence of operations as calcScore: starting from the bias term, the 
+ * features are multiplied and added from the last to the first.
+ */
+namespace {
+
+void scoreRowsScalar(const double* const* rows, std::size_t numRows,
+                     const double* w, std::size_t numFeatures, double* scores) {
+  for (std::size_t i = 0; i < numRows; ++i) {
+    const double* feat = rows[i];
+    double score = w[numFeatures];
+    for (std::size_t ix = numFeatures; ix--;) {
+      score += feat[ix] * w[ix];
+    }
+    scores[i] = score;
+  }
+}
+
+#ifdef SCORES_SIMD_DISPATCH
+// loads features ix..ix+3 of 4 rows and transposes them into one vector per feature
+SCORES_TARGET("avx2") inline void loadColumns4(const double* const* rows, 
+    std::size_t ix, __m256d& c0, __m256d& c1, __m256d& c2, __m256d& c3) {
+  __m256d a0 = _mm256_loadu_pd(rows[0] + ix);
+  __m256d a1 = _mm256_loadu_pd(rows[1] + ix);
+  __m256d a2 = _mm256_loadu_pd(rows[2] + ix);
+  __m256d a3 = _mm256_loadu_pd(rows[3] + ix);
+  __m256d t0 = _mm256_unpacklo_pd(a0, a1);
+  __m256d t1 = _mm256_unpackhi_pd(a0, a1);
+  __m256d t2 = _mm256_unpacklo_pd(a2, a3);
+  __m256d t3 = _mm256_unpackhi_pd(a2, a3);
+  c0 = _mm256_permute2f128_pd(t0, t2, 0x20);
+  c1 = _mm256_permute2f128_pd(t1, t3, 0x20);
+  c2 = _mm256_permute2f128_pd(t0, t2, 0x31);
+  c3 = _mm256_permute2f128_pd(t1, t3, 0x31);
+}
+
+// two groups of 4 rows, giving two independent dependency chains
+SCORES_TARGET("avx2") void scoreRowsAvx2(const double* const* rows, 
+    std::size_t numRows, const double* w, std::size_t numFeatures, 
+    double* scores) {
+  std::size_t i = 0;
+  for (; i + 8u <= numRows; i += 8u) {
+    const double* const* r = rows + i;
+    __m256d acc0 = _mm256_set1_pd(w[numFeatures]);
+    __m256d acc1 = acc0;
+    std::size_t ix = numFeatures;
+    while (ix >= 4u) {
+      ix -= 4u;
+      __m256d c0, c1, c2, c3, d0, d1, d2, d3;
+      loadColumns4(r, ix, c0, c1, c2, c3);
+      loadColumns4(r + 4, ix, d0, d1, d2, d3);
+      __m256d wv = _mm256_set1_pd(w[ix + 3u]);
+      acc0 = _mm256_add_pd(acc0, _mm256_mul_pd(c3, wv));
+      acc1 = _mm256_add_pd(acc1, _mm256_mul_pd(d3, wv));
+      wv = _mm256_set1_pd(w[ix + 2u]);
+      acc0 = _mm256_add_pd(acc0, _mm256_mul_pd(c2, wv));
+      acc1 = _mm256_add_pd(acc1, _mm256_mul_pd(d2, wv));
+      wv = _mm256_set1_pd(w[ix + 1u]);
+      acc0 = _mm256_add_pd(acc0, _mm256_mul_pd(c1, wv));
+      acc1 = _mm256_add_pd(acc1, _mm256_mul_pd(d1, wv));
+      wv = _mm256_set1_pd(w[ix]);
+      acc0 = _mm256_add_pd(acc0, _mm256_mul_pd(c0, wv));
+      acc1 = _mm256_add_pd(acc1, _mm256_mul_pd(d0, wv));
+    }
+    while (ix > 0u) {
+      --ix;
+      __m256d wv = _mm256_set1_pd(w[ix]);
+      acc0 = _mm256_add_pd(acc0, _mm256_mul_pd(
+          _mm256_set_pd(r[3][ix], r[2][ix], r[1][ix], r[0][ix]), wv));
+      acc1 = _mm256_add_pd(acc1, _mm256_mul_pd(
+          _mm256_set_pd(r[7][ix], r[6][ix], r[5][ix], r[4][ix]), wv));
+    }
+    _mm256_storeu_pd(scores + i, acc0);
+    _mm256_storeu_pd(scores + i + 4, acc1);
+  }
+  scoreRowsScalar(rows + i, numRows - i, w, numFeatures, scores + i);
+}
+
+SCORES_TARGET("avx512f") inline __m512d combineColumns(__m256d lo, __m256d hi) {
+  return _mm512_insertf64x4(_mm512_castpd256_pd512(lo), hi, 1);
+}
+
+// two groups of 8 rows, each built from two transposed blocks of 4 rows
+SCORES_TARGET("avx512f") void scoreRowsAvx512(const double* const* rows, 
+    std::size_t numRows, const double* w, std::size_t numFeatures, 
+    double* scores) {
+  std::size_t i = 0;
+  for (; i + 16u <= numRows; i += 16u) {
+    const double* const* r = rows + i;
+    __m512d acc0 = _mm512_set1_pd(w[numFeatures]);
+    __m512d acc1 = acc0;
+    std::size_t ix = numFeatures;
+    while (ix >= 4u) {
+      ix -= 4u;
+      __m256d c[4][4];
+      for (int g = 0; g < 4; ++g) {
+        loadColumns4(r + 4 * g, ix, c[g][0], c[g][1], c[g][2], c[g][3]);
+      }
+      for (int k = 3; k >= 0; --k) {
+        __m512d wv = _mm512_set1_pd(w[ix + static_cast<std::size_t>(k)]);
+        acc0 = _mm512_add_pd(acc0, _mm512_mul_pd(combineColumns(c[0][k], c[1][k]), wv));
+        acc1 = _mm512_add_pd(acc1, _mm512_mul_pd(combineColumns(c[2][k], c[3][k]), wv));
+      }
+    }
+    while (ix > 0u) {
+      --ix;
+      __m512d wv = _mm512_set1_pd(w[ix]);
+      acc0 = _mm512_add_pd(acc0, _mm512_mul_pd(_mm512_set_pd(
+          r[7][ix], r[6][ix], r[5][ix], r[4][ix], 
+          r[3][ix], r[2][ix], r[1][ix], r[0][ix]), wv));
+      acc1 = _mm512_add_pd(acc1, _mm512_mul_pd(_mm512_set_pd(
+          r[15][ix], r[14][ix], r[13][ix], r[12][ix], 
+          r[11][ix], r[10][ix], r[9][ix], r[8][ix]), wv));
+    }
+    _mm512_storeu_pd(scores + i, acc0);
+    _mm512_storeu_pd(scores + i + 8, acc1);
+  }
+  scoreRowsAvx2(rows + i, numRows - i, w, numFeatures, scores + i);
+}
+#endif
+
+typedef void (*ScoreRowsKernel)(const double* const*, std::size_t, 
+                                const double*, std::size_t, double*);
+
+ScoreRowsKernel selectScoreRowsKernel() {
+#ifdef SCORES_SIMD_DISPATCH
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) return scoreRowsAvx512;
+  if (__builtin_cpu_supports("avx2")) return scoreRowsAvx2;
+#endif
+  return scoreRowsScalar;
+}
+
+} // namespace
+
+namespace {
+
+// order preserving map of the scores to unsigned integers, in which the 
+// highest score gets the lowest key; -0.0 and 0.0 share the same key
+inline uint64_t descendingScoreBits(double score) {
+  const uint64_t kSignBit = 0x8000000000000000ULL;
+  if (score == 0.0) score = 0.0;
+  uint64_t bits;
+  memcpy(&bits, &score, sizeof(bits));
+  bits = (bits & kSignBit) ? ~bits : (bits | kSignBit);
+  return ~bits;
+}
+
+} // namespace
+
+template<> struct QValueTraits<ScoreHolder> {
+  static inline bool isTarget(const ScoreHolder& sh) { return sh.label > 0; }
+  static inline bool sameScore(const ScoreHolder& a, const ScoreHolder& b) { 
+    return a.score == b.score; 
+  }
+};
+
+template<> struct QValueTraits<ScoreKey> {
+  static inline bool isTarget(const ScoreKey& key) { return key.label > 0; }
+  static inline bool sameScore(const ScoreKey& a, const ScoreKey& b) { 
+    return a.bits == b.bits; 
+  }
+};
+
+const std::size_t Scores::kScoreBlockSize;
+const std::size_t Scores::kParallelSortSize;
+
+/**
+ * Calculates the scores of a batch of feature rows with the fastest kernel 
+ * supported by the CPU. Large batches are split into blocks that are scored
+ * in parallel; from within a parallel region, the blocks are scored as tasks
+ * that idle threads of the team can take over.
+ * @param rows pointers to the feature rows, e.g. PSMDescription::features
+ * @param scores output array with room for numRows scores
+ */
+void Scores::calcScoreBatch(const double* const* rows, std::size_t numRows,
+    const std::vector<double>& w, double* scores) {
+  static const ScoreRowsKernel kernel = selectScoreRowsKernel();
+  const std::size_t numFeatures = FeatureNames::getNumFeatures();
+  const int numBlocks = static_cast<int>((numRows + kScoreBlockSize - 1u) / kScoreBlockSize);
+#ifdef _OPENMP
+  if (numBlocks > 1 && omp_in_parallel()) {
+    const double* weights = &w[0];
+    for (int block = 0; block < numBlocks; ++block) {
+#pragma omp task firstprivate(block, rows, weights, scores)
+      {
+        std::size_t first = static_cast<std::size_t>(block) * kScoreBlockSize;
+        std::size_t numBlockRows = std::min(kScoreBlockSize, numRows - first);
+        kernel(rows + first, numBlockRows, weights, numFeatures, scores + first);
+      }
+    }
+#pragma omp taskwait
+    return;
+  }
+#endif
+#pragma omp parallel for schedule(static) if (numBlocks > 1)
+  for (int block = 0; block < numBlocks; ++block) {
+    std::size_t first = static_cast<std::size_t>(block) * kScoreBlockSize;
+    std::size_t numBlockRows = std::min(kScoreBlockSize, numRows - first);
+    kernel(rows + first, numBlockRows, &w[0], numFeatures, scores + first);
+  }
+}
+
 void Scores::scoreAndAddPSM(ScoreHolder& sh, 
     const std::vector<double>& rawWeights, FeatureMemoryPool& featurePool) {
   const unsigned int numFeatures = static_cast<unsigned int>(FeatureNames::getNumFeatures());
@@ -298,18 +841,13 @@ void Scores::populateWithPSMs(SetHandler& setHandler) {
 }
 
 /**
- * Divides the PSMs from pin file into xval_fold cross-validation sets based on
- * their spectrum scan number
- * @param train vector containing the training sets of PSMs
- * @param test vector containing the test sets of PSMs
- * @param xval_fold: number of folds in train and test
+ * Sorts the PSMs by spectrum and assigns them to xval_fold cross-validation
+ * folds, such that all PSMs of a spectrum end up in the same fold
+ * @param xval_fold number of folds
+ * @param folds fold of each ScoreHolder, in the new order of scores_
  */
-void Scores::createXvalSetsBySpectrum(std::vector<Scores>& train, 
-    std::vector<Scores>& test, const unsigned int xval_fold, 
-    FeatureMemoryPool& featurePool) {
-  // set the number of cross validation folds for train and test to xval_fold
-  train.resize(xval_fold, Scores(usePi0_));
-  test.resize(xval_fold, Scores(usePi0_));
+void Scores::assignXvalFoldsBySpectrum(const unsigned int xval_fold,
+    std::vector<unsigned int>& folds) {
   // remain keeps track of residual space available in each fold
   std::vector<int> remain(xval_fold);
   // set values for remain: initially each fold is assigned (tot number of
@@ -320,19 +858,18 @@ void Scores::createXvalSetsBySpectrum(std::vector<Scores>& train,
     ix -= remain[static_cast<std::size_t>(fold)];
   }
   
-  std::sort(scores_.begin(), scores_.end(), OrderScanMassCharge());
+  sortByColumns<ScoreColumns::OrderScanMassCharge>();
+  folds.resize(scores_.size());
+  if (scores_.empty()) return;
   
   // put scores into the folds; choose a fold (at random) and change it only
   // when scores from a new spectra are encountered
   unsigned int previousSpectrum = scores_.begin()->pPSM->scan;
   size_t randIndex = PseudoRandom::lcg_rand() % xval_fold;
-  for (std::vector<ScoreHolder>::iterator it = scores_.begin(); 
-        it != scores_.end(); ++it) {
-    const unsigned int curScan = (*it).pPSM->scan;
-    const ScoreHolder sh = (*it);
+  for (std::size_t idx = 0; idx < scores_.size(); ++idx) {
+    const unsigned int curScan = scores_[idx].pPSM->scan;
     // if current score is from a different spectra than the one encountered in
     // the previous iteration, choose new fold
-    
     if (previousSpectrum != curScan) {
       randIndex = PseudoRandom::lcg_rand() % xval_fold;
       // allow only indexes of folds that are non-full
@@ -340,19 +877,39 @@ void Scores::createXvalSetsBySpectrum(std::vector<Scores>& train,
         randIndex = PseudoRandom::lcg_rand() % xval_fold;
       }
     }
-    // insert
-    for (unsigned int i = 0; i < xval_fold; ++i) {
-      if (i == randIndex) {
-        test[i].addScoreHolder(sh);
-      } else {
-        train[i].addScoreHolder(sh);
-      }
-    }
+    folds[idx] = static_cast<unsigned int>(randIndex);
     // update number of free position for used fold
     --remain[randIndex];
     // set previous spectrum to current one for next iteration
     previousSpectrum = curScan;
   }
+}
+
+/**
+ * Divides the PSMs from pin file into xval_fold cross-validation sets based on
+ * their spectrum scan number
+ * @param train vector containing the training sets of PSMs
+ * @param test vector containing the test sets of PSMs
+ * @param xval_fold: number of folds in train and test
+ */
+void Scores::createXvalSetsBySpectrum(std::vector<Scores>& train, 
+    std::vector<Scores>& test, const unsigned int xval_fold, 
+    FeatureMemoryPool& featurePool) {
+  // set the number of cross validation folds for train and test to xval_fold
+  train.resize(xval_fold, Scores(usePi0_));
+  test.resize(xval_fold, Scores(usePi0_));
+  
+  std::vector<unsigned int> folds;
+  assignXvalFoldsBySpectrum(xval_fold, folds);
+  for (std::size_t ix = 0; ix < scores_.size(); ++ix) {
+    for (unsigned int i = 0; i < xval_fold; ++i) {
+      if (i == folds[ix]) {
+        test[i].addScoreHolder(scores_[ix]);
+      } else {
+        train[i].addScoreHolder(scores_[ix]);
+      }
+    }
+  }
 
   // calculate ratios of target over decoy for train and test set
   for (unsigned int i = 0; i < xval_fold; ++i) {
@@ -445,12 +1002,29 @@ void Scores::normalizeScores(double fdr) {
  * @return number of true positives
  */
 int Scores::calcScores(std::vector<double>& w, double fdr, bool skipDecoysPlusOne) {
-  std::size_t ix;
-  std::vector<ScoreHolder>::iterator scoreIt = scores_.begin();
-  for ( ; scoreIt != scores_.end(); ++scoreIt) {
-    scoreIt->score = calcScore(scoreIt->pPSM->features, w);
+  std::size_t ix, numScores = scores_.size();
+  std::vector<double> scoreBuffer;
+  std::vector<ScoreKey> keys;
+  calcScoreKeys(w, scoreBuffer, keys);
+  sortScoreKeys(keys);
+  
+  std::vector<ScoreHolder> sortedScores;
+  sortedScores.reserve(numScores);
+  for (ix = 0; ix < numScores; ++ix) {
+    sortedScores.push_back(scores_[keys[ix].index]);
+    sortedScores.back().score = scoreBuffer[keys[ix].index];
+  }
+  // the keys only order on the score, resolve ties like operator> does
+  std::size_t tieEnd;
+  for (ix = 0; ix < numScores; ix = tieEnd) {
+    for (tieEnd = ix + 1u; tieEnd < numScores && 
+                           keys[tieEnd].bits == keys[ix].bits; ++tieEnd) {}
+    if (tieEnd - ix > 1u) {
+      sortSequential(sortedScores.begin() + ix, sortedScores.begin() + tieEnd, 
+                     greater<ScoreHolder> ());
+    }
   }
-  sort(scores_.begin(), scores_.end(), greater<ScoreHolder> ());
+  scores_.swap(sortedScores);
   if (VERB > 3) {
     if (scores_.size() >= 10) {
       cerr << "10 best scores and labels" << endl;
@@ -468,6 +1042,116 @@ int Scores::calcScores(std::vector<double>& w, double fdr, bool skipDecoysPlusOn
   return calcQ(fdr, skipDecoysPlusOne);
 }
 
+/**
+ * Returns the number of positives that calcScores(w, fdr) would return, 
+ * without touching the ScoreHolders
+ */
+int Scores::calcNumPositives(const std::vector<double>& w, double fdr, 
+    bool skipDecoysPlusOne, const ScoreSubset& subset) const {
+  std::vector<double> scoreBuffer;
+  std::vector<ScoreKey> keys;
+  calcScoreKeys(w, scoreBuffer, keys, subset);
+  sortScoreKeys(keys);
+  QValueEngine qvalueEngine;
+  qvalueEngine.setSkipDecoysPlusOne(skipDecoysPlusOne);
+  return qvalueEngine.countPositives(keys, pi0_, fdr);
+}
+
+/**
+ * Scores the ScoreHolders in subset and creates their sort keys; the index
+ * of a key refers to the position in scores, not in scores_
+ */
+void Scores::calcScoreKeys(const std::vector<double>& w, 
+    std::vector<double>& scores, std::vector<ScoreKey>& keys,
+    const ScoreSubset& subset) const {
+  std::vector<const double*> rows;
+  std::vector<int> labels;
+  rows.reserve(scores_.size());
+  labels.reserve(scores_.size());
+  for (std::size_t ix = 0; ix < scores_.size(); ++ix) {
+    if (subset.contains(ix)) {
+      rows.push_back(scores_[ix].pPSM->features);
+      labels.push_back(scores_[ix].label);
+    }
+  }
+  std::size_t numScores = rows.size();
+  scores.resize(numScores);
+  if (numScores > 0u) calcScoreBatch(&rows[0], numScores, w, &scores[0]);
+  keys.resize(numScores);
+  for (std::size_t ix = 0; ix < numScores; ++ix) {
+    keys[ix].bits = descendingScoreBits(scores[ix]);
+    keys[ix].index = static_cast<unsigned int>(ix);
+    keys[ix].label = labels[ix];
+  }
+}
+
+/**
+ * Stable LSD radix sort of the keys on their score bits, 8 bits per pass. 
+ * Passes in which all keys share the same digit are skipped. Large arrays 
+ * are split into chunks with their own histograms, such that the counting 
+ * and scattering can be done in parallel.
+ */
+void Scores::sortScoreKeys(std::vector<ScoreKey>& keys) {
+  const std::size_t numKeys = keys.size();
+  if (numKeys < 2u) return;
+  const std::size_t kNumBuckets = 256u;
+  
+  int numChunks = 1;
+#ifdef _OPENMP
+  if (numKeys >= kParallelSortSize && !omp_in_parallel()) {
+    numChunks = omp_get_max_threads();
+  }
+#endif
+  std::vector<std::size_t> chunkStarts(static_cast<std::size_t>(numChunks) + 1u);
+  for (int chunk = 0; chunk <= numChunks; ++chunk) {
+    chunkStarts[chunk] = numKeys * static_cast<std::size_t>(chunk) / 
+                             static_cast<std::size_t>(numChunks);
+  }
+  
+  std::vector<ScoreKey> buffer(numKeys);
+  ScoreKey* src = &keys[0];
+  ScoreKey* dst = &buffer[0];
+  std::vector<std::size_t> offsets(static_cast<std::size_t>(numChunks) * kNumBuckets);
+  for (unsigned int shift = 0; shift < 64u; shift += 8u) {
+    std::fill(offsets.begin(), offsets.end(), 0u);
+#pragma omp parallel for schedule(static, 1) if (numChunks > 1)
+    for (int chunk = 0; chunk < numChunks; ++chunk) {
+      std::size_t* counts = &offsets[static_cast<std::size_t>(chunk) * kNumBuckets];
+      for (std::size_t ix = chunkStarts[chunk]; ix < chunkStarts[chunk + 1]; ++ix) {
+        ++counts[(src[ix].bits >> shift) & 0xFFu];
+      }
+    }
+    
+    // turn the counts into scatter offsets, bucket by bucket and within a
+    // bucket chunk by chunk to keep the sort stable
+    bool allInOneBucket = false;
+    std::size_t offset = 0u;
+    for (std::size_t bucket = 0; bucket < kNumBuckets; ++bucket) {
+      std::size_t bucketStart = offset;
+      for (int chunk = 0; chunk < numChunks; ++chunk) {
+        std::size_t& count = offsets[static_cast<std::size_t>(chunk) * kNumBuckets + bucket];
+        std::size_t chunkCount = count;
+        count = offset;
+        offset += chunkCount;
+      }
+      if (offset - bucketStart == numKeys) allInOneBucket = true;
+    }
+    if (allInOneBucket) continue;
+    
+#pragma omp parallel for schedule(static, 1) if (numChunks > 1)
+    for (int chunk = 0; chunk < numChunks; ++chunk) {
+      std::size_t* chunkOffsets = &offsets[static_cast<std::size_t>(chunk) * kNumBuckets];
+      for (std::size_t ix = chunkStarts[chunk]; ix < chunkStarts[chunk + 1]; ++ix) {
+        dst[chunkOffsets[(src[ix].bits >> shift) & 0xFFu]++] = src[ix];
+      }
+    }
+    std::swap(src, dst);
+  }
+  if (src != &keys[0]) {
+    std::copy(src, src + numKeys, keys.begin());
+  }
+}
+
 void Scores::getScoreLabelPairs(std::vector<pair<double, bool> >& combined) {
   combined.clear();
   transform(scores_.begin(), scores_.end(), back_inserter(combined),
@@ -483,18 +1167,13 @@ void Scores::getScoreLabelPairs(std::vector<pair<double, bool> >& combined) {
 int Scores::calcQ(double fdr, bool skipDecoysPlusOne) {
   assert(totalNumberOfDecoys_+totalNumberOfTargets_==size());
   
-  std::vector<pair<double, bool> > combined;
-  getScoreLabelPairs(combined);
+  qvalueEngine_.setSkipDecoysPlusOne(skipDecoysPlusOne);
+  qvalueEngine_.setIncludeDecoys(true);
+  const std::vector<double>& qvals = qvalueEngine_.calcQValues(scores_, pi0_);
   
-  std::vector<double> qvals;
-  PosteriorEstimator::setNegative(true); // also get q-values for decoys
-  PosteriorEstimator::getQValues(pi0_, combined, qvals, skipDecoysPlusOne);
-  
-  // set q-values and count number of positives
+  int numPos = 0;
   std::vector<double>::const_iterator qIt = qvals.begin();
   std::vector<ScoreHolder>::iterator scoreIt = scores_.begin();
-  
-  int numPos = 0;
   for (; qIt != qvals.end(); ++qIt, ++scoreIt) {
     scoreIt->q = *qIt;
     if (scoreIt->q < fdr && scoreIt->isTarget()) ++numPos;
@@ -503,12 +1182,12 @@ int Scores::calcQ(double fdr, bool skipDecoysPlusOne) {
   return numPos;
 }
 
-void Scores::generateNegativeTrainingSet(AlgIn& data, const double cneg) {
+void Scores::generateNegativeTrainingSet(AlgIn& data, const double cneg,
+    const ScoreSubset& subset) const {
   std::size_t ix2 = 0;
-  std::vector<ScoreHolder>::const_iterator scoreIt = scores_.begin();
-  for ( ; scoreIt != scores_.end(); ++scoreIt) {
-    if (scoreIt->isDecoy()) {
-      data.vals[ix2] = scoreIt->pPSM->features;
+  for (std::size_t ix = 0; ix < scores_.size(); ++ix) {
+    if (subset.contains(ix) && scores_[ix].isDecoy()) {
+      data.vals[ix2] = scores_[ix].pPSM->features;
       data.Y[ix2] = -1;
       data.C[ix2++] = cneg;
     }
@@ -516,23 +1195,36 @@ void Scores::generateNegativeTrainingSet(AlgIn& data, const double cneg) {
   data.negatives = static_cast<int>(ix2);
 }
 
+/**
+ * Adds the targets below the fdr threshold to the training set. With 
+ * trainBestPositive, only the best scoring PSM of each spectrum is 
+ * considered; this is determined on an index permutation, such that the
+ * ScoreHolders are left untouched.
+ */
 void Scores::generatePositiveTrainingSet(AlgIn& data, const double fdr,
-    const double cpos, const bool trainBestPositive) {
+    const double cpos, const bool trainBestPositive, 
+    const ScoreSubset& subset) const {
   std::size_t ix2 = static_cast<std::size_t>(data.negatives); 
   int p = 0;
   
-  std::vector<ScoreHolder>::iterator lastUniqueIt = scores_.end();
+  std::vector<unsigned int> order;
+  for (std::size_t ix = 0; ix < scores_.size(); ++ix) {
+    if (subset.contains(ix)) order.push_back(static_cast<unsigned int>(ix));
+  }
   if (trainBestPositive) {
-    std::sort(scores_.begin(), scores_.end(), OrderScanLabel());
-    lastUniqueIt = std::unique(scores_.begin(), scores_.end(), UniqueScanLabel());
-    std::sort(scores_.begin(), lastUniqueIt, greater<ScoreHolder> ());
+    ScoreColumns columns(scores_);
+    sortSequential(order.begin(), order.end(), ScoreColumns::OrderScanLabel(columns));
+    order.erase(std::unique(order.begin(), order.end(), 
+                    ScoreColumns::UniqueScanLabel(columns)), order.end());
+    sortSequential(order.begin(), order.end(), ScoreColumns::Greater(columns));
   }
   
-  std::vector<ScoreHolder>::const_iterator scoreIt = scores_.begin();
-  for ( ; scoreIt != lastUniqueIt; ++scoreIt) {
-    if (scoreIt->isTarget()) {
-      if (scoreIt->q <= fdr) {
-        data.vals[ix2] = scoreIt->pPSM->features;
+  std::vector<unsigned int>::const_iterator it = order.begin();
+  for ( ; it != order.end(); ++it) {
+    const ScoreHolder& sh = scores_[*it];
+    if (sh.isTarget()) {
+      if (sh.q <= fdr) {
+        data.vals[ix2] = sh.pPSM->features;
         data.Y[ix2] = 1;
         data.C[ix2++] = cpos;
         ++p;
@@ -555,7 +1247,7 @@ void Scores::weedOutRedundant() {
  */
 void Scores::weedOutRedundant(std::map<std::string, unsigned int>& peptideSpecCounts, double specCountQvalThreshold) {
   // lexicographically order the scores_ (based on peptides names,labels and scores)
-  std::sort(scores_.begin(), scores_.end(), lexicOrderProb());
+  sortSequential(scores_.begin(), scores_.end(), lexicOrderProb());
   
   /*
   * much simpler version but it does not fill up the peptide-PSM map:
@@ -589,8 +1281,9 @@ void Scores::weedOutRedundant(std::map<std::string, unsigned int>& peptideSpecCo
  */
 void Scores::weedOutRedundantTDC() {
   // order the scores (based on spectra id and score)
-  std::sort(scores_.begin(), scores_.end(), OrderScanMassCharge());  
-  scores_.erase(std::unique(scores_.begin(), scores_.end(), UniqueScanMassCharge()), scores_.end());
+  std::vector<ScoreHolder>::iterator lastUniqueIt = sortAndUniqueByColumns<
+      ScoreColumns::OrderScanMassCharge, ScoreColumns::UniqueScanMassCharge>();
+  scores_.erase(lastUniqueIt, scores_.end());
   
   /* does not actually release memory because of memory fragmentation
   double previousExpMass = 0.0;
@@ -619,8 +1312,9 @@ void Scores::weedOutRedundantTDC() {
  */
 void Scores::weedOutRedundantMixMax() {
   // order the scores (based on spectra id and score)
-  std::sort(scores_.begin(), scores_.end(), OrderScanMassLabelCharge());  
-  scores_.erase(std::unique(scores_.begin(), scores_.end(), UniqueScanMassLabelCharge()), scores_.end());
+  std::vector<ScoreHolder>::iterator lastUniqueIt = sortAndUniqueByColumns<
+      ScoreColumns::OrderScanMassLabelCharge, ScoreColumns::UniqueScanMassLabelCharge>();
+  scores_.erase(lastUniqueIt, scores_.end());
   
   postMergeStep();
 }
@@ -657,7 +1351,7 @@ int Scores::getInitDirection(const double initialSelectionFdr, std::vector<doubl
          scoreIt != scores_.end(); ++scoreIt) {
       scoreIt->score = scoreIt->pPSM->features[featNo];
     }
-    sort(scores_.begin(), scores_.end());
+    sortByColumns<ScoreColumns::Less>();
     // check once in forward direction (i = 0, higher scores are better) and 
     // once in backward direction (i = 1, lower scores are better)
     for (int i = 0; i < 2; i++) {
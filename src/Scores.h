@@ -23,6 +23,7 @@
 
 #include <cstdlib>
 #include <cfloat>
+#include <stdint.h>
 #include <algorithm>
 #include <vector>
 #include <map>
@@ -34,6 +35,7 @@
 #include "PseudoRandom.h"
 #include "Normalizer.h"
 #include "FeatureMemoryPool.h"
+#include "QValueEngine.h"
 
 #include <boost/unordered/unordered_map.hpp>
 
@@ -57,7 +59,6 @@ class ScoreHolder {
   ScoreHolder() : score(0.0), q(0.0), pep(0.0), p(0.0), label(0), pPSM(NULL) {}
   ScoreHolder(const double s, const int l, PSMDescription* psm = NULL) :
     score(s), q(0.0), pep(0.0), p(0.0), label(l), pPSM(psm) {}
-  virtual ~ScoreHolder() {}
   
   std::pair<double, bool> toPair() const { 
     return pair<double, bool> (score, label > 0); 
@@ -95,50 +96,118 @@ struct lexicOrderProb : public binary_function<ScoreHolder, ScoreHolder, bool> {
   }
 };
 
-struct OrderScanMassCharge : public binary_function<ScoreHolder, ScoreHolder, bool> {
-  bool operator()(const ScoreHolder& __x, const ScoreHolder& __y) const {
-    return ( (__x.pPSM->scan < __y.pPSM->scan ) 
-    || ( (__x.pPSM->scan == __y.pPSM->scan) && (__x.pPSM->expMass < __y.pPSM->expMass) )
-    || ( (__x.pPSM->scan == __y.pPSM->scan) && (__x.pPSM->expMass == __y.pPSM->expMass) 
-       && (__x.score > __y.score) ) );
-  }
-};
-
-struct OrderScanMassLabelCharge : public binary_function<ScoreHolder, ScoreHolder, bool> {
-  bool operator()(const ScoreHolder& __x, const ScoreHolder& __y) const {
-    return ( (__x.pPSM->scan < __y.pPSM->scan ) 
-    || ( (__x.pPSM->scan == __y.pPSM->scan) && (__x.pPSM->expMass < __y.pPSM->expMass) )
-    || ( (__x.pPSM->scan == __y.pPSM->scan) && (__x.pPSM->expMass == __y.pPSM->expMass) 
-       && (__x.label > __y.label) )
-    || ( (__x.pPSM->scan == __y.pPSM->scan) && (__x.pPSM->expMass == __y.pPSM->expMass) 
-       && (__x.label == __y.label) && (__x.score > __y.score) ) );
-  }
-};
-
-struct OrderScanLabel : public binary_function<ScoreHolder, ScoreHolder, bool> {
-  bool operator()(const ScoreHolder& __x, const ScoreHolder& __y) const {
-    return ( (__x.pPSM->scan < __y.pPSM->scan ) 
-    || ( (__x.pPSM->scan == __y.pPSM->scan) && (__x.label > __y.label) ) );
-  }
-};
-
-
-struct UniqueScanMassCharge : public binary_function<ScoreHolder, ScoreHolder, bool> {
-  bool operator()(const ScoreHolder& __x, const ScoreHolder& __y) const {
-    return (__x.pPSM->scan == __y.pPSM->scan) && (__x.pPSM->expMass == __y.pPSM->expMass);
-  }
-};
-
-struct UniqueScanMassLabelCharge : public binary_function<ScoreHolder, ScoreHolder, bool> {
-  bool operator()(const ScoreHolder& __x, const ScoreHolder& __y) const {
-    return (__x.pPSM->scan == __y.pPSM->scan) && (__x.label == __y.label) && (__x.pPSM->expMass == __y.pPSM->expMass);
-  }
-};
-
-struct UniqueScanLabel : public binary_function<ScoreHolder, ScoreHolder, bool> {
-  bool operator()(const ScoreHolder& __x, const ScoreHolder& __y) const {
-    return (__x.pPSM->scan == __y.pPSM->scan) && (__x.label == __y.label);
+/*
+* ScoreColumns is a structure-of-arrays copy of the fields of a vector of
+* ScoreHolders that the sorting and deduplication routines of Scores compare
+* on. The comparators work on indices into these contiguous arrays, so that
+* they neither have to touch the ScoreHolders nor dereference their
+* PSMDescription pointers; the ScoreHolders are permuted only once, after
+* their order has been established.
+*/
+class ScoreColumns {
+ public:
+  explicit ScoreColumns(std::size_t size = 0u) : score(size), expMass(size),
+    scan(size), label(size) {}
+  explicit ScoreColumns(const std::vector<ScoreHolder>& scores);
+  ScoreColumns(std::vector<ScoreHolder>::const_iterator first,
+               std::vector<ScoreHolder>::const_iterator last);
+  
+  std::vector<double> score, expMass;
+  std::vector<unsigned int> scan;
+  std::vector<int> label;
+  
+  inline void copy(std::size_t to, std::size_t from) {
+    score[to] = score[from];
+    expMass[to] = expMass[from];
+    scan[to] = scan[from];
+    label[to] = label[from];
   }
+  
+  // same order as operator> on the ScoreHolders
+  struct Greater {
+    const ScoreColumns& c;
+    explicit Greater(const ScoreColumns& columns) : c(columns) {}
+    bool operator()(unsigned int x, unsigned int y) const {
+      return (c.score[x] > c.score[y]) 
+          || (c.score[x] == c.score[y] && c.scan[x] > c.scan[y]) 
+          || (c.score[x] == c.score[y] && c.scan[x] == c.scan[y] && 
+                c.expMass[x] > c.expMass[y])
+          || (c.score[x] == c.score[y] && c.scan[x] == c.scan[y] && 
+                c.expMass[x] == c.expMass[y] && c.label[x] > c.label[y]);
+    }
+  };
+  
+  // same order as operator< on the ScoreHolders
+  struct Less {
+    const ScoreColumns& c;
+    explicit Less(const ScoreColumns& columns) : c(columns) {}
+    bool operator()(unsigned int x, unsigned int y) const {
+      return (c.score[x] < c.score[y]) 
+          || (c.score[x] == c.score[y] && c.scan[x] < c.scan[y]) 
+          || (c.score[x] == c.score[y] && c.scan[x] == c.scan[y] && 
+                c.expMass[x] < c.expMass[y])
+          || (c.score[x] == c.score[y] && c.scan[x] == c.scan[y] && 
+                c.expMass[x] == c.expMass[y] && c.label[x] < c.label[y]);
+    }
+  };
+  
+  struct OrderScanMassCharge {
+    const ScoreColumns& c;
+    explicit OrderScanMassCharge(const ScoreColumns& columns) : c(columns) {}
+    bool operator()(unsigned int x, unsigned int y) const {
+      return ( (c.scan[x] < c.scan[y]) 
+      || ( (c.scan[x] == c.scan[y]) && (c.expMass[x] < c.expMass[y]) )
+      || ( (c.scan[x] == c.scan[y]) && (c.expMass[x] == c.expMass[y]) 
+         && (c.score[x] > c.score[y]) ) );
+    }
+  };
+  
+  struct OrderScanMassLabelCharge {
+    const ScoreColumns& c;
+    explicit OrderScanMassLabelCharge(const ScoreColumns& columns) : c(columns) {}
+    bool operator()(unsigned int x, unsigned int y) const {
+      return ( (c.scan[x] < c.scan[y]) 
+      || ( (c.scan[x] == c.scan[y]) && (c.expMass[x] < c.expMass[y]) )
+      || ( (c.scan[x] == c.scan[y]) && (c.expMass[x] == c.expMass[y]) 
+         && (c.label[x] > c.label[y]) )
+      || ( (c.scan[x] == c.scan[y]) && (c.expMass[x] == c.expMass[y]) 
+         && (c.label[x] == c.label[y]) && (c.score[x] > c.score[y]) ) );
+    }
+  };
+  
+  struct OrderScanLabel {
+    const ScoreColumns& c;
+    explicit OrderScanLabel(const ScoreColumns& columns) : c(columns) {}
+    bool operator()(unsigned int x, unsigned int y) const {
+      return ( (c.scan[x] < c.scan[y]) 
+      || ( (c.scan[x] == c.scan[y]) && (c.label[x] > c.label[y]) ) );
+    }
+  };
+  
+  struct UniqueScanMassCharge {
+    const ScoreColumns& c;
+    explicit UniqueScanMassCharge(const ScoreColumns& columns) : c(columns) {}
+    bool operator()(unsigned int x, unsigned int y) const {
+      return (c.scan[x] == c.scan[y]) && (c.expMass[x] == c.expMass[y]);
+    }
+  };
+  
+  struct UniqueScanMassLabelCharge {
+    const ScoreColumns& c;
+    explicit UniqueScanMassLabelCharge(const ScoreColumns& columns) : c(columns) {}
+    bool operator()(unsigned int x, unsigned int y) const {
+      return (c.scan[x] == c.scan[y]) && (c.label[x] == c.label[y]) && 
+             (c.expMass[x] == c.expMass[y]);
+    }
+  };
+  
+  struct UniqueScanLabel {
+    const ScoreColumns& c;
+    explicit UniqueScanLabel(const ScoreColumns& columns) : c(columns) {}
+    bool operator()(unsigned int x, unsigned int y) const {
+      return (c.scan[x] == c.scan[y]) && (c.label[x] == c.label[y]);
+    }
+  };
 };
 
 inline string getRidOfUnprintablesAndUnicode(string inpString) {
@@ -153,6 +222,39 @@ inline string getRidOfUnprintablesAndUnicode(string inpString) {
   return outputs;
 }
 
+/*
+* ScoreKey is the compact sort key of the q-value pipeline in Scores: the 
+* score mapped to an unsigned integer whose ascending order is the descending
+* order of the scores, the index of the ScoreHolder and its label.
+*/
+struct ScoreKey {
+  uint64_t bits;
+  unsigned int index;
+  int label;
+};
+
+/*
+* ScoreSubset is a view on the ScoreHolders of a Scores object, selecting the
+* positions ix for which (*folds)[ix] equals fold, or differs from it if 
+* complement is set. Nested cross validation uses it to train and test on 
+* parts of a training set without copying ScoreHolders; the positions are 
+* only valid until the Scores object is sorted again. A default constructed
+* ScoreSubset selects everything.
+*/
+struct ScoreSubset {
+  const std::vector<unsigned int>* folds;
+  unsigned int fold;
+  bool complement;
+  
+  ScoreSubset() : folds(NULL), fold(0u), complement(false) {}
+  ScoreSubset(const std::vector<unsigned int>& f, unsigned int k, bool c) :
+    folds(&f), fold(k), complement(c) {}
+  
+  inline bool contains(std::size_t ix) const {
+    return folds == NULL || (((*folds)[ix] == fold) != complement);
+  }
+};
+
 class SetHandler;
 class AlgIn;
 
@@ -180,9 +282,14 @@ class Scores {
   std::vector<ScoreHolder>::iterator end() { return scores_.end(); }
   
   double calcScore(const double* features, const std::vector<double>& w) const;
+  static void calcScoreBatch(const double* const* rows, std::size_t numRows,
+                             const std::vector<double>& w, double* scores);
   void scoreAndAddPSM(ScoreHolder& sh, const std::vector<double>& rawWeights,
                       FeatureMemoryPool& featurePool);
   int calcScores(vector<double>& w, double fdr, bool skipDecoysPlusOne = false);
+  int calcNumPositives(const std::vector<double>& w, double fdr, 
+                       bool skipDecoysPlusOne = false, 
+                       const ScoreSubset& subset = ScoreSubset()) const;
   int calcQ(double fdr, bool skipDecoysPlusOne = false);
   void recalculateDescriptionOfCorrect(const double fdr);
   void calcPep();
@@ -193,10 +300,14 @@ class Scores {
   void createXvalSetsBySpectrum(std::vector<Scores>& train, 
       std::vector<Scores>& test, const unsigned int xval_fold,
       FeatureMemoryPool& featurePool);
+  void assignXvalFoldsBySpectrum(const unsigned int xval_fold,
+      std::vector<unsigned int>& folds);
   
   void generatePositiveTrainingSet(AlgIn& data, const double fdr,
-      const double cpos, const bool trainBestPositive);
-  void generateNegativeTrainingSet(AlgIn& data, const double cneg);
+      const double cpos, const bool trainBestPositive, 
+      const ScoreSubset& subset = ScoreSubset()) const;
+  void generateNegativeTrainingSet(AlgIn& data, const double cneg,
+      const ScoreSubset& subset = ScoreSubset()) const;
   
   void recalculateSizes();
   void normalizeScores(double fdr);
@@ -234,12 +345,17 @@ class Scores {
     return peptidePsmMap_[pPSM];
   }
   
+  void sortByScore();
+  
   void reset() { 
     scores_.clear(); 
     totalNumberOfTargets_ = 0;
     totalNumberOfDecoys_ = 0;
   }
   void setUsePi0(bool usePi0);
+  
+  // memory budget in bytes for sorting the ScoreHolders, 0 means unlimited
+  static void setMaxSortMemory(std::size_t bytes) { maxSortMemory_ = bytes; }
  protected:
   bool usePi0_;
   
@@ -250,10 +366,34 @@ class Scores {
   std::vector<ScoreHolder> scores_;
   std::map<PSMDescription*, std::vector<PSMDescription*> > peptidePsmMap_;
   DescriptionOfCorrect doc_;
+  QValueEngine qvalueEngine_; // keeps its q-value buffer between calcQ calls
   
   double* decoyPtr_;
   double* targetPtr_;
   
+  // number of feature rows scored by one thread in calcScoreBatch
+  static const std::size_t kScoreBlockSize = 8192u;
+  // minimal number of keys for sorting them with multiple threads
+  static const std::size_t kParallelSortSize = 65536u;
+  
+  void calcScoreKeys(const std::vector<double>& w, std::vector<double>& scores,
+                     std::vector<ScoreKey>& keys, 
+                     const ScoreSubset& subset = ScoreSubset()) const;
+  static void sortScoreKeys(std::vector<ScoreKey>& keys);
+  
+  static std::size_t maxSortMemory_;
+  // minimal number of ScoreHolders per sorted run of sortOnDisk
+  static const std::size_t kMinSortRunSize = 4096u;
+  
+  template<class Order> void sortByColumns();
+  template<class Order, class Same> 
+  std::vector<ScoreHolder>::iterator sortAndUniqueByColumns();
+  bool exceedsMaxSortMemory() const;
+  template<class Order, class Same> 
+  void sortOnDisk(std::vector<unsigned int>& order, bool unique) const;
+  void permute(const std::vector<unsigned int>& order);
+  void permuteInPlace(std::vector<unsigned int>& order);
+  
   void reorderFeatureRows(FeatureMemoryPool& featurePool, bool isTarget,
     boost::unordered_map<double*, double*>& movedAddresses, size_t& idx);
   void getScoreLabelPairs(std::vector<pair<double, bool> >& combined);
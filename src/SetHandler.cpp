@@ -17,6 +17,10 @@
 
 #include "SetHandler.h"
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 SetHandler::SetHandler(unsigned int maxPSMs) : maxPSMs_(maxPSMs) {}
 
 SetHandler::~SetHandler() {
@@ -249,7 +253,7 @@ void SetHandler::readPSMs(istream& dataStream, std::string& psmLine,
       psmLine = rtrim(psmLine);
       
       int label = 0;
-      ScanId scanId = getScanId(psmLine, label, optionalFields, lineNr);
+      ScanId scanId = getScanId(TabReader(psmLine), label, optionalFields, lineNr);
       bool isDecoy = (label == -1);
       size_t randIdx;
       if (scanIdLookUp.find(scanId) != scanIdLookUp.end()) {
@@ -283,41 +287,299 @@ void SetHandler::readPSMs(istream& dataStream, std::string& psmLine,
     
     addQueueToSets(subsetPSMs, targetSet, decoySet);
   } else { // simply read all PSMs
-    std::map<ScanId, bool> scanIdLookUp; // ScanId -> isDecoy
-    do {
+    try {
+      readAllPSMs(dataStream, psmLine, lineNr, concatenatedSearch, 
+                  optionalFields, targetSet, decoySet);
+    } catch (...) {
+      // the sets own the PSMs of the blocks that were read before the error
+      delete targetSet;
+      delete decoySet;
+      throw;
+    }
+  }
+  
+  if (VERB > 1) {
+    std::cerr << "Found " << lineNr - (hasInitialValueRow ? 3u : 2u) << " PSMs" << std::endl;
+  }
+  
+  push_back_dataset(targetSet);
+  push_back_dataset(decoySet);
+}
+
+/**
+ * Reads all remaining PSMs from the stream in blocks of complete lines. Each 
+ * block is split into newline-aligned byte ranges that are parsed in parallel,
+ * after which the PSMs are registered in line order, so that the result does
+ * not depend on the number of threads. If the input is a regular file, it is
+ * memory mapped and parsed in place instead.
+ * @param firstPsmLine first psm line, which was already consumed from the stream
+ * @param lineNr line number of firstPsmLine, updated to one past the last line
+ */
+void SetHandler::readAllPSMs(istream& dataStream, 
+    const std::string& firstPsmLine, unsigned int& lineNr, 
+    bool& concatenatedSearch, std::vector<OptionalField>& optionalFields,
+    DataSet* targetSet, DataSet* decoySet) {
+  boost::unordered_map<ScanId, bool> scanIdLookUp; // ScanId -> isDecoy
+  
+  std::vector<char> buffer(firstPsmLine.begin(), firstPsmLine.end());
+  buffer.push_back('\n');
+  if (!inputFN_.empty()) {
+    buffer.push_back('\0');
+    readPsmBlock(&buffer[0], &buffer[0] + buffer.size() - 1u, lineNr, 
+                 concatenatedSearch, optionalFields, scanIdLookUp, 
+                 targetSet, decoySet);
+    if (readMappedPSMs(dataStream, lineNr, concatenatedSearch, optionalFields,
+                       scanIdLookUp, targetSet, decoySet)) {
+      return;
+    }
+    buffer.clear();
+  }
+  
+  std::vector<char> remainder;
+  bool endOfStream = false;
+  while (!endOfStream) {
+    std::size_t numCarried = buffer.size();
+    buffer.resize(numCarried + kReadBlockSize);
+    dataStream.read(&buffer[numCarried], static_cast<std::streamsize>(kReadBlockSize));
+    buffer.resize(numCarried + static_cast<std::size_t>(dataStream.gcount()));
+    endOfStream = !dataStream;
+    
+    // keep the incomplete last line for the next block
+    std::size_t blockEnd = buffer.size();
+    if (!endOfStream) {
+      while (blockEnd > 0u && buffer[blockEnd - 1u] != '\n') --blockEnd;
+      if (blockEnd == 0u) continue; // line longer than kReadBlockSize
+    }
+    remainder.assign(buffer.begin() + static_cast<std::ptrdiff_t>(blockEnd), buffer.end());
+    buffer.resize(blockEnd);
+    
+    if (blockEnd > 0u) {
+      buffer.push_back('\0'); // terminates a final line without newline character
+      readPsmBlock(&buffer[0], &buffer[0] + blockEnd, lineNr, concatenatedSearch, 
+                   optionalFields, scanIdLookUp, targetSet, decoySet);
+    }
+    buffer.swap(remainder);
+  }
+}
+
+/**
+ * Memory maps the input file and parses the psm lines following the current
+ * stream position in place, in blocks of kReadBlockSize bytes. Pages that 
+ * have been parsed are released again, as all fields are copied or interned.
+ * @return false if the file could not be mapped, in which case nothing was read
+ */
+bool SetHandler::readMappedPSMs(istream& dataStream, unsigned int& lineNr,
+    bool& concatenatedSearch, std::vector<OptionalField>& optionalFields,
+    boost::unordered_map<ScanId, bool>& scanIdLookUp,
+    DataSet* targetSet, DataSet* decoySet) {
+  std::streamoff offset = static_cast<std::streamoff>(dataStream.tellg());
+  if (offset < 0) return false;
+  MappedFile mappedInput;
+  if (!mappedInput.open(inputFN_) || 
+        static_cast<std::size_t>(offset) > mappedInput.size()) {
+    return false;
+  }
+  
+  const char* fileEnd = mappedInput.data() + mappedInput.size();
+  const char* blockStart = mappedInput.data() + offset;
+  while (blockStart < fileEnd) {
+    const char* blockEnd = fileEnd;
+    if (static_cast<std::size_t>(fileEnd - blockStart) > kReadBlockSize) {
+      const char* newLine = static_cast<const char*>(memchr(
+          blockStart + kReadBlockSize, '\n', 
+          static_cast<std::size_t>(fileEnd - blockStart) - kReadBlockSize));
+      if (newLine != NULL) blockEnd = newLine + 1;
+    }
+    if (blockEnd == fileEnd && *(fileEnd - 1) != '\n') {
+      // the character after a final line without newline character is not
+      // readable, parse everything but this line from the mapping
+      const char* lastLine = fileEnd;
+      while (lastLine > blockStart && *(lastLine - 1) != '\n') --lastLine;
+      if (lastLine > blockStart) {
+        readPsmBlock(blockStart, lastLine, lineNr, concatenatedSearch, 
+                     optionalFields, scanIdLookUp, targetSet, decoySet);
+      }
+      std::vector<char> buffer(lastLine, fileEnd);
+      buffer.push_back('\0');
+      readPsmBlock(&buffer[0], &buffer[0] + buffer.size() - 1u, lineNr, 
+                   concatenatedSearch, optionalFields, scanIdLookUp, 
+                   targetSet, decoySet);
+    } else {
+      readPsmBlock(blockStart, blockEnd, lineNr, concatenatedSearch, 
+                   optionalFields, scanIdLookUp, targetSet, decoySet);
+    }
+    mappedInput.dropPages(static_cast<std::size_t>(blockStart - mappedInput.data()),
+                          static_cast<std::size_t>(blockEnd - blockStart));
+    blockStart = blockEnd;
+  }
+  dataStream.seekg(0, ios::end);
+  return true;
+}
+
+/**
+ * Splits a newline-aligned byte range into right-trimmed lines without 
+ * modifying it. A final line without a newline character is only kept if it 
+ * is not empty, mimicking the behavior of getline.
+ */
+void SetHandler::splitPsmLines(PsmLineRange& range) {
+  const char* lineStart = range.begin;
+  while (lineStart < range.end) {
+    const char* lineEnd = static_cast<const char*>(memchr(lineStart, '\n', 
+        static_cast<std::size_t>(range.end - lineStart)));
+    if (lineEnd == NULL) lineEnd = range.end;
+    const char* trimmedEnd = lineEnd;
+    while (trimmedEnd != lineStart && isspace(*(trimmedEnd - 1))) --trimmedEnd;
+    range.lines.push_back(TabReader(lineStart, trimmedEnd));
+    lineStart = lineEnd + 1;
+  }
+}
+
+/**
+ * Parses a block of complete psm lines and adds the PSMs to the target and
+ * decoy sets.
+ * @param blockStart start of the psm lines, which are parsed in place; every 
+ *        line except possibly the last one is terminated by a newline 
+ *        character, if it is not, *blockEnd has to be a null character
+ * @param blockEnd one past the last character of the block
+ */
+void SetHandler::readPsmBlock(const char* blockStart, const char* blockEnd,
+    unsigned int& lineNr, bool& concatenatedSearch, 
+    std::vector<OptionalField>& optionalFields,
+    boost::unordered_map<ScanId, bool>& scanIdLookUp,
+    DataSet* targetSet, DataSet* decoySet) {
+  std::size_t blockSize = static_cast<std::size_t>(blockEnd - blockStart);
+  if (blockSize == 0u) return;
+  
+  int numThreads = 1;
+#ifdef _OPENMP
+  numThreads = omp_get_max_threads();
+#endif
+  std::size_t numRanges = std::max<std::size_t>(1u, std::min<std::size_t>(
+      static_cast<std::size_t>(numThreads) * 4u, blockSize / kMinRangeSize));
+  
+  // split the block into newline-aligned byte ranges
+  std::vector<PsmLineRange> ranges(numRanges);
+  const char* rangeStart = blockStart;
+  for (std::size_t r = 0; r < numRanges; ++r) {
+    const char* rangeEnd = blockEnd;
+    if (r + 1u < numRanges) {
+      rangeEnd = blockStart + blockSize / numRanges * (r + 1u);
+      if (rangeEnd <= rangeStart) {
+        rangeEnd = rangeStart;
+      } else {
+        const char* newLine = static_cast<const char*>(memchr(rangeEnd - 1, '\n', 
+            static_cast<std::size_t>(blockEnd - rangeEnd + 1)));
+        rangeEnd = (newLine == NULL) ? blockEnd : newLine + 1;
+      }
+    }
+    ranges[r].begin = rangeStart;
+    ranges[r].end = rangeEnd;
+    rangeStart = rangeEnd;
+  }
+  
+  int numRangesInt = static_cast<int>(numRanges);
+#pragma omp parallel for schedule(dynamic, 1)
+  for (int r = 0; r < numRangesInt; ++r) {
+    splitPsmLines(ranges[static_cast<std::size_t>(r)]);
+  }
+  
+  // reserve the feature rows in line order, as a serial reader would
+  std::size_t numLines = 0u;
+  for (std::size_t r = 0; r < numRanges; ++r) {
+    ranges[r].firstIdx = numLines;
+    numLines += ranges[r].lines.size();
+  }
+  std::vector<double*> featureRows(numLines);
+  for (std::size_t i = 0; i < numLines; ++i) {
+    featureRows[i] = featurePool_.allocate();
+  }
+  std::vector<PSMDescription*> psms(numLines, NULL);
+  std::vector<ScanId> scanIds(numLines);
+  std::vector<int> labels(numLines, 0);
+  
+  const unsigned int firstLineNr = lineNr;
+#pragma omp parallel for schedule(dynamic, 1)
+  for (int r = 0; r < numRangesInt; ++r) {
+    PsmLineRange& range = ranges[static_cast<std::size_t>(r)];
+    for (std::size_t j = 0; j < range.lines.size(); ++j) {
+      std::size_t idx = range.firstIdx + j;
+      // the reader is left at the protein columns, which are interned below
+      TabReader& reader = range.lines[j];
+      TabReader lineReader = reader;
+      unsigned int curLineNr = firstLineNr + static_cast<unsigned int>(idx);
+      try {
+        std::string parseError;
+        try {
+          labels[idx] = DataSet::readPsm(reader, curLineNr, optionalFields, 
+                                         psms[idx], featureRows[idx]);
+        } catch (MyException& e) {
+          parseError = e.what();
+        }
+        if (parseError.empty() && (labels[idx] == 1 || labels[idx] == -1)) {
+          scanIds[idx].first = static_cast<int>(psms[idx]->scan);
+          scanIds[idx].second = psms[idx]->expMass;
+        } else {
+          // PSMs that will be ignored or could not be parsed are checked in 
+          // the same way as by getScanId in the subset reader, such that the
+          // same errors and warnings are reported
+          PSMDescription::deletePtr(psms[idx]);
+          psms[idx] = NULL;
+          scanIds[idx] = getScanId(lineReader, labels[idx], optionalFields, curLineNr);
+          if (!parseError.empty() && (labels[idx] == 1 || labels[idx] == -1)) {
+            throw MyException(parseError);
+          }
+        }
+      } catch (MyException& e) {
+        range.hasError = true;
+        range.errorMsg = e.what();
+        break;
+      }
+    }
+  }
+  
+  // report the error on the first faulty line, after releasing the PSMs and
+  // feature rows of the block, none of which have been registered yet
+  for (std::size_t r = 0; r < numRanges; ++r) {
+    if (ranges[r].hasError) {
+      for (std::size_t idx = 0; idx < numLines; ++idx) {
+        PSMDescription::deletePtr(psms[idx]);
+        featurePool_.deallocate(featureRows[idx]);
+      }
+      throw MyException(ranges[r].errorMsg);
+    }
+  }
+  
+  for (std::size_t r = 0; r < numRanges; ++r) {
+    for (std::size_t j = 0; j < ranges[r].lines.size(); ++j, ++lineNr) {
+      std::size_t idx = ranges[r].firstIdx + j;
       if (lineNr % 1000000 == 0 && VERB > 1) {
         std::cerr << "Reading line " << lineNr << std::endl;
       }
-      psmLine = rtrim(psmLine);
-      int label = 0;
-      ScanId scanId = getScanId(psmLine, label, optionalFields, lineNr);
-      bool isDecoy = (label == -1);
-      if (scanIdLookUp.find(scanId) != scanIdLookUp.end()) {
-        if (concatenatedSearch && isDecoy != scanIdLookUp[scanId]) {
+      bool isDecoy = (labels[idx] == -1);
+      boost::unordered_map<ScanId, bool>::const_iterator it = scanIdLookUp.find(scanIds[idx]);
+      if (it != scanIdLookUp.end()) {
+        if (concatenatedSearch && isDecoy != it->second) {
           concatenatedSearch = false;
         }
       } else {
-        scanIdLookUp[scanId] = isDecoy;
+        scanIdLookUp[scanIds[idx]] = isDecoy;
       }
       
-      if (label == 1) {
-        targetSet->readPsm(psmLine, lineNr, optionalFields, featurePool_);
-      } else if (label == -1) {
-        decoySet->readPsm(psmLine, lineNr, optionalFields, featurePool_);
+      if (labels[idx] == 1 || labels[idx] == -1) {
+        // protein accessions are interned in line order to get deterministic ids
+        DataSet::readProteins(ranges[r].lines[j], psms[idx]);
+        if (labels[idx] == 1) {
+          targetSet->registerPsm(psms[idx]);
+        } else {
+          decoySet->registerPsm(psms[idx]);
+        }
       } else {
         std::cerr << "Warning: the PSM on line " << lineNr
             << " has a label not in {1,-1} and will be ignored." << std::endl;
+        featurePool_.deallocate(featureRows[idx]);
       }
-      ++lineNr;
-    } while (getline(dataStream, psmLine));
-  }
-  
-  if (VERB > 1) {
-    std::cerr << "Found " << lineNr - (hasInitialValueRow ? 3u : 2u) << " PSMs" << std::endl;
+    }
   }
-  
-  push_back_dataset(targetSet);
-  push_back_dataset(decoySet);
 }
 
 void SetHandler::addQueueToSets(
@@ -339,10 +601,9 @@ void SetHandler::addQueueToSets(
   }
 }
 
-ScanId SetHandler::getScanId(const std::string& psmLine, int& label,
+ScanId SetHandler::getScanId(TabReader reader, int& label,
     std::vector<OptionalField>& optionalFields, unsigned int lineNr) {
   ScanId scanId;
-  TabReader reader(psmLine);
   
   reader.skip();
   if (reader.error()) {
@@ -42,6 +42,9 @@
 #include "PseudoRandom.h"
 #include "DescriptionOfCorrect.h"
 #include "FeatureMemoryPool.h"
+#include "MappedFile.h"
+
+#include <boost/unordered_map.hpp>
 
 using namespace std;
 
@@ -57,6 +60,22 @@ struct PSMDescriptionPriority {
 
 typedef std::pair<int, double> ScanId;
 
+/*
+* PsmLineRange is a newline-aligned byte range of a block of pin-tab input,
+* together with readers for the right-trimmed psm lines it contains. Each 
+* range is parsed by a single thread in SetHandler::readAllPSMs.
+*/
+struct PsmLineRange {
+  const char* begin;
+  const char* end;
+  std::size_t firstIdx; // index of the first line of this range in the block
+  std::vector<TabReader> lines;
+  bool hasError;
+  std::string errorMsg;
+  
+  PsmLineRange() : begin(NULL), end(NULL), firstIdx(0u), hasError(false) {}
+};
+
 /*
 * SetHandler is a class that provides functionality to handle training,
 * testing, Xval data sets, reads/writes from/to a file, prints them.
@@ -99,12 +118,22 @@ class SetHandler {
   
   FeatureMemoryPool& getFeaturePool() { return featurePool_; }
   
+  // file name of the tab delimited input, used to memory map the input
+  // instead of reading it through the stream if possible
+  void setInputFileName(const std::string& inputFN) { inputFN_ = inputFN; }
+  
   void reset();
   
  protected:
   size_t maxPSMs_;
   vector<DataSet*> subsets_;
   FeatureMemoryPool featurePool_;
+  std::string inputFN_;
+  
+  // number of bytes of pin-tab input read and parsed at once by readAllPSMs
+  static const std::size_t kReadBlockSize = 1u << 25;
+  // minimal number of bytes per thread before splitting a block further
+  static const std::size_t kMinRangeSize = 1u << 16;
   
   unsigned int getSubsetIndexFromLabel(int label);
   static inline std::string &rtrim(std::string &s);
@@ -117,12 +146,26 @@ class SetHandler {
     int optionalFieldCount, FeatureNames& featureNames);
   bool getInitValues(const std::string& defaultDirectionLine, 
     int optionalFieldCount, std::vector<double>& init_values);
-  ScanId getScanId(const std::string& psmLine, int& label,
+  ScanId getScanId(TabReader reader, int& label,
     std::vector<OptionalField>& optionalFields, unsigned int lineNr);
     
   void readPSMs(istream& dataStream, std::string& psmLine, 
     bool hasInitialValueRow, bool& separateSearches,
     std::vector<OptionalField>& optionalFields);
+  void readAllPSMs(istream& dataStream, const std::string& firstPsmLine,
+    unsigned int& lineNr, bool& concatenatedSearch,
+    std::vector<OptionalField>& optionalFields,
+    DataSet* targetSet, DataSet* decoySet);
+  bool readMappedPSMs(istream& dataStream, unsigned int& lineNr,
+    bool& concatenatedSearch, std::vector<OptionalField>& optionalFields,
+    boost::unordered_map<ScanId, bool>& scanIdLookUp,
+    DataSet* targetSet, DataSet* decoySet);
+  void readPsmBlock(const char* blockStart, const char* blockEnd,
+    unsigned int& lineNr,
+    bool& concatenatedSearch, std::vector<OptionalField>& optionalFields,
+    boost::unordered_map<ScanId, bool>& scanIdLookUp,
+    DataSet* targetSet, DataSet* decoySet);
+  static void splitPsmLines(PsmLineRange& range);
   void readAndScorePSMs(istream& dataStream, std::string& psmLine, 
     bool hasInitialValueRow, std::vector<OptionalField>& optionalFields, 
     std::vector<double>& rawWeights, Scores& allScores);
@@ -0,0 +1,86 @@
+/*******************************************************************************
+ Copyright 2006-2012 Lukas Käll <lukas.kall@scilifelab.se>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+
+ *******************************************************************************/
+
+#include "SymbolTable.h"
+
+#include <cstring>
+
+const unsigned int SymbolTable::kNoSymbol;
+
+// FNV-1a
+std::size_t SymbolTable::hash(const char* name, std::size_t length) {
+  unsigned long long h = 14695981039346656037ULL;
+  for (std::size_t i = 0; i < length; ++i) {
+    h ^= static_cast<unsigned char>(name[i]);
+    h *= 1099511628211ULL;
+  }
+  return static_cast<std::size_t>(h);
+}
+
+/**
+ * Returns the slot holding the name, or the empty slot where it belongs
+ */
+std::size_t SymbolTable::findSlot(const char* name, std::size_t length,
+                                  std::size_t h) const {
+  std::size_t slot = h & numSlotsMask_;
+  while (slots_[slot] != kNoSymbol) {
+    unsigned int id = slots_[slot];
+    if (hashes_[id] == h && names_[id].size() == length &&
+        memcmp(names_[id].data(), name, length) == 0) {
+      break;
+    }
+    slot = (slot + 1u) & numSlotsMask_;
+  }
+  return slot;
+}
+
+void SymbolTable::rehash(std::size_t numSlots) {
+  slots_.assign(numSlots, kNoSymbol);
+  numSlotsMask_ = numSlots - 1u;
+  for (std::size_t id = 0; id < names_.size(); ++id) {
+    std::size_t slot = hashes_[id] & numSlotsMask_;
+    while (slots_[slot] != kNoSymbol) slot = (slot + 1u) & numSlotsMask_;
+    slots_[slot] = static_cast<unsigned int>(id);
+  }
+}
+
+unsigned int SymbolTable::intern(const char* name, std::size_t length) {
+  // keep the load factor below 1/2
+  if (2u * (names_.size() + 1u) > slots_.size()) {
+    rehash(slots_.empty() ? 1024u : 2u * slots_.size());
+  }
+  std::size_t h = hash(name, length);
+  std::size_t slot = findSlot(name, length, h);
+  if (slots_[slot] == kNoSymbol) {
+    slots_[slot] = static_cast<unsigned int>(names_.size());
+    names_.push_back(std::string(name, length));
+    hashes_.push_back(h);
+  }
+  return slots_[slot];
+}
+
+unsigned int SymbolTable::find(const char* name, std::size_t length) const {
+  if (slots_.empty()) return kNoSymbol;
+  return slots_[findSlot(name, length, hash(name, length))];
+}
+
+void SymbolTable::clear() {
+  names_.clear();
+  hashes_.clear();
+  slots_.clear();
+  numSlotsMask_ = 0u;
+}
@@ -0,0 +1,68 @@
+/*******************************************************************************
+ Copyright 2006-2012 Lukas Käll <lukas.kall@scilifelab.se>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+
+ *******************************************************************************/
+#ifndef SYMBOL_TABLE_H_
+#define SYMBOL_TABLE_H_
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <cstddef>
+#include <climits>
+
+/*
+* SymbolTable
+*
+* Interns strings, e.g. protein accessions, and hands out a 32-bit id per
+* distinct string. Ids are assigned consecutively in order of first
+* occurrence, such that they are deterministic for a given input order.
+* References returned by getName stay valid until clear() is called.
+* Interning is not thread safe.
+*
+*/
+class SymbolTable {
+ public:
+  static const unsigned int kNoSymbol = UINT_MAX;
+
+  SymbolTable() : numSlotsMask_(0u) {}
+
+  unsigned int intern(const char* name, std::size_t length);
+  unsigned int intern(const std::string& name) {
+    return intern(name.data(), name.size());
+  }
+  // returns kNoSymbol if the name has not been interned
+  unsigned int find(const char* name, std::size_t length) const;
+  unsigned int find(const std::string& name) const {
+    return find(name.data(), name.size());
+  }
+
+  const std::string& getName(unsigned int id) const { return names_[id]; }
+  std::size_t size() const { return names_.size(); }
+  void clear();
+
+ protected:
+  std::deque<std::string> names_; // deque keeps references stable on growth
+  std::vector<std::size_t> hashes_;
+  std::vector<unsigned int> slots_; // open addressing with linear probing
+  std::size_t numSlotsMask_;
+
+  static std::size_t hash(const char* name, std::size_t length);
+  std::size_t findSlot(const char* name, std::size_t length,
+                       std::size_t h) const;
+  void rehash(std::size_t numSlots);
+};
+
+#endif /* SYMBOL_TABLE_H_ */
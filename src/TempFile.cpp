@@ -0,0 +1,71 @@
+/*******************************************************************************
+ Copyright 2006-2012 Lukas Käll <lukas.kall@scilifelab.se>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+
+ *******************************************************************************/
+
+#include "TempFile.h"
+
+#include <sys/types.h>
+
+#include "MyException.h"
+
+TempFile::TempFile() : file_(std::tmpfile()), size_(0u), atEnd_(true) {
+  if (file_ == NULL) {
+    throw MyException("ERROR: Could not create a temporary file, check if " 
+                      "the temporary directory is writable.\n");
+  }
+}
+
+TempFile::~TempFile() {
+  std::fclose(file_);
+}
+
+void TempFile::seek(uint64_t offset) {
+#ifdef _WIN32
+  int ret = _fseeki64(file_, static_cast<__int64>(offset), SEEK_SET);
+#else
+  int ret = fseeko(file_, static_cast<off_t>(offset), SEEK_SET);
+#endif
+  if (ret != 0) {
+    throw MyException("ERROR: Could not seek in temporary file.\n");
+  }
+}
+
+uint64_t TempFile::append(const void* data, std::size_t length) {
+  // switching from reading to writing requires a seek
+  if (!atEnd_) {
+    seek(size_);
+    atEnd_ = true;
+  }
+  if (length > 0u && std::fwrite(data, 1u, length, file_) != length) {
+    throw MyException("ERROR: Could not write to temporary file, check if " 
+                      "there is enough disk space.\n");
+  }
+  uint64_t offset = size_;
+  size_ += length;
+  return offset;
+}
+
+void TempFile::read(uint64_t offset, void* data, std::size_t length) {
+  if (length == 0u) return;
+  if (offset + length > size_) {
+    throw MyException("ERROR: Reading beyond the end of a temporary file.\n");
+  }
+  seek(offset);
+  atEnd_ = false;
+  if (std::fread(data, 1u, length, file_) != length) {
+    throw MyException("ERROR: Could not read from temporary file.\n");
+  }
+}
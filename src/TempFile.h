@@ -0,0 +1,55 @@
+/*******************************************************************************
+ Copyright 2006-2012 Lukas Käll <lukas.kall@scilifelab.se>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+
+ *******************************************************************************/
+#ifndef TEMP_FILE_H_
+#define TEMP_FILE_H_
+
+#include <cstdio>
+#include <cstddef>
+#include <stdint.h>
+
+/*
+* TempFile
+*
+* Anonymous temporary file for spilling data that does not fit into memory,
+* e.g. the sorted runs of an external merge sort. Data is appended and read
+* back from arbitrary byte offsets. The file is removed automatically when it
+* is closed or the program exits. Errors are reported as MyException.
+*
+*/
+class TempFile {
+ public:
+  TempFile();
+  ~TempFile();
+
+  // appends length bytes and returns the offset at which they were written
+  uint64_t append(const void* data, std::size_t length);
+  void read(uint64_t offset, void* data, std::size_t length);
+
+  inline uint64_t size() const { return size_; }
+
+ private:
+  std::FILE* file_;
+  uint64_t size_;
+  bool atEnd_; // the file position is at the end of the file
+
+  void seek(uint64_t offset);
+
+  TempFile(const TempFile&);
+  TempFile& operator=(const TempFile&);
+};
+
+#endif /* TEMP_FILE_H_ */
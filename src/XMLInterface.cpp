@@ -364,7 +364,7 @@ PSMDescription* XMLInterface::readPsm(
   percolatorInNs::peptideSpectrumMatch::occurence_const_iterator occIt;
   occIt = psm.occurence().begin();
   for ( ; occIt != psm.occurence().end(); ++occIt) {
-    if (readProteins) myPsm->proteinIds.push_back( occIt->proteinId() );
+    if (readProteins) myPsm->proteinIds.push_back( PSMDescription::internProteinName(occIt->proteinId()) );
     // adding n-term and c-term residues to peptide
     //NOTE the residues for the peptide in the PSMs are always the same for every protein
     myPsm->peptide = occIt->flankN() + "." + mypept + "." + occIt->flankC();
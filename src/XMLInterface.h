@@ -70,6 +70,11 @@ class XMLInterface {
     printExpMass_ = printExpMass; 
   }
   inline bool getPrintExpMass() { return printExpMass_; }
+  // command line of the search engine, as read from the pin-xml input
+  inline void setOtherCall(const std::string& otherCall) { 
+    otherCall_ = otherCall; 
+  }
+  inline const std::string& getOtherCall() const { return otherCall_; }
   
   int readPin(istream& dataStream, const std::string& xmlInputFN, 
     SetHandler& setHandler, SanityCheck*& pCheck, 
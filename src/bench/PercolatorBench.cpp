@@ -0,0 +1,559 @@
+/*******************************************************************************
+ Copyright 2006-2012 Lukas Käll <lukas.kall@scilifelab.se>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+
+ *******************************************************************************/
+
+/*
+* percolator-bench: offline microbenchmarks of the main stages of percolator
+* on a synthetic pin file, see SyntheticPinGenerator. The results are written
+* as JSON, with the throughput of each benchmark and the peak resident set 
+* size of the process after it, so that they can be compared run to run.
+*/
+
+#include <cstring>
+#include <cstdlib>
+#include <climits>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <set>
+#include <algorithm>
+#include <chrono>
+
+#ifdef _OPENMP
+  #include <omp.h>
+#endif
+
+#include "Version.h"
+#include "Globals.h"
+#include "MyException.h"
+#include "Option.h"
+#include "PseudoRandom.h"
+#include "Profiler.h"
+#include "DataSet.h"
+#include "SetHandler.h"
+#include "SanityCheck.h"
+#include "Normalizer.h"
+#include "Scores.h"
+#include "ssl.h"
+#include "Enzyme.h"
+#include "ProteinProbEstimator.h"
+#include "FidoInterface.h"
+#include "PickedProteinInterface.h"
+#include "SyntheticPinGenerator.h"
+
+namespace {
+
+class Stopwatch {
+ public:
+  Stopwatch() : start_(std::chrono::steady_clock::now()) {}
+  double seconds() const {
+    return std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start_).count();
+  }
+ private:
+  std::chrono::steady_clock::time_point start_;
+};
+
+struct BenchmarkResult {
+  BenchmarkResult(const std::string& n, const std::string& u) : 
+    name(n), unit(u), items(0.0), bytes(0.0), peakRssKb(0) {}
+  std::string name, unit; // unit of the processed items
+  double items, bytes; // processed per repetition
+  std::vector<double> seconds; // of each repetition
+  long peakRssKb;
+  
+  double bestSeconds() const { 
+    return *std::min_element(seconds.begin(), seconds.end()); 
+  }
+  double meanSeconds() const {
+    double sum = 0.0;
+    for (std::size_t i = 0; i < seconds.size(); ++i) sum += seconds[i];
+    return sum / static_cast<double>(seconds.size());
+  }
+};
+
+/*
+* State shared by the benchmarks, which are run in order: each benchmark 
+* works on the data prepared by the preceding ones
+*/
+struct BenchmarkContext {
+  BenchmarkContext() : setHandler(0u), allScores(true), pNorm(NULL), 
+    pCheck(NULL), enzyme(NULL), repeats(3u) {}
+  std::string pin;
+  SyntheticPinGenerator::Parameters params;
+  SetHandler setHandler;
+  Scores allScores;
+  Normalizer* pNorm;
+  SanityCheck* pCheck;
+  Enzyme* enzyme;
+  std::vector<double> direction; // of the correct PSMs, see SyntheticPinGenerator
+  std::vector<double> w; // normal vector of the separating hyperplane
+  unsigned int repeats;
+};
+
+/**
+ * Parses all PSM lines of the pin with TabReader only, without building 
+ * any data structures
+ */
+void benchTabReader(BenchmarkContext& ctx, BenchmarkResult& result) {
+  const char* pinStart = ctx.pin.c_str();
+  const char* pinEnd = pinStart + ctx.pin.size();
+  double checksum = 0.0;
+  for (unsigned int rep = 0; rep < ctx.repeats; ++rep) {
+    Stopwatch stopwatch;
+    const char* line = static_cast<const char*>(
+        memchr(pinStart, '\n', ctx.pin.size())) + 1;
+    while (line < pinEnd) {
+      const char* lineEnd = static_cast<const char*>(
+          memchr(line, '\n', static_cast<std::size_t>(pinEnd - line)));
+      if (lineEnd == NULL) lineEnd = pinEnd;
+      TabReader reader(line, lineEnd);
+      const char* field;
+      size_t fieldLength;
+      reader.readField(field, fieldLength); // SpecId
+      checksum += reader.readInt(); // Label
+      checksum += reader.readInt(); // ScanNr
+      checksum += reader.readDouble(); // ExpMass
+      checksum += reader.readDouble(); // CalcMass
+      for (unsigned int j = 0; j < ctx.params.numFeatures; ++j) {
+        checksum += reader.readDouble();
+      }
+      while (!reader.error()) { // peptide and proteins
+        reader.readField(field, fieldLength);
+        checksum += static_cast<double>(fieldLength);
+      }
+      line = lineEnd + 1;
+    }
+    result.seconds.push_back(stopwatch.seconds());
+  }
+  if (VERB > 2) cerr << "TabReader checksum: " << checksum << endl;
+  result.items = ctx.params.numPsms;
+  result.bytes = static_cast<double>(ctx.pin.size());
+}
+
+/**
+ * Reads the pin from memory with SetHandler::readTab, the PSMs of the last 
+ * repetition are kept for the following benchmarks
+ */
+void benchReadTab(BenchmarkContext& ctx, BenchmarkResult& result) {
+  for (unsigned int rep = 0; rep < ctx.repeats; ++rep) {
+    ctx.setHandler.reset();
+    if (ctx.pCheck) {
+      delete ctx.pCheck;
+      ctx.pCheck = NULL;
+    }
+    std::istringstream dataStream(ctx.pin);
+    Stopwatch stopwatch;
+    if (!ctx.setHandler.readTab(dataStream, ctx.pCheck)) {
+      throw MyException("ERROR: Failed to read the synthetic pin.\n");
+    }
+    result.seconds.push_back(stopwatch.seconds());
+  }
+  result.items = ctx.params.numPsms;
+  result.bytes = static_cast<double>(ctx.pin.size());
+  
+  ctx.setHandler.normalizeFeatures(ctx.pNorm);
+  ctx.allScores.populateWithPSMs(ctx.setHandler);
+  
+  // the generator's direction in normalized feature space, plus a bias term
+  ctx.w.assign(FeatureNames::getNumFeatures() + 1u, 0.0);
+  for (std::size_t j = 0; j < ctx.direction.size() && j < ctx.w.size(); ++j) {
+    ctx.w[j] = ctx.direction[j];
+  }
+}
+
+void benchCalcScores(BenchmarkContext& ctx, BenchmarkResult& result) {
+  for (unsigned int rep = 0; rep < ctx.repeats; ++rep) {
+    Stopwatch stopwatch;
+    int numPos = ctx.allScores.calcScores(ctx.w, 0.01);
+    result.seconds.push_back(stopwatch.seconds());
+    if (VERB > 2) cerr << "calcScores: " << numPos << " positives" << endl;
+  }
+  result.items = ctx.allScores.size();
+}
+
+void benchCalcQ(BenchmarkContext& ctx, BenchmarkResult& result) {
+  for (unsigned int rep = 0; rep < ctx.repeats; ++rep) {
+    Stopwatch stopwatch;
+    int numPos = ctx.allScores.calcQ(0.01);
+    result.seconds.push_back(stopwatch.seconds());
+    if (VERB > 2) cerr << "calcQ: " << numPos << " positives" << endl;
+  }
+  result.items = ctx.allScores.size();
+}
+
+void benchCreateXvalSets(BenchmarkContext& ctx, BenchmarkResult& result) {
+  const unsigned int numFolds = 3u;
+  for (unsigned int rep = 0; rep < ctx.repeats; ++rep) {
+    std::vector<Scores> train(numFolds, Scores(true)), test(numFolds, Scores(true));
+    Stopwatch stopwatch;
+    ctx.allScores.createXvalSetsBySpectrum(train, test, numFolds, 
+                                           ctx.setHandler.getFeaturePool());
+    result.seconds.push_back(stopwatch.seconds());
+  }
+  result.items = ctx.allScores.size();
+}
+
+/**
+ * Fills an AlgIn with the decoys and the targets below 1% FDR of allScores
+ * as scored by w, like a training iteration of CrossValidation
+ */
+void createTrainingSet(BenchmarkContext& ctx, AlgIn& data) {
+  ctx.allScores.calcScores(ctx.w, 0.01);
+  ctx.allScores.generateNegativeTrainingSet(data, 1.0);
+  ctx.allScores.generatePositiveTrainingSet(data, 0.01, 1.0, false);
+}
+
+void benchCgls(BenchmarkContext& ctx, BenchmarkResult& result) {
+  AlgIn data(ctx.allScores.size(), static_cast<int>(ctx.w.size()));
+  createTrainingSet(ctx, data);
+  
+  vector_int subset; // the destructor releases vec
+  subset.d = data.m;
+  subset.vec = new int[data.m];
+  for (int i = 0; i < data.m; ++i) subset.vec[i] = i;
+  SvmWorkspace workspace;
+  vector_double weights, outputs; // the destructors release vec
+  weights.d = data.n;
+  weights.vec = new double[data.n];
+  outputs.d = data.m;
+  outputs.vec = new double[data.m];
+  for (unsigned int rep = 0; rep < ctx.repeats; ++rep) {
+    std::fill(weights.vec, weights.vec + weights.d, 0.0);
+    std::fill(outputs.vec, outputs.vec + outputs.d, 0.0);
+    Stopwatch stopwatch;
+    CGLS(data, 1.0, CGITERMAX, EPSILON, subset, weights, outputs, 1.0, 1.0, 
+         workspace);
+    result.seconds.push_back(stopwatch.seconds());
+  }
+  result.items = data.m;
+}
+
+void benchL2SvmMfn(BenchmarkContext& ctx, BenchmarkResult& result) {
+  AlgIn data(ctx.allScores.size(), static_cast<int>(ctx.w.size()));
+  createTrainingSet(ctx, data);
+  
+  options svmOptions;
+  svmOptions.lambda = 1.0;
+  svmOptions.lambda_u = 1.0;
+  svmOptions.epsilon = EPSILON;
+  svmOptions.cgitermax = CGITERMAX;
+  svmOptions.mfnitermax = MFNITERMAX;
+  SvmWorkspace workspace;
+  vector_double weights, outputs; // the destructors release vec
+  weights.d = data.n;
+  weights.vec = new double[data.n];
+  outputs.d = data.m;
+  outputs.vec = new double[data.m];
+  for (unsigned int rep = 0; rep < ctx.repeats; ++rep) {
+    std::fill(weights.vec, weights.vec + weights.d, 0.0);
+    std::fill(outputs.vec, outputs.vec + outputs.d, 0.0);
+    Stopwatch stopwatch;
+    L2_SVM_MFN(data, svmOptions, weights, outputs, 1.0, 1.0, workspace);
+    result.seconds.push_back(stopwatch.seconds());
+  }
+  result.items = data.m;
+}
+
+/**
+ * Posterior error probabilities of the PSMs, i.e. the BaseSpline fit 
+ * through PosteriorEstimator::estimatePEP
+ */
+void benchPep(BenchmarkContext& ctx, BenchmarkResult& result) {
+  ctx.allScores.calcScores(ctx.w, 0.01);
+  for (unsigned int rep = 0; rep < ctx.repeats; ++rep) {
+    Stopwatch stopwatch;
+    ctx.allScores.calcPep();
+    result.seconds.push_back(stopwatch.seconds());
+  }
+  result.items = ctx.allScores.size();
+}
+
+/**
+ * Keeps the best PSM per peptide and calculates its q-value and PEP, as 
+ * done before protein inference
+ */
+void prepareProteinInference(BenchmarkContext& ctx) {
+  ctx.allScores.calcScores(ctx.w, 0.01);
+  ctx.allScores.weedOutRedundant();
+  ctx.allScores.calcQ(0.01);
+  ctx.allScores.calcPep();
+}
+
+void runProteinInference(ProteinProbEstimator& protEstimator, 
+                         BenchmarkContext& ctx) {
+  protEstimator.initialize(ctx.allScores, ctx.enzyme);
+  protEstimator.run();
+  protEstimator.computeProbabilities();
+  protEstimator.computeStatistics();
+}
+
+void benchFido(BenchmarkContext& ctx, BenchmarkResult& result) {
+  prepareProteinInference(ctx);
+  for (unsigned int rep = 0; rep < ctx.repeats; ++rep) {
+    // parameters as set by Caller without any fido options
+    FidoInterface fido(-1, -1, -1, false, false, false, 0u, 0.0, 0.01, 0.1, 
+                       1.0, false, "random_", true, -1.0);
+    Stopwatch stopwatch;
+    runProteinInference(fido, ctx);
+    result.seconds.push_back(stopwatch.seconds());
+  }
+  result.items = ctx.allScores.size();
+}
+
+void benchPickedProtein(BenchmarkContext& ctx, BenchmarkResult& result) {
+  std::string decoyPattern = "random_";
+  for (unsigned int rep = 0; rep < ctx.repeats; ++rep) {
+    PickedProteinInterface pickedProtein("auto", 1.0, false, false, true, 1.0, 
+                                         false, decoyPattern, -1.0);
+    Stopwatch stopwatch;
+    runProteinInference(pickedProtein, ctx);
+    result.seconds.push_back(stopwatch.seconds());
+  }
+  result.items = ctx.allScores.size();
+}
+
+typedef void (*BenchmarkFunction)(BenchmarkContext&, BenchmarkResult&);
+
+struct Benchmark {
+  const char* name;
+  const char* unit;
+  BenchmarkFunction run;
+};
+
+// in order of execution, see BenchmarkContext
+const Benchmark kBenchmarks[] = {
+  { "tab-reader", "psms", benchTabReader },
+  { "read-tab", "psms", benchReadTab },
+  { "calc-scores", "psms", benchCalcScores },
+  { "calc-q", "psms", benchCalcQ },
+  { "create-xval-sets", "psms", benchCreateXvalSets },
+  { "cgls", "examples", benchCgls },
+  { "l2-svm-mfn", "examples", benchL2SvmMfn },
+  { "pep", "psms", benchPep },
+  { "fido", "peptides", benchFido },
+  { "picked-protein", "peptides", benchPickedProtein }
+};
+const std::size_t kNumBenchmarks = sizeof(kBenchmarks) / sizeof(kBenchmarks[0]);
+
+void writeJson(std::ostream& os, const BenchmarkContext& ctx, 
+               unsigned long seed, double generateSeconds,
+               const std::vector<BenchmarkResult>& results) {
+  const SyntheticPinGenerator::Parameters& params = ctx.params;
+  int numThreads = 1;
+#ifdef _OPENMP
+  numThreads = omp_get_max_threads();
+#endif
+  os << "{\n"
+     << "  \"version\": \"" << VERSION << "\",\n"
+     << "  \"threads\": " << numThreads << ",\n"
+     << "  \"repeats\": " << ctx.repeats << ",\n"
+     << "  \"dataset\": {\n"
+     << "    \"psms\": " << params.numPsms << ",\n"
+     << "    \"features\": " << params.numFeatures << ",\n"
+     << "    \"target_decoy_ratio\": " << params.targetDecoyRatio << ",\n"
+     << "    \"separation\": " << params.separation << ",\n"
+     << "    \"psms_per_scan\": " << params.psmsPerScan << ",\n"
+     << "    \"proteins_per_peptide\": " << params.proteinsPerPeptide << ",\n"
+     << "    \"fraction_correct\": " << params.fractionCorrect << ",\n"
+     << "    \"concatenated\": " << (params.concatenated ? "true" : "false") << ",\n"
+     << "    \"seed\": " << seed << ",\n"
+     << "    \"pin_bytes\": " << ctx.pin.size() << ",\n"
+     << "    \"generate_seconds\": " << generateSeconds << "\n"
+     << "  },\n"
+     << "  \"benchmarks\": [";
+  for (std::size_t i = 0; i < results.size(); ++i) {
+    const BenchmarkResult& r = results[i];
+    double best = r.bestSeconds();
+    os << (i > 0 ? "," : "") << "\n    {\n"
+       << "      \"name\": \"" << r.name << "\",\n"
+       << "      \"unit\": \"" << r.unit << "\",\n"
+       << "      \"items\": " << r.items << ",\n"
+       << "      \"best_seconds\": " << best << ",\n"
+       << "      \"mean_seconds\": " << r.meanSeconds() << ",\n"
+       << "      \"items_per_second\": " << (best > 0.0 ? r.items / best : 0.0);
+    if (r.bytes > 0.0) {
+      os << ",\n      \"mb_per_second\": " 
+         << (best > 0.0 ? r.bytes / best / 1e6 : 0.0);
+    }
+    os << ",\n      \"peak_rss_kb\": " << r.peakRssKb << "\n    }";
+  }
+  os << "\n  ],\n"
+     << "  \"peak_rss_kb\": " << Profiler::getPeakRssKb() << "\n"
+     << "}" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  try {
+    ostringstream intro;
+    intro << "percolator-bench version " << VERSION << std::endl
+          << "Usage:" << std::endl
+          << "   percolator-bench [options]" << std::endl << std::endl
+          << "Generates a synthetic pin file in memory and times the main "
+          << "stages of" << std::endl 
+          << "percolator on it. Results are written in JSON format." 
+          << std::endl << std::endl
+          << "Benchmarks, in order of execution:";
+    for (std::size_t i = 0; i < kNumBenchmarks; ++i) {
+      intro << " " << kBenchmarks[i].name;
+    }
+    intro << std::endl;
+    
+    SyntheticPinGenerator::Parameters params;
+    CommandLineParser cmd(intro.str());
+    cmd.defineOption("n", "psms", "Number of PSMs. Default = 100000.", "value");
+    cmd.defineOption("f", "features", "Number of features. Default = 20.", "value");
+    cmd.defineOption("r", "target-decoy-ratio", 
+        "Number of target PSMs per decoy PSM. Default = 1.", "value");
+    cmd.defineOption("s", "separation", 
+        "Distance between the correct and incorrect PSMs in standard "
+        "deviations. Default = 3.", "value");
+    cmd.defineOption("c", "fraction-correct", 
+        "Fraction of the top ranked target PSMs that is correct. Default = 0.4.", 
+        "value");
+    cmd.defineOption("p", "psms-per-scan", "Number of PSMs per scan. Default = 1.", 
+        "value");
+    cmd.defineOption("P", "proteins-per-peptide", 
+        "Average number of proteins per peptide. Default = 1.5.", "value");
+    cmd.defineOption("Y", "concatenated", 
+        "Let targets and decoys compete for the same scans, as in a "
+        "concatenated search.", "", TRUE_IF_SET);
+    cmd.defineOption("S", "seed", "Seed of the random number generator. "
+        "Default = 1.", "value");
+    cmd.defineOption("R", "repeats", "Number of repetitions of each "
+        "benchmark. Default = 3.", "value");
+    cmd.defineOption("b", "benchmarks", "Comma separated list of benchmarks "
+        "to report, the benchmarks they depend on are run anyway. Default = all.",
+        "names");
+    cmd.defineOption("o", "output", "Write the JSON results to this file "
+        "instead of stdout.", "filename");
+    cmd.defineOption("w", "write-pin", "Also write the synthetic pin to this "
+        "file, e.g. to time the percolator binary on it.", "filename");
+    cmd.defineOption("v", "verbose", "Set verbosity of output: 0 = no "
+        "processing info, 5 = all. Default = 0.", "level");
+    cmd.parseArgs(argc, argv);
+    
+    Globals::getInstance()->setVerbose(0);
+    if (cmd.optionSet("verbose")) {
+      Globals::getInstance()->setVerbose(cmd.getInt("verbose", 0, 10));
+    }
+    if (cmd.optionSet("psms")) {
+      params.numPsms = cmd.getUInt("psms", 100, INT_MAX);
+    }
+    if (cmd.optionSet("features")) {
+      params.numFeatures = cmd.getUInt("features", 1, 1000);
+    }
+    if (cmd.optionSet("target-decoy-ratio")) {
+      params.targetDecoyRatio = cmd.getDouble("target-decoy-ratio", 0.01, 100.0);
+    }
+    if (cmd.optionSet("separation")) {
+      params.separation = cmd.getDouble("separation", 0.0, 100.0);
+    }
+    if (cmd.optionSet("fraction-correct")) {
+      params.fractionCorrect = cmd.getDouble("fraction-correct", 0.0, 1.0);
+    }
+    if (cmd.optionSet("psms-per-scan")) {
+      params.psmsPerScan = cmd.getUInt("psms-per-scan", 1, 100);
+    }
+    if (cmd.optionSet("proteins-per-peptide")) {
+      params.proteinsPerPeptide = cmd.getDouble("proteins-per-peptide", 1.0, 100.0);
+    }
+    params.concatenated = cmd.optionSet("concatenated");
+    unsigned long seed = 1u;
+    if (cmd.optionSet("seed")) {
+      seed = static_cast<unsigned long>(cmd.getInt("seed", 1, 20000));
+    }
+    
+    BenchmarkContext ctx;
+    if (cmd.optionSet("repeats")) {
+      ctx.repeats = cmd.getUInt("repeats", 1, 1000);
+    }
+    std::set<std::string> selected;
+    if (cmd.optionSet("benchmarks")) {
+      std::istringstream names(cmd.options["benchmarks"]);
+      std::string name;
+      while (getline(names, name, ',')) {
+        bool known = false;
+        for (std::size_t i = 0; i < kNumBenchmarks; ++i) {
+          if (name == kBenchmarks[i].name) known = true;
+        }
+        if (!known) {
+          throw MyException("ERROR: Unknown benchmark " + name + ".\n");
+        }
+        selected.insert(name);
+      }
+    }
+    
+    // protein inference needs well formatted peptides and the proteins
+    ProteinProbEstimator::setCalcProteinLevelProb(true);
+    ctx.enzyme = Enzyme::createEnzyme(Enzyme::TRYPSIN);
+    ctx.params = params;
+    
+    PseudoRandom::setSeed(seed);
+    Stopwatch generateStopwatch;
+    SyntheticPinGenerator generator(params);
+    std::ostringstream pinStream;
+    generator.write(pinStream);
+    ctx.pin = pinStream.str();
+    ctx.direction = generator.getDirection();
+    double generateSeconds = generateStopwatch.seconds();
+    if (cmd.optionSet("write-pin")) {
+      std::ofstream pinFile(cmd.options["write-pin"].c_str());
+      pinFile << ctx.pin;
+      if (!pinFile) {
+        throw MyException("ERROR: Could not write " + cmd.options["write-pin"] + ".\n");
+      }
+    }
+    
+    // the last selected benchmark determines how far the pipeline is run
+    std::size_t numToRun = kNumBenchmarks;
+    if (!selected.empty()) {
+      while (selected.count(kBenchmarks[numToRun - 1u].name) == 0u) --numToRun;
+    }
+    std::vector<BenchmarkResult> results;
+    for (std::size_t i = 0; i < numToRun; ++i) {
+      BenchmarkResult result(kBenchmarks[i].name, kBenchmarks[i].unit);
+      if (VERB > 0) cerr << "Running " << result.name << endl;
+      kBenchmarks[i].run(ctx, result);
+      result.peakRssKb = Profiler::getPeakRssKb();
+      if (selected.empty() || selected.count(result.name) > 0u) {
+        results.push_back(result);
+      }
+    }
+    
+    if (cmd.optionSet("output")) {
+      std::ofstream jsonFile(cmd.options["output"].c_str());
+      writeJson(jsonFile, ctx, seed, generateSeconds, results);
+    } else {
+      writeJson(std::cout, ctx, seed, generateSeconds, results);
+    }
+    
+    delete ctx.pCheck;
+    delete ctx.pNorm;
+    delete ctx.enzyme;
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+  } catch (...) {
+    std::cerr << "Unknown exception, contact the developer.." << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,169 @@
+/*******************************************************************************
+ Copyright 2006-2012 Lukas Käll <lukas.kall@scilifelab.se>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+
+ *******************************************************************************/
+
+#include <cmath>
+#include <sstream>
+
+#include "SyntheticPinGenerator.h"
+
+namespace {
+// amino acids that are not a tryptic cleavage site
+const char kAminoAcids[] = "ACDEFGHILMNPQSTVWY";
+const unsigned int kNumAminoAcids = sizeof(kAminoAcids) - 1u;
+const unsigned int kMinPeptideLength = 7u, kMaxPeptideLength = 20u;
+const double kPi = 3.14159265358979323846;
+}
+
+SyntheticPinGenerator::SyntheticPinGenerator(const Parameters& params) :
+    params_(params), numPresentPeptides_(0u), rng_(0u) {
+  if (params_.numFeatures == 0u) params_.numFeatures = 1u;
+  if (params_.psmsPerScan == 0u) params_.psmsPerScan = 1u;
+  if (params_.peptidesPerProtein == 0u) params_.peptidesPerProtein = 1u;
+  if (params_.proteinsPerPeptide < 1.0) params_.proteinsPerPeptide = 1.0;
+  
+  // decreasing contribution of the later features
+  double norm = 0.0;
+  for (unsigned int j = 0; j < params_.numFeatures; ++j) {
+    direction_.push_back(1.0 / std::sqrt(j + 1.0));
+    norm += direction_.back() * direction_.back();
+  }
+  norm = std::sqrt(norm);
+  for (unsigned int j = 0; j < params_.numFeatures; ++j) {
+    direction_[j] /= norm;
+  }
+  createPeptides();
+}
+
+double SyntheticPinGenerator::uniform() {
+  return static_cast<double>(rng_.lcg_rand()) / 
+             static_cast<double>(PseudoRandom::kRandMax);
+}
+
+double SyntheticPinGenerator::normal() {
+  // Box-Muller transform, uniform() is never zero
+  return std::sqrt(-2.0 * std::log(uniform())) * std::cos(2.0 * kPi * uniform());
+}
+
+/**
+ * Creates about 4 PSMs per peptide, the first fractionCorrect of the 
+ * proteins and their peptides are the ones present in the sample
+ */
+void SyntheticPinGenerator::createPeptides() {
+  unsigned int numPeptides = params_.numPsms / 4u + 1u;
+  unsigned int numProteins = numPeptides / params_.peptidesPerProtein + 1u;
+  numPresentPeptides_ = static_cast<unsigned int>(
+      params_.fractionCorrect * numPeptides) + 1u;
+  if (numPresentPeptides_ > numPeptides) numPresentPeptides_ = numPeptides;
+  
+  peptides_.resize(numPeptides);
+  peptideProteins_.resize(numPeptides);
+  for (unsigned int i = 0; i < numPeptides; ++i) {
+    unsigned int length = kMinPeptideLength + static_cast<unsigned int>(
+        uniform() * (kMaxPeptideLength - kMinPeptideLength));
+    std::string& peptide = peptides_[i];
+    for (unsigned int k = 0; k + 1u < length; ++k) {
+      peptide += kAminoAcids[static_cast<unsigned int>(uniform() * kNumAminoAcids)];
+    }
+    peptide += (uniform() < 0.5 ? 'K' : 'R');
+    
+    peptideProteins_[i].push_back(i / params_.peptidesPerProtein);
+    double numShared = params_.proteinsPerPeptide - 1.0;
+    while (numShared >= 1.0 || uniform() < numShared) {
+      peptideProteins_[i].push_back(
+          static_cast<unsigned int>(uniform() * numProteins));
+      numShared -= 1.0;
+    }
+  }
+}
+
+/**
+ * Writes the header and all PSMs. With separate searches, the target and 
+ * decoy PSMs come from different scans with the same scan numbers, with a 
+ * concatenated search each scan is either matched to targets or to decoys.
+ */
+void SyntheticPinGenerator::write(std::ostream& os) {
+  os << "SpecId\tLabel\tScanNr\tExpMass\tCalcMass";
+  for (unsigned int j = 0; j < params_.numFeatures; ++j) {
+    os << "\tfeature" << j + 1u;
+  }
+  os << "\tPeptide\tProteins\n";
+  
+  double targetFraction = params_.targetDecoyRatio / 
+                              (1.0 + params_.targetDecoyRatio);
+  unsigned int psmIdx = 0u;
+  if (params_.concatenated) {
+    for (unsigned int scan = 1u; psmIdx < params_.numPsms; ++scan) {
+      bool isDecoy = (uniform() >= targetFraction);
+      writeScan(os, psmIdx, params_.numPsms, scan, isDecoy);
+    }
+  } else {
+    unsigned int numTargets = static_cast<unsigned int>(
+        targetFraction * params_.numPsms + 0.5);
+    for (unsigned int scan = 1u; psmIdx < numTargets; ++scan) {
+      writeScan(os, psmIdx, numTargets, scan, false);
+    }
+    for (unsigned int scan = 1u; psmIdx < params_.numPsms; ++scan) {
+      writeScan(os, psmIdx, params_.numPsms, scan, true);
+    }
+  }
+}
+
+/**
+ * Writes the PSMs of one scan, of which only the top ranked can be correct
+ * @param psmIdx index of the first PSM, updated to one past the last one
+ * @param lastPsm index after which no PSMs are written
+ */
+void SyntheticPinGenerator::writeScan(std::ostream& os, unsigned int& psmIdx,
+    unsigned int lastPsm, unsigned int scan, bool isDecoy) {
+  bool isCorrect = !isDecoy && uniform() < params_.fractionCorrect;
+  for (unsigned int rank = 0; rank < params_.psmsPerScan && psmIdx < lastPsm; 
+         ++rank) {
+    writePsm(os, psmIdx++, scan, isDecoy, isCorrect && rank == 0u);
+  }
+}
+
+void SyntheticPinGenerator::writePsm(std::ostream& os, unsigned int psmIdx, 
+    unsigned int scan, bool isDecoy, bool isCorrect) {
+  unsigned int peptideIdx = static_cast<unsigned int>(uniform() * 
+      (isCorrect ? numPresentPeptides_ : peptides_.size()));
+  const std::string& peptide = peptides_[peptideIdx];
+  double expMass = 500.0 + 0.25 * scan;
+  
+  os << (isDecoy ? "decoy_" : "target_") << psmIdx << '\t' 
+     << (isDecoy ? -1 : 1) << '\t' << scan << '\t' << expMass << '\t' 
+     << expMass + 0.01 * normal();
+  for (unsigned int j = 0; j < params_.numFeatures; ++j) {
+    double feature = normal();
+    if (isCorrect) feature += params_.separation * direction_[j];
+    os << '\t' << feature;
+  }
+  
+  // decoy peptides are the reversed target peptides, keeping the C-terminus
+  os << "\tK.";
+  if (isDecoy) {
+    os << std::string(peptide.rbegin() + 1, peptide.rend()) 
+       << peptide[peptide.size() - 1u];
+  } else {
+    os << peptide;
+  }
+  os << ".A";
+  const std::vector<unsigned int>& proteins = peptideProteins_[peptideIdx];
+  for (std::size_t k = 0; k < proteins.size(); ++k) {
+    os << '\t' << (isDecoy ? "random_" : "") << "PROT_" << proteins[k];
+  }
+  os << '\n';
+}
@@ -0,0 +1,81 @@
+/*******************************************************************************
+ Copyright 2006-2012 Lukas Käll <lukas.kall@scilifelab.se>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+
+ *******************************************************************************/
+
+#ifndef SYNTHETIC_PIN_GENERATOR_H_
+#define SYNTHETIC_PIN_GENERATOR_H_
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "PseudoRandom.h"
+
+/*
+* SyntheticPinGenerator writes a tab delimited percolator input file (pin) 
+* without the need for search engine output. The file only depends on the
+* parameters and on the seed of PseudoRandom.
+*
+* The features of incorrect target PSMs and of decoy PSMs are standard 
+* normal, those of correct target PSMs are shifted by separation standard 
+* deviations along a fixed unit direction, see getDirection. Correct PSMs 
+* match peptides of a subset of "present" proteins, incorrect PSMs match any 
+* peptide. Every peptide belongs to one protein plus on average 
+* proteinsPerPeptide - 1 randomly chosen other ones.
+*
+*/
+class SyntheticPinGenerator {
+ public:
+  struct Parameters {
+    Parameters() : numPsms(100000u), numFeatures(20u), targetDecoyRatio(1.0),
+      separation(3.0), psmsPerScan(1u), proteinsPerPeptide(1.5), 
+      peptidesPerProtein(10u), fractionCorrect(0.4), concatenated(false) {}
+    unsigned int numPsms;
+    unsigned int numFeatures;
+    double targetDecoyRatio; // number of target PSMs per decoy PSM
+    double separation; // shift of the correct PSMs in standard deviations
+    unsigned int psmsPerScan;
+    double proteinsPerPeptide; // average, at least 1
+    unsigned int peptidesPerProtein;
+    double fractionCorrect; // of the top ranked target PSMs
+    bool concatenated; // targets and decoys compete for the same scans
+  };
+  
+  explicit SyntheticPinGenerator(const Parameters& params);
+  
+  void write(std::ostream& os);
+  
+  // unit direction along which correct PSMs are separated from incorrect ones
+  const std::vector<double>& getDirection() const { return direction_; }
+  
+ protected:
+  Parameters params_;
+  std::vector<double> direction_;
+  std::vector<std::string> peptides_;
+  std::vector<std::vector<unsigned int> > peptideProteins_;
+  unsigned int numPresentPeptides_;
+  PseudoRandom::Stream rng_;
+  
+  double uniform();
+  double normal();
+  void createPeptides();
+  void writeScan(std::ostream& os, unsigned int& psmIdx, unsigned int lastPsm,
+                 unsigned int scan, bool isDecoy);
+  void writePsm(std::ostream& os, unsigned int psmIdx, unsigned int scan,
+                bool isDecoy, bool isCorrect);
+};
+
+#endif /* SYNTHETIC_PIN_GENERATOR_H_ */
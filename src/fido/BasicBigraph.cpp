@@ -1,7 +1,9 @@
 // Written by Oliver Serang 2009
 // see license for more information
 
+#include <algorithm>
 #include "BasicBigraph.h"
+#include "CompactBigraph.h"
 
 BasicBigraph::BasicBigraph(): PsmThreshold(0.0), PeptideThreshold(1e-3),
   ProteinThreshold(1e-3) {}
@@ -17,7 +19,8 @@ void BasicBigraph::read(Scores* fullset, bool multiple_labeled_peptides) {
   string pepName, protName;
   double value =  -10;
   int pepIndex = -1;
-  StringTable PSMNames, proteinNames;
+  NameIndex PSMNames, proteinNames;
+  EdgeList edges;
 
   vector<ScoreHolder>::iterator psm = fullset->begin();
   for (; psm!= fullset->end(); ++psm) {
@@ -40,27 +43,20 @@ void BasicBigraph::read(Scores* fullset, bool multiple_labeled_peptides) {
       pepName += "*";
     }
     
-    if ( PSMNames.lookup(pepName) == -1 ){
-      add(PSMsToProteins, PSMNames, pepName);
-    }
-    pepIndex = PSMNames.lookup(pepName);
+    pepIndex = add(PSMsToProteins, PSMNames, pepName);
 
     // r proteins
-    std::vector<string>::const_iterator pid = psm->pPSM->proteinIds.begin();
+    std::vector<unsigned int>::const_iterator pid = psm->pPSM->proteinIds.begin();
     for (; pid!= psm->pPSM->proteinIds.end(); ++pid) {
-      protName = getRidOfUnprintablesAndUnicode(*pid);
-      if (proteinNames.lookup(protName) == -1) {
-        add(proteinsToPSMs, proteinNames, protName);
-      }
-      connect(PSMNames, pepName, proteinNames, protName);
+      protName = getRidOfUnprintablesAndUnicode(PSMDescription::getProteinName(*pid));
+      int protIndex = add(proteinsToPSMs, proteinNames, protName);
+      edges.push_back(std::make_pair(pepIndex, protIndex));
     }
     // p probability of the peptide match to the spectrum
     value = 1 - psm->pep;
     PSMsToProteins.weights[ pepIndex ] = max(PSMsToProteins.weights[pepIndex], value);
  }
-
-  PSMsToProteins.names = PSMNames.getItemsByNumber();
-  proteinsToPSMs.names = proteinNames.getItemsByNumber();
+  connect(edges);
   
   //NOTE this function is assigning PeptideThreshold probablity to all the PSMs with a prob below PeptideThreshold
   /**pseudoCountPSMs();**/
@@ -75,7 +71,8 @@ void BasicBigraph::read(istream & is, bool multiple_labeled_peptides) {
   int pepIndex = -1;
   int state = 'e';
 
-  StringTable PSMNames, proteinNames;
+  NameIndex PSMNames, proteinNames;
+  EdgeList edges;
 
   while (is >> instr) {
     if (instr == 'e' && (state == 'e' || state == 'p')) {
@@ -90,21 +87,15 @@ void BasicBigraph::read(istream & is, bool multiple_labeled_peptides) {
       is >> pepName;
       //pepName = cleanPeptideSequence(pepName);
       
-      if (PSMNames.lookup(pepName) == -1) {
-        add(PSMsToProteins, PSMNames, pepName);
-      }
-      
-      pepIndex = PSMNames.lookup(pepName);
+      pepIndex = add(PSMsToProteins, PSMNames, pepName);
       state = 'c';
     } else if (instr == 'c' && state == 'c') {
       state = 'r';
     } else if ( instr == 'r' && ( state == 'c' || state == 'r' || state == 'p' ) ) {
       is >> protName;
 
-      if ( proteinNames.lookup(protName) == -1 )
-        add(proteinsToPSMs, proteinNames, protName);
-
-      connect(PSMNames, pepName, proteinNames, protName);
+      int protIndex = add(proteinsToPSMs, proteinNames, protName);
+      edges.push_back(std::make_pair(pepIndex, protIndex));
       state = 'p';
     } else if ( instr == 'p' && state == 'p' ) {
       is >> value;
@@ -119,9 +110,7 @@ void BasicBigraph::read(istream & is, bool multiple_labeled_peptides) {
       throw MyException("");
     }
   }
-
-  PSMsToProteins.names = PSMNames.getItemsByNumber();
-  proteinsToPSMs.names = proteinNames.getItemsByNumber();
+  connect(edges);
 
   //NOTE this function is assigning PeptideThreshold probablity to all the PSMs with a prob below PeptideThreshold
   /**pseudoCountPSMs();**/
@@ -142,88 +131,11 @@ void BasicBigraph::printGraphStats() const
 }
 
 
-void BasicBigraph::saveSeveredProteins() {
-  severedProteins = Array<string>();
-  for (int k = 0; k < proteinsToPSMs.size(); k++) {
-    if (proteinsToPSMs.associations[k].size() == 0) {
-      severedProteins.add( proteinsToPSMs.names[k] );
-    }
-  }
-}
-
+/* prunes in the compressed form, see CompactBigraph */
 void BasicBigraph::prune() {
-  removePoorPSMs();
-  removePoorProteins();
-  saveSeveredProteins();
-  reindex();
-  markSectionPartitions();
-  cloneMultipleMarkedPSMs();
-  reindex();
-}
-
-
-void BasicBigraph::cloneMultipleMarkedPSMs() {
-  numberClones = 0;
-  // compute this once, since it will change as you add clones
-  int N = PSMsToProteins.size();
-
-  for (int k = 0; k < N; k++) {
-    const GraphNode & psm = PSMsToProteins[k];
-    // the way the marking procedure works, it will only multiple
-    // mark PSMs with a score <= PeptideThreshold
-    if (psm.sectionMark.size() > 1) {
-      clonePSM(k);
-    }
-  }
-}
-
-void BasicBigraph::clonePSM(int pepIndex) {
-  // add a new copy of this PSM for every section
-  // first find the sections that this PSM associates with
-  Set sections;
-  const Set & s = PSMsToProteins.associations[pepIndex];
-  for (int k = 0; k < s.size(); k++) {
-    int sect = proteinsToPSMs[ s[k] ].section;
-    sections |= Set::SingletonSet(sect);
-  }
-  // index the proteins by the sections they belong to
-  Array<Set> associatedProteinsBySection(sections.size());
-  for (int k = 0; k < s.size(); k++) {
-    int sect = proteinsToPSMs.sections[ s[k] ];
-    int ind = sections.find(sect);
-    associatedProteinsBySection[ ind ] |= Set::SingletonSet(s[k]);
-  }
-  // add a clone for each of the sections-- include the first one,
-  // since it will be easier to build them all than to have a special
-  // case. 
-
-  for (int k = 0; k < associatedProteinsBySection.size(); k++) {
-    int sect = sections[k];
-    ostringstream ost;
-    ost << PSMsToProteins[ pepIndex ].name << "_clone_" << sect;
-    
-    PSMsToProteins.names.add( ost.str() );
-    PSMsToProteins.associations.add( associatedProteinsBySection[k] );
-    PSMsToProteins.weights.add( PSMsToProteins[ pepIndex ].weight );
-    PSMsToProteins.sections.add(sect);
-
-    // add the association from this section's proteins to the new peptide
-    for (int j = 0; j<associatedProteinsBySection[k].size(); j++)
-      proteinsToPSMs.associations[ associatedProteinsBySection[k][j] ] |= Set::SingletonSet( PSMsToProteins.size()-1 );
-  }
-
-  // afterward, erase the original
-  // (remove the associations from proteins)
-  for (int k = 0; k < associatedProteinsBySection.size(); k++) {
-    for (int j = 0; j < associatedProteinsBySection[k].size(); j++) {
-      int prot = associatedProteinsBySection[k][j];
-      proteinsToPSMs[prot].association = proteinsToPSMs[prot].association.without( Set::SingletonSet(pepIndex) );
-    }
-  }
-
-  // (remove the associations to proteins)
-  PSMsToProteins[ pepIndex ].association = Set();
-  numberClones += static_cast<int>(sections.size()-1);
+  CompactBigraph graph(*this);
+  graph.prune();
+  graph.toBasicBigraph(*this);
 }
 
 void BasicBigraph::reindex() {
@@ -278,31 +190,6 @@ BasicBigraph BasicBigraph::buildSubgraph(const Set & connectedProteins, const Se
   return result;
 }
 
-void BasicBigraph::removePoorPSMs() {
-  for (int k = 0; k < PSMsToProteins.size(); k++) {
-    if (PSMsToProteins.weights[k] < PsmThreshold) {
-      disconnectPSM(k);
-    }
-  }
-}
-
-void BasicBigraph::removePoorProteins() {
-  for (int k = 0; k < proteinsToPSMs.size(); k++) {
-    if (Vector(PSMsToProteins.weights[ proteinsToPSMs.associations[k] ]).max() < ProteinThreshold) {
-      disconnectProtein(k);
-    }
-  }
-}
-
-void BasicBigraph::disconnectPSM(int k) {
-  Set& as = PSMsToProteins.associations[k];
-  for (Set::Iterator iter = as.begin(); iter != as.end(); iter++) {
-    Set& setRef = proteinsToPSMs.associations[ *iter ];
-    setRef = setRef.without( Set::SingletonSet( k ) );
-  }
-  as = Set();
-}
-
 void BasicBigraph::disconnectProtein(int k) {
   Set & as = proteinsToPSMs.associations[k];
   for (Set::Iterator iter = as.begin(); iter != as.end(); iter++) {
@@ -312,26 +199,33 @@ void BasicBigraph::disconnectProtein(int k) {
   as = Set();
 }
 
-void BasicBigraph::add(GraphLayer & gl, StringTable & st, const string & item) {
-  if ( st.lookup(item) == -1 ) {
-    // if the string is not already known, then add a new node for it
-    st.add(item);
+// returns the index of @item, adding a new node for it if it is not known yet
+int BasicBigraph::add(GraphLayer & gl, NameIndex & index, const string & item) {
+  std::pair<NameIndex::iterator, bool> inserted = 
+      index.insert(std::make_pair(item, gl.size()));
+  if (inserted.second) {
+    gl.names.add(item);
     gl.associations.add( Set() );
     gl.weights.add( -1.0 );
     gl.sections.add(-1);
   }
+  return inserted.first->second;
 }
 
-void BasicBigraph::connect(const StringTable & pepNames, const string & pepName, const StringTable & proteinNames, const string & protName)
-{
-  int pepIndex = pepNames.lookup(pepName);
-  int protIndex = proteinNames.lookup(protName);
-
-  // performance note: currently O(n^2) worstcase. Later use a bitset
-  // and then after the graph is read, pack it into a set. 
-
-  PSMsToProteins.associations[ pepIndex ] |= Set::SingletonSet(protIndex);
-  proteinsToPSMs.associations[ protIndex ] |= Set::SingletonSet(pepIndex);
+/* packs the (PSM, protein) pairs read from the input into the associations of
+   both layers. The sorted edge list is the compressed adjacency of the PSMs, 
+   and since it is traversed in order of the PSMs, the associations of the 
+   proteins come out sorted as well. */
+void BasicBigraph::connect(EdgeList & PSMProteinEdges) {
+  std::sort(PSMProteinEdges.begin(), PSMProteinEdges.end());
+  PSMProteinEdges.erase(std::unique(PSMProteinEdges.begin(), PSMProteinEdges.end()), 
+                        PSMProteinEdges.end());
+  
+  EdgeList::const_iterator edge = PSMProteinEdges.begin();
+  for (; edge != PSMProteinEdges.end(); ++edge) {
+    PSMsToProteins.associations[ edge->first ].add(edge->second);
+    proteinsToPSMs.associations[ edge->second ].add(edge->first);
+  }
 }
 
 void BasicBigraph::printProteinWeights() const
@@ -346,84 +240,15 @@ void BasicBigraph::printProteinWeights() const
     }
 }
 
-void BasicBigraph::traceConnected(int index, GraphLayer & gl, int sectionNumber) {
-  if ( gl.sections[index] == sectionNumber )
-    return;
-  
-  // if it has not already been marked by this section, do so
-  gl.sections[index] = sectionNumber;
-  // add mark to set of marks for this node, set can only be larger than 1 for 
-  // peptides below PeptideThreshold
-  gl.sectionMarks[index] |= Set::SingletonSet(sectionNumber);
-  
-  // do not follow edges with PSM probability below PeptideThreshold
-  if (&gl == &PSMsToProteins && gl.weights[index] <= PeptideThreshold)
-    return;
-
-  const Set& as = gl.associations[index];
-  for (Set::Iterator iter = as.begin(); iter != as.end(); iter++) {
-    if ( &gl == &proteinsToPSMs )
-      traceConnected(*iter, PSMsToProteins, sectionNumber);
-    else
-      traceConnected(*iter, proteinsToPSMs, sectionNumber);
-  }
-}
-
-int BasicBigraph::markSectionPartitions() {
-  // returns the number of sections that are found
-  proteinsToPSMs.sectionMarks = Array<Set>(proteinsToPSMs.size());
-  PSMsToProteins.sectionMarks = Array<Set>(PSMsToProteins.size());
-
-  PSMsToProteins.sections = Array<int>(PSMsToProteins.size(), -1);
-  proteinsToPSMs.sections = Array<int>(proteinsToPSMs.size(), -1);
-  
-  // MT: make sure proteins with equal peptide evidence end up in the same section
-  Array<Set> groups = ReplicateIndexer<Set>::replicates(Set::sumSetElements, proteinsToPSMs.associations );
-  std::map<int, int> mapToFirstInGroup;
-  
-  for (int k = 0; k < groups.size(); k++) {
-    Set reps = groups[k].without( Set::SingletonSet(groups[k][0]) );
-    for (Set::Iterator iter = reps.begin(); iter != reps.end(); iter++) {
-      mapToFirstInGroup[*iter] = groups[k][0];
-    }
-  }
-  
-  int section = 0;
-  for (int k = 0; k < proteinsToPSMs.size(); k++) {
-    if (mapToFirstInGroup.find(k) != mapToFirstInGroup.end()) {
-      int sectionNumber = proteinsToPSMs.sections[mapToFirstInGroup[k]];
-      proteinsToPSMs.sections[k] = sectionNumber;
-      // add mark to set of marks for this node, set can only be larger than 1 for 
-      // peptides below PeptideThreshold
-      proteinsToPSMs.sectionMarks[k] |= Set::SingletonSet(sectionNumber);
-    } else if (proteinsToPSMs[k].section == -1) {
-      traceConnected(k, proteinsToPSMs, section);
-      section++;
-    }
-  }
-
-  return section;
-}
-
 Array<BasicBigraph> BasicBigraph::partitionSections() {
-  int numSections = markSectionPartitions();
-
-  Array<Set> proteinSubsets(numSections), PSMSubsets(numSections);
-  for (int k = 0; k < proteinsToPSMs.size(); k++) {
-    proteinSubsets[ proteinsToPSMs[k].section ].add(k);
-  }
-
-  for (int k = 0; k < PSMsToProteins.size(); k++) {
-    PSMSubsets[ PSMsToProteins[k].section ].add(k);
-  }
-
-  // now reindex them to their proper sets
-
-  Array<BasicBigraph> result;
-  for (int k = 0; k < numSections; k++) {
-    result.add( buildSubgraph( proteinSubsets[k], PSMSubsets[k] ) );
+  CompactBigraph graph(*this);
+  std::vector<CompactBigraph> sections;
+  graph.partitionSections(sections);
+  
+  Array<BasicBigraph> result(static_cast<int>(sections.size()));
+  for (std::size_t k = 0; k < sections.size(); k++) {
+    sections[k].toBasicBigraph(result[static_cast<int>(k)]);
   }
-
   return result;
 }
 
@@ -451,17 +276,17 @@ void BasicBigraph::setProteinThreshold(double __protein_threshold)
   ProteinThreshold = __protein_threshold;
 }
 
-double BasicBigraph::getPeptideThreshold()
+double BasicBigraph::getPeptideThreshold() const
 {
   return PeptideThreshold;
 }
 
-double BasicBigraph::getProteinThreshold()
+double BasicBigraph::getProteinThreshold() const
 {
   return ProteinThreshold;
 }
 
-double BasicBigraph::getPsmThreshold()
+double BasicBigraph::getPsmThreshold() const
 {
   return PsmThreshold; 
 }
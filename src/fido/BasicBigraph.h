@@ -2,6 +2,9 @@
 #define _BasicBigraph_H
 
 #include <fstream>
+#include <vector>
+#include <utility>
+#include <boost/unordered_map.hpp>
 #include "Scores.h"
 #include "StringTable.h"
 #include "Array.h"
@@ -66,6 +69,7 @@ class BasicBigraph {
   
   void read(Scores* fullset, bool multiple_labeled_peptides = false);
   void read(istream & is, bool multiple_labeled_peptides = false);
+  /* pruning and partitioning are done on a CompactBigraph */
   void prune();
   void printGraph();
   void printProteinWeights() const;
@@ -80,33 +84,24 @@ class BasicBigraph {
   
   Array<BasicBigraph> partitionSections();
   void setPsmThreshold(double psm_threshold);
-  double getPsmThreshold();
+  double getPsmThreshold() const;
   void setPeptideThreshold(double peptide_threshold);
-  double getPeptideThreshold();
+  double getPeptideThreshold() const;
   void setProteinThreshold(double protein_threshold);
-  double getProteinThreshold();
+  double getProteinThreshold() const;
   
 protected:
   
-  void add(GraphLayer & gl, StringTable & st, const string & item);
-  void connect(const StringTable & PSMNames, const string & pepStr, 
-	       const StringTable & proteinNames, const string & protStr);
+  typedef boost::unordered_map<string, int> NameIndex;
+  typedef std::vector<std::pair<int, int> > EdgeList;
+  
+  int add(GraphLayer & gl, NameIndex & index, const string & item);
+  void connect(EdgeList & PSMProteinEdges);
   void disconnectProtein(int k);
-  void disconnectPSM(int k);
   void pseudoCountPSMs();
-  void floorLowPSMs();
-  int markSectionPartitions();
-  void removeDegeneratePSMs();
-  void cloneDegeneratePSMs();
-  void removePoorPSMs();
-  void removePoorProteins();
   void reindex();
-  void cloneMultipleMarkedPSMs();
-  void clonePSM(int pepIndex);
-  void saveSeveredProteins();
   
   BasicBigraph buildSubgraph(const Set & connectedProteins, const Set & connectedPSMs);
-  void traceConnected(int index, GraphLayer & gl, int sectionNumber);
 
   double PsmThreshold;
   double PeptideThreshold;
@@ -1,8 +1,12 @@
 // Written by Oliver Serang 2009
 // see license for more information
 
+#include <limits>
 #include "BasicGroupBigraph.h"
 
+const uint64_t BasicGroupBigraph::kMinConfigurationsPerChunk;
+const uint64_t BasicGroupBigraph::kMaxChunks;
+
 BasicGroupBigraph::BasicGroupBigraph(double peptidePrior, bool noClustering, bool trivialGrouping) :
     logLikelihoodConstantCachedFunctor(
       &BasicGroupBigraph::logLikelihoodConstant, "logLikelihoodConstant"),
@@ -37,6 +41,7 @@ void BasicGroupBigraph::trivialGroupProteins() {
     groupProtNames[k] = Array<string>(1, proteinsToPSMs.names[k]);
     originalN[k] = Counter(1);
   }
+  buildKernelLayout();
 }
 
 void BasicGroupBigraph::groupProteinsBy(const Array<Set> & groups) {
@@ -63,6 +68,15 @@ void BasicGroupBigraph::groupProteinsBy(const Array<Set> & groups) {
   }
 
   reindex();
+  buildKernelLayout();
+}
+
+void BasicGroupBigraph::buildKernelLayout() {
+  std::vector<int> groupSizes(originalN.size());
+  for (int k = 0; k < originalN.size(); k++) {
+    groupSizes[k] = originalN[k].size;
+  }
+  kernelLayout_ = LikelihoodKernel::Layout(groupSizes, PSMsToProteins.associations);
 }
 
 // uses hashing of PSMs associations set per protein to find proteins with the
@@ -188,7 +202,11 @@ double BasicGroupBigraph::probabilityNNu(const Model & m, const Counter & nNu) c
 }
 
 double BasicGroupBigraph::probabilityNGivenD(const Model & m, const Array<Counter> & n) const {
-  double logLike= logLikelihoodNGivenD(m,n) + log2(probabilityN(m,n)) - logLikelihoodConstantCachedFunctor(m,this);
+  return probabilityNGivenD(m, n, logLikelihoodConstantCachedFunctor(m,this));
+}
+
+double BasicGroupBigraph::probabilityNGivenD(const Model & m, const Array<Counter> & n, double logLikelihoodConst) const {
+  double logLike= logLikelihoodNGivenD(m,n) + log2(probabilityN(m,n)) - logLikelihoodConst;
   return pow(2.0, logLike);
 }
 
@@ -266,24 +284,79 @@ double BasicGroupBigraph::eCorrectionEpsilon(int indexEpsilon, const Model & m,
   return termE / term;
 }
 
-Array<double> BasicGroupBigraph::probabilityRGivenD(const Model & m) {
-  Array<Counter> n = originalN;
-  Vector result;
+uint64_t BasicGroupBigraph::numberOfConfigurations() const {
+  if (logNumberOfConfigurations() >= 64.0) {
+    return std::numeric_limits<uint64_t>::max();
+  }
+  uint64_t result = 1u;
 
-  for (Counter::start(n); Counter::inRange(n); Counter::advance(n)) {
-    Vector term = probabilityNGivenD(m, n) * Vector( probabilityRGivenN(n) );
+  for (int k = 0; k < originalN.size(); k++) {
+    result *= static_cast<uint64_t>(originalN[k].size) + 1u;
+  }
 
-    if ( result.size() == 0 ) {
-      result = term;
-    } else {
-      result += term;
+  return result;
+}
+
+// number of chunks that the configurations are enumerated in; only graphs
+// with at least two chunks worth of configurations are split
+uint64_t BasicGroupBigraph::numberOfChunks() const {
+  if (logNumberOfConfigurations() >= 62.0) {
+    // too many configurations to count, the enumeration will not finish anyway
+    return 1u;
+  }
+  uint64_t numChunks = numberOfConfigurations() / kMinConfigurationsPerChunk;
+  return std::max<uint64_t>(1u, std::min(kMaxChunks, numChunks));
+}
+
+/* Large graphs are enumerated in chunks of consecutive configurations, once
+   for the likelihood constant and once for the probabilities, with the chunks
+   as OpenMP tasks. The partial sums are added up in the order of the chunks,
+   such that the result does not depend on the number of threads. The 
+   likelihood constant is computed here instead of through the cache, which 
+   is shared by all callers. */
+Array<double> BasicGroupBigraph::probabilityRGivenD(const Model & m) const {
+  const LikelihoodKernel kernel(m, kernelLayout_, PSMsToProteins.weights, PeptidePrior);
+  
+  const uint64_t numChunks = numberOfChunks();
+  const uint64_t numConfigurations = numberOfConfigurations();
+  std::vector<uint64_t> bounds(numChunks + 1u);
+  for (uint64_t chunk = 0; chunk <= numChunks; chunk++) {
+    bounds[chunk] = numConfigurations / numChunks * chunk + 
+                    numConfigurations % numChunks * chunk / numChunks;
+  }
+  
+  std::vector<double> logConstants(numChunks);
+  for (uint64_t chunk = 0; chunk < numChunks; chunk++) {
+#pragma omp task if (numChunks > 1u) firstprivate(chunk) shared(kernel, bounds, logConstants)
+    logConstants[chunk] = kernel.logLikelihoodConstant(bounds[chunk], bounds[chunk + 1u]);
+  }
+#pragma omp taskwait
+  double logLikelihoodConst = logConstants[0];
+  for (uint64_t chunk = 1; chunk < numChunks; chunk++) {
+    logLikelihoodConst = Numerical::logAdd(logLikelihoodConst, logConstants[chunk]);
+  }
+  
+  std::vector<std::vector<double> > partialSums(numChunks);
+  for (uint64_t chunk = 0; chunk < numChunks; chunk++) {
+#pragma omp task if (numChunks > 1u) firstprivate(chunk) shared(kernel, bounds, partialSums, logLikelihoodConst)
+    kernel.addPresentCounts(bounds[chunk], bounds[chunk + 1u], 
+                            logLikelihoodConst, partialSums[chunk]);
+  }
+#pragma omp taskwait
+  Array<double> result(originalN.size(), 0.0);
+  for (uint64_t chunk = 0; chunk < numChunks; chunk++) {
+    for (int k = 0; k < result.size(); k++) {
+      result[k] += partialSums[chunk][k];
     }
   }
+  for (int k = 0; k < result.size(); k++) {
+    result[k] /= originalN[k].size;
+  }
 
-  return result.unpack();
+  return result;
 }
 
-Array<double> BasicGroupBigraph::probabilityRGivenN(const Array<Counter> & n) {
+Array<double> BasicGroupBigraph::probabilityRGivenN(const Array<Counter> & n) const {
   Array<double> result(n.size());
 
   for (int k=0; k<result.size(); k++) {
@@ -293,7 +366,7 @@ Array<double> BasicGroupBigraph::probabilityRGivenN(const Array<Counter> & n) {
   return result;
 }
 
-double BasicGroupBigraph::probabilityRRhoGivenN(int indexRho, const Array<Counter> & n) {
+double BasicGroupBigraph::probabilityRRhoGivenN(int indexRho, const Array<Counter> & n) const {
   const Counter & c = n[indexRho];
 
   return double(c.state) / c.size;
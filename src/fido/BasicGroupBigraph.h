@@ -4,10 +4,12 @@
 #ifndef _BasicGroupBigraph_H
 #define _BasicGroupBigraph_H
 
+#include <stdint.h>
 #include "ReplicateIndexer.h"
 #include "BasicBigraph.h"
 #include "Model.h"
 #include "Cache.h"
+#include "LikelihoodKernel.h"
 
 #ifdef TRUE_BRUTE
 #define NOCACHE
@@ -54,6 +56,16 @@ class Counter {
     return cA.back().inRange();
   }
 
+  // sets the counters to the configuration that is reached after index 
+  // calls of advance from start
+  static void seek(Array<Counter> & cA, uint64_t index) {
+    for (int k=0; static_cast<std::size_t>(k)<cA.size(); k++) {
+      uint64_t numStates = static_cast<uint64_t>(cA[k].size) + 1u;
+      cA[k].state = static_cast<int>(index % numStates);
+      index /= numStates;
+    }
+  }
+
   static void advance(Array<Counter> & cA) {
     for (int k=0; static_cast<std::size_t>(k)<cA.size(); k++) {
 	    cA[k].advance();
@@ -95,7 +107,10 @@ class BasicGroupBigraph : public BasicBigraph {
   }
   
   double logNumberOfConfigurations() const;
+  uint64_t numberOfConfigurations() const;
   void getProteinProbs(const Model& m);
+  // does not modify the graph, so that several models can be evaluated concurrently
+  Array<double> proteinProbs(const Model& m) const { return probabilityRGivenD(m); }
   void printProteinWeights() const;
 
   const Array<double>& proteinProbabilities() const { return probabilityR; }
@@ -108,9 +123,16 @@ class BasicGroupBigraph : public BasicBigraph {
   double getPeptidePrior();
 
  private:  
+  // the enumeration of the configurations of large graphs is split into 
+  // chunks of consecutive configurations, which are evaluated as OpenMP tasks
+  static const uint64_t kMinConfigurationsPerChunk = 4096u;
+  static const uint64_t kMaxChunks = 256u;
+  
   Array<Counter> originalN;
   Array<Array<string> > groupProtNames;
   Array<double> probabilityR;
+  // model independent part of the likelihood kernel, rebuilt when grouping
+  LikelihoodKernel::Layout kernelLayout_;
   
   // cache functors
   // note that these will need to be updated if the object is copied
@@ -127,6 +149,7 @@ class BasicGroupBigraph : public BasicBigraph {
   void groupProteins();
   void trivialGroupProteins();
   void groupProteinsBy(const Array<Set> & groups);
+  void buildKernelLayout();
  
   // protected utility functions
   int numberAssociatedProteins(int indexEpsilon) const;
@@ -145,13 +168,16 @@ class BasicGroupBigraph : public BasicBigraph {
   double probabilityN(const Model& m, const Array<Counter> & n) const;
   double probabilityNNu(const Model& m, const Counter & nNu) const;
   double probabilityNGivenD(const Model& m, const Array<Counter> & n) const;
+  double probabilityNGivenD(const Model& m, const Array<Counter> & n, 
+                            double logLikelihoodConst) const;
 
   double logLikelihoodConstant(const Model& m) const;
   double likelihoodConstant(const Model& m) const;
 
-  Array<double> probabilityRGivenD(const Model& m);
-  Array<double> probabilityRGivenN(const Array<Counter> & n);
-  double probabilityRRhoGivenN(int indexRho, const Array<Counter> & n);
+  Array<double> probabilityRGivenD(const Model& m) const;
+  uint64_t numberOfChunks() const;
+  Array<double> probabilityRGivenN(const Array<Counter> & n) const;
+  double probabilityRRhoGivenN(int indexRho, const Array<Counter> & n) const;
 
   Array<double> probabilityEGivenD(const Model& m);
   Array<double> eCorrection(const Model& m, const Array<Counter> & n);
@@ -0,0 +1,419 @@
+/*******************************************************************************
+ Copyright 2006-2012 Lukas Käll <lukas.kall@scilifelab.se>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+
+ *******************************************************************************/
+
+#include <algorithm>
+#include <limits>
+#include <sstream>
+#include "CompactBigraph.h"
+
+namespace {
+/* disjoint sets of the integers 0...n-1, with union by size and path halving */
+class DisjointSets {
+ public:
+  explicit DisjointSets(uint32_t n) : parent_(n), size_(n, 1u) {
+    for (uint32_t k = 0; k < n; k++) parent_[k] = k;
+  }
+  
+  uint32_t find(uint32_t k) {
+    while (parent_[k] != k) {
+      parent_[k] = parent_[parent_[k]];
+      k = parent_[k];
+    }
+    return k;
+  }
+  
+  void join(uint32_t a, uint32_t b) {
+    a = find(a);
+    b = find(b);
+    if (a == b) return;
+    if (size_[a] < size_[b]) std::swap(a, b);
+    parent_[b] = a;
+    size_[a] += size_[b];
+  }
+  
+ private:
+  std::vector<uint32_t> parent_, size_;
+};
+
+/* orders nodes by their lists of neighbours, such that nodes with the same 
+   neighbours end up next to each other */
+class NeighbourOrder {
+ public:
+  explicit NeighbourOrder(const CompactLayer & layer) : layer_(layer) {}
+  
+  bool operator()(uint32_t a, uint32_t b) const {
+    std::vector<uint32_t>::const_iterator begin = layer_.adjacency.begin();
+    return std::lexicographical_compare(
+        begin + layer_.offsets[a], begin + layer_.offsets[a + 1],
+        begin + layer_.offsets[b], begin + layer_.offsets[b + 1]);
+  }
+  
+  bool equal(uint32_t a, uint32_t b) const {
+    std::vector<uint32_t>::const_iterator begin = layer_.adjacency.begin();
+    return layer_.degree(a) == layer_.degree(b) && 
+        std::equal(begin + layer_.offsets[a], begin + layer_.offsets[a + 1],
+                   begin + layer_.offsets[b]);
+  }
+  
+ private:
+  const CompactLayer & layer_;
+};
+} // namespace
+
+CompactBigraph::CompactBigraph() : psmThreshold_(0.0), peptideThreshold_(1e-3),
+  proteinThreshold_(1e-3), numberClones_(0), 
+  names_(new std::vector<std::string>()) {}
+
+CompactBigraph::CompactBigraph(const NameTable & names) : psmThreshold_(0.0), 
+  peptideThreshold_(1e-3), proteinThreshold_(1e-3), numberClones_(0), 
+  names_(names) {}
+
+/* the names of the PSMs come first in the name table, followed by the names 
+   of the proteins */
+CompactBigraph::CompactBigraph(const BasicBigraph & bb) : 
+  psmThreshold_(bb.getPsmThreshold()), 
+  peptideThreshold_(bb.getPeptideThreshold()),
+  proteinThreshold_(bb.getProteinThreshold()), numberClones_(0), 
+  names_(new std::vector<std::string>()) {
+  const GraphLayer & psms = bb.PSMsToProteins;
+  const GraphLayer & proteins = bb.proteinsToPSMs;
+  names_->reserve(static_cast<std::size_t>(psms.size() + proteins.size()));
+  for (int k = 0; k < psms.size(); k++) {
+    PSMs_.nameIds.push_back(static_cast<uint32_t>(names_->size()));
+    names_->push_back(psms.names[k]);
+    PSMs_.weights.push_back(psms.weights[k]);
+    PSMs_.sections.push_back(k < psms.sections.size() ? psms.sections[k] : -1);
+    const Set & as = psms.associations[k];
+    for (int j = 0; j < as.size(); j++) {
+      PSMs_.adjacency.push_back(static_cast<uint32_t>(as[j]));
+    }
+    PSMs_.offsets.push_back(static_cast<uint32_t>(PSMs_.adjacency.size()));
+  }
+  for (int k = 0; k < proteins.size(); k++) {
+    proteins_.nameIds.push_back(static_cast<uint32_t>(names_->size()));
+    names_->push_back(proteins.names[k]);
+    proteins_.weights.push_back(proteins.weights[k]);
+    proteins_.sections.push_back(k < proteins.sections.size() ? proteins.sections[k] : -1);
+  }
+  transposePSMs();
+}
+
+/* rebuilds the edges of the proteins from those of the PSMs with a counting
+   sort, which leaves the PSMs of each protein in increasing order */
+void CompactBigraph::transposePSMs() {
+  const uint32_t numProteins = proteins_.size();
+  proteins_.offsets.assign(numProteins + 1u, 0u);
+  for (std::size_t e = 0; e < PSMs_.adjacency.size(); e++) {
+    ++proteins_.offsets[PSMs_.adjacency[e] + 1u];
+  }
+  for (uint32_t p = 0; p < numProteins; p++) {
+    proteins_.offsets[p + 1u] += proteins_.offsets[p];
+  }
+  proteins_.adjacency.resize(PSMs_.adjacency.size());
+  std::vector<uint32_t> next(proteins_.offsets.begin(), proteins_.offsets.end() - 1);
+  for (uint32_t k = 0; k < PSMs_.size(); k++) {
+    for (uint32_t e = PSMs_.offsets[k]; e < PSMs_.offsets[k + 1u]; e++) {
+      proteins_.adjacency[next[PSMs_.adjacency[e]]++] = k;
+    }
+  }
+}
+
+/* disconnects the PSMs below psmThreshold_, and then the proteins of which 
+   the best remaining PSM is below proteinThreshold_ */
+void CompactBigraph::removePoorPSMsAndProteins() {
+  const uint32_t numPSMs = PSMs_.size();
+  std::vector<bool> isPoorPSM(numPSMs), isPoorProtein(proteins_.size());
+  std::vector<double> bestWeights(proteins_.size(), 
+                                  -std::numeric_limits<double>::infinity());
+  for (uint32_t k = 0; k < numPSMs; k++) {
+    isPoorPSM[k] = (PSMs_.weights[k] < psmThreshold_);
+    if (isPoorPSM[k]) continue;
+    for (uint32_t e = PSMs_.offsets[k]; e < PSMs_.offsets[k + 1u]; e++) {
+      double & best = bestWeights[PSMs_.adjacency[e]];
+      best = std::max(best, PSMs_.weights[k]);
+    }
+  }
+  for (uint32_t p = 0; p < proteins_.size(); p++) {
+    isPoorProtein[p] = (bestWeights[p] < proteinThreshold_);
+  }
+  
+  uint32_t numEdges = 0u, begin = PSMs_.offsets[0];
+  for (uint32_t k = 0; k < numPSMs; k++) {
+    uint32_t end = PSMs_.offsets[k + 1u];
+    if (!isPoorPSM[k]) {
+      for (uint32_t e = begin; e < end; e++) {
+        if (!isPoorProtein[PSMs_.adjacency[e]]) {
+          PSMs_.adjacency[numEdges++] = PSMs_.adjacency[e];
+        }
+      }
+    }
+    PSMs_.offsets[k + 1u] = numEdges;
+    begin = end;
+  }
+  PSMs_.adjacency.resize(numEdges);
+  transposePSMs();
+}
+
+void CompactBigraph::saveSeveredProteins() {
+  severedProteins_ = Array<std::string>();
+  for (uint32_t p = 0; p < proteins_.size(); p++) {
+    if (proteins_.degree(p) == 0u) {
+      severedProteins_.add((*names_)[proteins_.nameIds[p]]);
+    }
+  }
+}
+
+/* drops the PSMs and proteins without edges, keeping the order of the others */
+void CompactBigraph::removeUnconnected() {
+  const uint32_t kRemoved = std::numeric_limits<uint32_t>::max();
+  std::vector<uint32_t> newProteinIdx(proteins_.size(), kRemoved);
+  CompactLayer proteins, PSMs;
+  for (uint32_t p = 0; p < proteins_.size(); p++) {
+    if (proteins_.degree(p) > 0u) {
+      newProteinIdx[p] = proteins.size();
+      proteins.addNode(proteins_, p);
+    }
+  }
+  PSMs.adjacency.reserve(PSMs_.adjacency.size());
+  for (uint32_t k = 0; k < PSMs_.size(); k++) {
+    if (PSMs_.degree(k) == 0u) continue;
+    PSMs.addNode(PSMs_, k);
+    for (uint32_t e = PSMs_.offsets[k]; e < PSMs_.offsets[k + 1u]; e++) {
+      PSMs.adjacency.push_back(newProteinIdx[PSMs_.adjacency[e]]);
+    }
+    PSMs.offsets.push_back(static_cast<uint32_t>(PSMs.adjacency.size()));
+  }
+  PSMs_.offsets.swap(PSMs.offsets);
+  PSMs_.adjacency.swap(PSMs.adjacency);
+  PSMs_.nameIds.swap(PSMs.nameIds);
+  PSMs_.weights.swap(PSMs.weights);
+  PSMs_.sections.swap(PSMs.sections);
+  proteins_.nameIds.swap(proteins.nameIds);
+  proteins_.weights.swap(proteins.weights);
+  proteins_.sections.swap(proteins.sections);
+  transposePSMs();
+}
+
+/* Proteins are in the same section if they are connected through PSMs with a
+   probability above peptideThreshold_, or if they have the same PSMs. 
+   Sections are numbered in order of their first protein. Each PSM is marked 
+   with the sections of its proteins, the marks of PSM k are 
+   marks[markOffsets[k]] up to marks[markOffsets[k+1]-1] in increasing order, 
+   and its section is the last of them. Only PSMs with a probability below 
+   peptideThreshold_ can have more than one mark. Returns the number of 
+   sections. */
+int CompactBigraph::markSectionPartitions(std::vector<uint32_t> & markOffsets,
+                                          std::vector<int> & marks) {
+  const uint32_t numProteins = proteins_.size();
+  const uint32_t numPSMs = PSMs_.size();
+  
+  DisjointSets connectedProteins(numProteins);
+  for (uint32_t k = 0; k < numPSMs; k++) {
+    // do not follow edges with PSM probability below peptideThreshold_
+    if (PSMs_.weights[k] <= peptideThreshold_ || PSMs_.degree(k) < 2u) continue;
+    uint32_t first = PSMs_.adjacency[PSMs_.offsets[k]];
+    for (uint32_t e = PSMs_.offsets[k] + 1u; e < PSMs_.offsets[k + 1u]; e++) {
+      connectedProteins.join(first, PSMs_.adjacency[e]);
+    }
+  }
+  
+  // MT: make sure proteins with equal peptide evidence end up in the same section
+  NeighbourOrder order(proteins_);
+  std::vector<uint32_t> byNeighbours(numProteins);
+  for (uint32_t p = 0; p < numProteins; p++) byNeighbours[p] = p;
+  std::sort(byNeighbours.begin(), byNeighbours.end(), order);
+  for (uint32_t i = 1; i < numProteins; i++) {
+    if (order.equal(byNeighbours[i - 1u], byNeighbours[i])) {
+      connectedProteins.join(byNeighbours[i - 1u], byNeighbours[i]);
+    }
+  }
+  
+  int numSections = 0;
+  std::vector<int> sectionOfRoot(numProteins, -1);
+  for (uint32_t p = 0; p < numProteins; p++) {
+    uint32_t root = connectedProteins.find(p);
+    if (sectionOfRoot[root] == -1) {
+      sectionOfRoot[root] = numSections++;
+    }
+    proteins_.sections[p] = sectionOfRoot[root];
+  }
+  
+  markOffsets.assign(1u, 0u);
+  marks.clear();
+  for (uint32_t k = 0; k < numPSMs; k++) {
+    std::size_t first = marks.size();
+    for (uint32_t e = PSMs_.offsets[k]; e < PSMs_.offsets[k + 1u]; e++) {
+      marks.push_back(proteins_.sections[PSMs_.adjacency[e]]);
+    }
+    std::sort(marks.begin() + first, marks.end());
+    marks.erase(std::unique(marks.begin() + first, marks.end()), marks.end());
+    markOffsets.push_back(static_cast<uint32_t>(marks.size()));
+    PSMs_.sections[k] = (marks.size() > first) ? marks.back() : -1;
+  }
+  return numSections;
+}
+
+/* replaces each PSM with more than one mark by a clone per marked section, 
+   connected to the proteins of that section. The clones are appended in 
+   order of the PSMs and sections, the original PSMs keep no edges. */
+void CompactBigraph::cloneMultipleMarkedPSMs(
+    const std::vector<uint32_t> & markOffsets, const std::vector<int> & marks) {
+  numberClones_ = 0;
+  const uint32_t numPSMs = PSMs_.size();
+  CompactLayer PSMs;
+  PSMs.adjacency.reserve(PSMs_.adjacency.size());
+  for (uint32_t k = 0; k < numPSMs; k++) {
+    PSMs.addNode(PSMs_, k);
+    if (markOffsets[k + 1u] - markOffsets[k] <= 1u) {
+      PSMs.adjacency.insert(PSMs.adjacency.end(), 
+          PSMs_.adjacency.begin() + PSMs_.offsets[k], 
+          PSMs_.adjacency.begin() + PSMs_.offsets[k + 1u]);
+    }
+    PSMs.offsets.push_back(static_cast<uint32_t>(PSMs.adjacency.size()));
+  }
+  
+  for (uint32_t k = 0; k < numPSMs; k++) {
+    uint32_t numMarks = markOffsets[k + 1u] - markOffsets[k];
+    if (numMarks <= 1u) continue;
+    if (!names_.unique()) {
+      // copy on write, e.g. the graph read by GroupPowerBigraph keeps its table
+      names_.reset(new std::vector<std::string>(*names_));
+    }
+    for (uint32_t m = markOffsets[k]; m < markOffsets[k + 1u]; m++) {
+      int section = marks[m];
+      std::ostringstream ost;
+      ost << (*names_)[PSMs_.nameIds[k]] << "_clone_" << section;
+      PSMs.nameIds.push_back(static_cast<uint32_t>(names_->size()));
+      names_->push_back(ost.str());
+      PSMs.weights.push_back(PSMs_.weights[k]);
+      PSMs.sections.push_back(section);
+      for (uint32_t e = PSMs_.offsets[k]; e < PSMs_.offsets[k + 1u]; e++) {
+        if (proteins_.sections[PSMs_.adjacency[e]] == section) {
+          PSMs.adjacency.push_back(PSMs_.adjacency[e]);
+        }
+      }
+      PSMs.offsets.push_back(static_cast<uint32_t>(PSMs.adjacency.size()));
+    }
+    numberClones_ += static_cast<int>(numMarks - 1u);
+  }
+  PSMs_.offsets.swap(PSMs.offsets);
+  PSMs_.adjacency.swap(PSMs.adjacency);
+  PSMs_.nameIds.swap(PSMs.nameIds);
+  PSMs_.weights.swap(PSMs.weights);
+  PSMs_.sections.swap(PSMs.sections);
+  transposePSMs();
+}
+
+void CompactBigraph::prune() {
+  removePoorPSMsAndProteins();
+  saveSeveredProteins();
+  removeUnconnected();
+  std::vector<uint32_t> markOffsets;
+  std::vector<int> marks;
+  markSectionPartitions(markOffsets, marks);
+  cloneMultipleMarkedPSMs(markOffsets, marks);
+  removeUnconnected();
+}
+
+/* splits the graph into its sections in one pass over the nodes; edges of 
+   PSMs to proteins outside of their section, which only exist in graphs that
+   were not pruned, are dropped */
+void CompactBigraph::partitionSections(std::vector<CompactBigraph> & sections) {
+  std::vector<uint32_t> markOffsets;
+  std::vector<int> marks;
+  int numSections = markSectionPartitions(markOffsets, marks);
+  
+  sections.assign(static_cast<std::size_t>(numSections), CompactBigraph(names_));
+  std::vector<uint32_t> localIdx(proteins_.size());
+  for (uint32_t p = 0; p < proteins_.size(); p++) {
+    CompactLayer & proteins = sections[proteins_.sections[p]].proteins_;
+    localIdx[p] = proteins.size();
+    proteins.addNode(proteins_, p);
+  }
+  for (uint32_t k = 0; k < PSMs_.size(); k++) {
+    int section = PSMs_.sections[k];
+    if (section < 0) continue;
+    CompactLayer & PSMs = sections[section].PSMs_;
+    PSMs.addNode(PSMs_, k);
+    for (uint32_t e = PSMs_.offsets[k]; e < PSMs_.offsets[k + 1u]; e++) {
+      if (proteins_.sections[PSMs_.adjacency[e]] == section) {
+        PSMs.adjacency.push_back(localIdx[PSMs_.adjacency[e]]);
+      }
+    }
+    PSMs.offsets.push_back(static_cast<uint32_t>(PSMs.adjacency.size()));
+  }
+  for (std::size_t s = 0; s < sections.size(); s++) {
+    sections[s].transposePSMs();
+    sections[s].ownNames();
+  }
+}
+
+/* replaces the shared name table by one with only the names of this graph, 
+   such that clones added later do not copy the table of the whole graph */
+void CompactBigraph::ownNames() {
+  NameTable names(new std::vector<std::string>());
+  names->reserve(static_cast<std::size_t>(PSMs_.size() + proteins_.size()));
+  CompactLayer * layers[2] = { &PSMs_, &proteins_ };
+  for (int l = 0; l < 2; l++) {
+    std::vector<uint32_t> & nameIds = layers[l]->nameIds;
+    for (std::size_t k = 0; k < nameIds.size(); k++) {
+      names->push_back((*names_)[nameIds[k]]);
+      nameIds[k] = static_cast<uint32_t>(names->size() - 1u);
+    }
+  }
+  names_ = names;
+}
+
+/* fills the Set based layers of bb, for the likelihood computations of the
+   BasicGroupBigraph */
+void CompactBigraph::toBasicBigraph(BasicBigraph & bb) const {
+  bb.setPsmThreshold(psmThreshold_);
+  bb.setPeptideThreshold(peptideThreshold_);
+  bb.setProteinThreshold(proteinThreshold_);
+  bb.numberClones = numberClones_;
+  bb.severedProteins = severedProteins_;
+  
+  const CompactLayer * layers[2] = { &PSMs_, &proteins_ };
+  GraphLayer * graphLayers[2] = { &bb.PSMsToProteins, &bb.proteinsToPSMs };
+  for (int l = 0; l < 2; l++) {
+    const CompactLayer & layer = *layers[l];
+    GraphLayer & graphLayer = *graphLayers[l];
+    const int size = static_cast<int>(layer.size());
+    graphLayer.names = Array<std::string>(size);
+    graphLayer.associations = Array<Set>(size);
+    graphLayer.weights = Array<double>(size);
+    graphLayer.sections = Array<int>(size);
+    graphLayer.sectionMarks = Array<Set>();
+    for (int k = 0; k < size; k++) {
+      graphLayer.names[k] = (*names_)[layer.nameIds[k]];
+      graphLayer.weights[k] = layer.weights[k];
+      graphLayer.sections[k] = layer.sections[k];
+      Set & as = graphLayer.associations[k];
+      for (uint32_t e = layer.offsets[k]; e < layer.offsets[k + 1]; e++) {
+        as.add(static_cast<int>(layer.adjacency[e]));
+      }
+    }
+  }
+}
+
+double CompactBigraph::getMaxPSMWeight() const {
+  double largest = -std::numeric_limits<double>::infinity();
+  for (uint32_t k = 0; k < PSMs_.size(); k++) {
+    largest = std::max(largest, PSMs_.weights[k]);
+  }
+  return largest;
+}
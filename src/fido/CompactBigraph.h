@@ -0,0 +1,105 @@
+/*******************************************************************************
+ Copyright 2006-2012 Lukas Käll <lukas.kall@scilifelab.se>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+
+ *******************************************************************************/
+
+#ifndef _CompactBigraph_H
+#define _CompactBigraph_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <boost/shared_ptr.hpp>
+#include "Array.h"
+#include "BasicBigraph.h"
+
+/*
+* CompactLayer holds the PSMs or proteins of a CompactBigraph in compressed
+* sparse row form: the neighbours of node k are adjacency[offsets[k]] up to
+* adjacency[offsets[k+1]-1], in increasing order. Names are ids into the name
+* table of the bigraph, which is shared by its copies until one of them adds
+* the names of clones.
+*
+*/
+struct CompactLayer {
+  std::vector<uint32_t> offsets;
+  std::vector<uint32_t> adjacency;
+  std::vector<uint32_t> nameIds;
+  std::vector<double> weights;
+  std::vector<int> sections;
+  
+  CompactLayer() : offsets(1, 0u) {}
+  
+  uint32_t size() const { return static_cast<uint32_t>(nameIds.size()); }
+  uint32_t degree(uint32_t k) const { return offsets[k + 1] - offsets[k]; }
+  
+  // appends node k of source with no neighbours yet
+  void addNode(const CompactLayer & source, uint32_t k) {
+    nameIds.push_back(source.nameIds[k]);
+    weights.push_back(source.weights[k]);
+    sections.push_back(source.sections[k]);
+  }
+};
+
+/*
+* CompactBigraph is the BasicBigraph in compressed sparse row form, on which 
+*   the pruning and the partitioning into sections are done. Both steps only 
+*   filter and relabel the contiguous arrays, instead of the per node Set 
+*   operations of the BasicBigraph. The PSM layer holds the edges, the protein
+*   layer is its transpose and is rebuilt after each change.
+*
+*/
+class CompactBigraph {
+ public:
+  CompactBigraph();
+  explicit CompactBigraph(const BasicBigraph & bb);
+  
+  void prune();
+  /* sections get the default PSM and protein thresholds of a new BasicBigraph,
+     as they did when they were built as BasicBigraph */
+  void partitionSections(std::vector<CompactBigraph> & sections);
+  void toBasicBigraph(BasicBigraph & bb) const;
+  
+  double getMaxPSMWeight() const;
+  const Array<std::string> & getSeveredProteins() const { return severedProteins_; }
+  int getNumberClones() const { return numberClones_; }
+  
+  void setPsmThreshold(double t) { psmThreshold_ = t; }
+  void setPeptideThreshold(double t) { peptideThreshold_ = t; }
+  void setProteinThreshold(double t) { proteinThreshold_ = t; }
+  
+ protected:
+  typedef boost::shared_ptr<std::vector<std::string> > NameTable;
+  
+  explicit CompactBigraph(const NameTable & names);
+  
+  void transposePSMs();
+  void removePoorPSMsAndProteins();
+  void saveSeveredProteins();
+  void removeUnconnected();
+  int markSectionPartitions(std::vector<uint32_t> & markOffsets, 
+                            std::vector<int> & marks);
+  void cloneMultipleMarkedPSMs(const std::vector<uint32_t> & markOffsets, 
+                               const std::vector<int> & marks);
+  void ownNames();
+  
+  double psmThreshold_, peptideThreshold_, proteinThreshold_;
+  int numberClones_;
+  Array<std::string> severedProteins_;
+  NameTable names_;
+  CompactLayer PSMs_, proteins_;
+};
+
+#endif
@@ -3,19 +3,82 @@
 
 #include "GroupPowerBigraph.h"
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+const double GroupPowerBigraph::kMinConfigurationsPerTask = 4096.0;
+
 GroupPowerBigraph::~GroupPowerBigraph() { }
 
-Array<double> GroupPowerBigraph::proteinProbs() {
+/* probabilities of the protein groups under the model @m. The subgraphs are
+   independent and are evaluated as OpenMP tasks, the largest first, such that
+   the small ones fill up the threads at the end. Large subgraphs split their
+   enumeration into tasks as well. Called from within a parallel region, e.g.
+   by the parallel grid search, the subgraphs are evaluated by the calling 
+   thread only. */
+Array<double> GroupPowerBigraph::proteinProbs(const Model& m) const {
+  std::vector<Array<double> > probs(subgraphs_.size());
+  bool inParallel = false;
+#ifdef _OPENMP
+  inParallel = omp_in_parallel();
+#endif
+#pragma omp parallel if (!inParallel)
+#pragma omp single
+  {
+    for (std::size_t batch = 0; batch + 1u < subgraphBatches_.size(); batch++) {
+#pragma omp task firstprivate(batch) shared(m, probs)
+      subgraphProbs(m, batch, probs);
+    }
+  } // all tasks are finished at the barrier that ends the single construct
+  
   Array<double> result;
-  for (int k = 0; k < subgraphs_.size(); k++) {
-    subgraphs_[k].getProteinProbs(params_);
-    result.append( subgraphs_[k].proteinProbabilities() );
+  for (std::size_t k = 0; k < probs.size(); k++) {
+    result.append(probs[k]);
   }
   return result;
 }
 
-void GroupPowerBigraph::getProteinProbs() {
-  probsPresentProteins_ = proteinProbs();
+void GroupPowerBigraph::subgraphProbs(const Model& m, std::size_t batch, 
+    std::vector<Array<double> >& probs) const {
+  for (std::size_t pos = subgraphBatches_[batch]; 
+       pos < subgraphBatches_[batch + 1u]; pos++) {
+    int k = subgraphOrder_[pos];
+    probs[static_cast<std::size_t>(k)] = subgraphs_[k].proteinProbs(m);
+  }
+}
+
+static bool hasMoreConfigurations(const std::pair<double, int>& a, 
+                                  const std::pair<double, int>& b) {
+  return a.first > b.first || (a.first == b.first && a.second < b.second);
+}
+
+void GroupPowerBigraph::scheduleSubgraphs() {
+  std::vector<std::pair<double, int> > logNumConfigs;
+  for (int k = 0; k < subgraphs_.size(); k++) {
+    logNumConfigs.push_back(std::make_pair(
+        subgraphs_[k].logNumberOfConfigurations(), k));
+  }
+  std::sort(logNumConfigs.begin(), logNumConfigs.end(), hasMoreConfigurations);
+  
+  subgraphOrder_.clear();
+  subgraphBatches_.assign(1u, 0u);
+  double batchConfigurations = 0.0;
+  for (std::size_t pos = 0; pos < logNumConfigs.size(); pos++) {
+    subgraphOrder_.push_back(logNumConfigs[pos].second);
+    batchConfigurations += pow(2.0, logNumConfigs[pos].first);
+    if (batchConfigurations >= kMinConfigurationsPerTask) {
+      subgraphBatches_.push_back(pos + 1u);
+      batchConfigurations = 0.0;
+    }
+  }
+  if (subgraphBatches_.back() != subgraphOrder_.size()) {
+    subgraphBatches_.push_back(subgraphOrder_.size());
+  }
+}
+
+void GroupPowerBigraph::getProteinProbs(const Model& m) {
+  probsPresentProteins_ = proteinProbs(m);
 }
 
 void GroupPowerBigraph::getGroupProtNames() {
@@ -86,10 +149,19 @@ void GroupPowerBigraph::getProteinNames(std::vector<std::vector<std::string> > &
 void GroupPowerBigraph::getProteinProbsAndNames(
     std::vector<std::vector<std::string> > &names, 
     std::vector<double> &probs) const {
+  getProteinProbsAndNames(probsPresentProteins_, names, probs);
+}
+
+/* PEPs in ascending order and their protein groups, for the probabilities 
+   @groupProbs of the protein groups as returned by proteinProbs() */
+void GroupPowerBigraph::getProteinProbsAndNames(
+    const Array<double>& groupProbs,
+    std::vector<std::vector<std::string> > &names, 
+    std::vector<double> &probs) const {
   names.clear();
   probs.clear();
   
-  Array<double> sorted = probsPresentProteins_;
+  Array<double> sorted = groupProbs;
   Array<int> indices = sorted.sort();
   for (int k=0; k<sorted.size(); k++) {
     double pep = (1.0 - sorted[k]);
@@ -115,18 +187,23 @@ double GroupPowerBigraph::getLogNumberStates() const {
   return total + 1;
 }
 
-Array<BasicBigraph> GroupPowerBigraph::iterativePartitionSubgraphs(BasicBigraph & bb, double newPeptideThreshold) {
-  bb.setPeptideThreshold(newPeptideThreshold);
-  bb.prune();
-  severedProteins_.append( bb.severedProteins );
+/* prunes and partitions the compressed graph, only the sections that are 
+   evaluated for their number of configurations are converted to Sets */
+Array<BasicBigraph> GroupPowerBigraph::iterativePartitionSubgraphs(CompactBigraph & graph, double newPeptideThreshold) {
+  graph.setPeptideThreshold(newPeptideThreshold);
+  graph.prune();
+  severedProteins_.append( graph.getSeveredProteins() );
 
-  Array<BasicBigraph> preResult = bb.partitionSections();
+  std::vector<CompactBigraph> preResult;
+  graph.partitionSections(preResult);
   Array<BasicBigraph> result;
   
   bool warnTooManyConfigurations = false;
   
-  for (int k = 0; k < preResult.size(); k++) {
-    BasicGroupBigraph bgb = BasicGroupBigraph(peptidePrior_, preResult[k], noClustering_/*,trivialGrouping_*/);
+  for (std::size_t k = 0; k < preResult.size(); k++) {
+    BasicBigraph section;
+    preResult[k].toBasicBigraph(section);
+    BasicGroupBigraph bgb = BasicGroupBigraph(peptidePrior_, section, noClustering_/*,trivialGrouping_*/);
     double logNumConfig = bgb.logNumberOfConfigurations();
     if ( newPeptideThreshold >= 0.0 &&
          logNumConfig > LOG_MAX_ALLOWED_CONFIGURATIONS && 
@@ -137,7 +214,7 @@ Array<BasicBigraph> GroupPowerBigraph::iterativePartitionSubgraphs(BasicBigraph
     } else if (newPeptideThreshold >= 0.0 && logNumConfig > LOG_MAX_ALLOWED_CONFIGURATIONS) {
       // the graph cannot become pruned to the desired efficiency;
       // prune as much as possible
-      double largest = Vector(preResult[k].PSMsToProteins.weights).max();
+      double largest = preResult[k].getMaxPSMWeight();
       Array<BasicBigraph> completelyFragmented = iterativePartitionSubgraphs(preResult[k], largest);
       result.append( completelyFragmented );
     } else {
@@ -145,7 +222,7 @@ Array<BasicBigraph> GroupPowerBigraph::iterativePartitionSubgraphs(BasicBigraph
         warnTooManyConfigurations = true;
       }
       // the graph is already pruned to the desired degree
-      result.add( preResult[k] );
+      result.add( section );
     }
   }
   
@@ -157,31 +234,54 @@ Array<BasicBigraph> GroupPowerBigraph::iterativePartitionSubgraphs(BasicBigraph
 }
 
 void GroupPowerBigraph::read(Scores* fullset) {
-  BasicBigraph basicBigraph(psmThreshold_, peptideThreshold_, proteinThreshold_);
-  basicBigraph.read(fullset, addPeptideDecoyLabel_);  
-  initialize(basicBigraph);
+  BasicBigraph basicBigraph;
+  basicBigraph.read(fullset, addPeptideDecoyLabel_);
+  unprunedGraph_ = CompactBigraph(basicBigraph);
+  unprunedGraphDecoyLabel_ = addPeptideDecoyLabel_;
+  repartition();
 }
 
 void GroupPowerBigraph::read(istream& is) {
-  BasicBigraph basicBigraph(psmThreshold_, peptideThreshold_, proteinThreshold_);
+  BasicBigraph basicBigraph;
   basicBigraph.read(is, addPeptideDecoyLabel_);
-  initialize(basicBigraph);
+  unprunedGraph_ = CompactBigraph(basicBigraph);
+  unprunedGraphDecoyLabel_ = addPeptideDecoyLabel_;
+  repartition();
+}
+
+/* only the pruning, partitioning and grouping depend on the thresholds, so 
+   e.g. the final estimation after a grid search on a reduced graph starts 
+   from the graph that was read for the grid search */
+void GroupPowerBigraph::repartition() {
+  if (unprunedGraphDecoyLabel_ != addPeptideDecoyLabel_) {
+    throw MyException("Error: the protein graph has to be read again to change the labeling of decoy peptides.");
+  }
+  CompactBigraph graph(unprunedGraph_);
+  graph.setPsmThreshold(psmThreshold_);
+  graph.setPeptideThreshold(peptideThreshold_);
+  graph.setProteinThreshold(proteinThreshold_);
+  initialize(graph);
 }
 
-void GroupPowerBigraph::initialize(BasicBigraph& basicBigraph) {
+void GroupPowerBigraph::initialize(CompactBigraph& graph) {
+  // repartition() initializes again, so drop the results of the last graph
   severedProteins_ = Array<string>();
+  groupProtNames_ = Array<Array<string> >();
+  probsPresentProteins_ = Array<double>();
   if (noPartitioning_) {
-    basicBigraph.prune();
-    severedProteins_.append(basicBigraph.severedProteins);
+    graph.prune();
+    severedProteins_.append(graph.getSeveredProteins());
+    BasicBigraph basicBigraph;
+    graph.toBasicBigraph(basicBigraph);
     subgraphs_ = Array<BasicGroupBigraph>(1, BasicGroupBigraph(peptidePrior_, basicBigraph, noClustering_, trivialGrouping_));
   } else {
     Array<BasicBigraph> subBasic;
     subBasic = Array<BasicBigraph>();
     
     if (noPruning_)
-      subBasic = iterativePartitionSubgraphs(basicBigraph, -1);
+      subBasic = iterativePartitionSubgraphs(graph, -1);
     else
-      subBasic = iterativePartitionSubgraphs(basicBigraph, peptideThreshold_);
+      subBasic = iterativePartitionSubgraphs(graph, peptideThreshold_);
 
     subgraphs_ = Array<BasicGroupBigraph>(static_cast<int>(subBasic.size()), BasicGroupBigraph(peptidePrior_));
 
@@ -190,6 +290,7 @@ void GroupPowerBigraph::initialize(BasicBigraph& basicBigraph) {
     }
   }
   getGroupProtNames();
+  scheduleSubgraphs();
 }
 
 ostream & operator <<(ostream & os, pair<double,double> rhs) {
@@ -4,7 +4,9 @@
 #ifndef _GroupPowerBigraph_H
 #define _GroupPowerBigraph_H
 
+#include <vector>
 #include "BasicGroupBigraph.h"
+#include "CompactBigraph.h"
 #include "StringTable.h"
 #include "Array.h"
 #include "Random.h"
@@ -20,39 +22,41 @@ using namespace std;
 * GroupPowerBigraph represents a collection of bigraphs of PSMs on one side and 
 *   protein groups on the other. The power set enumerates all possible combinations 
 *   of present and absent proteins.
+*
+* The model parameters are passed to each evaluation rather than stored in the
+*   graph, so that the grid search can evaluate several models concurrently on
+*   the same graph with the const functions.
 * 
 */
 class GroupPowerBigraph {
   
  public:
   
-  GroupPowerBigraph(double alpha, double beta, double gamma, 
-      bool noClustering = false, bool noPartitioning = false , 
+  GroupPowerBigraph(bool noClustering = false, bool noPartitioning = false , 
       bool noPruning = false, bool trivialGrouping = false) :
-        params_(alpha, beta, gamma), noPartitioning_(noPartitioning), 
+        noPartitioning_(noPartitioning), 
         noClustering_(noClustering), noPruning_(noPruning),
+        addPeptideDecoyLabel_(false),
         LOG_MAX_ALLOWED_CONFIGURATIONS(18),
         psmThreshold_(0.0), peptideThreshold_(1e-3),
         proteinThreshold_(1e-3), peptidePrior_(0.1),
-        trivialGrouping_(trivialGrouping) {}
+        trivialGrouping_(trivialGrouping), unprunedGraphDecoyLabel_(false) {}
   ~GroupPowerBigraph();
   
-  Array<double> proteinProbs();
+  Array<double> proteinProbs(const Model& m) const;
   void printProteinWeights() const;
   void getProteinProbsPercolator(
     std::vector<ProteinScoreHolder>& proteins,
     std::map<std::string, size_t>& proteinToIdxMap) const;
   void getProteinProbsAndNames(std::vector<std::vector<std::string> > &names, std::vector<double> &probs) const;
+  void getProteinProbsAndNames(const Array<double>& groupProbs, 
+    std::vector<std::vector<std::string> > &names, std::vector<double> &probs) const;
   void getProteinNames(std::vector<std::vector<std::string> > &names) const;
-  void getProteinProbs();
+  void getProteinProbs(const Model& m);
   Array<string> peptideNames() const;
   double getLogNumberStates() const;
   pair<Array<Array<string> >, Array<double> > getDescendingProteinsAndWeights() const;
   
-  void setAlphaBetaGamma(double alpha, double beta, double gamma) {
-    params_.setAlphaBetaGamma(alpha, beta, gamma);
-  }
-  
   Array<std::string> getSeveredProteins() { return severedProteins_; }
   
   void setMaxAllowedConfigurations(double max_conf) {
@@ -89,16 +93,20 @@ class GroupPowerBigraph {
   
   void read(Scores* fullset);
   void read(istream & is);
+  /* prunes and partitions the graph that was read again, with the current 
+     thresholds and grouping options, without reading it again */
+  void repartition();
   //NOTE to clone object
   //GroupPowerBigraph *clone();
 private:
-  void initialize(BasicBigraph& basicBigraph);
+  void initialize(CompactBigraph& graph);
   void getGroupProtNames();
+  void scheduleSubgraphs();
+  void subgraphProbs(const Model& m, std::size_t batch, 
+                     std::vector<Array<double> >& probs) const;
   
-  Array<BasicBigraph> iterativePartitionSubgraphs(BasicBigraph & bb, double newPeptideThreshold );
+  Array<BasicBigraph> iterativePartitionSubgraphs(CompactBigraph & graph, double newPeptideThreshold );
   
-  /* struct with alpha, beta and gamma parameter (Fig 2 in Serang et al. 2010) */
-  Model params_;
   /* turns off partitioning, clustering or pruning of the graph (Fig 3 in Serang et al. 2010) */
   bool noPartitioning_;
   bool noClustering_;
@@ -117,6 +125,10 @@ private:
   double peptidePrior_;
   /* groups are either present or absent and cannot be partially present */
   bool trivialGrouping_;
+  /* the graph as read, before pruning, which is the same for all thresholds */
+  CompactBigraph unprunedGraph_;
+  /* addPeptideDecoyLabel_ at the time unprunedGraph_ was read */
+  bool unprunedGraphDecoyLabel_;
   /* proteins that have no PSMs remaining after pruning */
   Array<std::string> severedProteins_;
   /* probabilities for each protein to be present ("R" in Serang et al. 2010) */
@@ -125,6 +137,13 @@ private:
   Array<Array<std::string> > groupProtNames_;
   /* subgraphs resulting from the partitioning and pruning steps */
   Array<BasicGroupBigraph> subgraphs_;
+  /* indices of the subgraphs by decreasing number of configurations, cut into
+     batches that are evaluated as one task each; batch k runs from position
+     subgraphBatches_[k] up to subgraphBatches_[k+1] in subgraphOrder_ */
+  std::vector<int> subgraphOrder_;
+  std::vector<std::size_t> subgraphBatches_;
+  /* small subgraphs are batched until they have this many configurations */
+  static const double kMinConfigurationsPerTask;
 };
 
 ostream & operator <<(ostream & os, pair<double,double> rhs);
@@ -0,0 +1,224 @@
+/*******************************************************************************
+ Copyright 2006-2012 Lukas Käll <lukas.kall@scilifelab.se>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+
+ *******************************************************************************/
+
+#include <cmath>
+#include <algorithm>
+#include <limits>
+#include "LikelihoodKernel.h"
+
+const std::size_t LikelihoodKernel::kBlockSize;
+
+LikelihoodKernel::Layout::Layout(const std::vector<int>& sizes, 
+    const Array<Set>& groupsOfPeptide) :
+      numGroups(sizes.size()), numPeptides(groupsOfPeptide.size()), 
+      groupSizes(sizes) {
+  // invert the peptide to group associations
+  groupStart.assign(numGroups + 1u, 0);
+  for (std::size_t k = 0; k < numPeptides; k++) {
+    const Set& groups = groupsOfPeptide[k];
+    for (int j = 0; j < groups.size(); j++) {
+      groupStart[groups[j] + 1]++;
+    }
+  }
+  for (std::size_t g = 0; g < numGroups; g++) {
+    groupStart[g + 1u] += groupStart[g];
+  }
+  groupPeptides.resize(groupStart[numGroups]);
+  std::vector<int> fill(groupStart.begin(), groupStart.end() - 1);
+  for (std::size_t k = 0; k < numPeptides; k++) {
+    const Set& groups = groupsOfPeptide[k];
+    for (int j = 0; j < groups.size(); j++) {
+      groupPeptides[fill[groups[j]]++] = static_cast<int>(k);
+    }
+  }
+  
+  groupTableStart.resize(numGroups + 1u);
+  groupTableStart[0] = 0;
+  for (std::size_t g = 0; g < numGroups; g++) {
+    groupTableStart[g + 1u] = groupTableStart[g] + groupSizes[g] + 1;
+  }
+  
+  peptideTableStart.resize(numPeptides + 1u);
+  peptideTableStart[0] = 0;
+  for (std::size_t k = 0; k < numPeptides; k++) {
+    const Set& groups = groupsOfPeptide[k];
+    int maxActive = 0;
+    for (int j = 0; j < groups.size(); j++) {
+      maxActive += groupSizes[groups[j]];
+    }
+    peptideTableStart[k + 1u] = peptideTableStart[k] + maxActive + 1;
+  }
+}
+
+LikelihoodKernel::LikelihoodKernel(const Model& m, const Layout& layout,
+    const Array<double>& peptideProbs, double peptidePrior) : layout_(layout) {
+  // the same terms as BasicGroupBigraph::probabilityN and 
+  // BasicGroupBigraph::logLikelihoodNGivenD
+  logProbGroup_.reserve(layout_.groupTableStart.back());
+  for (std::size_t g = 0; g < layout_.numGroups; g++) {
+    int size = layout_.groupSizes[g];
+    for (int present = 0; present <= size; present++) {
+      logProbGroup_.push_back(log2(m.probabilityProteins(size, present)));
+    }
+  }
+  
+  logTermPeptide_.reserve(layout_.peptideTableStart.back());
+  for (std::size_t k = 0; k < layout_.numPeptides; k++) {
+    int maxActive = layout_.peptideTableStart[k + 1u] - layout_.peptideTableStart[k] - 1;
+    double probEGivenD = peptideProbs[static_cast<int>(k)];
+    double probE = peptidePrior;
+    for (int active = 0; active <= maxActive; active++) {
+      double probEGivenN = 1 - m.probabilityNoEmissionFrom(active);
+      double termE = probEGivenD / probE * probEGivenN;
+      double termNotE = (1-probEGivenD) / (1-probE) * (1-probEGivenN);
+      logTermPeptide_.push_back(log2(termE + termNotE));
+    }
+  }
+}
+
+/* terms with probability 0 are counted instead of added, since the log 
+   likelihood could otherwise not recover from -inf in advance() */
+inline void LikelihoodKernel::addLogTerm(State& s, double logTerm, int sign) const {
+  if (std::isinf(logTerm)) {
+    s.numZeroTerms += sign;
+  } else {
+    s.logLikelihood += sign * logTerm;
+  }
+}
+
+inline double LikelihoodKernel::logLikelihood(const State& s) const {
+  return (s.numZeroTerms > 0) ? -std::numeric_limits<double>::infinity() 
+                              : s.logLikelihood;
+}
+
+/* sets @s to the configuration at position @index of the Gray code order: 
+   with the digits c_g of the ordinary mixed-radix representation of the 
+   index, group g is reflected, i.e. counts down, if the number formed by the 
+   digits above g is odd */
+void LikelihoodKernel::seek(State& s, uint64_t index) const {
+  s.present.resize(layout_.numGroups);
+  s.direction.resize(layout_.numGroups);
+  for (std::size_t g = 0; g < layout_.numGroups; g++) {
+    uint64_t numStates = static_cast<uint64_t>(layout_.groupSizes[g]) + 1u;
+    int digit = static_cast<int>(index % numStates);
+    index /= numStates;
+    bool reflected = (index % 2u == 1u);
+    s.present[g] = reflected ? layout_.groupSizes[g] - digit : digit;
+    s.direction[g] = reflected ? -1 : 1;
+  }
+  recompute(s);
+}
+
+void LikelihoodKernel::recompute(State& s) const {
+  s.active.assign(layout_.numPeptides, 0);
+  s.logLikelihood = 0.0;
+  s.numZeroTerms = 0;
+  for (std::size_t g = 0; g < layout_.numGroups; g++) {
+    for (int j = layout_.groupStart[g]; j < layout_.groupStart[g + 1u]; j++) {
+      s.active[layout_.groupPeptides[j]] += s.present[g];
+    }
+    addLogTerm(s, logProbGroup_[layout_.groupTableStart[g] + s.present[g]], 1);
+  }
+  for (std::size_t k = 0; k < layout_.numPeptides; k++) {
+    addLogTerm(s, logTermPeptide_[layout_.peptideTableStart[k] + s.active[k]], 1);
+  }
+}
+
+/* moves to the next configuration in Gray code order, which changes the 
+   lowest group that can still move in its direction; the groups below it 
+   reverse their direction. Must not be called on the last configuration. */
+void LikelihoodKernel::advance(State& s) const {
+  std::size_t g = 0;
+  while (s.present[g] + s.direction[g] < 0 || 
+         s.present[g] + s.direction[g] > layout_.groupSizes[g]) {
+    s.direction[g] = -s.direction[g];
+    g++;
+  }
+  int step = s.direction[g];
+  const double* logProb = &logProbGroup_[layout_.groupTableStart[g]];
+  addLogTerm(s, logProb[s.present[g]], -1);
+  s.present[g] += step;
+  addLogTerm(s, logProb[s.present[g]], 1);
+  for (int j = layout_.groupStart[g]; j < layout_.groupStart[g + 1u]; j++) {
+    int k = layout_.groupPeptides[j];
+    const double* logTerm = &logTermPeptide_[layout_.peptideTableStart[k]];
+    addLogTerm(s, logTerm[s.active[k]], -1);
+    s.active[k] += step;
+    addLogTerm(s, logTerm[s.active[k]], 1);
+  }
+}
+
+/* The log likelihoods of a block of configurations are buffered and added 
+   up as 2^(x - max) in one pass, instead of one Numerical::logAdd, i.e. a 
+   log2 and a pow, per configuration. The blocks are combined in the same 
+   way. */
+double LikelihoodKernel::logLikelihoodConstant(uint64_t first, uint64_t last) const {
+  const double kNegInf = -std::numeric_limits<double>::infinity();
+  double maxLog = kNegInf, scaledSum = 0.0;
+  std::vector<double> buffer(kBlockSize);
+  State s;
+  seek(s, first);
+  for (uint64_t blockStart = first; blockStart < last; blockStart += kBlockSize) {
+    if (blockStart > first) recompute(s);
+    std::size_t blockSize = static_cast<std::size_t>(
+        std::min<uint64_t>(kBlockSize, last - blockStart));
+    double blockMax = kNegInf;
+    for (std::size_t i = 0; i < blockSize; i++) {
+      if (i > 0) advance(s);
+      buffer[i] = logLikelihood(s);
+      blockMax = std::max(blockMax, buffer[i]);
+    }
+    if (blockStart + blockSize < last) advance(s);
+    if (blockMax == kNegInf) continue;
+    
+    double blockSum = 0.0;
+    for (std::size_t i = 0; i < blockSize; i++) {
+      blockSum += exp2(buffer[i] - blockMax);
+    }
+    if (blockMax > maxLog) {
+      scaledSum = scaledSum * exp2(maxLog - blockMax) + blockSum;
+      maxLog = blockMax;
+    } else {
+      scaledSum += blockSum * exp2(blockMax - maxLog);
+    }
+  }
+  if (maxLog == kNegInf) return kNegInf;
+  return log2(scaledSum) + maxLog;
+}
+
+void LikelihoodKernel::addPresentCounts(uint64_t first, uint64_t last, 
+    double logLikelihoodConst, std::vector<double>& weightedCounts) const {
+  weightedCounts.resize(layout_.numGroups, 0.0);
+  State s;
+  seek(s, first);
+  for (uint64_t index = first; index < last; index++) {
+    if (index > first) {
+      if ((index - first) % kBlockSize == 0u) {
+        advance(s);
+        recompute(s);
+      } else {
+        advance(s);
+      }
+    }
+    double prob = exp2(logLikelihood(s) - logLikelihoodConst);
+    if (prob > 0.0) {
+      for (std::size_t g = 0; g < layout_.numGroups; g++) {
+        weightedCounts[g] += prob * s.present[g];
+      }
+    }
+  }
+}
@@ -0,0 +1,101 @@
+/*******************************************************************************
+ Copyright 2006-2012 Lukas Käll <lukas.kall@scilifelab.se>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+
+ *******************************************************************************/
+
+#ifndef _LikelihoodKernel_H
+#define _LikelihoodKernel_H
+
+#include <stdint.h>
+#include <vector>
+#include "Array.h"
+#include "Set.h"
+#include "Model.h"
+
+/*
+* LikelihoodKernel evaluates the sums over the configurations of the protein 
+*   groups of a BasicGroupBigraph for one model, i.e. the likelihood constant 
+*   and the probabilities of the groups being present (probabilityRGivenD).
+*
+* The configurations are enumerated in reflected mixed-radix Gray code order,
+*   in which consecutive configurations differ by one protein more or less in 
+*   one group. The number of active proteins of each peptide and the log 
+*   likelihood are updated for the peptides of that group only, from tables 
+*   of the per peptide and per group log terms that are computed once for the 
+*   model. The log likelihood is recomputed from scratch at the start of 
+*   every block of kBlockSize configurations, such that rounding errors do not 
+*   build up. A range of configurations [first, last) refers to positions in 
+*   the Gray code order, so that disjoint ranges can be evaluated in parallel.
+*
+*/
+class LikelihoodKernel {
+ public:
+  /* the parts that do not depend on the model, built once per subgraph: 
+     the number of proteins per group and the adjacency of groups and peptides */
+  struct Layout {
+    Layout() : numGroups(0), numPeptides(0) {}
+    Layout(const std::vector<int>& groupSizes, const Array<Set>& groupsOfPeptide);
+    
+    std::size_t numGroups, numPeptides;
+    std::vector<int> groupSizes;
+    /* peptides of group g are groupPeptides[groupStart[g]...groupStart[g+1]) */
+    std::vector<int> groupStart, groupPeptides;
+    /* offsets of the per group and per peptide tables of the kernel, which 
+       have one entry per possible number of present (active) proteins */
+    std::vector<int> groupTableStart, peptideTableStart;
+  };
+  
+  /* @layout has to outlive the kernel */
+  LikelihoodKernel(const Model& m, const Layout& layout, 
+      const Array<double>& peptideProbs, double peptidePrior);
+  
+  /* log2 of the sum over configurations [first, last) of the likelihood 
+     times the prior probability of the configuration */
+  double logLikelihoodConstant(uint64_t first, uint64_t last) const;
+  /* adds the probability of each configuration in [first, last) times its 
+     number of present proteins to @weightedCounts, per group */
+  void addPresentCounts(uint64_t first, uint64_t last, 
+      double logLikelihoodConst, std::vector<double>& weightedCounts) const;
+  
+  const std::vector<int>& groupSizes() const { return layout_.groupSizes; }
+  
+ private:
+  static const std::size_t kBlockSize = 1024u;
+  
+  /* position in the enumeration */
+  struct State {
+    std::vector<int> present; // number of present proteins per group
+    std::vector<int> direction; // +1 or -1 per group
+    std::vector<int> active; // number of active proteins per peptide
+    double logLikelihood; // of the finite terms
+    int numZeroTerms; // number of terms with probability 0
+  };
+  
+  void seek(State& s, uint64_t index) const;
+  void recompute(State& s) const;
+  void advance(State& s) const;
+  inline void addLogTerm(State& s, double logTerm, int sign) const;
+  inline double logLikelihood(const State& s) const;
+  
+  const Layout& layout_;
+  /* log2 prior probability of group g with s present proteins at 
+     logProbGroup_[layout_.groupTableStart[g] + s] */
+  std::vector<double> logProbGroup_;
+  /* log2 likelihood term of peptide k with a active proteins at 
+     logTermPeptide_[layout_.peptideTableStart[k] + a] */
+  std::vector<double> logTermPeptide_;
+};
+
+#endif /* _LikelihoodKernel_H */
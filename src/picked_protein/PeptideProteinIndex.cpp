@@ -0,0 +1,251 @@
+/*******************************************************************************
+ Copyright 2006-2012 Lukas Käll <lukas.kall@scilifelab.se>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+
+ *******************************************************************************/
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#include "PeptideProteinIndex.h"
+#include "ProteinPeptideIterator.h"
+#include "Peptide.h"
+#include "Protein.h"
+
+using namespace PercolatorCrux;
+
+const size_t PeptideProteinIndex::kProteinsPerChunk;
+
+PeptideProteinIndex::PeptideProteinIndex() {}
+
+/* polynomial rolling hash of the residues */
+uint64_t PeptideProteinIndex::hashSequence(const char* sequence, size_t length) {
+  uint64_t hash = 0u;
+  for (size_t i = 0; i < length; ++i) {
+    hash = hash * 1099511628211ull + static_cast<unsigned char>(sequence[i]);
+  }
+  return hash;
+}
+
+/* the low bits of the polynomial hash only depend on the low bits of the 
+   residues, so the bits are mixed before taking the slot */
+static inline size_t slotOfHash(uint64_t hash, size_t mask) {
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdull;
+  hash ^= hash >> 33;
+  return static_cast<size_t>(hash) & mask;
+}
+
+void PeptideProteinIndex::build(Database& db, 
+    const std::vector<size_t>& proteinIdxs, 
+    PeptideConstraint& peptideConstraint, int minMetCleavedLength) {
+  proteinIdxs_ = proteinIdxs;
+  numDigestedPeptides_.clear();
+  residues_.clear();
+  peptideStart_.assign(1u, 0u);
+  peptideHashes_.clear();
+  table_.assign(1024u, 0u);
+  proteinStart_.assign(1u, 0u);
+  proteinPeptides_.clear();
+  
+  // every chunk digests with its own copy of the constraints, since the 
+  // iterator changes the reference count of the constraint object
+  ENZYME_T enzyme = peptideConstraint.getEnzyme();
+  DIGEST_T digest = peptideConstraint.getDigest();
+  int minLength = peptideConstraint.getMinLength();
+  int maxLength = peptideConstraint.getMaxLength();
+  int numMisCleavages = peptideConstraint.getNumMisCleavage();
+  
+  int numChunks = static_cast<int>(
+      (proteinIdxs_.size() + kProteinsPerChunk - 1u) / kProteinsPerChunk);
+#pragma omp parallel for ordered schedule(dynamic, 1) if (numChunks > 1)
+  for (int c = 0; c < numChunks; ++c) {
+    size_t firstProtein = static_cast<size_t>(c) * kProteinsPerChunk;
+    size_t lastProtein = (std::min)(firstProtein + kProteinsPerChunk, 
+                                    proteinIdxs_.size());
+    PeptideConstraint constraint(enzyme, digest, minLength, maxLength, 
+                                 numMisCleavages);
+    DigestedChunk chunk;
+    digestChunk(db, firstProtein, lastProtein, constraint, 
+                minMetCleavedLength, chunk);
+#pragma omp ordered
+    addChunk(chunk);
+  }
+  
+  buildPostings();
+}
+
+void PeptideProteinIndex::digestChunk(Database& db, size_t firstProtein, 
+    size_t lastProtein, PeptideConstraint& peptideConstraint, 
+    int minMetCleavedLength, DigestedChunk& chunk) const {
+  for (size_t p = firstProtein; p < lastProtein; ++p) {
+    Protein* protein = db.getProteinAtIdx(static_cast<unsigned int>(proteinIdxs_[p]));
+    ProteinPeptideIterator proteinPeptideIterator(protein, &peptideConstraint);
+    size_t numPeptides = 0, numDigested = 0;
+    while (proteinPeptideIterator.hasNext()) {
+      Peptide* peptide = proteinPeptideIterator.next();
+      const char* sequence = peptide->getSequencePointer();
+      size_t length = peptide->getLength();
+      chunk.residues.append(sequence, length);
+      chunk.peptideEnds.push_back(chunk.residues.size());
+      chunk.hashes.push_back(hashSequence(sequence, length));
+      ++numPeptides;
+      if (sequence[0] == 'M' && peptide->getNTermFlankingAA() == '-'
+            && static_cast<int>(length) - 1 >= minMetCleavedLength) {
+        chunk.residues.append(sequence + 1, length - 1u);
+        chunk.peptideEnds.push_back(chunk.residues.size());
+        chunk.hashes.push_back(hashSequence(sequence + 1, length - 1u));
+        ++numPeptides;
+      }
+      Peptide::free(peptide);
+      ++numDigested;
+    }
+    chunk.numPeptidesPerProtein.push_back(numPeptides);
+    chunk.numDigestedPeptides.push_back(numDigested);
+  }
+}
+
+void PeptideProteinIndex::addChunk(const DigestedChunk& chunk) {
+  size_t entry = 0, start = 0;
+  for (size_t p = 0; p < chunk.numPeptidesPerProtein.size(); ++p) {
+    for (size_t k = 0; k < chunk.numPeptidesPerProtein[p]; ++k, ++entry) {
+      size_t end = chunk.peptideEnds[entry];
+      int peptide = insert(chunk.residues.data() + start, end - start, 
+                           chunk.hashes[entry]);
+      proteinPeptides_.push_back(static_cast<uint32_t>(peptide));
+      start = end;
+    }
+    proteinStart_.push_back(proteinPeptides_.size());
+    numDigestedPeptides_.push_back(chunk.numDigestedPeptides[p]);
+  }
+}
+
+int PeptideProteinIndex::insert(const char* sequence, size_t length, 
+                                uint64_t hash) {
+  if (2u * (peptideHashes_.size() + 1u) > table_.size()) growTable();
+  size_t mask = table_.size() - 1u;
+  size_t slot = slotOfHash(hash, mask);
+  while (table_[slot] != 0u) {
+    size_t peptide = table_[slot] - 1u;
+    if (peptideHashes_[peptide] == hash && 
+        peptideStart_[peptide + 1u] - peptideStart_[peptide] == length &&
+        std::memcmp(residues_.data() + peptideStart_[peptide], sequence, length) == 0) {
+      return static_cast<int>(peptide);
+    }
+    slot = (slot + 1u) & mask;
+  }
+  size_t peptide = peptideHashes_.size();
+  residues_.append(sequence, length);
+  peptideStart_.push_back(residues_.size());
+  peptideHashes_.push_back(hash);
+  table_[slot] = static_cast<uint32_t>(peptide + 1u);
+  return static_cast<int>(peptide);
+}
+
+void PeptideProteinIndex::growTable() {
+  table_.assign(2u * table_.size(), 0u);
+  size_t mask = table_.size() - 1u;
+  for (size_t peptide = 0; peptide < peptideHashes_.size(); ++peptide) {
+    size_t slot = slotOfHash(peptideHashes_[peptide], mask);
+    while (table_[slot] != 0u) slot = (slot + 1u) & mask;
+    table_[slot] = static_cast<uint32_t>(peptide + 1u);
+  }
+}
+
+/* inverts the peptides per protein; a protein that contains a peptide more 
+   than once is listed once for it */
+void PeptideProteinIndex::buildPostings() {
+  const size_t numPeptides = getNumPeptides();
+  const size_t kNone = (std::numeric_limits<size_t>::max)();
+  std::vector<size_t> lastProtein(numPeptides, kNone);
+  postingStart_.assign(numPeptides + 1u, 0u);
+  for (size_t p = 0; p < getNumProteins(); ++p) {
+    for (size_t k = proteinStart_[p]; k < proteinStart_[p + 1u]; ++k) {
+      uint32_t peptide = proteinPeptides_[k];
+      if (lastProtein[peptide] != p) {
+        lastProtein[peptide] = p;
+        ++postingStart_[peptide + 1u];
+      }
+    }
+  }
+  for (size_t peptide = 0; peptide < numPeptides; ++peptide) {
+    postingStart_[peptide + 1u] += postingStart_[peptide];
+  }
+  
+  peptideProteins_.resize(postingStart_[numPeptides]);
+  std::vector<size_t> fill(postingStart_.begin(), postingStart_.end() - 1);
+  lastProtein.assign(numPeptides, kNone);
+  for (size_t p = 0; p < getNumProteins(); ++p) {
+    for (size_t k = proteinStart_[p]; k < proteinStart_[p + 1u]; ++k) {
+      uint32_t peptide = proteinPeptides_[k];
+      if (lastProtein[peptide] != p) {
+        lastProtein[peptide] = p;
+        peptideProteins_[fill[peptide]++] = static_cast<uint32_t>(p);
+      }
+    }
+  }
+}
+
+int PeptideProteinIndex::lookup(const std::string& sequence) const {
+  uint64_t hash = hashSequence(sequence.data(), sequence.size());
+  size_t mask = table_.size() - 1u;
+  size_t slot = slotOfHash(hash, mask);
+  while (table_[slot] != 0u) {
+    size_t peptide = table_[slot] - 1u;
+    if (peptideHashes_[peptide] == hash && 
+        residues_.compare(peptideStart_[peptide], 
+            peptideStart_[peptide + 1u] - peptideStart_[peptide], sequence) == 0) {
+      return static_cast<int>(peptide);
+    }
+    slot = (slot + 1u) & mask;
+  }
+  return -1;
+}
+
+std::string PeptideProteinIndex::getSequence(int peptide) const {
+  size_t k = static_cast<size_t>(peptide);
+  return residues_.substr(peptideStart_[k], peptideStart_[k + 1u] - peptideStart_[k]);
+}
+
+void PeptideProteinIndex::getSupersetProteins(size_t protein, 
+    std::vector<size_t>& supersets) const {
+  supersets.clear();
+  std::vector<uint32_t> intersection, next;
+  for (size_t k = proteinStart_[protein]; k < proteinStart_[protein + 1u]; ++k) {
+    uint32_t peptide = proteinPeptides_[k];
+    const uint32_t* first = &peptideProteins_[0] + postingStart_[peptide];
+    const uint32_t* last = &peptideProteins_[0] + postingStart_[peptide + 1u];
+    if (k == proteinStart_[protein]) {
+      intersection.assign(first, last);
+    } else {
+      next.clear();
+      std::vector<uint32_t>::const_iterator it = intersection.begin();
+      while (it != intersection.end() && first != last) {
+        if (*it < *first) {
+          ++it;
+        } else if (*first < *it) {
+          ++first;
+        } else {
+          next.push_back(*it);
+          ++it;
+          ++first;
+        }
+      }
+      intersection.swap(next);
+    }
+    if (intersection.size() < 2u) break;
+  }
+  supersets.assign(intersection.begin(), intersection.end());
+}
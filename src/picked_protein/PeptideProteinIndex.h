@@ -0,0 +1,111 @@
+/*******************************************************************************
+ Copyright 2006-2012 Lukas Käll <lukas.kall@scilifelab.se>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+
+ *******************************************************************************/
+
+#ifndef PICKED_PROTEIN_PEPTIDE_PROTEIN_INDEX_H_
+#define PICKED_PROTEIN_PEPTIDE_PROTEIN_INDEX_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "Database.h"
+#include "PeptideConstraint.h"
+
+/*
+ * PeptideProteinIndex holds the digested peptides of a set of proteins of a 
+ * database. Peptides are interned into integer IDs through an open 
+ * addressing hash table, so that the peptides of a protein and the proteins 
+ * of a peptide are stored as flat integer arrays (compressed sparse rows).
+ *
+ * Proteins are referred to by their position in the list of protein indices 
+ * passed to build(). The proteins are digested in parallel, in chunks of 
+ * consecutive proteins that are added to the index in order, so that the 
+ * peptide IDs do not depend on the number of threads.
+ */
+class PeptideProteinIndex {
+ public:
+  PeptideProteinIndex();
+  
+  /* digests the proteins @proteinIdxs of @db. Peptides starting with a 
+     methionine at the protein N-terminus are also added without it, if they 
+     are at least @minMetCleavedLength long. */
+  void build(PercolatorCrux::Database& db, 
+             const std::vector<size_t>& proteinIdxs, 
+             PercolatorCrux::PeptideConstraint& peptideConstraint,
+             int minMetCleavedLength);
+  
+  size_t getNumProteins() const { return proteinIdxs_.size(); }
+  size_t getNumPeptides() const { return peptideHashes_.size(); }
+  size_t getProteinIdx(size_t protein) const { return proteinIdxs_[protein]; }
+  /* number of peptides in the digest of the protein, not counting the 
+     methionine cleaved variants */
+  size_t getNumDigestedPeptides(size_t protein) const { 
+    return numDigestedPeptides_[protein];
+  }
+  
+  /* returns the ID of the peptide, or -1 if it is not in the index */
+  int lookup(const std::string& sequence) const;
+  std::string getSequence(int peptide) const;
+  
+  /* positions of the proteins that contain all peptides of @protein, 
+     including @protein itself, in ascending order. Stops as soon as fewer 
+     than two proteins remain. */
+  void getSupersetProteins(size_t protein, std::vector<size_t>& supersets) const;
+  
+ private:
+  static const size_t kProteinsPerChunk = 256u;
+  
+  /* digests of a chunk of consecutive proteins */
+  struct DigestedChunk {
+    std::string residues;
+    std::vector<size_t> peptideEnds; // end of each peptide in residues
+    std::vector<uint64_t> hashes;
+    std::vector<size_t> numPeptidesPerProtein; // incl. methionine cleaved ones
+    std::vector<size_t> numDigestedPeptides;
+  };
+  
+  static uint64_t hashSequence(const char* sequence, size_t length);
+  void digestChunk(PercolatorCrux::Database& db, size_t firstProtein, 
+                   size_t lastProtein, 
+                   PercolatorCrux::PeptideConstraint& peptideConstraint,
+                   int minMetCleavedLength, DigestedChunk& chunk) const;
+  void addChunk(const DigestedChunk& chunk);
+  int insert(const char* sequence, size_t length, uint64_t hash);
+  void growTable();
+  void buildPostings();
+  
+  std::vector<size_t> proteinIdxs_;
+  std::vector<size_t> numDigestedPeptides_;
+  
+  /* peptide dictionary: peptide k is residues_[peptideStart_[k], 
+     peptideStart_[k+1]) and is found at a slot of table_ that holds k+1 */
+  std::string residues_;
+  std::vector<size_t> peptideStart_;
+  std::vector<uint64_t> peptideHashes_;
+  std::vector<uint32_t> table_;
+  
+  /* peptides of protein p are proteinPeptides_[proteinStart_[p], 
+     proteinStart_[p+1]), in digestion order and possibly repeated */
+  std::vector<size_t> proteinStart_;
+  std::vector<uint32_t> proteinPeptides_;
+  /* proteins of peptide k are peptideProteins_[postingStart_[k], 
+     postingStart_[k+1]), ascending and unique */
+  std::vector<size_t> postingStart_;
+  std::vector<uint32_t> peptideProteins_;
+};
+
+#endif /* PICKED_PROTEIN_PEPTIDE_PROTEIN_INDEX_H_ */
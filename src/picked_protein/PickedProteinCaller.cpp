@@ -94,108 +94,79 @@ bool PickedProteinCaller::parseOptions(int argc, char** argv) {
   return true;
 }
 
-void PickedProteinCaller::addToPeptideProteinMap(Database& db, 
-    size_t protein_idx, PeptideConstraint& peptide_constraint,
-    std::map<std::string, std::vector<size_t> >& peptide_protein_map,
-    std::map<size_t, size_t>& num_peptides_per_protein,
+//!
+//! reverses the protein sequences to create a decoy database, or checks if 
+//! the database already contains decoys
+//!
+void PickedProteinCaller::prepareProteins(Database& db, 
     bool reverseProteinSeqs) {
-  PercolatorCrux::Protein* protein = db.getProteinAtIdx(static_cast<unsigned int>(protein_idx));
-  
-  if (reverseProteinSeqs) {
-    protein->shuffle(PROTEIN_REVERSE_DECOYS);
+  for (size_t protein_idx = 0; protein_idx < db.getNumProteins(); 
+       ++protein_idx) {
+    PercolatorCrux::Protein* protein = db.getProteinAtIdx(static_cast<unsigned int>(protein_idx));
     
-    // MT: the crux interface will change the protein identifier. If we are
-    // not inside the crux environment we do this separately here.
-    std::string currentId(protein->getIdPointer());
-    if (currentId.substr(0, decoyPattern_.size()) != decoyPattern_) {
-      currentId = decoyPattern_ + currentId;
-      protein->setId(currentId.c_str());
-    }
-  } else if (!fasta_has_decoys_) {
-    std::string currentId(protein->getIdPointer());
-    if (currentId.substr(0, decoyPattern_.size()) == decoyPattern_) {
-      fasta_has_decoys_ = true;
-    }
-  }
-  
-  ProteinPeptideIterator cur_protein_peptide_iterator(protein, &peptide_constraint);
-  size_t numPeptides = 0;
-  while (cur_protein_peptide_iterator.hasNext()) {
-    PercolatorCrux::Peptide* peptide = cur_protein_peptide_iterator.next();
-    std::string sequence(peptide->getSequencePointer(), peptide->getLength());
-    peptide_protein_map[sequence].push_back(protein_idx);
-    if (sequence[0] == 'M' && peptide->getNTermFlankingAA() == '-'
-          && peptide->getLength() - 1 >= min_peptide_length_) {
-      std::string metCleavedSequence(sequence.substr(1, static_cast<std::size_t>(peptide->getLength() - 1)));
-      peptide_protein_map[metCleavedSequence].push_back(protein_idx);
+    if (reverseProteinSeqs) {
+      protein->shuffle(PROTEIN_REVERSE_DECOYS);
+      
+      // MT: the crux interface will change the protein identifier. If we are
+      // not inside the crux environment we do this separately here.
+      std::string currentId(protein->getIdPointer());
+      if (currentId.substr(0, decoyPattern_.size()) != decoyPattern_) {
+        currentId = decoyPattern_ + currentId;
+        protein->setId(currentId.c_str());
+      }
+    } else if (!fasta_has_decoys_) {
+      std::string currentId(protein->getIdPointer());
+      if (currentId.substr(0, decoyPattern_.size()) == decoyPattern_) {
+        fasta_has_decoys_ = true;
+      }
     }
-    PercolatorCrux::Peptide::free(peptide);
-    ++numPeptides;
   }
-  num_peptides_per_protein[protein_idx] = numPeptides;
 }
 
 //!
 //! fills \p fragment_protein_map which contains groups of proteins with same or
 //! subset peptides 
 //! 
-//! @param[in] db fasta database representation
-//! @param[in] protein_idx protein index of protein to be digested
-//! @param[in] peptide_constraint digestion parameters
-//! @param[in] num_peptides_per_protein helps to find out which proteins have 
+//! @param[in] index digested peptides of the proteins to be compared
+//! @param[out] num_peptides_per_protein helps to find out which proteins have 
 //!   identical sets and which ones are proper subsets.
 //! @param[out] fragment_protein_map groups of proteins with same or subset peptides
 //!
-void PickedProteinCaller::findFragmentProteins(Database& db, 
-    size_t protein_idx, PeptideConstraint& peptide_constraint,
-    std::map<std::string, std::vector<size_t> >& peptide_protein_map,
+void PickedProteinCaller::findFragmentProteins(
+    const PeptideProteinIndex& index,
     std::map<size_t, size_t>& num_peptides_per_protein,
     std::map<size_t, std::vector<size_t> >& fragment_protein_map) {
-  PercolatorCrux::Protein* protein = db.getProteinAtIdx(static_cast<unsigned int>(protein_idx));
-  
-  ProteinPeptideIterator cur_protein_peptide_iterator(protein, &peptide_constraint);
+  const size_t numProteins = index.getNumProteins();
+  for (size_t protein = 0; protein < numProteins; ++protein) {
+    num_peptides_per_protein[index.getProteinIdx(protein)] = 
+        index.getNumDigestedPeptides(protein);
+  }
   
-  // find all proteins of which the current protein's peptides are a subset (possibly identical)
-  bool is_first = true;
-  std::vector<size_t> protein_idx_intersection;
-  while (cur_protein_peptide_iterator.hasNext()) {
-    PercolatorCrux::Peptide* peptide = cur_protein_peptide_iterator.next();
-    std::string sequence(peptide->getSequencePointer(), peptide->getLength());   
-    
-    if (is_first) {
-      protein_idx_intersection = peptide_protein_map[sequence]; // proteins sharing the first peptide
-      is_first = false;
-    } else {
-      std::vector<size_t> newprotein_idx_intersection(protein_idx_intersection.size());
-      std::vector<size_t>::iterator it = std::set_intersection(
-          protein_idx_intersection.begin(), protein_idx_intersection.end(), 
-          peptide_protein_map[sequence].begin(), peptide_protein_map[sequence].end(), 
-          newprotein_idx_intersection.begin());
-      newprotein_idx_intersection.resize(static_cast<std::size_t>(it - newprotein_idx_intersection.begin()));
-      protein_idx_intersection = newprotein_idx_intersection;
+  // find all proteins of which the current protein's peptides are a subset 
+  // (possibly identical). The intersections are computed in parallel for a 
+  // block of proteins, the groups are formed in order of the proteins.
+  const size_t kBlockSize = 4096u;
+  std::vector<std::vector<size_t> > supersets((std::min)(kBlockSize, numProteins));
+  for (size_t blockStart = 0; blockStart < numProteins; blockStart += kBlockSize) {
+    int blockSize = static_cast<int>((std::min)(kBlockSize, numProteins - blockStart));
+#pragma omp parallel for schedule(dynamic, 64)
+    for (int i = 0; i < blockSize; ++i) {
+      index.getSupersetProteins(blockStart + static_cast<size_t>(i), supersets[i]);
     }
     
-    if (sequence[0] == 'M' && peptide->getNTermFlankingAA() == '-'
-          && peptide->getLength() - 1 >= min_peptide_length_) {
-      std::string metCleavedSequence(sequence.substr(1, static_cast<std::size_t>(peptide->getLength() - 1)));
-      std::vector<size_t> newprotein_idx_intersection(protein_idx_intersection.size());
-      std::vector<size_t>::iterator it = std::set_intersection(
-          protein_idx_intersection.begin(), protein_idx_intersection.end(), 
-          peptide_protein_map[metCleavedSequence].begin(), peptide_protein_map[metCleavedSequence].end(), 
-          newprotein_idx_intersection.begin());
-      newprotein_idx_intersection.resize(static_cast<std::size_t>(it - newprotein_idx_intersection.begin()));
-      protein_idx_intersection = newprotein_idx_intersection;
+    // if there are still proteins left in the intersection, it means that the 
+    // current protein is a subset of at least one another protein
+    for (int i = 0; i < blockSize; ++i) {
+      if (supersets[i].size() > 1) {
+        std::vector<size_t> protein_idx_intersection;
+        for (size_t j = 0; j < supersets[i].size(); ++j) {
+          protein_idx_intersection.push_back(index.getProteinIdx(supersets[i][j]));
+        }
+        addToFragmentProteinMap(index.getProteinIdx(blockStart + static_cast<size_t>(i)), 
+            protein_idx_intersection, num_peptides_per_protein, 
+            fragment_protein_map);
+      }
     }
-     
-    PercolatorCrux::Peptide::free(peptide);
-    if (protein_idx_intersection.size() < 2) break;
-  }
-  
-  // if there are still proteins left in the intersection, it means that the 
-  // current protein is a subset of at least one another protein
-  if (protein_idx_intersection.size() > 1) {
-    addToFragmentProteinMap(protein_idx, protein_idx_intersection, 
-        num_peptides_per_protein, fragment_protein_map);
   }
 }
   
@@ -265,7 +236,6 @@ void PickedProteinCaller::findFragmentsAndDuplicatesExtraDigest(Database& db,
     std::map<size_t, std::vector<size_t> >& fragment_protein_map,
     std::map<std::string, std::string>& fragment_map, 
     std::map<std::string, std::string>& duplicate_map) {
-  bool reverseProteinSeqs = false;
   std::map<size_t, std::vector<size_t> >::iterator it;
   for (it = fragment_protein_map.begin(); it != fragment_protein_map.end(); ++it) {
     size_t i = it->first;
@@ -274,19 +244,13 @@ void PickedProteinCaller::findFragmentsAndDuplicatesExtraDigest(Database& db,
     }
     std::sort(it->second.begin(), it->second.end());
     
-    std::map<std::string, std::vector<size_t> > peptide_protein_map;
-    std::map<size_t, size_t> num_peptides_per_protein_local;
-    for (std::vector<size_t>::iterator it2 = it->second.begin(); it2 != it->second.end(); ++it2) {
-      addToPeptideProteinMap(db, *it2, peptide_constraint, 
-          peptide_protein_map, num_peptides_per_protein_local, reverseProteinSeqs);
-    }
+    PeptideProteinIndex index;
+    index.build(db, it->second, peptide_constraint, min_peptide_length_);
     
+    std::map<size_t, size_t> num_peptides_per_protein_local;
     std::map<size_t, std::vector<size_t> > fragment_protein_map_local;
-    for (std::vector<size_t>::iterator it2 = it->second.begin(); it2 != it->second.end(); ++it2) {
-      findFragmentProteins(db, *it2, peptide_constraint, 
-          peptide_protein_map, num_peptides_per_protein_local, 
-          fragment_protein_map_local);
-    }
+    findFragmentProteins(index, num_peptides_per_protein_local, 
+                         fragment_protein_map_local);
     
     findFragmentsAndDuplicates(db, fragment_protein_map_local, 
         num_peptides_per_protein_local, fragment_map, duplicate_map);
@@ -373,13 +337,13 @@ bool PickedProteinCaller::getProteinFragmentsAndDuplicates(
   PeptideConstraint peptide_constraint(enzyme_, FULL_DIGEST, 
       min_peptide_length_, (std::min)(50, max_peptide_length_), 
       (std::min)(2, max_miscleavages_) );
-  std::map<std::string, std::vector<size_t> > peptide_protein_map;
-  std::map<size_t, size_t> num_peptides_per_protein;
-  for (size_t protein_idx = 0; protein_idx < db.getNumProteins(); 
-       ++protein_idx) {
-    addToPeptideProteinMap(db, protein_idx, peptide_constraint, 
-        peptide_protein_map, num_peptides_per_protein, reverseProteinSeqs);
+  prepareProteins(db, reverseProteinSeqs);
+  std::vector<size_t> protein_idxs(db.getNumProteins());
+  for (size_t protein_idx = 0; protein_idx < protein_idxs.size(); ++protein_idx) {
+    protein_idxs[protein_idx] = protein_idx;
   }
+  PeptideProteinIndex index;
+  index.build(db, protein_idxs, peptide_constraint, min_peptide_length_);
   
   if (VERB > 3) {
     reportProgress("Creating protein peptide map", startTime, startClock);
@@ -387,12 +351,9 @@ bool PickedProteinCaller::getProteinFragmentsAndDuplicates(
   
   // Find all proteins whose peptides form a subset (possibly identical) 
   // of another protein
+  std::map<size_t, size_t> num_peptides_per_protein;
   std::map<size_t, std::vector<size_t> > fragment_protein_map;
-  for (size_t protein_idx = 0; protein_idx < db.getNumProteins(); 
-       ++protein_idx) {
-    findFragmentProteins(db, protein_idx, peptide_constraint,
-        peptide_protein_map, num_peptides_per_protein, fragment_protein_map);
-  }
+  findFragmentProteins(index, num_peptides_per_protein, fragment_protein_map);
   
   if (VERB > 3) {
     reportProgress("Creating fragment protein map", startTime, startClock);
@@ -33,6 +33,7 @@
 
 #include "Database.h"
 #include "PeptideConstraint.h"
+#include "PeptideProteinIndex.h"
 #include "ProteinPeptideIterator.h"
 #include "Protein.h"
 
@@ -71,15 +72,9 @@ class PickedProteinCaller{
   
   std::string protein_db_file_, peptide_input_file_, protein_output_file_;
   
-  void addToPeptideProteinMap(PercolatorCrux::Database& db, 
-    size_t protein_idx, PercolatorCrux::PeptideConstraint& peptide_constraint,
-    std::map<std::string, std::vector<size_t> >& peptide_protein_map,
-    std::map<size_t, size_t>& num_peptides_per_protein,
-    bool reverseProteinSeqs);
+  void prepareProteins(PercolatorCrux::Database& db, bool reverseProteinSeqs);
   
-  void findFragmentProteins(PercolatorCrux::Database& db, 
-    size_t protein_idx, PercolatorCrux::PeptideConstraint& peptide_constraint,
-    std::map<std::string, std::vector<size_t> >& peptide_protein_map,
+  void findFragmentProteins(const PeptideProteinIndex& index,
     std::map<size_t, size_t>& num_peptides_per_protein,
     std::map<size_t, std::vector<size_t> >& fragment_protein_map);
   void addToFragmentProteinMap(
@@ -25,6 +25,7 @@ using namespace std;
 #include <stdarg.h>
 #include <cstring>
 #include "Timer.h"
+#include "Profiler.h"
 
 extern "C" {
   extern double dnrm2_(int *, double *, int *); // Return the Euclidian norm of a vector
@@ -57,45 +58,56 @@ AlgIn::~AlgIn() {
   delete[] C;
 }
 
-double cglsFun1(int active, int* J, const double* Y,
-                double* set2, int n, double* q, 
-                double* p, double cpos, double cneg){
-  double omega_q = 0.0;
-  int inc = 1;
-  int i = 0;
+/* Dot product of an example with p; the example is the feature row x */
+/* extended with a constant 1.0 for the bias term */
+static inline double dotExample(int n0, const double* x, const double* p) {
+  double sum = 0.0;
+  for (int k = 0; k < n0; k++) {
+    sum += x[k] * p[k];
+  }
+  sum += 1.0 * p[n0];
+  return sum;
+}
 
-  char trans = 'T';
-  double alpha = 1.0;
-  double beta = 0.0;
-  dgemv_(&trans, &n, &active,
-         &alpha, set2, &n,
-         p, &inc, &beta, q, &inc);
+/* r := a * example + r, skipped for a == 0 like daxpy */
+static inline void addScaledExample(int n0, double a, const double* x,
+                                    double* r) {
+  if (a != 0.0) {
+    for (int k = 0; k < n0; k++) {
+      r[k] += a * x[k];
+    }
+    r[n0] += a * 1.0;
+  }
+}
 
-  for (i = 0; i < active; i++) {
+/* q := X_J p, with the rows gathered through the active set, fused with */
+/* the cost weighted sum of squares of q */
+double cglsFun1(int active, const int* J, const double* Y,
+                double* const* set, int n0, double* q, 
+                const double* p, double cpos, double cneg){
+  double omega_q = 0.0;
+  for (int i = 0; i < active; i++) {
+    q[i] = dotExample(n0, set[J[i]], p);
     omega_q += ((Y[J[i]]==1)? cpos : cneg) * (q[i]) * (q[i]);
   }
-
   return(omega_q);
 }
 
-void cglsFun2(int active, int* J, const double* Y,
-              double* set2, int n0, int n, double* q, 
+void cglsFun2(int active, const int* J, const double* Y,
+              double* const* set, int n0, double* q, 
               double* o, double* z, double* r, 
               double cpos, double cneg){
-  int i;
-  int inc = 1;
-  
-  for (i = 0; i < active; i++) {
+  for (int i = 0; i < active; i++) {
     o[J[i]] += q[i];
     z[i] -= ((Y[J[i]]==1)? cpos : cneg) * q[i];
-    daxpy_(&n, &(z[i]), set2 + i * n, &inc, r, &inc);
+    addScaledExample(n0, z[i], set[J[i]], r);
   }
 }
 
 int CGLS(const AlgIn& data, const double lambda, const int cgitermax,
          const double epsilon, const vector_int& Subset,
          vector_double& Weights, vector_double& Outputs,
-         double cpos, double cneg) {
+         double cpos, double cneg, SvmWorkspace& workspace) {
   if (VERBOSE_CGLS) {
     cout << "CGLS starting..." << endl;
   }
@@ -109,29 +121,28 @@ int CGLS(const AlgIn& data, const double lambda, const int cgitermax,
   double* beta = Weights.vec;
   double* o = Outputs.vec;
   // initialize z
-  double* z = new double[active];
-  double* q = new double[active];
+  workspace.z.resize(static_cast<std::size_t>(std::max(active, 1)));
+  workspace.q.resize(static_cast<std::size_t>(std::max(active, 1)));
+  workspace.r.resize(static_cast<std::size_t>(n));
+  workspace.p.resize(static_cast<std::size_t>(n));
+  double* z = &workspace.z[0];
+  double* q = &workspace.q[0];
+  double* r = &workspace.r[0];
+  double* p = &workspace.p[0];
   int ii = 0;
   register int i;
   int n0 = n-1;
   int inc = 1;
   double one = 1;
   double negLambda = -lambda;
-  int rowStart = 0;
-  double* set2 = new double[n*active];
-  double* r = new double[n];
   for (i = n; i--;) {
     r[i] = 0.0;
   }
   for (i = 0; i < active; i++) {
     ii = J[i];
     z[i] = ((Y[ii]==1)? cpos : cneg) * (Y[ii] - o[ii]);
-    rowStart = i * n;
-    memcpy(set2 + rowStart, set[ii], sizeof(double)*static_cast<std::size_t>(n0));
-    set2[rowStart + n0] = 1.0;
-    daxpy_(&n, &(z[i]), set2 + i*n, &inc, r, &inc);
+    addScaledExample(n0, z[i], set[ii], r);
   }
-  double* p = new double[n];
   daxpy_(&n, &negLambda, beta, &inc, r, &inc);
   memcpy(p, r, sizeof(double)*static_cast<std::size_t>(n));
   double omega1 = ddot_(&n, r, &inc, r, &inc);
@@ -147,7 +158,7 @@ int CGLS(const AlgIn& data, const double lambda, const int cgitermax,
   // iterate
   while (cgiter < cgitermax) {
     cgiter++;
-    omega_q = cglsFun1(active, J, Y, set2, n, q, p, cpos, cneg);
+    omega_q = cglsFun1(active, J, Y, set, n0, q, p, cpos, cneg);
     gamma = omega1 / (lambda * omega_p + omega_q);
     inv_omega2 = 1 / omega1;
 
@@ -157,8 +168,7 @@ int CGLS(const AlgIn& data, const double lambda, const int cgitermax,
     daxpy_(&n, &gamma, p, &inc, beta, &inc);
     dscal_(&active, &gamma, q, &inc);
 
-    cglsFun2(active, J, Y, set2,
-             n0, n, q, o, z, r, cpos, cneg);
+    cglsFun2(active, J, Y, set, n0, q, o, z, r, cpos, cneg);
 
     omega_z = ddot_(&active, z, &inc, z, &inc);
     omega1 = ddot_(&n, r, &inc, r, &inc);
@@ -181,21 +191,27 @@ int CGLS(const AlgIn& data, const double lambda, const int cgitermax,
     cout << "...Done." << endl;
   }
   tictoc.stop();
+  Profiler::addCount("svm-solve", "cgls_calls", 1.0);
+  Profiler::addCount("svm-solve", "cgls_iterations", cgiter);
   if (VERB > 4) {
     cerr << "CGLS converged in " << cgiter << " iteration(s) and "
         << tictoc.getCPUTimeStr() << " CPU seconds." << endl;
   }
-  delete[] z;
-  delete[] q;
-  delete[] r;
-  delete[] p;
-  delete[] set2;
   return optimality;
 }
 
 int L2_SVM_MFN(const AlgIn& data, options& Options,
                vector_double& Weights,
                vector_double& Outputs, double cpos, double cneg) {
+  SvmWorkspace workspace;
+  return L2_SVM_MFN(data, Options, Weights, Outputs, cpos, cneg, workspace);
+}
+
+int L2_SVM_MFN(const AlgIn& data, options& Options,
+               vector_double& Weights,
+               vector_double& Outputs, double cpos, double cneg,
+               SvmWorkspace& workspace) {
+  Profiler::Scope profile("svm-solve");
   /* Disassemble the structures */
   Timer tictoc;
   double** set = data.vals;
@@ -248,6 +264,9 @@ int L2_SVM_MFN(const AlgIn& data, options& Options,
   int ii = 0;
   while (iter < Options.mfnitermax) {
     iter++;
+    // the mean active set size is active_examples / mfn_iterations
+    Profiler::addCount("svm-solve", "mfn_iterations", 1.0);
+    Profiler::addCount("svm-solve", "active_examples", active);
     if (VERB > 4) {
       cerr << "L2_SVM_MFN Iteration# " << iter << " (" << active
           << " active examples, " << " objective_value = " << F << ")"
@@ -261,7 +280,7 @@ int L2_SVM_MFN(const AlgIn& data, options& Options,
                epsilon,
                ActiveSubset,
                Weights_bar,
-               Outputs_bar, cpos, cneg);
+               Outputs_bar, cpos, cneg, workspace);
     for (register int i = active; i < m; i++) {
       ii = ActiveSubset.vec[i];
       o_bar[ii] = ddot_(&n0, set[ii], &inc, w_bar, &inc) + w_bar[n - 1];
@@ -331,6 +350,17 @@ int L2_SVM_MFN(const AlgIn& data, options& Options,
   return 0;
 }
 
+/* Sets the outputs of all examples to w'x, e.g. to start L2_SVM_MFN from */
+/* the weights of an earlier solution */
+void setOutputs(const AlgIn& data, const vector_double& Weights,
+                vector_double& Outputs) {
+  int n0 = Weights.d - 1;
+  int inc = 1;
+  for (int i = 0; i < data.m; i++) {
+    Outputs.vec[i] = ddot_(&n0, data.vals[i], &inc, Weights.vec, &inc) + Weights.vec[n0];
+  }
+}
+
 double line_search(double* w, double* w_bar, double lambda, double* o,
                    double* o_bar, const double* Y, int d, /* data dimensionality -- 'n' */
                    int l, double cpos, double cneg){
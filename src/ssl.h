@@ -88,6 +88,12 @@ struct options {
 
 };
 
+/* Buffers of CGLS, kept between calls such that the repeated CGLS calls */
+/* of L2_SVM_MFN, and repeated training on the same thread, reuse them */
+struct SvmWorkspace {
+    std::vector<double> z, q, r, p;
+};
+
 class Delta { /* used in line search */
   public:
     Delta() {
@@ -109,16 +115,23 @@ inline bool operator<(const Delta& a, const Delta& b) {
 /* Conjugate Gradient for Sparse Linear Least Squares Problems */
 /* Solves: min_w 0.5*Options->lamda*w'*w + 0.5*sum_{i in Subset} Data->C[i] (Y[i]- w' x_i)^2 */
 /* over a subset of examples x_i specified by vector_int Subset */
+/* The examples are read directly from their feature rows in set.vals */
 int CGLS(const AlgIn& set, const double lambda, const int cgitermax,
          const double epsilon, const vector_int& Subset,
          vector_double& Weights, vector_double& Outputs,
-         double cpos, double cneg);
+         double cpos, double cneg, SvmWorkspace& workspace);
 
 /* Linear Modified Finite Newton L2-SVM*/
 /* Solves: min_w 0.5*Options->lamda*w'*w + 0.5*sum_i Data->C[i] max(0,1 - Y[i] w' x_i)^2 */
 int L2_SVM_MFN(const AlgIn& set, options& Options,
                vector_double& Weights,
                vector_double& Outputs, double cpos, double cneg);
+int L2_SVM_MFN(const AlgIn& set, options& Options,
+               vector_double& Weights,
+               vector_double& Outputs, double cpos, double cneg,
+               SvmWorkspace& workspace);
+void setOutputs(const AlgIn& set, const vector_double& Weights,
+                vector_double& Outputs);
 double line_search(double* w, double* w_bar, double lambda, double* o,
                          double* o_bar, const double* Y, int d, int l,
                           double cpos, double cneg);
@@ -0,0 +1,124 @@
+/*******************************************************************************
+ Copyright 2006-2012 Lukas Käll <lukas.kall@scilifelab.se>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+
+ *******************************************************************************/
+
+/*
+ * Unit tests for the banded LDL^T solve of B = R + alpha*Qt*W^-1*Q in
+ * BaseSpline, compared against the sparse Gaussian elimination of the full
+ * matrix that BaseSpline used before.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <vector>
+
+#include "BaseSpline.h"
+#include "PseudoRandom.h"
+
+namespace {
+
+double uniform() {
+  return static_cast<double>(PseudoRandom::lcg_rand() % 100000u) / 100000.0;
+}
+
+// Exposes the protected solver of BaseSpline
+class SplineSystem : public BaseSpline {
+ public:
+  // n knots with random spacing and random positive weights
+  explicit SplineSystem(std::size_t n) {
+    double pos = 0.0;
+    for (std::size_t ix = 0; ix < n; ++ix) {
+      pos += 0.01 + uniform();
+      x.push_back(pos);
+    }
+    initiateQR();
+    w = PackedVector(static_cast<int>(n));
+    for (std::size_t ix = 0; ix < n; ++ix) {
+      w.packedReplace(static_cast<int>(ix), 0.001 + uniform());
+    }
+  }
+
+  std::size_t numGammas() const { return x.size() - 2; }
+
+  void solveBanded(double alpha, std::vector<double>& res) {
+    factorizeB(alpha);
+    solveFactorizedB(res);
+  }
+
+  // Builds Q and R as full matrices from the knots, the way initiateQR did
+  // before it stored their diagonals, and solves with solveInPlace
+  void solveDense(double alpha, std::vector<double>& res) const {
+    int n = static_cast<int>(x.size());
+    int m = n - 2;
+    PackedMatrix Q(n, m), R(m, m);
+    for (int j = 0; j < m; ++j) {
+      double h0 = x[j + 1] - x[j], h1 = x[j + 2] - x[j + 1];
+      Q[j].packedAddElement(j, 1 / h0);
+      Q[j + 1].packedAddElement(j, -1 / h0 - 1 / h1);
+      Q[j + 2].packedAddElement(j, 1 / h1);
+      R[j].packedAddElement(j, (h0 + h1) / 3);
+      if (j + 1 < m) {
+        R[j].packedAddElement(j + 1, h1 / 6);
+        R[j + 1].packedAddElement(j, h1 / 6);
+      }
+    }
+    PackedMatrix Qt = Q.packedTranspose(Q);
+    PackedMatrix diag = PackedMatrix::packedDiagonalMatrix(
+        PackedVector(n, 1) / w).packedMultiply(alpha);
+    PackedMatrix M = R.packedAdd(Qt.packedMultiply(diag.packedMultiply(Q)));
+    PackedVector packedRes(m);
+    for (int ix = 0; ix < m; ++ix) packedRes.packedReplace(ix, res[ix]);
+    solveInPlace(M, packedRes);
+    for (int ix = 0; ix < m; ++ix) res[ix] = packedRes[ix];
+  }
+};
+
+void expectSameSolution(std::size_t numKnots, double alpha) {
+  SplineSystem system(numKnots);
+  std::size_t m = system.numGammas();
+  std::vector<double> banded(m);
+  for (std::size_t ix = 0; ix < m; ++ix) banded[ix] = uniform() - 0.5;
+  std::vector<double> dense(banded);
+  system.solveBanded(alpha, banded);
+  system.solveDense(alpha, dense);
+  for (std::size_t ix = 0; ix < m; ++ix) {
+    EXPECT_NEAR(dense[ix], banded[ix], 1e-8 * (1.0 + std::fabs(dense[ix])))
+        << "knots=" << numKnots << " alpha=" << alpha << " ix=" << ix;
+  }
+}
+
+} // namespace
+
+class BaseSplineBandedSolveTest : public ::testing::TestWithParam<double> {
+ protected:
+  virtual void SetUp() { PseudoRandom::setSeed(4711); }
+};
+
+TEST_P(BaseSplineBandedSolveTest, MatchesDenseSolve) {
+  expectSameSolution(50, GetParam());
+  expectSameSolution(500, GetParam());
+}
+
+TEST_P(BaseSplineBandedSolveTest, SmallestSystems) {
+  // m = 1, 2 and 3 exercise the special cases of the first rows
+  expectSameSolution(3, GetParam());
+  expectSameSolution(4, GetParam());
+  expectSameSolution(5, GetParam());
+}
+
+INSTANTIATE_TEST_CASE_P(Alphas, BaseSplineBandedSolveTest,
+                        ::testing::Values(0.0, 0.01, 1.0, 100.0));
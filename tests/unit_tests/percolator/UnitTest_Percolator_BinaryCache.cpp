@@ -0,0 +1,171 @@
+/*******************************************************************************
+ Copyright 2006-2012 Lukas Käll <lukas.kall@scilifelab.se>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+
+ *******************************************************************************/
+/*
+ * Unit tests for BinaryCache: the PSMs read back from a written cache match 
+ * the parsed ones, in the same order and feature pool layout.
+ */
+
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "BinaryCache.h"
+#include "SqtSanityCheck.h"
+
+namespace {
+
+const char* kTabInput = 
+    "SpecId\tLabel\tScanNr\tExpMass\tCalcMass\tfeatA\tfeatB\tPeptide\tProteins\n"
+    "psm_1\t1\t11\t1000.5\t1000.25\t0.5\t-1.25\tK.PEPTIDEK.A\tprot_1\tprot_2\n"
+    "psm_2\t-1\t11\t1000.5\t1000.75\t0.25\t2.5\tK.EDITPEPK.A\tdecoy_prot_1\n"
+    "psm_3\t-1\t12\t1200.125\t1200.0\t-3.0\t0.125\tR.SAMPLER.G\tdecoy_prot_2\n"
+    "psm_4\t1\t13\t1300.0\t1300.5\t1.5\t4.0\tK.PEPTIDEK.A\tprot_1\n"
+    "psm_5\t1\t14\t1400.25\t1400.0\t7.0\t-0.5\tR.ANOTHERK.L\tprot_3\tprot_1\n"
+    "psm_6\t-1\t15\t1500.0\t1500.5\t-2.0\t3.25\tR.REHTONAK.L\tdecoy_prot_3\n";
+
+// the PSMs of both sets in the order of their feature rows in the pool
+void getPsmsInPoolOrder(SetHandler& setHandler, 
+    std::vector<PSMDescription*>& psms, std::vector<int>& labels) {
+  FeatureMemoryPool& pool = setHandler.getFeaturePool();
+  int setLabels[2] = { 1, -1 };
+  std::vector<const double*> rows;
+  std::vector<PSMDescription*> setPsms;
+  std::vector<int> setPsmLabels;
+  for (int s = 0; s < 2; ++s) {
+    const std::vector<PSMDescription*>& subset = 
+        setHandler.getSubsetFromLabel(setLabels[s])->getPsms();
+    for (std::size_t i = 0; i < subset.size(); ++i) {
+      setPsms.push_back(subset[i]);
+      setPsmLabels.push_back(setLabels[s]);
+      rows.push_back(subset[i]->features);
+    }
+  }
+  std::vector<unsigned int> rowIdxs;
+  pool.getRowIndices(rows, rowIdxs);
+  psms.assign(setPsms.size(), NULL);
+  labels.assign(setPsms.size(), 0);
+  for (std::size_t i = 0; i < setPsms.size(); ++i) {
+    ASSERT_LT(rowIdxs[i], setPsms.size());
+    ASSERT_EQ(pool.addressFromIdx(rowIdxs[i]), rows[i]);
+    psms[rowIdxs[i]] = setPsms[i];
+    labels[rowIdxs[i]] = setPsmLabels[i];
+  }
+}
+
+class BinaryCacheTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    char tempName[] = "/tmp/percolator_bin_XXXXXX";
+    int fd = mkstemp(tempName);
+    if (fd != -1) close(fd);
+    cacheFN_ = tempName;
+    DataSet::setCalcDoc(false);
+    DataSet::resetFeatureNames();
+  }
+  
+  virtual void TearDown() {
+    std::remove(cacheFN_.c_str());
+    DataSet::resetFeatureNames();
+  }
+  
+  std::string cacheFN_;
+};
+
+TEST_F(BinaryCacheTest, RoundTrip) {
+  SetHandler parsed(0u);
+  SanityCheck* pParsedCheck = NULL;
+  std::istringstream input(kTabInput);
+  ASSERT_EQ(1, parsed.readTab(input, pParsedCheck));
+  BinaryCache::write(cacheFN_, parsed, pParsedCheck, "sqt2pin -o out.xml");
+  unsigned int numFeatures = DataSet::getNumFeatures();
+  
+  DataSet::resetFeatureNames();
+  SetHandler reloaded(0u);
+  SanityCheck* pReloadedCheck = NULL;
+  std::string otherCall;
+  ASSERT_EQ(1, BinaryCache::read(cacheFN_, reloaded, pReloadedCheck, otherCall));
+  EXPECT_EQ("sqt2pin -o out.xml", otherCall);
+  EXPECT_TRUE(dynamic_cast<SqtSanityCheck*>(pReloadedCheck) != NULL);
+  EXPECT_EQ(pParsedCheck->concatenatedSearch(), pReloadedCheck->concatenatedSearch());
+  ASSERT_EQ(numFeatures, DataSet::getNumFeatures());
+  EXPECT_EQ("featA", DataSet::getFeatureNames().getFeatureName(0u));
+  EXPECT_EQ("featB", DataSet::getFeatureNames().getFeatureName(1u));
+  
+  std::vector<PSMDescription*> parsedPsms, reloadedPsms;
+  std::vector<int> parsedLabels, reloadedLabels;
+  getPsmsInPoolOrder(parsed, parsedPsms, parsedLabels);
+  getPsmsInPoolOrder(reloaded, reloadedPsms, reloadedLabels);
+  ASSERT_EQ(6u, parsedPsms.size());
+  ASSERT_EQ(parsedPsms.size(), reloadedPsms.size());
+  EXPECT_EQ(parsedLabels, reloadedLabels);
+  for (std::size_t i = 0; i < parsedPsms.size(); ++i) {
+    PSMDescription* a = parsedPsms[i];
+    PSMDescription* b = reloadedPsms[i];
+    EXPECT_EQ(a->getId(), b->getId());
+    EXPECT_EQ(a->scan, b->scan);
+    EXPECT_EQ(a->expMass, b->expMass);
+    EXPECT_EQ(a->calcMass, b->calcMass);
+    EXPECT_EQ(a->peptide, b->peptide);
+    ASSERT_EQ(a->proteinIds.size(), b->proteinIds.size());
+    for (std::size_t k = 0; k < a->proteinIds.size(); ++k) {
+      EXPECT_EQ(PSMDescription::getProteinName(a->proteinIds[k]), 
+                PSMDescription::getProteinName(b->proteinIds[k]));
+    }
+    for (unsigned int j = 0; j < numFeatures; ++j) {
+      EXPECT_EQ(a->features[j], b->features[j]);
+    }
+  }
+  
+  // the order within each set is kept as well
+  int setLabels[2] = { 1, -1 };
+  for (int s = 0; s < 2; ++s) {
+    const std::vector<PSMDescription*>& a = 
+        parsed.getSubsetFromLabel(setLabels[s])->getPsms();
+    const std::vector<PSMDescription*>& b = 
+        reloaded.getSubsetFromLabel(setLabels[s])->getPsms();
+    ASSERT_EQ(a.size(), b.size());
+    for (std::size_t i = 0; i < a.size(); ++i) {
+      EXPECT_EQ(a[i]->getId(), b[i]->getId());
+    }
+  }
+  delete pParsedCheck;
+  delete pReloadedCheck;
+}
+
+TEST_F(BinaryCacheTest, PlainSanityCheckWithoutSqtFingerprint) {
+  SetHandler parsed(0u);
+  SanityCheck* pParsedCheck = NULL;
+  std::istringstream input(kTabInput);
+  ASSERT_EQ(1, parsed.readTab(input, pParsedCheck));
+  BinaryCache::write(cacheFN_, parsed, pParsedCheck, "");
+  
+  DataSet::resetFeatureNames();
+  SetHandler reloaded(0u);
+  SanityCheck* pReloadedCheck = NULL;
+  std::string otherCall = "previous";
+  ASSERT_EQ(1, BinaryCache::read(cacheFN_, reloaded, pReloadedCheck, otherCall));
+  EXPECT_EQ("", otherCall);
+  EXPECT_TRUE(dynamic_cast<SqtSanityCheck*>(pReloadedCheck) == NULL);
+  delete pParsedCheck;
+  delete pReloadedCheck;
+}
+
+}
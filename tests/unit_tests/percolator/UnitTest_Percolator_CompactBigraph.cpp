@@ -0,0 +1,170 @@
+/*******************************************************************************
+ Copyright 2006-2012 Lukas Käll <lukas.kall@scilifelab.se>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+
+ *******************************************************************************/
+/*
+ * Unit tests for CompactBigraph: pruning, cloning of PSMs that connect 
+ * several sections and the partitioning into sections.
+ */
+
+#include <gtest/gtest.h>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "CompactBigraph.h"
+
+namespace {
+
+// P4 only has a PSM below the protein threshold, PEP_LOW connects two 
+// sections but is below the peptide threshold and gets cloned, P7 and P8 
+// have the same PSMs and end up in the same section
+const char* kGraph =
+    "e PEP_A\nc\nr P1\nr P2\np 0.9\n"
+    "e PEP_B\nc\nr P2\np 0.8\n"
+    "e PEP_C\nc\nr P3\np 0.7\n"
+    "e PEP_LOW\nc\nr P2\nr P3\np 0.0005\n"
+    "e PEP_D\nc\nr P4\np 0.00001\n"
+    "e PEP_F\nc\nr P7\nr P8\np 0.0005\n";
+
+std::vector<std::string> names(const GraphLayer& layer) {
+  std::vector<std::string> result;
+  for (int k = 0; k < layer.size(); k++) result.push_back(layer.names[k]);
+  return result;
+}
+
+std::vector<std::string> neighbourNames(const GraphLayer& layer, 
+    const GraphLayer& other, int k) {
+  std::vector<std::string> result;
+  const Set& as = layer.associations[k];
+  for (int j = 0; j < as.size(); j++) result.push_back(other.names[as[j]]);
+  return result;
+}
+
+std::vector<std::string> list(const char* a, const char* b = NULL, 
+    const char* c = NULL) {
+  std::vector<std::string> result(1, a);
+  if (b != NULL) result.push_back(b);
+  if (c != NULL) result.push_back(c);
+  return result;
+}
+
+// gives access to the name table of a copy of a graph
+class NameTableOf : public CompactBigraph {
+ public:
+  explicit NameTableOf(const CompactBigraph& graph) : CompactBigraph(graph) {}
+  std::size_t size() const { return names_->size(); }
+};
+
+class CompactBigraphTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    std::istringstream is(kGraph);
+    BasicBigraph bb(0.0, 1e-3, 1e-4);
+    bb.read(is);
+    graph_ = CompactBigraph(bb);
+  }
+  
+  CompactBigraph graph_;
+};
+
+TEST_F(CompactBigraphTest, PruneClonesAndSeversProteins) {
+  graph_.prune();
+  BasicBigraph pruned;
+  graph_.toBasicBigraph(pruned);
+  
+  EXPECT_EQ(1, graph_.getNumberClones());
+  ASSERT_EQ(1, graph_.getSeveredProteins().size());
+  EXPECT_EQ("P4", graph_.getSeveredProteins()[0]);
+  
+  std::vector<std::string> psms;
+  psms.push_back("PEP_A");
+  psms.push_back("PEP_B");
+  psms.push_back("PEP_C");
+  psms.push_back("PEP_F");
+  psms.push_back("PEP_LOW_clone_0");
+  psms.push_back("PEP_LOW_clone_1");
+  EXPECT_EQ(psms, names(pruned.PSMsToProteins));
+  
+  std::vector<std::string> proteins;
+  proteins.push_back("P1");
+  proteins.push_back("P2");
+  proteins.push_back("P3");
+  proteins.push_back("P7");
+  proteins.push_back("P8");
+  EXPECT_EQ(proteins, names(pruned.proteinsToPSMs));
+  
+  const GraphLayer& PSMs = pruned.PSMsToProteins;
+  const GraphLayer& prots = pruned.proteinsToPSMs;
+  EXPECT_EQ(list("P1", "P2"), neighbourNames(PSMs, prots, 0));
+  EXPECT_EQ(list("P2"), neighbourNames(PSMs, prots, 4));
+  EXPECT_EQ(list("P3"), neighbourNames(PSMs, prots, 5));
+  EXPECT_EQ(0.0005, PSMs.weights[4]);
+  EXPECT_EQ(list("PEP_A", "PEP_B", "PEP_LOW_clone_0"), neighbourNames(prots, PSMs, 1));
+  EXPECT_EQ(list("PEP_C", "PEP_LOW_clone_1"), neighbourNames(prots, PSMs, 2));
+}
+
+TEST_F(CompactBigraphTest, PartitionSections) {
+  graph_.prune();
+  std::vector<CompactBigraph> sections;
+  graph_.partitionSections(sections);
+  ASSERT_EQ(3u, sections.size());
+  
+  BasicBigraph bb[3];
+  for (int s = 0; s < 3; s++) sections[s].toBasicBigraph(bb[s]);
+  EXPECT_EQ(list("P1", "P2"), names(bb[0].proteinsToPSMs));
+  EXPECT_EQ(list("PEP_A", "PEP_B", "PEP_LOW_clone_0"), names(bb[0].PSMsToProteins));
+  EXPECT_EQ(list("P3"), names(bb[1].proteinsToPSMs));
+  EXPECT_EQ(list("PEP_C", "PEP_LOW_clone_1"), names(bb[1].PSMsToProteins));
+  EXPECT_EQ(list("P7", "P8"), names(bb[2].proteinsToPSMs));
+  EXPECT_EQ(list("PEP_F"), names(bb[2].PSMsToProteins));
+  
+  // indices are local to the section, in both directions
+  EXPECT_EQ(list("P1", "P2"), neighbourNames(bb[0].PSMsToProteins, bb[0].proteinsToPSMs, 0));
+  EXPECT_EQ(list("PEP_A", "PEP_B", "PEP_LOW_clone_0"), 
+            neighbourNames(bb[0].proteinsToPSMs, bb[0].PSMsToProteins, 1));
+  EXPECT_EQ(list("PEP_F"), neighbourNames(bb[2].proteinsToPSMs, bb[2].PSMsToProteins, 1));
+  EXPECT_EQ(0.9, sections[0].getMaxPSMWeight());
+  EXPECT_EQ(0.0005, sections[2].getMaxPSMWeight());
+  
+  // the sections are pruned with the default protein threshold of 1e-3
+  sections[2].prune();
+  ASSERT_EQ(2, sections[2].getSeveredProteins().size());
+  EXPECT_EQ("P7", sections[2].getSeveredProteins()[0]);
+}
+
+TEST_F(CompactBigraphTest, PruningACopyKeepsTheNameTable) {
+  const std::size_t numNames = NameTableOf(graph_).size();
+  for (int repeat = 0; repeat < 2; repeat++) {
+    CompactBigraph copy(graph_);
+    copy.prune();
+    EXPECT_EQ(1, copy.getNumberClones());
+    std::vector<CompactBigraph> sections;
+    copy.partitionSections(sections);
+    EXPECT_EQ(numNames, NameTableOf(graph_).size());
+  }
+  
+  // each section only keeps the names of its own nodes
+  graph_.prune();
+  std::vector<CompactBigraph> sections;
+  graph_.partitionSections(sections);
+  ASSERT_EQ(3u, sections.size());
+  EXPECT_EQ(5u, NameTableOf(sections[0]).size());
+  EXPECT_EQ(3u, NameTableOf(sections[1]).size());
+  EXPECT_EQ(3u, NameTableOf(sections[2]).size());
+}
+
+}
@@ -53,7 +53,7 @@ TEST_F(DataSetTest, ChecMinimalPsmParsing)
     ASSERT_EQ("Id", myPsm->getId());
     ASSERT_EQ("PEPTIDE", myPsm->peptide);
     ASSERT_EQ(1, myPsm->proteinIds.size());
-    ASSERT_EQ("ProteinList", myPsm->proteinIds[0]);
+    ASSERT_EQ("ProteinList", PSMDescription::getProteinName(myPsm->proteinIds[0]));
 }
 
 // Throw on lines with missing fields.
@@ -0,0 +1,98 @@
+/*******************************************************************************
+ Copyright 2006-2012 Lukas Käll <lukas.kall@scilifelab.se>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+
+ *******************************************************************************/
+/*
+ * Unit tests for GroupPowerBigraph: repartitioning the graph that was read 
+ * with other thresholds, as done after --fido-fast-gridsearch, has to give 
+ * the same proteins and probabilities as reading it with those thresholds.
+ */
+
+#include <gtest/gtest.h>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "GroupPowerBigraph.h"
+
+namespace {
+
+const char* kGraph =
+    "e PEP_A\nc\nr P1\nr P2\np 0.9\n"
+    "e PEP_B\nc\nr P2\np 0.8\n"
+    "e PEP_C\nc\nr P3\np 0.7\n"
+    "e PEP_D\nc\nr P2\nr P3\np 0.05\n"
+    "e PEP_E\nc\nr P4\np 0.3\n"
+    "e PEP_F\nc\nr P5\nr P6\np 0.6\n"
+    "e PEP_G\nc\nr P7\np 0.02\n";
+
+const Model kModel(0.1, 0.01, 0.5);
+
+void setFinalOptions(GroupPowerBigraph& graph) {
+  graph.setProteinThreshold(1e-3);
+  graph.setPsmThreshold(0.0);
+  graph.setPeptideThreshold(1e-3);
+  graph.setNoClustering(false);
+  graph.setNoPartitioning(false);
+  graph.setNoPruning(false);
+  graph.setTrivialGrouping(false);
+}
+
+void getProbsAndNames(GroupPowerBigraph& graph, 
+    std::vector<std::vector<std::string> >& names, std::vector<double>& probs) {
+  graph.getProteinProbs(kModel);
+  graph.getProteinProbsAndNames(names, probs);
+}
+
+}
+
+TEST(GroupPowerBigraphTest, RepartitionAfterReducedGraph) {
+  std::vector<std::vector<std::string> > expectedNames, names;
+  std::vector<double> expectedProbs, probs;
+  {
+    std::istringstream is(kGraph);
+    GroupPowerBigraph graph;
+    setFinalOptions(graph);
+    graph.read(is);
+    getProbsAndNames(graph, expectedNames, expectedProbs);
+  }
+  ASSERT_FALSE(expectedNames.empty());
+  
+  // the reduced graph of the fast grid search
+  std::istringstream is(kGraph);
+  GroupPowerBigraph graph;
+  graph.setProteinThreshold(0.1);
+  graph.setPsmThreshold(0.1);
+  graph.setPeptideThreshold(0.1);
+  graph.setTrivialGrouping(true);
+  graph.read(is);
+  getProbsAndNames(graph, names, probs);
+  EXPECT_NE(expectedNames, names);
+  
+  setFinalOptions(graph);
+  graph.repartition();
+  getProbsAndNames(graph, names, probs);
+  EXPECT_EQ(expectedNames, names);
+  ASSERT_EQ(expectedProbs.size(), probs.size());
+  for (std::size_t k = 0; k < probs.size(); k++) {
+    EXPECT_DOUBLE_EQ(expectedProbs[k], probs[k]);
+  }
+  
+  // repartitioning with the same options gives the same result again
+  graph.repartition();
+  getProbsAndNames(graph, names, probs);
+  EXPECT_EQ(expectedNames, names);
+}
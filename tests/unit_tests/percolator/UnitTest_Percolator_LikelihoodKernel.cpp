@@ -0,0 +1,213 @@
+/*******************************************************************************
+ Copyright 2006-2012 Lukas Käll <lukas.kall@scilifelab.se>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+
+ *******************************************************************************/
+
+/*
+ * Unit tests for the Fido LikelihoodKernel, compared against a brute-force
+ * enumeration of all configurations of small subgraphs in the linear domain.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <vector>
+
+#include "LikelihoodKernel.h"
+#include "Model.h"
+
+namespace {
+
+const double kPeptidePrior = 0.1;
+
+struct Subgraph {
+  std::vector<int> groupSizes;
+  Array<Set> groupsOfPeptide;
+  Array<double> peptideProbs;
+  
+  void addPeptide(double prob, int group1, int group2 = -1) {
+    Set groups;
+    groups.add(group1);
+    if (group2 >= 0) groups.add(group2);
+    groupsOfPeptide.add(groups);
+    peptideProbs.add(prob);
+  }
+  
+  uint64_t numConfigurations() const {
+    uint64_t num = 1u;
+    for (std::size_t g = 0; g < groupSizes.size(); g++) {
+      num *= static_cast<uint64_t>(groupSizes[g]) + 1u;
+    }
+    return num;
+  }
+};
+
+/* the likelihood constant and the probability weighted present counts per
+   group, summed over the configurations in lexicographic order */
+void bruteForce(const Model& m, const Subgraph& graph, 
+    double& likelihoodConst, std::vector<double>& weightedCounts) {
+  std::size_t numGroups = graph.groupSizes.size();
+  std::vector<int> present(numGroups, 0);
+  std::vector<double> likelihoods;
+  std::vector<std::vector<int> > configurations;
+  likelihoodConst = 0.0;
+  for (uint64_t index = 0; index < graph.numConfigurations(); index++) {
+    double likelihood = 1.0;
+    for (std::size_t g = 0; g < numGroups; g++) {
+      likelihood *= m.probabilityProteins(graph.groupSizes[g], present[g]);
+    }
+    for (int k = 0; k < graph.groupsOfPeptide.size(); k++) {
+      const Set& groups = graph.groupsOfPeptide[k];
+      int active = 0;
+      for (int j = 0; j < groups.size(); j++) active += present[groups[j]];
+      double probEGivenD = graph.peptideProbs[k];
+      double probEGivenN = 1 - m.probabilityNoEmissionFrom(active);
+      likelihood *= probEGivenD / kPeptidePrior * probEGivenN + 
+          (1 - probEGivenD) / (1 - kPeptidePrior) * (1 - probEGivenN);
+    }
+    likelihoodConst += likelihood;
+    likelihoods.push_back(likelihood);
+    configurations.push_back(present);
+    
+    for (std::size_t g = 0; g < numGroups; g++) {
+      if (++present[g] <= graph.groupSizes[g]) break;
+      present[g] = 0;
+    }
+  }
+  weightedCounts.assign(numGroups, 0.0);
+  for (std::size_t ix = 0; ix < likelihoods.size(); ix++) {
+    for (std::size_t g = 0; g < numGroups; g++) {
+      weightedCounts[g] += likelihoods[ix] / likelihoodConst * configurations[ix][g];
+    }
+  }
+}
+
+/* evaluates the kernel over the configurations split at @splits, the way 
+   BasicGroupBigraph::probabilityRGivenD combines its chunks */
+void evaluateKernel(const Model& m, const Subgraph& graph, 
+    const std::vector<uint64_t>& splits, 
+    double& likelihoodConst, std::vector<double>& weightedCounts) {
+  LikelihoodKernel::Layout layout(graph.groupSizes, graph.groupsOfPeptide);
+  LikelihoodKernel kernel(m, layout, graph.peptideProbs, kPeptidePrior);
+  std::vector<uint64_t> bounds(1, 0u);
+  bounds.insert(bounds.end(), splits.begin(), splits.end());
+  bounds.push_back(graph.numConfigurations());
+  
+  likelihoodConst = 0.0;
+  for (std::size_t chunk = 0; chunk + 1u < bounds.size(); chunk++) {
+    likelihoodConst += exp2(kernel.logLikelihoodConstant(bounds[chunk], bounds[chunk + 1u]));
+  }
+  weightedCounts.clear();
+  for (std::size_t chunk = 0; chunk + 1u < bounds.size(); chunk++) {
+    std::vector<double> partialSums;
+    kernel.addPresentCounts(bounds[chunk], bounds[chunk + 1u], 
+                            log2(likelihoodConst), partialSums);
+    weightedCounts.resize(partialSums.size(), 0.0);
+    for (std::size_t g = 0; g < partialSums.size(); g++) {
+      weightedCounts[g] += partialSums[g];
+    }
+  }
+}
+
+void expectMatchesBruteForce(const Model& m, const Subgraph& graph, 
+    const std::vector<uint64_t>& splits) {
+  double expectedConst, kernelConst;
+  std::vector<double> expectedCounts, kernelCounts;
+  bruteForce(m, graph, expectedConst, expectedCounts);
+  evaluateKernel(m, graph, splits, kernelConst, kernelCounts);
+  
+  EXPECT_NEAR(expectedConst, kernelConst, 1e-10 * expectedConst);
+  ASSERT_EQ(expectedCounts.size(), kernelCounts.size());
+  for (std::size_t g = 0; g < expectedCounts.size(); g++) {
+    EXPECT_NEAR(expectedCounts[g], kernelCounts[g], 1e-10 * graph.groupSizes[g])
+        << "group " << g;
+  }
+}
+
+/* 3 groups with 3 * 2 * 4 = 24 configurations */
+Subgraph smallSubgraph() {
+  Subgraph graph;
+  graph.groupSizes.push_back(2);
+  graph.groupSizes.push_back(1);
+  graph.groupSizes.push_back(3);
+  graph.addPeptide(0.9, 0);
+  graph.addPeptide(0.5, 0, 1);
+  graph.addPeptide(0.01, 1, 2);
+  graph.addPeptide(0.99, 2);
+  return graph;
+}
+
+/* 6 groups with 4 * 3 * 5 * 2 * 4 * 3 = 1440 configurations, i.e. more 
+   than one block of the kernel */
+Subgraph largeSubgraph() {
+  Subgraph graph;
+  int sizes[] = { 3, 2, 4, 1, 3, 2 };
+  graph.groupSizes.assign(sizes, sizes + 6);
+  graph.addPeptide(0.95, 0);
+  graph.addPeptide(0.3, 0, 1);
+  graph.addPeptide(0.7, 1, 2);
+  graph.addPeptide(0.05, 2);
+  graph.addPeptide(0.6, 2, 3);
+  graph.addPeptide(0.8, 3, 4);
+  graph.addPeptide(0.2, 4, 5);
+  graph.addPeptide(0.99, 5);
+  graph.addPeptide(0.4, 0, 5);
+  return graph;
+}
+
+} // namespace
+
+TEST(LikelihoodKernelTest, SmallSubgraph) {
+  Subgraph graph = smallSubgraph();
+  expectMatchesBruteForce(Model(0.1, 0.01, 0.5), graph, std::vector<uint64_t>());
+  expectMatchesBruteForce(Model(0.7, 0.2, 0.3), graph, std::vector<uint64_t>());
+}
+
+TEST(LikelihoodKernelTest, SmallSubgraphInChunks) {
+  Subgraph graph = smallSubgraph();
+  std::vector<uint64_t> splits;
+  splits.push_back(1u);
+  splits.push_back(7u);
+  splits.push_back(8u);
+  splits.push_back(23u);
+  expectMatchesBruteForce(Model(0.1, 0.01, 0.5), graph, splits);
+}
+
+TEST(LikelihoodKernelTest, CrossesRecomputeBoundary) {
+  Subgraph graph = largeSubgraph();
+  ASSERT_GT(graph.numConfigurations(), 1024u);
+  expectMatchesBruteForce(Model(0.1, 0.01, 0.5), graph, std::vector<uint64_t>());
+  expectMatchesBruteForce(Model(0.9, 0.3, 0.1), graph, std::vector<uint64_t>());
+}
+
+TEST(LikelihoodKernelTest, ChunksCrossRecomputeBoundary) {
+  Subgraph graph = largeSubgraph();
+  // chunks that start within a block and span the boundary of the blocks 
+  // counted from their start
+  std::vector<uint64_t> splits;
+  splits.push_back(500u);
+  splits.push_back(1030u);
+  splits.push_back(1100u);
+  expectMatchesBruteForce(Model(0.1, 0.01, 0.5), graph, splits);
+}
+
+TEST(LikelihoodKernelTest, ZeroProbabilityConfigurations) {
+  // without noise emissions, a peptide of probability 1 cannot be observed 
+  // unless one of its proteins is present, which gives terms of probability
+  // 0 that have to be recovered from when the protein comes back
+  Subgraph graph = largeSubgraph();
+  graph.peptideProbs[7] = 1.0;
+  expectMatchesBruteForce(Model(0.5, 0.0, 0.5), graph, std::vector<uint64_t>());
+}
@@ -0,0 +1,207 @@
+/*******************************************************************************
+ Copyright 2006-2012 Lukas Käll <lukas.kall@scilifelab.se>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+
+ *******************************************************************************/
+
+/*
+ * Unit tests for the superset detection of PeptideProteinIndex, compared 
+ * against the inclusion of the sets of peptides that a separate digest of 
+ * each protein yields.
+ */
+
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+#include <cstdio>
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Database.h"
+#include "PeptideConstraint.h"
+#include "PeptideProteinIndex.h"
+#include "ProteinPeptideIterator.h"
+#include "Peptide.h"
+#include "PseudoRandom.h"
+
+using namespace PercolatorCrux;
+
+namespace {
+
+const int kMinLength = 6;
+
+class PeptideProteinIndexTest : public ::testing::Test {
+ protected:
+  PeptideProteinIndexTest() : constraint_(TRYPSIN, FULL_DIGEST, kMinLength, 50, 0) {}
+  
+  virtual void SetUp() {
+    PseudoRandom::setSeed(1);
+    std::vector<std::string> sequences;
+    // a duplicate, a fragment and a protein that is only contained in the 
+    // first one if its N-terminal methionine is cleaved
+    sequences.push_back("MAAAAAKCCCCCCRDDDDDDKEEEEEEK");
+    sequences.push_back("MAAAAAKCCCCCCRDDDDDDKEEEEEEK");
+    sequences.push_back("CCCCCCRDDDDDDK");
+    sequences.push_back("AAAAAKCCCCCCR");
+    sequences.push_back("FFFFFFKGGGGGGR");
+    sequences.push_back("GGGGGGRHHHHHHK");
+    // random concatenations of a few tryptic peptides, such that there are 
+    // many subsets, spread over more than one chunk of the index
+    const char* pool[] = { "SIIIIIK", "TLLLLLR", "VNNNNNK", "WQQQQQK",
+                           "YSSSSSR", "ETTTTTK", "DVVVVVR", "GWWWWWK" };
+    for (int ix = 0; ix < 600; ++ix) {
+      std::string sequence;
+      unsigned long numPeptides = 1u + PseudoRandom::lcg_rand() % 4u;
+      for (unsigned long j = 0; j < numPeptides; ++j) {
+        sequence += pool[PseudoRandom::lcg_rand() % 8u];
+      }
+      sequences.push_back(sequence);
+    }
+    
+    char tempName[] = "/tmp/percolator_fasta_XXXXXX";
+    int fd = mkstemp(tempName);
+    ASSERT_NE(-1, fd);
+    close(fd);
+    fastaFN_ = tempName;
+    std::ofstream fasta(fastaFN_.c_str());
+    for (std::size_t ix = 0; ix < sequences.size(); ++ix) {
+      fasta << ">prot_" << ix << "\n" << sequences[ix] << "\n";
+    }
+    fasta.close();
+    
+    db_ = new Database(fastaFN_.c_str(), false);
+    ASSERT_TRUE(db_->parse());
+    ASSERT_EQ(sequences.size(), db_->getNumProteins());
+  }
+  
+  virtual void TearDown() {
+    delete db_;
+    std::remove(fastaFN_.c_str());
+  }
+  
+  /* the peptides of each protein, including the methionine cleaved ones */
+  void digestSeparately(std::vector<std::set<std::string> >& peptides) {
+    peptides.resize(db_->getNumProteins());
+    for (unsigned int ix = 0; ix < db_->getNumProteins(); ++ix) {
+      ProteinPeptideIterator iterator(db_->getProteinAtIdx(ix), &constraint_);
+      while (iterator.hasNext()) {
+        Peptide* peptide = iterator.next();
+        std::string sequence(peptide->getSequencePointer(), peptide->getLength());
+        peptides[ix].insert(sequence);
+        if (sequence[0] == 'M' && peptide->getNTermFlankingAA() == '-' 
+              && static_cast<int>(sequence.size()) - 1 >= kMinLength) {
+          peptides[ix].insert(sequence.substr(1));
+        }
+        Peptide::free(peptide);
+      }
+    }
+  }
+  
+  std::string fastaFN_;
+  Database* db_;
+  PeptideConstraint constraint_;
+};
+
+bool includes(const std::set<std::string>& superset, 
+              const std::set<std::string>& subset) {
+  return std::includes(superset.begin(), superset.end(), 
+                       subset.begin(), subset.end());
+}
+
+} // namespace
+
+TEST_F(PeptideProteinIndexTest, SupersetsMatchSeparateDigests) {
+  std::vector<size_t> proteinIdxs(db_->getNumProteins());
+  for (size_t ix = 0; ix < proteinIdxs.size(); ++ix) proteinIdxs[ix] = ix;
+  PeptideProteinIndex index;
+  index.build(*db_, proteinIdxs, constraint_, kMinLength);
+  std::vector<std::set<std::string> > peptides;
+  digestSeparately(peptides);
+  
+  ASSERT_EQ(proteinIdxs.size(), index.getNumProteins());
+  std::size_t numWithSupersets = 0u;
+  for (size_t protein = 0; protein < index.getNumProteins(); ++protein) {
+    ASSERT_FALSE(peptides[protein].empty());
+    std::vector<size_t> expected;
+    for (size_t other = 0; other < peptides.size(); ++other) {
+      if (includes(peptides[other], peptides[protein])) {
+        expected.push_back(other);
+      }
+    }
+    std::vector<size_t> supersets;
+    index.getSupersetProteins(protein, supersets);
+    if (expected.size() > 1u) {
+      EXPECT_EQ(expected, supersets) << "protein " << protein;
+      ++numWithSupersets;
+    } else {
+      // the intersection stops as soon as fewer than two proteins remain
+      EXPECT_GT(2u, supersets.size()) << "protein " << protein;
+    }
+  }
+  EXPECT_LT(100u, numWithSupersets);
+}
+
+TEST_F(PeptideProteinIndexTest, DuplicatesFragmentsAndMethionineCleavage) {
+  std::vector<size_t> proteinIdxs;
+  for (size_t ix = 0; ix < 6u; ++ix) proteinIdxs.push_back(ix);
+  PeptideProteinIndex index;
+  index.build(*db_, proteinIdxs, constraint_, kMinLength);
+  
+  std::vector<size_t> supersets, expected;
+  expected.push_back(0u);
+  expected.push_back(1u);
+  index.getSupersetProteins(0u, supersets);
+  EXPECT_EQ(expected, supersets);
+  index.getSupersetProteins(1u, supersets);
+  EXPECT_EQ(expected, supersets);
+  index.getSupersetProteins(2u, supersets);
+  expected.push_back(2u);
+  EXPECT_EQ(expected, supersets);
+  index.getSupersetProteins(3u, supersets);
+  expected.back() = 3u;
+  EXPECT_EQ(expected, supersets);
+  index.getSupersetProteins(4u, supersets);
+  EXPECT_EQ(std::vector<size_t>(1, 4u), supersets);
+  
+  // the methionine cleaved peptide is in the index, but is not counted as 
+  // a digested peptide
+  EXPECT_LE(0, index.lookup("AAAAAK"));
+  EXPECT_EQ("AAAAAK", index.getSequence(index.lookup("AAAAAK")));
+  EXPECT_EQ(-1, index.lookup("HHHHHHKM"));
+  EXPECT_EQ(4u, index.getNumDigestedPeptides(0u));
+  EXPECT_EQ(2u, index.getNumDigestedPeptides(3u));
+}
+
+TEST_F(PeptideProteinIndexTest, SubsetOfProteins) {
+  // proteins are referred to by their position in the list passed to build
+  std::vector<size_t> proteinIdxs;
+  proteinIdxs.push_back(5u);
+  proteinIdxs.push_back(2u);
+  proteinIdxs.push_back(0u);
+  PeptideProteinIndex index;
+  index.build(*db_, proteinIdxs, constraint_, kMinLength);
+  EXPECT_EQ(0u, index.getProteinIdx(2u));
+  std::vector<size_t> supersets, expected;
+  index.getSupersetProteins(1u, supersets);
+  expected.push_back(1u);
+  expected.push_back(2u);
+  EXPECT_EQ(expected, supersets);
+  index.getSupersetProteins(0u, supersets);
+  EXPECT_EQ(std::vector<size_t>(1, 0u), supersets);
+}
@@ -0,0 +1,187 @@
+/*******************************************************************************
+ Copyright 2006-2012 Lukas Käll <lukas.kall@scilifelab.se>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+
+ *******************************************************************************/
+
+/*
+ * Unit tests for PickedProteinCache: round trip, key mismatches, corrupt 
+ * caches that are regenerated and files that are not caches, which must 
+ * not be overwritten.
+ */
+
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+
+#include "PickedProteinCache.h"
+#include "MyException.h"
+
+namespace {
+
+// gives access to the file layout, to write caches with a valid checksum 
+// but an inconsistent structure
+class CacheLayout : public PickedProteinCache {
+ public:
+  static void writeHeaderOnly(const std::string& fileName, const Key& key) {
+    Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.byteOrderMark = kByteOrderMark;
+    header.numSections = 4u;
+    header.fastaSize = key.fastaSize;
+    header.fastaHash = key.fastaHash;
+    Writer writer(fileName);
+    writer.write(&header, sizeof(header));
+    writer.writeStringSection(DIGEST_PARAMS, std::vector<std::string>(1u, key.digestParams));
+    writer.close();
+  }
+};
+
+class PickedProteinCacheTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    fastaFN_ = makeTempName();
+    cacheFN_ = makeTempName();
+    std::remove(cacheFN_.c_str());
+    writeFile(fastaFN_, ">prot_1\nMAAAAAKCCCCCCR\n>prot_2\nCCCCCCR\n");
+    ASSERT_TRUE(PickedProteinCache::computeKey(fastaFN_, kParams, key_));
+    
+    fragments_["prot_2"] = "prot_1";
+    fragments_["prot_4"] = "prot_1";
+    duplicates_["prot_3"] = "prot_5";
+  }
+  
+  virtual void TearDown() {
+    std::remove(fastaFN_.c_str());
+    std::remove(cacheFN_.c_str());
+  }
+  
+  static std::string makeTempName() {
+    char tempName[] = "/tmp/percolator_cache_XXXXXX";
+    int fd = mkstemp(tempName);
+    if (fd != -1) close(fd);
+    return tempName;
+  }
+  
+  static void writeFile(const std::string& fileName, const std::string& content) {
+    std::ofstream out(fileName.c_str(), std::ios::out | std::ios::binary);
+    out << content;
+  }
+  
+  static std::string readFile(const std::string& fileName) {
+    std::ifstream in(fileName.c_str(), std::ios::in | std::ios::binary);
+    std::ostringstream content;
+    content << in.rdbuf();
+    return content.str();
+  }
+  
+  bool readCache(const PickedProteinCache::Key& key) {
+    fastaHasDecoys_ = false;
+    readFragments_.clear();
+    readDuplicates_.clear();
+    return PickedProteinCache::read(cacheFN_, key, fastaHasDecoys_, 
+                                    readFragments_, readDuplicates_);
+  }
+  
+  static const char* kParams;
+  std::string fastaFN_, cacheFN_;
+  PickedProteinCache::Key key_;
+  std::map<std::string, std::string> fragments_, duplicates_;
+  bool fastaHasDecoys_;
+  std::map<std::string, std::string> readFragments_, readDuplicates_;
+};
+
+const char* PickedProteinCacheTest::kParams = "enzyme=1, digestion=0";
+
+} // namespace
+
+TEST_F(PickedProteinCacheTest, RoundTrip) {
+  EXPECT_FALSE(readCache(key_));
+  PickedProteinCache::write(cacheFN_, key_, true, fragments_, duplicates_);
+  ASSERT_TRUE(readCache(key_));
+  EXPECT_TRUE(fastaHasDecoys_);
+  EXPECT_EQ(fragments_, readFragments_);
+  EXPECT_EQ(duplicates_, readDuplicates_);
+  // the temporary file was renamed into place
+  EXPECT_FALSE(std::ifstream((cacheFN_ + ".tmp").c_str()).is_open());
+  
+  PickedProteinCache::write(cacheFN_, key_, false, 
+      std::map<std::string, std::string>(), duplicates_);
+  ASSERT_TRUE(readCache(key_));
+  EXPECT_FALSE(fastaHasDecoys_);
+  EXPECT_TRUE(readFragments_.empty());
+  EXPECT_EQ(duplicates_, readDuplicates_);
+}
+
+TEST_F(PickedProteinCacheTest, KeyMismatch) {
+  PickedProteinCache::write(cacheFN_, key_, false, fragments_, duplicates_);
+  
+  PickedProteinCache::Key otherParams;
+  ASSERT_TRUE(PickedProteinCache::computeKey(fastaFN_, "enzyme=2, digestion=0", 
+                                             otherParams));
+  EXPECT_FALSE(readCache(otherParams));
+  EXPECT_TRUE(readFragments_.empty());
+  
+  // same size, different contents
+  writeFile(fastaFN_, ">prot_1\nMAAAAAKCCCCCCR\n>prot_2\nCCCCCCK\n");
+  PickedProteinCache::Key otherFasta;
+  ASSERT_TRUE(PickedProteinCache::computeKey(fastaFN_, kParams, otherFasta));
+  EXPECT_EQ(key_.fastaSize, otherFasta.fastaSize);
+  EXPECT_NE(key_.fastaHash, otherFasta.fastaHash);
+  EXPECT_FALSE(readCache(otherFasta));
+  
+  EXPECT_TRUE(readCache(key_));
+}
+
+TEST_F(PickedProteinCacheTest, RefusesToOverwriteOtherFiles) {
+  std::string content(">prot_1\nMAAAAAKCCCCCCR\n");
+  writeFile(cacheFN_, content);
+  EXPECT_THROW(readCache(key_), MyException);
+  EXPECT_EQ(content, readFile(cacheFN_));
+  
+  writeFile(cacheFN_, "");
+  EXPECT_THROW(readCache(key_), MyException);
+}
+
+TEST_F(PickedProteinCacheTest, CorruptCachesAreRegenerated) {
+  PickedProteinCache::write(cacheFN_, key_, false, fragments_, duplicates_);
+  std::string content = readFile(cacheFN_);
+  
+  // truncated by an interrupted copy
+  writeFile(cacheFN_, content.substr(0, 16u));
+  EXPECT_FALSE(readCache(key_));
+  writeFile(cacheFN_, content.substr(0, content.size() - 16u));
+  EXPECT_FALSE(readCache(key_));
+  
+  std::string flipped(content);
+  flipped[flipped.size() / 2u] ^= 0x10;
+  writeFile(cacheFN_, flipped);
+  EXPECT_FALSE(readCache(key_));
+  
+  // a valid checksum over an inconsistent structure
+  CacheLayout::writeHeaderOnly(cacheFN_, key_);
+  EXPECT_FALSE(readCache(key_));
+  EXPECT_TRUE(readFragments_.empty());
+  
+  PickedProteinCache::write(cacheFN_, key_, false, fragments_, duplicates_);
+  EXPECT_TRUE(readCache(key_));
+}
@@ -0,0 +1,185 @@
+/*******************************************************************************
+ Copyright 2006-2012 Lukas Käll <lukas.kall@scilifelab.se>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+
+ *******************************************************************************/
+
+/*
+ * Unit tests for QValueEngine, compared against a direct evaluation of the
+ * target-decoy and mix-max FDR definitions at every position of the list.
+ */
+
+#include <gtest/gtest.h>
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+#include "QValueEngine.h"
+#include "PseudoRandom.h"
+
+namespace {
+
+typedef std::pair<double, bool> ScorePair;
+
+bool descendingScore(const ScorePair& a, const ScorePair& b) {
+  return a.first > b.first;
+}
+
+// numScores scores drawn from numLevels distinct values, such that there
+// are ties, with target scores shifted upwards
+void makeList(std::size_t numScores, unsigned long numLevels, 
+              std::vector<ScorePair>& sorted) {
+  sorted.clear();
+  for (std::size_t ix = 0; ix < numScores; ++ix) {
+    bool isTarget = (PseudoRandom::lcg_rand() % 3u) != 0u;
+    unsigned long level = PseudoRandom::lcg_rand() % numLevels;
+    if (isTarget) level += numLevels / 4u;
+    sorted.push_back(ScorePair(static_cast<double>(level), isTarget));
+  }
+  std::stable_sort(sorted.begin(), sorted.end(), descendingScore);
+}
+
+/*
+ * The FDR down to and including the group of ties at position ix. The 
+ * mix-max correction adds, for every decoy scoring at least as high, the 
+ * estimated fraction of incorrect targets scoring at most as high as that 
+ * decoy.
+ */
+double referenceFdr(const std::vector<ScorePair>& sorted, std::size_t ix,
+                    double pi0, bool skipDecoysPlusOne) {
+  double score = sorted[ix].first;
+  int numTargets = 0, numDecoys = 0;
+  double mixMaxDecoys = 0.0;
+  for (std::size_t jx = 0; jx < sorted.size(); ++jx) {
+    if (sorted[jx].first < score) continue;
+    if (sorted[jx].second) {
+      ++numTargets;
+      continue;
+    }
+    ++numDecoys;
+    if (pi0 < 1.0) {
+      int cntW = 0, cntZ = 0;
+      for (std::size_t kx = 0; kx < sorted.size(); ++kx) {
+        if (sorted[kx].first > sorted[jx].first) continue;
+        if (sorted[kx].second) ++cntW; else ++cntZ;
+      }
+      double estPx = (cntW - pi0 * cntZ) / ((1.0 - pi0) * cntZ);
+      estPx = (std::min)(1.0, (std::max)(0.0, estPx));
+      mixMaxDecoys += estPx * (1.0 - pi0);
+    }
+  }
+  int decoyCount = numDecoys + (skipDecoysPlusOne ? 0 : 1);
+  double fdr = (decoyCount * pi0 + mixMaxDecoys) / (std::max)(1, numTargets);
+  return (std::min)(fdr, 1.0);
+}
+
+// q-values of all elements, the minimum FDR of any list extending past them
+void referenceQValues(const std::vector<ScorePair>& sorted, double pi0,
+                      bool skipDecoysPlusOne, std::vector<double>& qvals) {
+  qvals.resize(sorted.size());
+  for (std::size_t ix = sorted.size(); ix-- > 0u; ) {
+    qvals[ix] = referenceFdr(sorted, ix, pi0, skipDecoysPlusOne);
+    if (ix + 1u < sorted.size() && qvals[ix + 1u] < qvals[ix]) {
+      qvals[ix] = qvals[ix + 1u];
+    }
+  }
+}
+
+}
+
+class QValueEngineTest : public ::testing::TestWithParam<double> {
+ protected:
+  virtual void SetUp() { PseudoRandom::setSeed(1u); }
+};
+
+TEST_P(QValueEngineTest, MatchesReferenceWithDecoys) {
+  double pi0 = GetParam();
+  QValueEngine engine;
+  engine.setIncludeDecoys(true);
+  std::vector<ScorePair> sorted;
+  std::vector<double> expected;
+  for (int trial = 0; trial < 10; ++trial) {
+    makeList(200u, 40u, sorted);
+    for (int skip = 0; skip < 2; ++skip) {
+      engine.setSkipDecoysPlusOne(skip == 1);
+      referenceQValues(sorted, pi0, skip == 1, expected);
+      const std::vector<double>& qvals = engine.calcQValues(sorted, pi0);
+      ASSERT_EQ(expected.size(), qvals.size());
+      for (std::size_t ix = 0; ix < qvals.size(); ++ix) {
+        EXPECT_NEAR(expected[ix], qvals[ix], 1e-12) << "at " << ix;
+      }
+    }
+  }
+}
+
+TEST_P(QValueEngineTest, TargetsOnly) {
+  double pi0 = GetParam();
+  QValueEngine engine;
+  std::vector<ScorePair> sorted;
+  std::vector<double> expected;
+  makeList(300u, 50u, sorted);
+  referenceQValues(sorted, pi0, false, expected);
+  const std::vector<double>& qvals = engine.calcQValues(sorted, pi0);
+  std::size_t numQvals = 0u;
+  for (std::size_t ix = 0; ix < sorted.size(); ++ix) {
+    if (!sorted[ix].second) continue;
+    ASSERT_LT(numQvals, qvals.size());
+    EXPECT_NEAR(expected[ix], qvals[numQvals++], 1e-12) << "at " << ix;
+  }
+  EXPECT_EQ(numQvals, qvals.size());
+}
+
+// countPositives stops early, it has to agree with the full calculation
+TEST_P(QValueEngineTest, CountPositivesMatchesQValues) {
+  double pi0 = GetParam();
+  const double thresholds[] = { 0.0, 0.001, 0.01, 0.05, 0.1, 0.3, 1.0, 1.5 };
+  QValueEngine engine;
+  std::vector<ScorePair> sorted;
+  for (int trial = 0; trial < 10; ++trial) {
+    makeList(500u, 100u, sorted);
+    for (int skip = 0; skip < 2; ++skip) {
+      engine.setSkipDecoysPlusOne(skip == 1);
+      std::vector<double> qvals = engine.calcQValues(sorted, pi0);
+      for (std::size_t t = 0; t < sizeof(thresholds) / sizeof(double); ++t) {
+        int expected = 0;
+        for (std::size_t ix = 0; ix < qvals.size(); ++ix) {
+          if (qvals[ix] < thresholds[t]) ++expected;
+        }
+        EXPECT_EQ(expected, engine.countPositives(sorted, pi0, thresholds[t]))
+            << "threshold " << thresholds[t];
+      }
+    }
+  }
+}
+
+TEST(QValueEngineEdgeTest, EmptyAndAllTargets) {
+  QValueEngine engine;
+  std::vector<ScorePair> sorted;
+  EXPECT_TRUE(engine.calcQValues(sorted, 1.0).empty());
+  EXPECT_EQ(0, engine.countPositives(sorted, 1.0, 0.01));
+  for (int ix = 0; ix < 10; ++ix) {
+    sorted.push_back(ScorePair(10.0 - ix, true));
+  }
+  engine.setSkipDecoysPlusOne(true);
+  const std::vector<double>& qvals = engine.calcQValues(sorted, 1.0);
+  ASSERT_EQ(10u, qvals.size());
+  for (std::size_t ix = 0; ix < qvals.size(); ++ix) {
+    EXPECT_EQ(0.0, qvals[ix]);
+  }
+  EXPECT_EQ(10, engine.countPositives(sorted, 1.0, 0.01));
+}
+
+INSTANTIATE_TEST_CASE_P(Pi0, QValueEngineTest, 
+                        ::testing::Values(1.0, 0.9, 0.5, 0.1));
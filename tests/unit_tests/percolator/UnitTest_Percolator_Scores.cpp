@@ -0,0 +1,157 @@
+/*******************************************************************************
+ Copyright 2006-2012 Lukas Käll <lukas.kall@scilifelab.se>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+
+ *******************************************************************************/
+
+/*
+ * Unit tests for the external merge sort of Scores, which takes over from 
+ * the sorts in memory when they would exceed the --max-sort-memory budget. 
+ * With a budget set, both have to give the order of a stable sort of the 
+ * ScoreHolders; without one, ties are left in the order of std::sort.
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "Scores.h"
+#include "PSMDescription.h"
+#include "PseudoRandom.h"
+
+namespace {
+
+// the order of operator> on the ScoreHolders
+bool greaterScore(const ScoreHolder& x, const ScoreHolder& y) {
+  if (x.score != y.score) return x.score > y.score;
+  if (x.pPSM->scan != y.pPSM->scan) return x.pPSM->scan > y.pPSM->scan;
+  if (x.pPSM->expMass != y.pPSM->expMass) return x.pPSM->expMass > y.pPSM->expMass;
+  return x.label > y.label;
+}
+
+// the order of ScoreColumns::OrderScanMassCharge
+bool scanMassThenScore(const ScoreHolder& x, const ScoreHolder& y) {
+  if (x.pPSM->scan != y.pPSM->scan) return x.pPSM->scan < y.pPSM->scan;
+  if (x.pPSM->expMass != y.pPSM->expMass) return x.pPSM->expMass < y.pPSM->expMass;
+  return x.score > y.score;
+}
+
+bool sameScanMass(const ScoreHolder& x, const ScoreHolder& y) {
+  return x.pPSM->scan == y.pPSM->scan && x.pPSM->expMass == y.pPSM->expMass;
+}
+
+class ScoresSortTest : public ::testing::Test {
+ protected:
+  // enough PSMs for several runs of the external sort, with few distinct 
+  // values per field such that many of them tie on all compared fields
+  virtual void SetUp() {
+    PseudoRandom::setSeed(17);
+    const std::size_t numPsms = 20000u;
+    psms_.resize(numPsms);
+    for (std::size_t ix = 0; ix < numPsms; ++ix) {
+      psms_[ix].scan = static_cast<unsigned int>(PseudoRandom::lcg_rand() % 3000u);
+      psms_[ix].expMass = (PseudoRandom::lcg_rand() % 2u == 0u) ? 1000.5 : 2000.25;
+      double score = static_cast<double>(PseudoRandom::lcg_rand() % 40u) / 8.0;
+      int label = (PseudoRandom::lcg_rand() % 3u == 0u) ? -1 : 1;
+      holders_.push_back(ScoreHolder(score, label, &psms_[ix]));
+    }
+  }
+  
+  virtual void TearDown() {
+    Scores::setMaxSortMemory(0u);
+  }
+  
+  void fill(Scores& scores) const {
+    for (std::size_t ix = 0; ix < holders_.size(); ++ix) {
+      scores.addScoreHolder(holders_[ix]);
+    }
+  }
+  
+  static std::vector<PSMDescription*> getOrder(Scores& scores) {
+    std::vector<PSMDescription*> order;
+    for (std::vector<ScoreHolder>::iterator it = scores.begin(); 
+         it != scores.end(); ++it) {
+      order.push_back(it->pPSM);
+    }
+    return order;
+  }
+  
+  static std::vector<PSMDescription*> getOrder(const std::vector<ScoreHolder>& holders) {
+    std::vector<PSMDescription*> order;
+    for (std::size_t ix = 0; ix < holders.size(); ++ix) {
+      order.push_back(holders[ix].pPSM);
+    }
+    return order;
+  }
+  
+  std::vector<PSMDescription> psms_;
+  std::vector<ScoreHolder> holders_;
+};
+
+} // namespace
+
+TEST_F(ScoresSortTest, SortByScoreOnDiskMatchesInMemory) {
+  std::vector<ScoreHolder> expected(holders_);
+  std::stable_sort(expected.begin(), expected.end(), greaterScore);
+  
+  Scores unlimited(true);
+  fill(unlimited);
+  unlimited.sortByScore();
+  std::vector<ScoreHolder> sorted(unlimited.begin(), unlimited.end());
+  EXPECT_TRUE(std::is_sorted(sorted.begin(), sorted.end(), greaterScore));
+  
+  // a budget that fits all PSMs sorts in memory
+  Scores::setMaxSortMemory(1u << 30);
+  Scores inMemory(true);
+  fill(inMemory);
+  inMemory.sortByScore();
+  EXPECT_EQ(getOrder(expected), getOrder(inMemory));
+  
+  // a budget of 1 byte gives runs of the minimal size
+  Scores::setMaxSortMemory(1u);
+  Scores onDisk(true);
+  fill(onDisk);
+  onDisk.sortByScore();
+  EXPECT_EQ(getOrder(expected), getOrder(onDisk));
+}
+
+TEST_F(ScoresSortTest, WeedOutRedundantTDCOnDiskMatchesInMemory) {
+  // keep the best scoring PSM of each spectrum, the first one among ties
+  std::vector<ScoreHolder> expected(holders_);
+  std::stable_sort(expected.begin(), expected.end(), scanMassThenScore);
+  expected.erase(std::unique(expected.begin(), expected.end(), sameScanMass), 
+                 expected.end());
+  std::stable_sort(expected.begin(), expected.end(), greaterScore);
+  ASSERT_LT(expected.size(), holders_.size());
+  
+  Scores unlimited(true);
+  fill(unlimited);
+  unlimited.weedOutRedundantTDC();
+  EXPECT_EQ(expected.size(), static_cast<std::size_t>(unlimited.size()));
+  
+  Scores::setMaxSortMemory(1u << 30);
+  Scores inMemory(true);
+  fill(inMemory);
+  inMemory.weedOutRedundantTDC();
+  EXPECT_EQ(getOrder(expected), getOrder(inMemory));
+  
+  Scores::setMaxSortMemory(1u);
+  Scores onDisk(true);
+  fill(onDisk);
+  onDisk.weedOutRedundantTDC();
+  EXPECT_EQ(getOrder(expected), getOrder(onDisk));
+  EXPECT_EQ(inMemory.posSize(), onDisk.posSize());
+  EXPECT_EQ(inMemory.negSize(), onDisk.negSize());
+}
@@ -103,3 +103,28 @@ TEST_F(TabReaderTest, CheckSequentialReading)
     reader.readInt();
     ASSERT_TRUE(reader.error());
 }
+
+// Tests reading a line in place from a larger buffer; fields must never be
+// read past the end of the line.
+TEST_F(TabReaderTest, CheckBoundedReading)
+{
+    const char* buffer = "1\t2.5\tPEPTIDE\n3\t4";
+    TabReader reader(buffer, buffer + 13);
+    ASSERT_EQ(1, reader.readInt());
+    ASSERT_EQ(2.5, reader.readDouble());
+    ASSERT_EQ("PEPTIDE", reader.readString());
+    ASSERT_TRUE(reader.error());
+
+    TabReader numericReader(buffer, buffer + 5);
+    ASSERT_EQ(1, numericReader.readInt());
+    ASSERT_EQ(2.5, numericReader.readDouble());
+    ASSERT_FALSE(numericReader.error());
+    numericReader.readInt();
+    ASSERT_TRUE(numericReader.error());
+
+    const char* trailing = "1\t \n3";
+    TabReader trailingReader(trailing, trailing + 3);
+    ASSERT_EQ(1, trailingReader.readInt());
+    trailingReader.readInt();
+    ASSERT_TRUE(trailingReader.error());
+}